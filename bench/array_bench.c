@@ -0,0 +1,92 @@
+#include "../src/object.h"
+#include "bench.h"
+
+/* One heap object per element, as an `obj_t **` backed array would do */
+static void bench_boxed(size_t n) {
+  double start = bench_now();
+  size_t capacity = ARRAY_MIN_CAPACITY;
+  size_t len = 0;
+  obj_t **values = malloc(capacity * sizeof(obj_t *));
+  for (size_t i = 0; i < n; i++) {
+    if (len == capacity) {
+      capacity *= 2;
+      values = realloc(values, capacity * sizeof(obj_t *));
+    }
+    values[len++] = obj_new(INT_OBJ, int_obj_new((int32_t)i));
+  }
+  double built = bench_now();
+
+  int64_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += values[i]->int_obj->value;
+  }
+  bench_sink += sum;
+  double summed = bench_now();
+
+  bench_report("boxed build", n, built - start);
+  bench_report("boxed sum", n, summed - built);
+
+  for (size_t i = 0; i < len; i++) {
+    obj_destroy(&values[i]);
+  }
+  free(values);
+}
+
+static void bench_unboxed(size_t n) {
+  double start = bench_now();
+  array_obj_t *array = array_obj_new(array_buf_new(0), 0, 0);
+  for (size_t i = 0; i < n; i++) {
+    array_obj_t *next =
+        array_obj_push(array, obj_new(INT_OBJ, int_obj_new((int32_t)i)));
+    array_obj_destroy(&array);
+    array = next;
+  }
+  double built = bench_now();
+
+  int64_t sum = 0;
+  array_value_t *values = array->buf->values + array->offset;
+  for (size_t i = 0; i < array->len; i++) {
+    sum += values[i].int_value;
+  }
+  bench_sink += sum;
+  double summed = bench_now();
+
+  /* `array_obj_get` boxes the element it returns */
+  sum = 0;
+  for (size_t i = 0; i < array->len; i++) {
+    obj_t *value = array_obj_get(array, i);
+    sum += value->int_obj->value;
+    obj_destroy(&value);
+  }
+  bench_sink += sum;
+  double got = bench_now();
+
+  bench_report("unboxed build (push)", n, built - start);
+  bench_report("unboxed sum (scan)", n, summed - built);
+  bench_report("unboxed sum (get)", n, got - summed);
+
+  /* first/rest recursion: every `rest` is a view, not a copy */
+  start = bench_now();
+  array_obj_t *view = array_obj_copy(array);
+  sum = 0;
+  while (view != NULL) {
+    sum += view->buf->values[view->offset].int_value;
+    array_obj_t *rest = array_obj_rest(view);
+    array_obj_destroy(&view);
+    view = rest;
+  }
+  bench_sink += sum;
+  bench_report("unboxed walk (rest)", n, bench_now() - start);
+
+  array_obj_destroy(&array);
+}
+
+int main(void) {
+  size_t sizes[] = {1000, 100000, 1000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    printf("-- %zu elements\n", sizes[i]);
+    bench_boxed(sizes[i]);
+    bench_unboxed(sizes[i]);
+  }
+  return 0;
+}
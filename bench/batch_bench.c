@@ -0,0 +1,48 @@
+#include "../src/batch.h"
+#include "bench.h"
+
+#define SCRIPTS 20000
+
+/*
+ * Small rule snippets. Every 64th one is much heavier, and they are
+ * clustered at the front so an even split leaves work to be stolen.
+ */
+static char **make_scripts(size_t n) {
+  char **scripts = malloc(n * sizeof(char *));
+  assert(scripts);
+  for (size_t i = 0; i < n; i++) {
+    if (i % 64 == 0 && i < n / 4) {
+      asprintf(&scripts[i],
+               "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + "
+               "fib(n - 2) } }; fib(%zu)",
+               12 + i % 5);
+    } else {
+      asprintf(&scripts[i],
+               "let limits = {\"max\": %zu, \"min\": 10}; let value = %zu;"
+               "if (value < limits[\"max\"]) { value * 2 } else { false }",
+               i % 1000, i % 997);
+    }
+  }
+  return scripts;
+}
+
+int main(void) {
+  printf("%ld online cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+  char **scripts = make_scripts(SCRIPTS);
+
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    double start = bench_now();
+    char **results = monkey_batch_eval((const char **)scripts, SCRIPTS, threads);
+    double elapsed = bench_now() - start;
+    bench_sink += strlen(results[SCRIPTS - 1]);
+    monkey_batch_results_destroy(&results, SCRIPTS);
+
+    char label[128];
+    snprintf(label, sizeof(label), "%2zu threads (%.0f scripts/s)", threads,
+             SCRIPTS / elapsed);
+    bench_report(label, SCRIPTS, elapsed);
+  }
+
+  monkey_batch_results_destroy(&scripts, SCRIPTS);
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../src/utils.h"
+#include <time.h>
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_report(const char *name, size_t iterations, double seconds) {
+  printf("%-44s %10zu ops %10.3f ms %10.1f ns/op\n", name, iterations,
+         seconds * 1e3, seconds * 1e9 / iterations);
+}
+
+/* Keeps the optimizer from discarding benchmarked work */
+static volatile uintptr_t bench_sink;
+
+#endif
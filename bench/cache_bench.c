@@ -0,0 +1,92 @@
+#include "../src/evaluator.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+#define SNIPPETS 100
+#define ROUNDS 200
+
+static char **make_snippets(size_t n) {
+  char **snippets = malloc(n * sizeof(char *));
+  assert(snippets);
+  for (size_t i = 0; i < n; i++) {
+    asprintf(&snippets[i],
+             "let limits = {\"max\": %zu, \"min\": 10, \"name\": \"rule %zu\"};"
+             "let score = [%zu, 2, 3, 4, 5];"
+             "if (score[0] < limits[\"max\"]) { score[0] * 2 + len(score) } "
+             "else { limits[\"min\"] }",
+             i * 7 % 100, i, i);
+  }
+  return snippets;
+}
+
+static void bench_vm(const char *name, char **snippets, size_t max_bytes) {
+  monkey_vm_t *vm = monkey_vm_new();
+  if (max_bytes != 0) {
+    monkey_vm_enable_cache(vm, max_bytes);
+  }
+
+  double start = bench_now();
+  for (size_t round = 0; round < ROUNDS; round++) {
+    for (size_t i = 0; i < SNIPPETS; i++) {
+      obj_t *result = monkey_vm_eval(vm, snippets[i]);
+      assert(result != NULL && result->type == INT_OBJ);
+      bench_sink += result->int_obj->value;
+      monkey_vm_result_destroy(vm, &result);
+    }
+  }
+  double elapsed = bench_now() - start;
+  bench_report(name, SNIPPETS * ROUNDS, elapsed);
+
+  if (vm->cache != NULL) {
+    program_cache_stats_t *stats = &vm->cache->stats;
+    printf("  hits %zu misses %zu evictions %zu entries %zu bytes %zu\n",
+           stats->hits, stats->misses, stats->evictions, stats->entries,
+           stats->bytes);
+  }
+  monkey_vm_destroy(&vm);
+}
+
+/* The floor: evaluating already parsed programs */
+static void bench_eval_only(char **snippets) {
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, SIZE_MAX);
+  for (size_t i = 0; i < SNIPPETS; i++) {
+    obj_t *result = monkey_vm_eval(vm, snippets[i]);
+    monkey_vm_result_destroy(vm, &result);
+  }
+
+  intern_table_t *previous = intern_table_swap(vm->symbols);
+  program_t *programs[SNIPPETS];
+  for (size_t i = 0; i < SNIPPETS; i++) {
+    programs[i] = program_cache_get(vm->cache, snippets[i], strlen(snippets[i]));
+  }
+  double start = bench_now();
+  for (size_t round = 0; round < ROUNDS; round++) {
+    for (size_t i = 0; i < SNIPPETS; i++) {
+      obj_t *result = eval(programs[i], vm->globals);
+      bench_sink += result->int_obj->value;
+      obj_destroy(&result);
+    }
+  }
+  bench_report("eval only", SNIPPETS * ROUNDS, bench_now() - start);
+  intern_table_swap(previous);
+  monkey_vm_destroy(&vm);
+}
+
+int main(void) {
+  char **snippets = make_snippets(SNIPPETS);
+
+  /* Cached runs first: the uncached VM leaves 20000 programs' worth of
+     fragmented heap behind */
+  bench_vm("cache (all fit)", snippets, 4 << 20);
+  bench_eval_only(snippets);
+  bench_vm("no cache", snippets, 0);
+  /* Too small for the working set: round robin access misses every time */
+  bench_vm("cache (half fit)", snippets, SNIPPETS / 2 * 4096);
+
+  for (size_t i = 0; i < SNIPPETS; i++) {
+    free(snippets[i]);
+  }
+  free(snippets);
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "../src/count.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+#define ROUNDS 5
+#define RUNS 20
+
+/* fib(20) visits about 260000 nodes */
+static const char *DEFINE =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };";
+static const char *CALL = "fib(20)";
+
+#define RESULT 6765
+
+static double bench_fib(monkey_vm_t *vm) {
+  double best = 0;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    double start = bench_now();
+    for (size_t i = 0; i < RUNS; i++) {
+      obj_t *result = monkey_vm_eval(vm, CALL);
+      assert(result != NULL && result->type == INT_OBJ &&
+             result->int_obj->value == RESULT);
+      monkey_vm_result_destroy(vm, &result);
+    }
+    double elapsed = bench_now() - start;
+    if (round == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+int main(void) {
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *result = monkey_vm_eval(vm, DEFINE);
+  assert(result == NULL);
+
+  /* Counts one run first, to know how many visits a run makes */
+  count_t *count = count_new();
+  count_start(count);
+  result = monkey_vm_eval(vm, CALL);
+  count_stop(count);
+  monkey_vm_result_destroy(vm, &result);
+  size_t visits = 0;
+  for (size_t i = 1; i < count->len; i++) {
+    visits += count->nodes[i].hits;
+  }
+  printf("  nodes %zu, %zu bytes of counters\n", count->len - 1,
+         (count->len - 1) * sizeof(count_node_t));
+
+  double off = bench_fib(vm);
+  bench_report("not counted", visits * RUNS, off);
+
+  count_start(count);
+  double on = bench_fib(vm);
+  count_stop(count);
+  char label[128];
+  snprintf(label, sizeof(label), "counted (%+.1f%%)", (on / off - 1) * 100);
+  bench_report(label, visits * RUNS, on);
+
+  count_destroy(&count);
+  monkey_vm_destroy(&vm);
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+#define SOURCE_BYTES (1024 * 1024)
+#define ROUNDS 5
+
+/* Identifiers are letters only, so spell `i` in base 26 */
+static void name(char *buf, size_t i) {
+  do {
+    *buf++ = 'a' + i % 26;
+    i /= 26;
+  } while (i > 0);
+  *buf = '\0';
+}
+
+/* Every `every`-th statement is broken in one of a few ways, 0 for none */
+static char *script(size_t bytes, size_t every) {
+  static const char *broken[] = {
+      "let %.0s= %zu;\n",
+      "let v%s = fn(a, 1) { a * %zu };\n",
+      "let v%s = if (a < %zu { a };\n",
+      "let v%s = [1, 2, %zu, ];\n",
+  };
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  assert(out);
+  for (size_t i = 0; len < bytes; i++) {
+    char suffix[16];
+    name(suffix, i);
+    if (every != 0 && i % every == 0) {
+      fprintf(out, broken[(i / every) % 4], suffix, i);
+    } else {
+      fprintf(out,
+              "let v%s = fn(a, b) { if (a < b) { [a, b, %zu] } else { a } };\n",
+              suffix, i);
+    }
+    fflush(out);
+  }
+  fclose(out);
+  return input;
+}
+
+/* Best of ROUNDS parses of `input`, and how many errors it had */
+static double parse(const char *input, size_t max_errors, size_t *errors) {
+  double best = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    parser_t *parser = parser_new(lexer_new(input));
+    parser->max_errors = max_errors;
+    double start = bench_now();
+    program_t *program = parser_parse_program(parser);
+    double elapsed = bench_now() - start;
+    best = round == 0 || elapsed < best ? elapsed : best;
+    *errors = parser->errors_len;
+    program_destroy(&program);
+    parser_destroy(&parser);
+  }
+  return best;
+}
+
+static void report(const char *label, const char *input, size_t max_errors) {
+  size_t errors = 0;
+  double seconds = parse(input, max_errors, &errors);
+  char line[128];
+  snprintf(line, sizeof(line), "%s, %zu errors", label, errors);
+  bench_report(line, strlen(input), seconds);
+}
+
+int main(void) {
+  char *clean = script(SOURCE_BYTES, 0);
+  char *tenth = script(SOURCE_BYTES, 10);
+  char *all = script(SOURCE_BYTES, 1);
+  printf("%zu bytes\n", strlen(clean));
+
+  report("clean", clean, PARSER_MAX_ERRORS);
+  report("10% malformed, no limit", tenth, 0);
+  report("10% malformed, limit", tenth, PARSER_MAX_ERRORS);
+  report("all malformed, no limit", all, 0);
+  report("all malformed, limit", all, PARSER_MAX_ERRORS);
+
+  /* Messages are only made when asked for */
+  parser_t *parser = parser_new(lexer_new(tenth));
+  parser->max_errors = 0;
+  program_t *program = parser_parse_program(parser);
+  double start = bench_now();
+  for (size_t i = 0; i < parser->errors_len; i++) {
+    char *error = parser_format_error(parser, i);
+    bench_sink += (uintptr_t)error[0];
+    free(error);
+  }
+  bench_report("format every error", parser->errors_len, bench_now() - start);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  free(all);
+  free(tenth);
+  free(clean);
+  return 0;
+}
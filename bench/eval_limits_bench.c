@@ -0,0 +1,66 @@
+#include "../src/vm.h"
+#include "bench.h"
+
+#define ROUNDS 5
+#define RUNS 8
+
+/* fib(20) makes 21891 calls, each of them a step */
+static const char *DEFINE =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };";
+static const char *CALL = "fib(20)";
+
+#define CALLS 21891
+#define RESULT 6765
+
+static double bench_limits(const eval_limits_t *limits) {
+  monkey_vm_t *vm = monkey_vm_new();
+  vm->limits = *limits;
+  obj_t *result = monkey_vm_eval(vm, DEFINE);
+  assert(result == NULL);
+
+  double best = 0;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    double start = bench_now();
+    for (size_t i = 0; i < RUNS; i++) {
+      result = monkey_vm_eval(vm, CALL);
+      assert(result != NULL && result->type == INT_OBJ &&
+             result->int_obj->value == RESULT);
+      monkey_vm_result_destroy(vm, &result);
+    }
+    double elapsed = bench_now() - start;
+    if (round == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  monkey_vm_destroy(&vm);
+  return best;
+}
+
+int main(void) {
+  static const struct {
+    const char *name;
+    eval_limits_t limits;
+  } cases[] = {
+      {"unbounded", {0}},
+      {"max_steps", {.max_steps = UINT64_MAX - 1}},
+      {"max_steps + timeout", {.max_steps = UINT64_MAX - 1,
+                               .timeout_ns = 60 * 1000000000ULL}},
+      {"max_steps + timeout + max_depth", {.max_steps = UINT64_MAX - 1,
+                                           .timeout_ns = 60 * 1000000000ULL,
+                                           .max_depth = 10000}},
+      {"max_bytes", {.max_bytes = SIZE_MAX}},
+  };
+
+  double unbounded = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    double seconds = bench_limits(&cases[i].limits);
+    if (i == 0) {
+      unbounded = seconds;
+    }
+    char label[128];
+    snprintf(label, sizeof(label), "%s (%+.1f%%)", cases[i].name,
+             (seconds / unbounded - 1) * 100);
+    bench_report(label, (size_t)CALLS * RUNS, seconds);
+  }
+  return 0;
+}
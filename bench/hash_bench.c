@@ -0,0 +1,187 @@
+#include "../src/hash.h"
+#include "bench.h"
+
+/*
+ * The chaining table src/hash.c used to implement: a fixed number of
+ * buckets, one malloc'd entry and key copy per insert.
+ */
+typedef struct _chain_he_t {
+  char *key;
+  hd_t *data;
+  struct _chain_he_t *next;
+} chain_he_t;
+
+typedef struct {
+  chain_he_t **entries;
+  size_t capacity;
+} chain_ht_t;
+
+static chain_ht_t *chain_ht_create(size_t n) {
+  chain_ht_t *ht = malloc(sizeof(chain_ht_t));
+  ht->capacity = n;
+  ht->entries = calloc(sizeof(chain_he_t *), n);
+  return ht;
+}
+
+static void chain_ht_destroy(chain_ht_t **ht_p) {
+  chain_ht_t *ht = *ht_p;
+  for (size_t i = 0; i < ht->capacity; i++) {
+    chain_he_t *he = ht->entries[i];
+    while (he != NULL) {
+      chain_he_t *next = he->next;
+      free(he->key);
+      hd_destroy(&he->data);
+      free(he);
+      he = next;
+    }
+  }
+  free(ht->entries);
+  free(ht);
+  *ht_p = NULL;
+}
+
+static void chain_ht_add(chain_ht_t *ht, char *key, hd_t *data) {
+  chain_he_t *he = malloc(sizeof(chain_he_t));
+  he->key = strdup(key);
+  he->data = data;
+  he->next = NULL;
+  size_t idx = gnu_hash((const uint8_t *)key) % ht->capacity;
+  if (ht->entries[idx] == NULL) {
+    ht->entries[idx] = he;
+  } else {
+    chain_he_t *cur = ht->entries[idx];
+    while (cur->next != NULL) {
+      cur = cur->next;
+    }
+    cur->next = he;
+  }
+}
+
+static hd_t *chain_ht_get(chain_ht_t *ht, char *key) {
+  size_t idx = gnu_hash((const uint8_t *)key) % ht->capacity;
+  for (chain_he_t *he = ht->entries[idx]; he != NULL; he = he->next) {
+    if (strcmp(he->key, key) == 0) {
+      return he->data;
+    }
+  }
+  return NULL;
+}
+
+/* Identifier-like keys: short names with common prefixes */
+static char **make_keys(size_t n, const char *prefix) {
+  char **keys = malloc(n * sizeof(char *));
+  assert(keys);
+  for (size_t i = 0; i < n; i++) {
+    asprintf(&keys[i], "%s%zu", prefix, i);
+  }
+  return keys;
+}
+
+static void free_keys(char **keys, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    free(keys[i]);
+  }
+  free(keys);
+}
+
+static void bench_chain(size_t n, size_t buckets, char **keys, char **misses) {
+  char label[128];
+  double start = bench_now();
+  chain_ht_t *ht = chain_ht_create(buckets);
+  for (size_t i = 0; i < n; i++) {
+    chain_ht_add(ht, keys[i], hd_create(HD_INT_DT, (uintptr_t *)i));
+  }
+  double elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "chain/%zu insert (%zu)", buckets, n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += chain_ht_get(ht, keys[i])->num;
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "chain/%zu lookup hit (%zu)", buckets, n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += (uintptr_t)chain_ht_get(ht, misses[i]);
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "chain/%zu lookup miss (%zu)", buckets, n);
+  bench_report(label, n, elapsed);
+
+  chain_ht_destroy(&ht);
+}
+
+static void bench_swiss(size_t n, char **keys, char **misses) {
+  char label[128];
+  double start = bench_now();
+  ht_t *ht = ht_create(1);
+  for (size_t i = 0; i < n; i++) {
+    ht_add(ht, keys[i], hd_create(HD_INT_DT, (uintptr_t *)i));
+  }
+  double elapsed = bench_now() - start;
+  assert(ht->length == n);
+  snprintf(label, sizeof(label), "swiss insert (%zu)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += ht_get(ht, keys[i])->num;
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "swiss lookup hit (%zu)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += (uintptr_t)ht_get(ht, misses[i]);
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "swiss lookup miss (%zu)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i += 2) {
+    bench_sink += ht_delete(ht, keys[i]);
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "swiss delete (%zu)", n);
+  bench_report(label, (n + 1) / 2, elapsed);
+
+  /* Deleting one key must not disturb any other */
+  assert(ht->length == n / 2);
+  for (size_t i = 0; i < n; i++) {
+    assert((ht_get(ht, keys[i]) != NULL) == (i % 2 == 1));
+  }
+
+  /* Churn: tombstones must be reclaimed instead of growing forever */
+  start = bench_now();
+  for (size_t i = 0; i < n; i += 2) {
+    ht_add(ht, misses[i], hd_create(HD_INT_DT, (uintptr_t *)i));
+    ht_delete(ht, misses[i]);
+  }
+  elapsed = bench_now() - start;
+  assert(ht->length == n / 2);
+  snprintf(label, sizeof(label), "swiss insert+delete churn (%zu)", n);
+  bench_report(label, (n + 1) / 2, elapsed);
+
+  ht_destroy(&ht);
+}
+
+int main(void) {
+  size_t sizes[] = {64, 1000, 10000, 100000, 1000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    size_t n = sizes[i];
+    char **keys = make_keys(n, "ident_");
+    char **misses = make_keys(n, "other_");
+    printf("-- %zu keys\n", n);
+    /* The old table was created with a fixed number of buckets */
+    bench_chain(n, 10000, keys, misses);
+    bench_swiss(n, keys, misses);
+    free_keys(keys, n);
+    free_keys(misses, n);
+  }
+  return 0;
+}
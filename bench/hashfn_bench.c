@@ -0,0 +1,84 @@
+#include "../src/hash.h"
+#include "bench.h"
+
+#define THROUGHPUT_BYTES (64 * 1024 * 1024)
+
+typedef uint32_t (*hash_fn)(const char *data, size_t len);
+
+/* What `ht_t` did before: a strlen pass and a byte at a time hash */
+static uint32_t hash_gnu(const char *data, size_t len) {
+  (void)len;
+  bench_sink += strlen(data);
+  return gnu_hash((const uint8_t *)data);
+}
+
+static uint32_t hash_wy(const char *data, size_t len) {
+  return hash_bytes(data, len);
+}
+
+static void bench_throughput(const char *name, hash_fn fn, size_t len) {
+  char *data = malloc(len + 1);
+  assert(data);
+  for (size_t i = 0; i < len; i++) {
+    data[i] = 'a' + i % 26;
+  }
+  data[len] = '\0';
+
+  size_t iterations = THROUGHPUT_BYTES / len;
+  double start = bench_now();
+  for (size_t i = 0; i < iterations; i++) {
+    data[0] = 'a' + i % 26;
+    bench_sink += fn(data, len);
+  }
+  double elapsed = bench_now() - start;
+
+  char label[128];
+  snprintf(label, sizeof(label), "%-10s %5zu bytes (%.0f MB/s)", name, len,
+           THROUGHPUT_BYTES / elapsed / 1e6);
+  bench_report(label, iterations, elapsed);
+  free(data);
+}
+
+/*
+ * Hashes `n` keys into `n` buckets using the low bits, as the tables
+ * do. With a uniform hash about 1/e of the buckets stay empty and the
+ * longest chain is around ln(n) / ln(ln(n)).
+ */
+static void bench_distribution(const char *name, hash_fn fn, const char *fmt,
+                               size_t n) {
+  uint32_t *chains = calloc(n, sizeof(uint32_t));
+  assert(chains);
+  for (size_t i = 0; i < n; i++) {
+    char key[64];
+    int len = snprintf(key, sizeof(key), fmt, i);
+    chains[fn(key, (size_t)len) & (n - 1)]++;
+  }
+
+  size_t empty = 0;
+  uint32_t longest = 0;
+  double chi2 = 0;
+  for (size_t i = 0; i < n; i++) {
+    empty += chains[i] == 0;
+    longest = chains[i] > longest ? chains[i] : longest;
+    chi2 += (chains[i] - 1.0) * (chains[i] - 1.0);
+  }
+  printf("%-8s %-12s empty %5.1f%% (ideal 36.8%%)  longest %3" PRIu32
+         "  chi2/n %.3f (ideal 1.0)\n",
+         name, fmt, 100.0 * empty / n, longest, chi2 / n);
+  free(chains);
+}
+
+int main(void) {
+  size_t lens[] = {4, 8, 16, 32, 64, 256, 4096};
+  for (size_t i = 0; i < sizeof(lens) / sizeof(*lens); i++) {
+    bench_throughput("gnu_hash", hash_gnu, lens[i]);
+    bench_throughput("hash_bytes", hash_wy, lens[i]);
+  }
+
+  const char *formats[] = {"x%zu", "ident_%zu", "%zu_tmp", "fooBarBaz%zu"};
+  for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); i++) {
+    bench_distribution("gnu_hash", hash_gnu, formats[i], 1 << 16);
+    bench_distribution("hash", hash_wy, formats[i], 1 << 16);
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include "../src/lexer.h"
+#include "../src/source.h"
+#include "bench.h"
+
+#define SOURCE_BYTES (8 * 1024 * 1024)
+#define ROUNDS 5
+#define LOOKUPS 1000000
+
+/* Identifiers are letters only, so spell `i` in base 26 */
+static void name(char *buf, size_t i) {
+  do {
+    *buf++ = 'a' + i % 26;
+    i /= 26;
+  } while (i > 0);
+  *buf = '\0';
+}
+
+static char *large_script(size_t bytes) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  assert(out);
+  for (size_t i = 0; len < bytes; i++) {
+    char suffix[16];
+    name(suffix, i);
+    fprintf(out,
+            "let fun%s = fn(a, b) {\n  if (a < b) { [a, b, \"lt\"] } "
+            "else { {\"a\": a * %zu} }\n};\nlet val%s = fun%s(%zu, 7)[0];\n",
+            suffix, i, suffix, suffix, i);
+    fflush(out);
+  }
+  fclose(out);
+  return input;
+}
+
+/*
+ * Lexing speed with token offsets, best of ROUNDS. Positions cost
+ * nothing more while lexing; compare with a build from before they were
+ * added. Then the one-off line index and the lookups it serves.
+ */
+int main(void) {
+  char *input = large_script(SOURCE_BYTES);
+  uint32_t len = (uint32_t)strlen(input);
+  intern_table_t *symbols = intern_table_new();
+  intern_table_t *previous = intern_table_swap(symbols);
+
+  size_t tokens = 0;
+  double best = 0;
+  uint32_t last = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    lexer_t *lexer = lexer_new(input);
+    tokens = 0;
+    double start = bench_now();
+    for (;;) {
+      token_t *tok = lexer_next_token(lexer);
+      TokenType type = tok->type;
+      last = tok->offset;
+      token_destroy(&tok);
+      tokens++;
+      if (type == EOF_TOKEN) {
+        break;
+      }
+    }
+    double elapsed = bench_now() - start;
+    best = round == 0 || elapsed < best ? elapsed : best;
+    lexer_destroy(&lexer);
+  }
+  printf("%.1f MB, %zu tokens\n", len / 1e6, tokens);
+  bench_report("lex (best round)", tokens, best);
+  printf("%-44s %10.1f MB/s\n", "lex (best round)", len / 1e6 / best);
+
+  source_t *source = source_new("bench", input, len, 0);
+  double start = bench_now();
+  source_location_t location = source_locate(source, last);
+  bench_report("line index, first lookup", 1, bench_now() - start);
+  printf("%-44s %u:%u of %u lines\n", "EOF at", location.line,
+         location.column, source->lines);
+
+  srand(1);
+  start = bench_now();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    location = source_locate(source, (uint32_t)rand() % len);
+    bench_sink += location.line;
+  }
+  bench_report("line:column lookup", LOOKUPS, bench_now() - start);
+
+  source_destroy(&source);
+  intern_table_swap(previous);
+  intern_table_destroy(&symbols);
+  free(input);
+  return 0;
+}
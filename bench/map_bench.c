@@ -0,0 +1,138 @@
+#include "../src/map.h"
+#include "bench.h"
+
+static array_value_t int_key(int32_t i) {
+  return (array_value_t){.type = INT_OBJ, .int_value = i};
+}
+
+/* Keys in a fixed pseudo random order, so probes are not sequential */
+static int32_t *shuffled_keys(size_t n) {
+  int32_t *keys = malloc(n * sizeof(int32_t));
+  assert(keys);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = (int32_t)i;
+  }
+  uint64_t state = 88172645463325252ULL;
+  for (size_t i = n - 1; i > 0; i--) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    size_t j = state % (i + 1);
+    int32_t tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+  return keys;
+}
+
+static void bench_int_keys(size_t n) {
+  int32_t *keys = shuffled_keys(n);
+  char label[128];
+
+  double start = bench_now();
+  map_t *map = map_new(0);
+  for (size_t i = 0; i < n; i++) {
+    map_set(map, int_key(keys[i]), int_key(keys[i]));
+  }
+  double elapsed = bench_now() - start;
+  assert(map->len == n);
+  snprintf(label, sizeof(label), "insert (%zu int keys)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    array_value_t key = int_key((int32_t)i);
+    bench_sink += map_get(map, &key)->int_value;
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "lookup hit (%zu int keys)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    array_value_t key = int_key((int32_t)(n + i));
+    bench_sink += (uintptr_t)map_get(map, &key);
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "lookup miss (%zu int keys)", n);
+  bench_report(label, n, elapsed);
+
+  /* Delete every other key, the rest must still be found */
+  start = bench_now();
+  for (size_t i = 0; i < n; i += 2) {
+    array_value_t key = int_key(keys[i]);
+    bench_sink += map_delete(map, &key);
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "delete (%zu int keys)", n);
+  bench_report(label, (n + 1) / 2, elapsed);
+
+  assert(map->len == n / 2);
+  for (size_t i = 1; i < n; i += 2) {
+    array_value_t key = int_key(keys[i]);
+    assert(map_get(map, &key) != NULL);
+    (void)key;
+  }
+
+  map_release(&map);
+  free(keys);
+}
+
+static void bench_string_keys(size_t n) {
+  array_value_t *keys = malloc(n * sizeof(array_value_t));
+  assert(keys);
+  for (size_t i = 0; i < n; i++) {
+    char name[32];
+    int len = snprintf(name, sizeof(name), "identifier_%zu", i);
+    keys[i] = (array_value_t){
+        .type = STRING_OBJ,
+        .obj = obj_new(STRING_OBJ, str_obj_new(name, (size_t)len))};
+  }
+  char label[128];
+
+  double start = bench_now();
+  map_t *map = map_new(0);
+  for (size_t i = 0; i < n; i++) {
+    map_set(map,
+            (array_value_t){.type = STRING_OBJ, .obj = obj_copy(keys[i].obj)},
+            int_key((int32_t)i));
+  }
+  double elapsed = bench_now() - start;
+  assert(map->len == n);
+  snprintf(label, sizeof(label), "insert (%zu string keys)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += map_get(map, &keys[i])->int_value;
+  }
+  elapsed = bench_now() - start;
+  snprintf(label, sizeof(label), "lookup hit (%zu string keys)", n);
+  bench_report(label, n, elapsed);
+
+  start = bench_now();
+  for (size_t i = 0; i < n; i++) {
+    bench_sink += map_delete(map, &keys[i]);
+  }
+  elapsed = bench_now() - start;
+  assert(map->len == 0);
+  snprintf(label, sizeof(label), "delete (%zu string keys)", n);
+  bench_report(label, n, elapsed);
+
+  map_release(&map);
+  for (size_t i = 0; i < n; i++) {
+    array_value_destroy(&keys[i]);
+  }
+  free(keys);
+}
+
+int main(void) {
+  size_t sizes[] = {1000, 10000, 100000, 1000000, 10000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    bench_int_keys(sizes[i]);
+  }
+  for (size_t i = 0; i < 4; i++) {
+    bench_string_keys(sizes[i]);
+  }
+  return 0;
+}
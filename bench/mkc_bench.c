@@ -0,0 +1,120 @@
+#include "../src/lexer.h"
+#include "../src/mkc.h"
+#include "../src/parser.h"
+#include "bench.h"
+#include <malloc.h>
+#include <sys/stat.h>
+
+#define SOURCE_BYTES (16 * 1024 * 1024)
+#define ROUNDS 3
+
+/* Identifiers are letters only, so spell `i` in base 26 */
+static void name(char *buf, size_t i) {
+  do {
+    *buf++ = 'a' + i % 26;
+    i /= 26;
+  } while (i > 0);
+  *buf = '\0';
+}
+
+/* Functions, literals and calls, repeated with fresh names */
+static char *large_script(size_t bytes) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  assert(out);
+  for (size_t i = 0; len < bytes; i++) {
+    char suffix[16];
+    name(suffix, i);
+    fprintf(out,
+            "let fun%s = fn(a, b) { if (a < b) { return [a, b, \"lt\"]; } "
+            "else { {\"a\": a * %zu, \"b\": -b} } };\n"
+            "let val%s = fun%s(%zu, len(\"value %zu\") + 1)[0];\n",
+            suffix, i, suffix, suffix, i, i);
+    fflush(out);
+  }
+  fclose(out);
+  return input;
+}
+
+static size_t file_size(const char *path) {
+  struct stat st;
+  assert(stat(path, &st) == 0);
+  return (size_t)st.st_size;
+}
+
+static char *read_source(const char *path) {
+  FILE *file = fopen(path, "r");
+  assert(file);
+  size_t size = file_size(path);
+  char *input = malloc(size + 1);
+  assert(input && fread(input, 1, size, file) == size);
+  input[size] = '\0';
+  fclose(file);
+  return input;
+}
+
+int main(void) {
+  char source_path[] = "/tmp/mkc_benchXXXXXX";
+  int fd = mkstemp(source_path);
+  assert(fd >= 0);
+  char *input = large_script(SOURCE_BYTES);
+  assert(write(fd, input, strlen(input)) == (ssize_t)strlen(input));
+  close(fd);
+
+  char compiled_path[64];
+  snprintf(compiled_path, sizeof(compiled_path), "%s.mkc", source_path);
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  size_t statements = program->len;
+  FILE *out = fopen(compiled_path, "w");
+  assert(out && mkc_write(program, out));
+  fclose(out);
+  program_destroy(&program);
+  parser_destroy(&parser);
+  free(input);
+
+  printf("source %.1f MB, compiled %.1f MB, %zu statements\n",
+         file_size(source_path) / 1e6, file_size(compiled_path) / 1e6,
+         statements);
+
+  for (int round = 0; round < ROUNDS; round++) {
+    /* Startup from source: read, lex and parse */
+    size_t heap_before = mallinfo2().uordblks;
+    double start = bench_now();
+    input = read_source(source_path);
+    lexer = lexer_new(input);
+    parser = parser_new(lexer);
+    program = parser_parse_program(parser);
+    double loaded = bench_now();
+    size_t heap_after = mallinfo2().uordblks;
+    bench_report("startup from source", statements, loaded - start);
+    printf("%-44s %10zu bytes of heap\n", "startup from source",
+           heap_after - heap_before);
+    start = bench_now();
+    program_destroy(&program);
+    parser_destroy(&parser);
+    free(input);
+    bench_report("teardown from source", statements, bench_now() - start);
+
+    /* Startup from the compiled file: mmap and build nodes in an arena */
+    char *error = NULL;
+    heap_before = mallinfo2().uordblks;
+    start = bench_now();
+    program = mkc_load(compiled_path, &error);
+    loaded = bench_now();
+    heap_after = mallinfo2().uordblks;
+    assert(program && program->len == statements);
+    bench_report("startup from .mkc", statements, loaded - start);
+    printf("%-44s %10zu bytes of heap\n", "startup from .mkc",
+           heap_after - heap_before);
+    start = bench_now();
+    program_destroy(&program);
+    bench_report("teardown from .mkc", statements, bench_now() - start);
+  }
+
+  unlink(compiled_path);
+  unlink(source_path);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+#define MAX_DEPTH 1000000
+
+typedef struct {
+  const char *name;
+  const char *open;
+  const char *leaf;
+  const char *close;
+} nesting_t;
+
+static const nesting_t nestings[] = {
+    {"((x))", "(", "x", ")"},
+    {"-!-!x", "-!", "x", ""},
+    {"1 + (1 + (1))", "1 + (", "1", ")"},
+    {"[[1]]", "[", "1", "]"},
+    {"f(f(x))", "f(", "x", ")"},
+};
+
+static char *nested(const nesting_t *nesting, size_t depth) {
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  assert(out);
+  for (size_t i = 0; i < depth; i++) {
+    fputs(nesting->open, out);
+  }
+  fputs(nesting->leaf, out);
+  for (size_t i = 0; i < depth; i++) {
+    fputs(nesting->close, out);
+  }
+  fclose(out);
+  return str;
+}
+
+/* Time per nesting level should stay flat as the depth grows */
+int main(void) {
+  for (size_t n = 0; n < sizeof(nestings) / sizeof(*nestings); n++) {
+    for (size_t depth = 100; depth <= MAX_DEPTH; depth *= 100) {
+      char *input = nested(&nestings[n], depth);
+      char label[64];
+
+      parser_t *parser = parser_new(lexer_new(input));
+      double start = bench_now();
+      program_t *program = parser_parse_program(parser);
+      double parsed = bench_now();
+      assert(parser->errors_len == 0 && program->len == 1);
+      snprintf(label, sizeof(label), "parse %s", nestings[n].name);
+      bench_report(label, depth, parsed - start);
+
+      start = bench_now();
+      char *str = program_to_string(program);
+      snprintf(label, sizeof(label), "print %s", nestings[n].name);
+      bench_report(label, depth, bench_now() - start);
+      free(str);
+
+      start = bench_now();
+      program_destroy(&program);
+      snprintf(label, sizeof(label), "destroy %s", nestings[n].name);
+      bench_report(label, depth, bench_now() - start);
+
+      parser_destroy(&parser);
+      free(input);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "../src/pool.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+#define ROUNDS 5
+#define BURST 1000
+#define BURSTS 10000
+#define RUNS 20
+
+/* fib(20) makes about 30000 calls, each with a few objects */
+static const char *DEFINE =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };";
+static const char *CALL = "fib(20)";
+
+#define RESULT 6765
+
+/* Bursts of allocations freed in reverse, as nested calls free them */
+static double bench_pairs(bool pooled) {
+  void **blocks = malloc(BURST * sizeof(void *));
+  assert(blocks);
+  double best = 0;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    double start = bench_now();
+    for (size_t i = 0; i < BURSTS; i++) {
+      for (size_t j = 0; j < BURST; j++) {
+        blocks[j] = pooled ? pool_alloc(POOL_INT, MEM_INT)
+                           : mem_malloc(sizeof(int_obj_t));
+      }
+      bench_sink += (uintptr_t)blocks[BURST / 2];
+      for (size_t j = BURST; j-- > 0;) {
+        if (pooled) {
+          pool_free(POOL_INT, blocks[j]);
+        } else {
+          mem_free(blocks[j], sizeof(int_obj_t));
+        }
+      }
+    }
+    double elapsed = bench_now() - start;
+    best = round == 0 || elapsed < best ? elapsed : best;
+  }
+  free(blocks);
+  return best;
+}
+
+static double bench_fib(monkey_vm_t *vm) {
+  double best = 0;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    double start = bench_now();
+    for (size_t i = 0; i < RUNS; i++) {
+      obj_t *result = monkey_vm_eval(vm, CALL);
+      assert(result != NULL && result->type == INT_OBJ &&
+             result->int_obj->value == RESULT);
+      monkey_vm_result_destroy(vm, &result);
+    }
+    double elapsed = bench_now() - start;
+    best = round == 0 || elapsed < best ? elapsed : best;
+  }
+  return best;
+}
+
+/*
+ * Allocation pairs from the pools against the system allocator, then
+ * the recursion they serve; build with and without --disable-pools to
+ * compare the latter.
+ */
+int main(void) {
+#ifdef MONKEY_POOLS
+  printf("pools on, %d blocks per batch\n", POOL_BATCH);
+#else
+  printf("pools off, the objects come from the system allocator\n");
+#endif
+  bench_report("malloc/free pairs", BURST * BURSTS, bench_pairs(false));
+  bench_report("pool_alloc/pool_free pairs", BURST * BURSTS,
+               bench_pairs(true));
+
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *result = monkey_vm_eval(vm, DEFINE);
+  assert(result == NULL);
+  bench_report("fib(20)", RUNS, bench_fib(vm));
+  monkey_vm_destroy(&vm);
+  return 0;
+}
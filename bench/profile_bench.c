@@ -0,0 +1,58 @@
+#include "../src/profile.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+#define ROUNDS 5
+#define RUNS 20
+
+/* fib(20) makes 21891 calls, each of them pushes a frame when profiled */
+static const char *DEFINE =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };";
+static const char *CALL = "fib(20)";
+
+#define CALLS 21891
+#define RESULT 6765
+
+static double bench_fib(monkey_vm_t *vm) {
+  double best = 0;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    double start = bench_now();
+    for (size_t i = 0; i < RUNS; i++) {
+      obj_t *result = monkey_vm_eval(vm, CALL);
+      assert(result != NULL && result->type == INT_OBJ &&
+             result->int_obj->value == RESULT);
+      monkey_vm_result_destroy(vm, &result);
+    }
+    double elapsed = bench_now() - start;
+    if (round == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+int main(void) {
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *result = monkey_vm_eval(vm, DEFINE);
+  assert(result == NULL);
+
+  double off = bench_fib(vm);
+  bench_report("not profiled", (size_t)CALLS * RUNS, off);
+
+  profile_t *profile = profile_new(PROFILE_DEFAULT_HZ);
+  bool started = profile_start(profile);
+  assert(started);
+  (void)started;
+  double on = bench_fib(vm);
+  profile_stop(profile);
+  char label[128];
+  snprintf(label, sizeof(label), "profiled at %u Hz (%+.1f%%)", profile->hz,
+           (on / off - 1) * 100);
+  bench_report(label, (size_t)CALLS * RUNS, on);
+  printf("  samples %zu dropped %zu\n", profile->samples_len,
+         profile->dropped);
+
+  profile_destroy(&profile);
+  monkey_vm_destroy(&vm);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+#define SOURCE_BYTES (1024 * 1024)
+#define EDITS 2000
+
+/* Identifiers are letters only, so spell `i` in base 26 */
+static void name(char *buf, size_t i) {
+  do {
+    *buf++ = 'a' + i % 26;
+    i /= 26;
+  } while (i > 0);
+  *buf = '\0';
+}
+
+static char *large_script(size_t bytes, size_t *len) {
+  char *input = NULL;
+  FILE *out = open_memstream(&input, len);
+  assert(out);
+  for (size_t i = 0; *len < bytes; i++) {
+    char suffix[16];
+    name(suffix, i);
+    fprintf(out,
+            "let fun%s = fn(a, b) {\n  if (a < b) { [a, b, %zu] } "
+            "else { {\"a\": a * %zu} }\n};\nlet val%s = fun%s(%zu, 7);\n",
+            suffix, i, i, suffix, suffix, i);
+    fflush(out);
+  }
+  fclose(out);
+  return input;
+}
+
+/*
+ * Single character edits that keep the program valid: a digit replaced
+ * by another, or a space inserted before a newline and removed again.
+ */
+static source_edit_t next_edit(char *text, size_t *len, size_t i) {
+  size_t at = (size_t)rand() % *len;
+  if (i % 2 == 0) {
+    while (!is_digit(text[at])) {
+      at = (at + 1) % *len;
+    }
+    text[at] = text[at] == '9' ? '1' : text[at] + 1;
+    return (source_edit_t){at, 1, 1};
+  }
+  static size_t space = SIZE_MAX;
+  if (space != SIZE_MAX) {
+    memmove(text + space, text + space + 1, *len - space);
+    (*len)--;
+    source_edit_t edit = {space, 1, 0};
+    space = SIZE_MAX;
+    return edit;
+  }
+  while (text[at] != '\n') {
+    at = (at + 1) % *len;
+  }
+  memmove(text + at + 1, text + at, *len - at + 1);
+  text[at] = ' ';
+  (*len)++;
+  space = at;
+  return (source_edit_t){at, 0, 1};
+}
+
+int main(void) {
+  size_t len = 0;
+  char *input = large_script(SOURCE_BYTES, &len);
+  char *text = malloc(len + 2);
+  assert(text);
+  memcpy(text, input, len + 1);
+  free(input);
+
+  parser_t *parser = parser_new(lexer_new(text));
+  program_t *program = parser_parse_program(parser);
+  parser_destroy(&parser);
+  printf("%zu bytes, %zu statements\n", len, program->len);
+
+  srand(1);
+  double incremental = 0, full = 0;
+  for (size_t i = 0; i < EDITS; i++) {
+    source_edit_t edit = next_edit(text, &len, i);
+
+    double start = bench_now();
+    parser = parser_new(lexer_new(text));
+    parser_reparse_program(parser, program, &edit);
+    incremental += bench_now() - start;
+    assert(parser->errors_len == 0);
+    parser_destroy(&parser);
+
+    if (i % 100 == 0) {
+      /* A full parse now and then, as the baseline and as a check */
+      start = bench_now();
+      parser = parser_new(lexer_new(text));
+      program_t *reparsed = parser_parse_program(parser);
+      full += bench_now() - start;
+      assert(reparsed->len == program->len);
+      for (size_t j = 0; j < program->len; j++) {
+        assert(reparsed->spans[j].start == program->spans[j].start);
+        assert(reparsed->spans[j].end == program->spans[j].end);
+      }
+      program_destroy(&reparsed);
+      parser_destroy(&parser);
+    }
+  }
+
+  bench_report("incremental reparse per edit", EDITS, incremental);
+  bench_report("full parse per edit", EDITS / 100, full);
+
+  program_destroy(&program);
+  free(text);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include "../src/object.h"
+#include "bench.h"
+
+#define PIECE "0123456789"
+
+/* What `str_obj_concat` did before ropes: copy both operands every time */
+static str_obj_t *flat_concat(str_obj_t *left, str_obj_t *right) {
+  size_t left_len = str_obj_len(left);
+  size_t right_len = str_obj_len(right);
+  str_buf_t *buf = str_buf_new(NULL, left_len + right_len);
+  memcpy(buf->data, str_obj_data(left), left_len);
+  memcpy(buf->data + left_len, str_obj_data(right), right_len);
+  str_obj_t *obj = str_obj_from_buf(buf);
+  str_buf_release(&buf);
+  return obj;
+}
+
+typedef str_obj_t *(*concat_fn)(str_obj_t *left, str_obj_t *right);
+
+/*
+ * Builds a string from `pieces` appends. With `read_every` set, the
+ * bytes of the intermediate string are read after every append.
+ */
+static void bench_build(const char *name, concat_fn concat, size_t pieces,
+                        bool read_every) {
+  str_obj_t *piece = str_obj_new(PIECE, strlen(PIECE));
+  str_obj_t *str = str_obj_new("", 0);
+
+  double start = bench_now();
+  for (size_t i = 0; i < pieces; i++) {
+    str_obj_t *next = concat(str, piece);
+    str_obj_destroy(&str);
+    str = next;
+    if (read_every) {
+      bench_sink += str_obj_data(str)[str_obj_len(str) - 1];
+    }
+  }
+  /* One final read, as printing the result would do */
+  bench_sink += str_obj_data(str)[0];
+  double elapsed = bench_now() - start;
+
+  char label[128];
+  snprintf(label, sizeof(label), "%s (%zu pieces)", name, pieces);
+  bench_report(label, pieces, elapsed);
+
+  str_obj_destroy(&str);
+  str_obj_destroy(&piece);
+}
+
+int main(void) {
+  size_t sizes[] = {10000, 20000, 40000};
+
+  puts("-- append heavy");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    bench_build("flat", flat_concat, sizes[i], false);
+  }
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    bench_build("rope", str_obj_concat, sizes[i], false);
+  }
+  /* 10 MB from 10^6 pieces */
+  bench_build("rope", str_obj_concat, 1000000, false);
+
+  puts("-- read heavy");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    bench_build("flat", flat_concat, sizes[i], true);
+  }
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    bench_build("rope", str_obj_concat, sizes[i], true);
+  }
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include "../src/lexer.h"
+#include "../src/memory.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+#define PARSES 200000
+#define ROUNDS 5
+
+/* What a REPL line or a batch snippet looks like */
+static const struct {
+  const char *name;
+  const char *code;
+} snippets[] = {
+    {"expression", "1 + 2"},
+    {"let", "let x = 5;"},
+    {"call", "len(\"abc\")"},
+    {"function", "let add = fn(a, b) { a + b }; add(1, 2);"},
+};
+
+/*
+ * Bytes a new parser holds before parsing: the lexer, the parser and
+ * its first two tokens. The Pratt table is shared, but construction
+ * still allocates these.
+ */
+static size_t construction_bytes(const char *code) {
+  /* Not counting the keywords, which the first lexer interns */
+  parser_t *parser = parser_new(lexer_new(code));
+  parser_destroy(&parser);
+
+  memory_t *memory = memory_new();
+  memory_t *previous = memory_swap(memory);
+  parser = parser_new(lexer_new(code));
+  size_t bytes = memory->current;
+  parser_destroy(&parser);
+  memory_swap(previous);
+  memory_destroy(&memory);
+  return bytes;
+}
+
+int main(void) {
+  for (size_t s = 0; s < sizeof(snippets) / sizeof(*snippets); s++) {
+    printf("%s: parser_new holds %zu bytes before parsing\n",
+           snippets[s].name, construction_bytes(snippets[s].code));
+  }
+  for (size_t s = 0; s < sizeof(snippets) / sizeof(*snippets); s++) {
+    /* Best of ROUNDS, the machine is rarely quiet for long */
+    double elapsed = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+      double start = bench_now();
+      for (size_t i = 0; i < PARSES; i++) {
+        parser_t *parser = parser_new(lexer_new(snippets[s].code));
+        program_t *program = parser_parse_program(parser);
+        bench_sink += program->len;
+        program_destroy(&program);
+        parser_destroy(&parser);
+      }
+      double round_elapsed = bench_now() - start;
+      elapsed = round == 0 || round_elapsed < elapsed ? round_elapsed : elapsed;
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "parse %s (%.0f/s)", snippets[s].name,
+             PARSES / elapsed);
+    bench_report(label, PARSES, elapsed);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "../src/evaluator.h"
+#include "../src/lexer.h"
+#include "../src/object.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+#define ITERATIONS 1000000
+
+static void bench_concat(const char *name, const char *left_str,
+                         const char *right_str) {
+  str_obj_t *left = str_obj_new(left_str, strlen(left_str));
+  str_obj_t *right = str_obj_new(right_str, strlen(right_str));
+
+  double start = bench_now();
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    str_obj_t *result = str_obj_concat(left, right);
+    bench_sink += str_obj_len(result);
+    str_obj_destroy(&result);
+  }
+  bench_report(name, ITERATIONS, bench_now() - start);
+
+  str_obj_destroy(&left);
+  str_obj_destroy(&right);
+}
+
+static void bench_equals(const char *name, str_obj_t *left, str_obj_t *right) {
+  double start = bench_now();
+  for (size_t i = 0; i < ITERATIONS * 10; i++) {
+    bench_sink += str_obj_equals(left, right);
+  }
+  bench_report(name, ITERATIONS * 10, bench_now() - start);
+}
+
+static void bench_eval(const char *name, const char *input, size_t runs) {
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  env_t *env = env_new();
+
+  double start = bench_now();
+  for (size_t i = 0; i < runs; i++) {
+    obj_t *obj = eval(program, env);
+    bench_sink += obj->type;
+    obj_destroy(&obj);
+  }
+  bench_report(name, runs, bench_now() - start);
+
+  env_destroy(&env);
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+
+int main(void) {
+  const char *long_str = "a string that is much too long to be stored inline "
+                         "and therefore lives in a heap buffer";
+
+  bench_concat("concat inline + inline -> inline", "foo", "bar");
+  bench_concat("concat inline + inline -> heap", "0123456789abcdef",
+               "0123456789abcdef");
+  bench_concat("concat heap + heap -> heap", long_str, long_str);
+
+  str_obj_t *inline_a = str_obj_new("identifier", strlen("identifier"));
+  str_obj_t *inline_b = str_obj_new("identifier", strlen("identifier"));
+  bench_equals("equals inline", inline_a, inline_b);
+
+  str_obj_t *interned_a = str_obj_from_buf(intern(long_str, strlen(long_str)));
+  str_obj_t *interned_b = str_obj_from_buf(intern(long_str, strlen(long_str)));
+  bench_equals("equals interned (pointer compare)", interned_a, interned_b);
+
+  str_obj_t *heap_a = str_obj_new(long_str, strlen(long_str));
+  str_obj_t *heap_b = str_obj_new(long_str, strlen(long_str));
+  bench_equals("equals heap (memcmp)", heap_a, heap_b);
+
+  bench_eval("eval literal == literal",
+             "\"a string that is much too long to be stored inline\" == "
+             "\"a string that is much too long to be stored inline\"",
+             ITERATIONS);
+  bench_eval("eval literal + literal",
+             "\"a string that is much too long \" + \"to be stored inline\"",
+             ITERATIONS);
+
+  str_obj_destroy(&inline_a);
+  str_obj_destroy(&inline_b);
+  str_obj_destroy(&interned_a);
+  str_obj_destroy(&interned_b);
+  str_obj_destroy(&heap_a);
+  str_obj_destroy(&heap_b);
+  intern_destroy();
+  return 0;
+}
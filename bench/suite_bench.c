@@ -0,0 +1,391 @@
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+#include "bench.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * The benchmark suite: representative workloads, each run in a child
+ * process of its own so that peak RSS is its own and no heap state
+ * carries over, reported as JSON. With a baseline written by an
+ * earlier run, workloads whose median got slower by more than the
+ * threshold are listed on stderr and the exit status is 1, as it is
+ * when the baseline has no median for a workload that runs.
+ *
+ * suite_bench [-n samples] [-o out.json] [-b baseline.json]
+ *             [-t percent] [workload...]
+ */
+
+#define DEFAULT_SAMPLES 31
+#define DEFAULT_THRESHOLD 10.0
+#define LARGE_SCRIPT_BYTES (1024 * 1024)
+#define NAME_MAX_LEN 64
+
+typedef struct {
+  const char *name;
+  /* Builds the input once, untimed */
+  char *(*input)(void);
+  /* One sample; the work must be charged to `memory` */
+  void (*run)(const char *input, memory_t *memory);
+} workload_t;
+
+/* What a child sends back through its pipe */
+typedef struct {
+  uint64_t median_ns;
+  uint64_t p99_ns;
+  size_t peak_bytes; /* of one sample's memory context */
+  uint64_t allocs;   /* by one sample, with alloc stats only */
+  long peak_rss_kb;
+} result_t;
+
+/* Identifiers are letters only, so spell `i` in base 26 */
+static void name(char *buf, size_t i) {
+  do {
+    *buf++ = 'a' + i % 26;
+    i /= 26;
+  } while (i > 0);
+  *buf = '\0';
+}
+
+static char *large_script(void) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  assert(out);
+  for (size_t i = 0; len < LARGE_SCRIPT_BYTES; i++) {
+    char suffix[16];
+    name(suffix, i);
+    fprintf(out,
+            "let fun%s = fn(a, b) {\n  if (a < b) { [a, b, \"lt\"] } "
+            "else { {\"a\": a * %zu} }\n};\nlet val%s = fun%s(%zu, 7)[0];\n",
+            suffix, i, suffix, suffix, i);
+    fflush(out);
+  }
+  fclose(out);
+  return input;
+}
+
+/* Statements of long operator chains, and no calls */
+static char *arithmetic_script(void) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  assert(out);
+  for (size_t i = 0; i < 100; i++) {
+    fprintf(out, "let x%c = 0", 'a' + (int)(i % 26));
+    for (size_t j = 1; j <= 100; j++) {
+      fprintf(out, " + %zu * %zu - %zu / %zu", i + j, j % 7 + 1, i * j,
+              j % 5 + 1);
+    }
+    fputs(";\n", out);
+  }
+  fputs("xa + xb;\n", out);
+  fclose(out);
+  return input;
+}
+
+static char *recursion_script(void) {
+  return strdup(
+      "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+      "fib(18);");
+}
+
+static char *conditionals_script(void) {
+  return strdup(
+      "let classify = fn(n) {"
+      "  if (n < 10) { 1 } else {"
+      "    if (n < 100) { 2 } else {"
+      "      if (n == 500) { 3 } else { if (n > 900) { 4 } else { 5 } }"
+      "    }"
+      "  }"
+      "};"
+      "let walk = fn(n, acc) {"
+      "  if (n == 0) { acc } else { walk(n - 1, acc + classify(n)) }"
+      "};"
+      "walk(1000, 0) + walk(1000, 0) + walk(1000, 0);");
+}
+
+static void run_lex(const char *input, memory_t *memory) {
+  memory_t *previous = memory_swap(memory);
+  intern_table_t *symbols = intern_table_new();
+  intern_table_t *previous_symbols = intern_table_swap(symbols);
+  lexer_t *lexer = lexer_new(input);
+  for (;;) {
+    token_t *tok = lexer_next_token(lexer);
+    TokenType type = tok->type;
+    token_destroy(&tok);
+    if (type == EOF_TOKEN) {
+      break;
+    }
+  }
+  lexer_destroy(&lexer);
+  intern_table_swap(previous_symbols);
+  intern_table_destroy(&symbols);
+  memory_swap(previous);
+}
+
+static void run_parse(const char *input, memory_t *memory) {
+  memory_t *previous = memory_swap(memory);
+  intern_table_t *symbols = intern_table_new();
+  intern_table_t *previous_symbols = intern_table_swap(symbols);
+  parser_t *parser = parser_new(lexer_new(input));
+  program_t *program = parser_parse_program(parser);
+  assert(parser->errors_len == 0);
+  bench_sink += program->len;
+  program_destroy(&program);
+  parser_destroy(&parser);
+  intern_table_swap(previous_symbols);
+  intern_table_destroy(&symbols);
+  memory_swap(previous);
+}
+
+/* A fresh VM per sample, as isolated scripts would get */
+static void run_eval(const char *input, memory_t *memory) {
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *result = monkey_vm_eval(vm, input);
+  assert(vm->errors_len == 0);
+  assert(result != NULL && result->type == INT_OBJ);
+  bench_sink += result->int_obj->value;
+  monkey_vm_result_destroy(vm, &result);
+  *memory = *vm->memory;
+  monkey_vm_destroy(&vm);
+}
+
+static const workload_t WORKLOADS[] = {
+    {"lex", large_script, run_lex},
+    {"parse", large_script, run_parse},
+    {"arithmetic", arithmetic_script, run_eval},
+    {"recursion", recursion_script, run_eval},
+    {"conditionals", conditionals_script, run_eval},
+};
+
+#define WORKLOADS_LEN (sizeof(WORKLOADS) / sizeof(WORKLOADS[0]))
+
+static int compare_ns(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void measure(const workload_t *workload, size_t samples,
+                    result_t *result) {
+  char *input = workload->input();
+  memory_t memory = {0};
+  /* Warms up caches and the allocator */
+  workload->run(input, &memory);
+
+  uint64_t *ns = malloc(samples * sizeof(uint64_t));
+  assert(ns);
+  for (size_t i = 0; i < samples; i++) {
+    memory = (memory_t){0};
+    double start = bench_now();
+    workload->run(input, &memory);
+    ns[i] = (uint64_t)((bench_now() - start) * 1e9);
+    result->peak_bytes =
+        memory.peak > result->peak_bytes ? memory.peak : result->peak_bytes;
+  }
+#ifdef MONKEY_ALLOC_STATS
+  for (size_t i = 0; i < MEM_CATEGORIES; i++) {
+    result->allocs += memory.stats.categories[i].allocs;
+  }
+#endif
+  qsort(ns, samples, sizeof(uint64_t), compare_ns);
+  result->median_ns = (ns[(samples - 1) / 2] + ns[samples / 2]) / 2;
+  /* Nearest rank */
+  result->p99_ns = ns[(samples * 99 + 99) / 100 - 1];
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  result->peak_rss_kb = usage.ru_maxrss;
+  free(ns);
+  free(input);
+}
+
+/* Measures in a child, false if it did not finish */
+static bool measure_isolated(const workload_t *workload, size_t samples,
+                             result_t *result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    result_t measured = {0};
+    measure(workload, samples, &measured);
+    ssize_t written = write(fds[1], &measured, sizeof(measured));
+    _exit(written == sizeof(measured) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  close(fds[1]);
+  ssize_t got = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return got == sizeof(*result) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static void write_json(FILE *out, size_t samples, const result_t *results,
+                       const bool *selected) {
+  fprintf(out, "{\n  \"samples\": %zu,\n  \"workloads\": [\n", samples);
+  bool first = true;
+  for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+    if (!selected[i]) {
+      continue;
+    }
+    const result_t *result = &results[i];
+    fprintf(out,
+            "%s    {\"name\": \"%s\", \"median_ns\": %" PRIu64
+            ", \"p99_ns\": %" PRIu64 ", \"peak_bytes\": %zu, \"allocs\": ",
+            first ? "" : ",\n", WORKLOADS[i].name, result->median_ns,
+            result->p99_ns, result->peak_bytes);
+#ifdef MONKEY_ALLOC_STATS
+    fprintf(out, "%" PRIu64, result->allocs);
+#else
+    fputs("null", out);
+#endif
+    fprintf(out, ", \"peak_rss_kb\": %ld}", result->peak_rss_kb);
+    first = false;
+  }
+  fputs("\n  ]\n}\n", out);
+}
+
+/*
+ * Reads a median back from a file this program wrote, which has one
+ * workload per line. Returns 0 if the workload is not in it.
+ */
+static uint64_t read_median(FILE *baseline, const char *workload) {
+  rewind(baseline);
+  char line[512];
+  while (fgets(line, sizeof(line), baseline) != NULL) {
+    char found[NAME_MAX_LEN];
+    uint64_t median = 0;
+    const char *at = strstr(line, "\"name\": \"");
+    if (at != NULL &&
+        sscanf(at, "\"name\": \"%63[^\"]\", \"median_ns\": %" SCNu64,
+               found, &median) == 2 &&
+        strcmp(found, workload) == 0) {
+      return median;
+    }
+  }
+  return 0;
+}
+
+/* Lists the comparison on stderr, returns the number of regressions */
+static size_t compare_baseline(const uint64_t *baseline, double threshold,
+                               const result_t *results, const bool *selected) {
+  size_t regressions = 0;
+  fprintf(stderr, "%-14s %14s %14s %9s\n", "workload", "baseline ns",
+          "median ns", "change");
+  for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+    if (!selected[i]) {
+      continue;
+    }
+    uint64_t before = baseline[i];
+    double change = 100.0 * ((double)results[i].median_ns / before - 1);
+    bool regressed = change > threshold;
+    fprintf(stderr, "%-14s %14" PRIu64 " %14" PRIu64 " %+8.1f%%%s\n",
+            WORKLOADS[i].name, before, results[i].median_ns, change,
+            regressed ? "  REGRESSION" : "");
+    regressions += regressed;
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  size_t samples = DEFAULT_SAMPLES;
+  const char *out_path = NULL;
+  const char *baseline_path = NULL;
+  double threshold = DEFAULT_THRESHOLD;
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "n:o:b:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      samples = strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    case 'b':
+      baseline_path = optarg;
+      break;
+    case 't':
+      threshold = strtod(optarg, NULL);
+      break;
+    default:
+      samples = 0;
+      break;
+    }
+  }
+  if (samples == 0) {
+    fprintf(stderr, "usage: suite_bench [-n samples] [-o out.json] "
+                    "[-b baseline.json] [-t percent] [workload...]\n");
+    return EXIT_FAILURE;
+  }
+
+  bool selected[WORKLOADS_LEN];
+  for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+    selected[i] = optind == argc;
+    for (int j = optind; j < argc; j++) {
+      selected[i] |= strcmp(argv[j], WORKLOADS[i].name) == 0;
+    }
+  }
+
+  /* Read first, the output may replace it */
+  uint64_t baseline[WORKLOADS_LEN] = {0};
+  if (baseline_path != NULL) {
+    FILE *in = fopen(baseline_path, "r");
+    if (in == NULL) {
+      fprintf(stderr, "suite_bench: cannot read %s\n", baseline_path);
+      return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+      baseline[i] = read_median(in, WORKLOADS[i].name);
+    }
+    fclose(in);
+    /* A baseline that checks nothing must not pass as one that holds */
+    for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+      if (selected[i] && baseline[i] == 0) {
+        fprintf(stderr, "suite_bench: no median for %s in %s\n",
+                WORKLOADS[i].name, baseline_path);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  result_t results[WORKLOADS_LEN] = {0};
+  for (size_t i = 0; i < WORKLOADS_LEN; i++) {
+    if (selected[i] && !measure_isolated(&WORKLOADS[i], samples, &results[i])) {
+      fprintf(stderr, "suite_bench: %s failed\n", WORKLOADS[i].name);
+      return EXIT_FAILURE;
+    }
+  }
+
+  FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+  if (out == NULL) {
+    fprintf(stderr, "suite_bench: cannot write %s\n", out_path);
+    return EXIT_FAILURE;
+  }
+  write_json(out, samples, results, selected);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  if (baseline_path != NULL) {
+    size_t regressions =
+        compare_baseline(baseline, threshold, results, selected);
+    if (regressions != 0) {
+      fprintf(stderr, "suite_bench: %zu regressions beyond %.1f%%\n",
+              regressions, threshold);
+      return EXIT_FAILURE;
+    }
+  }
+  return 0;
+}
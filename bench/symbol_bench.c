@@ -0,0 +1,73 @@
+#include "../src/evaluator.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+#include <malloc.h>
+
+#define STATEMENTS 100000
+
+/* A few names, each repeated many times */
+static char *repeated_identifiers_script(size_t statements) {
+  const char *prelude = "let counter = 0; let offset = 1; let factor = 2;\n";
+  const char *line = "let counter = counter + offset * factor - offset;\n";
+  size_t prelude_len = strlen(prelude);
+  size_t line_len = strlen(line);
+  char *input = malloc(prelude_len + statements * line_len + 1);
+  assert(input);
+  memcpy(input, prelude, prelude_len);
+  for (size_t i = 0; i < statements; i++) {
+    memcpy(input + prelude_len + i * line_len, line, line_len);
+  }
+  input[prelude_len + statements * line_len] = '\0';
+  return input;
+}
+
+static void bench_script(const char *name, const char *input, size_t ops) {
+  char label[128];
+
+  size_t heap_before = mallinfo2().uordblks;
+  double start = bench_now();
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  double parsed = bench_now();
+  size_t heap_after = mallinfo2().uordblks;
+
+  snprintf(label, sizeof(label), "%s parse", name);
+  bench_report(label, program->len, parsed - start);
+  printf("%-44s %10zu bytes of AST (%.1f bytes/statement)\n", label,
+         heap_after - heap_before,
+         (double)(heap_after - heap_before) / program->len);
+
+  env_t *env = env_new();
+  start = bench_now();
+  obj_t *result = eval(program, env);
+  double evaluated = bench_now();
+  assert(result != NULL && result->type == INT_OBJ);
+  bench_sink += result->int_obj->value;
+
+  snprintf(label, sizeof(label), "%s eval", name);
+  bench_report(label, ops, evaluated - start);
+
+  obj_destroy(&result);
+  env_destroy(&env);
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+
+int main(void) {
+  char *input = repeated_identifiers_script(STATEMENTS);
+  char *script = NULL;
+  asprintf(&script, "%s counter;", input);
+  /* Every statement looks up `counter` once, `offset` twice, `factor` once */
+  bench_script("repeated identifiers", script, STATEMENTS * 4);
+  free(script);
+  free(input);
+
+  /* Lookups walk the enclosing environments of every call */
+  const char *fib = "let fib = fn(n) { if (n < 2) { n } else { "
+                    "fib(n - 1) + fib(n - 2) } }; fib(24);";
+  /* fib(24) makes 2 * fib(25) - 1 calls */
+  bench_script("fib(24)", fib, 2 * 75025 - 1);
+  return 0;
+}
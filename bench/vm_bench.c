@@ -0,0 +1,64 @@
+#include "../src/vm.h"
+#include "bench.h"
+#include <pthread.h>
+
+#define SCRIPTS 2048
+
+/* Each script gets a fresh VM, as isolated scripts would */
+static const char *SCRIPT =
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+    "let names = {\"one\": 1, \"two\": 2, \"three\": 3};"
+    "let greeting = \"hello, \" + \"world\";"
+    "fib(12) + names[\"two\"] + len(greeting) + len(push([1, 2], 3));";
+
+#define SCRIPT_RESULT (144 + 2 + 12 + 3)
+
+typedef struct {
+  size_t scripts;
+  pthread_t thread;
+} worker_t;
+
+static void *worker_run(void *arg) {
+  worker_t *worker = arg;
+  for (size_t i = 0; i < worker->scripts; i++) {
+    monkey_vm_t *vm = monkey_vm_new();
+    obj_t *result = monkey_vm_eval(vm, SCRIPT);
+    assert(result != NULL && result->type == INT_OBJ &&
+           result->int_obj->value == SCRIPT_RESULT);
+    obj_destroy(&result);
+    monkey_vm_destroy(&vm);
+  }
+  return NULL;
+}
+
+static void bench_threads(size_t threads) {
+  worker_t *workers = calloc(threads, sizeof(worker_t));
+  assert(workers);
+
+  double start = bench_now();
+  for (size_t i = 0; i < threads; i++) {
+    /* The same total work, split as evenly as it goes */
+    workers[i].scripts = SCRIPTS / threads + (i < SCRIPTS % threads);
+    int rc = pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    assert(rc == 0);
+    (void)rc;
+  }
+  for (size_t i = 0; i < threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  double elapsed = bench_now() - start;
+
+  char label[128];
+  snprintf(label, sizeof(label), "%2zu threads (%.0f scripts/s)", threads,
+           SCRIPTS / elapsed);
+  bench_report(label, SCRIPTS, elapsed);
+  free(workers);
+}
+
+int main(void) {
+  printf("%ld online cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    bench_threads(threads);
+  }
+  return 0;
+}
@@ -1,8 +1,9 @@
 #include "ast.h"
 #include "config.h"
+#include "memory.h"
 
 statement_t *statement_new(void *statement, STATEMENT_TYPE st) {
-  statement_t *s = malloc(sizeof(statement_t));
+  statement_t *s = mem_malloc_as(MEM_AST, sizeof(statement_t));
 
   switch (st) {
   case LET_STATEMENT:
@@ -40,7 +41,7 @@ void statement_destroy(statement_t **s_p) {
     case BLOCK_STATEMENT:
       block_statement_destroy(&statement->block_statement);
     }
-    free(statement);
+    mem_free(statement, sizeof(statement_t));
     *s_p = NULL;
   }
 }
@@ -63,9 +64,10 @@ char *statement_to_string(statement_t *statement) {
 
 expression_t *expression_new(EXPRESSION_TYPE e_type, void *expression) {
   assert(expression);
-  expression_t *exp = malloc(sizeof(expression_t));
+  expression_t *exp = mem_malloc_as(MEM_AST, sizeof(expression_t));
   assert(exp);
   exp->type = e_type;
+  exp->id = 0;
   switch (e_type) {
   case IDENT_EXP:
     exp->identifier = (identifier_t *)expression;
@@ -73,6 +75,9 @@ expression_t *expression_new(EXPRESSION_TYPE e_type, void *expression) {
   case INT_EXP:
     exp->integer = (integer_t *)expression;
     break;
+  case STRING_EXP:
+    exp->string = (string_t *)expression;
+    break;
   case BOOLEAN_EXP:
     exp->boolean = (boolean_t *)expression;
     break;
@@ -91,16 +96,91 @@ expression_t *expression_new(EXPRESSION_TYPE e_type, void *expression) {
   case CALL_EXP:
     exp->call_exp = (call_exp_t *)expression;
     break;
+  case ARRAY_EXP:
+    exp->array = (array_t *)expression;
+    break;
+  case INDEX_EXP:
+    exp->index_exp = (index_exp_t *)expression;
+    break;
+  case MAP_EXP:
+    exp->map = (map_literal_t *)expression;
+    break;
   default:
     assert("Invalid expression");
   }
   return exp;
 }
 
+/*
+ * Expressions are freed and printed with an explicit stack instead of
+ * recursion, so deeply nested ones don't overflow the C stack. Small
+ * ones don't leave the local array.
+ */
+#define EXPRESSION_STACK_LOCAL 32
+
+typedef struct {
+  expression_t *expression; /* or, if NULL, `text` is next */
+  const char *text;
+} expression_work_t;
+
+typedef struct {
+  expression_work_t *items;
+  size_t len;
+  size_t capacity;
+  expression_work_t local[EXPRESSION_STACK_LOCAL];
+} expression_stack_t;
+
+static void expression_stack_init(expression_stack_t *stack) {
+  stack->items = stack->local;
+  stack->len = 0;
+  stack->capacity = EXPRESSION_STACK_LOCAL;
+}
+
+static void expression_stack_push(expression_stack_t *stack,
+                                  expression_t *expression, const char *text) {
+  if (stack->len == stack->capacity) {
+    stack->capacity *= 2;
+    if (stack->items == stack->local) {
+      stack->items = malloc(stack->capacity * sizeof(expression_work_t));
+      assert(stack->items);
+      memcpy(stack->items, stack->local, sizeof(stack->local));
+    } else {
+      stack->items = reallocarray(stack->items, stack->capacity,
+                                  sizeof(expression_work_t));
+      assert(stack->items);
+    }
+  }
+  stack->items[stack->len++] = (expression_work_t){expression, text};
+}
+
+static void expression_stack_free(expression_stack_t *stack) {
+  if (stack->items != stack->local) {
+    free(stack->items);
+  }
+}
+
+/* Moves the expressions of `list` to the stack, leaving NULLs behind */
+static void expression_stack_push_list(expression_stack_t *stack,
+                                       param_exp_t *list) {
+  for (size_t i = 0; i < list->len; i++) {
+    expression_stack_push(stack, list->expressions[i], NULL);
+    list->expressions[i] = NULL;
+  }
+}
+
 void expression_destroy(expression_t **e_p) {
   assert(e_p);
-  if (*e_p) {
-    expression_t *expression = *e_p;
+  if (*e_p == NULL) {
+    return;
+  }
+  expression_stack_t stack;
+  expression_stack_init(&stack);
+  expression_stack_push(&stack, *e_p, NULL);
+  *e_p = NULL;
+
+  while (stack.len != 0) {
+    expression_t *expression = stack.items[--stack.len].expression;
+    /* Children go on the stack, the rest is freed as before */
     switch (expression->type) {
     case IDENT_EXP:
       identifier_destroy(&expression->identifier);
@@ -108,13 +188,21 @@ void expression_destroy(expression_t **e_p) {
     case INT_EXP:
       integer_destroy(&expression->integer);
       break;
+    case STRING_EXP:
+      string_destroy(&expression->string);
+      break;
     case BOOLEAN_EXP:
       boolean_destroy(&expression->boolean);
       break;
     case PREFIX_EXP:
+      expression_stack_push(&stack, expression->prefix->operand, NULL);
+      expression->prefix->operand = NULL;
       prefix_destroy(&expression->prefix);
       break;
     case INFIX_EXP:
+      expression_stack_push(&stack, expression->infix->left, NULL);
+      expression_stack_push(&stack, expression->infix->right, NULL);
+      expression->infix->left = expression->infix->right = NULL;
       infix_destroy(&expression->infix);
       break;
     case IF_EXP:
@@ -124,50 +212,173 @@ void expression_destroy(expression_t **e_p) {
       fn_destroy(&expression->fn);
       break;
     case CALL_EXP:
+      expression_stack_push(&stack, expression->call_exp->call_exp, NULL);
+      expression->call_exp->call_exp = NULL;
+      expression_stack_push_list(&stack, expression->call_exp->param_exps);
       call_exp_destroy(&expression->call_exp);
       break;
+    case ARRAY_EXP:
+      expression_stack_push_list(&stack, expression->array->elements);
+      array_destroy(&expression->array);
+      break;
+    case INDEX_EXP:
+      expression_stack_push(&stack, expression->index_exp->left, NULL);
+      expression_stack_push(&stack, expression->index_exp->index, NULL);
+      expression->index_exp->left = expression->index_exp->index = NULL;
+      index_exp_destroy(&expression->index_exp);
+      break;
+    case MAP_EXP:
+      for (size_t i = 0; i < expression->map->len; i++) {
+        expression_stack_push(&stack, expression->map->keys[i], NULL);
+        expression_stack_push(&stack, expression->map->values[i], NULL);
+        expression->map->keys[i] = expression->map->values[i] = NULL;
+      }
+      map_literal_destroy(&expression->map);
+      break;
     default:
       assert("Invalid expression");
     }
-    free(expression);
-    *e_p = NULL;
+    mem_free(expression, sizeof(expression_t));
+  }
+  expression_stack_free(&stack);
+}
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+} expression_str_t;
+
+static void expression_str_append(expression_str_t *str, const char *text) {
+  size_t len = strlen(text);
+  if (str->len + len + 1 > str->capacity) {
+    while (str->len + len + 1 > str->capacity) {
+      str->capacity = str->capacity == 0 ? 64 : str->capacity * 2;
+    }
+    str->data = realloc(str->data, str->capacity);
+    assert(str->data);
+  }
+  memcpy(str->data + str->len, text, len + 1);
+  str->len += len;
+}
+
+/* Pushes `expressions` to print them separated by ", " */
+static void expression_stack_push_printed_list(expression_stack_t *stack,
+                                               expression_t **expressions,
+                                               size_t len) {
+  for (size_t i = len; i-- > 0;) {
+    expression_stack_push(stack, expressions[i], NULL);
+    if (i > 0) {
+      expression_stack_push(stack, NULL, ", ");
+    }
   }
 }
 
 char *expression_to_string(expression_t *expression) {
   assert(expression);
 
-  char *expression_str = NULL;
-  switch (expression->type) {
-  case INT_EXP:
-    return integer_to_string(expression->integer);
-  case BOOLEAN_EXP:
-    return boolean_to_string(expression->boolean);
-  case IDENT_EXP:
-    return identifier_to_string(expression->identifier);
-  case PREFIX_EXP:
-    return prefix_to_string(expression->prefix);
-  case INFIX_EXP:
-    return infix_to_string(expression->infix);
-  case IF_EXP:
-    return if_exp_to_string(expression->if_exp);
-  case FN_EXP:
-    return fn_to_string(expression->fn);
-  case CALL_EXP:
-    return call_exp_to_string(expression->call_exp);
-  default:
-    puts("Error: Unknown expression");
-    assert(false);
-    return NULL;
+  expression_str_t str = {NULL, 0, 0};
+  expression_stack_t stack;
+  expression_stack_init(&stack);
+  expression_stack_push(&stack, expression, NULL);
+
+  /* Pushed in reverse, what is printed first goes on the stack last */
+  while (stack.len != 0) {
+    expression_work_t work = stack.items[--stack.len];
+    expression = work.expression;
+    if (expression == NULL) {
+      expression_str_append(&str, work.text);
+      continue;
+    }
+    char *leaf = NULL;
+    switch (expression->type) {
+    case INT_EXP:
+      leaf = integer_to_string(expression->integer);
+      break;
+    case STRING_EXP:
+      leaf = string_to_string(expression->string);
+      break;
+    case BOOLEAN_EXP:
+      leaf = boolean_to_string(expression->boolean);
+      break;
+    case IDENT_EXP:
+      leaf = identifier_to_string(expression->identifier);
+      break;
+    case IF_EXP:
+      leaf = if_exp_to_string(expression->if_exp);
+      break;
+    case FN_EXP:
+      leaf = fn_to_string(expression->fn);
+      break;
+    case PREFIX_EXP:
+      expression_str_append(&str, "(");
+      expression_str_append(&str, expression->prefix->operator->literal);
+      expression_stack_push(&stack, NULL, ")");
+      expression_stack_push(&stack, expression->prefix->operand, NULL);
+      break;
+    case INFIX_EXP:
+      expression_str_append(&str, "(");
+      expression_stack_push(&stack, NULL, ")");
+      expression_stack_push(&stack, expression->infix->right, NULL);
+      expression_stack_push(&stack, NULL, " ");
+      expression_stack_push(&stack, NULL, expression->infix->operator->literal);
+      expression_stack_push(&stack, NULL, " ");
+      expression_stack_push(&stack, expression->infix->left, NULL);
+      break;
+    case CALL_EXP:
+      expression_stack_push(&stack, NULL, ")");
+      expression_stack_push_printed_list(
+          &stack, expression->call_exp->param_exps->expressions,
+          expression->call_exp->param_exps->len);
+      expression_stack_push(&stack, NULL, "(");
+      expression_stack_push(&stack, expression->call_exp->call_exp, NULL);
+      break;
+    case ARRAY_EXP:
+      expression_str_append(&str, "[");
+      expression_stack_push(&stack, NULL, "]");
+      expression_stack_push_printed_list(
+          &stack, expression->array->elements->expressions,
+          expression->array->elements->len);
+      break;
+    case INDEX_EXP:
+      expression_str_append(&str, "(");
+      expression_stack_push(&stack, NULL, "])");
+      expression_stack_push(&stack, expression->index_exp->index, NULL);
+      expression_stack_push(&stack, NULL, "[");
+      expression_stack_push(&stack, expression->index_exp->left, NULL);
+      break;
+    case MAP_EXP:
+      expression_str_append(&str, "{");
+      expression_stack_push(&stack, NULL, "}");
+      for (size_t i = expression->map->len; i-- > 0;) {
+        expression_stack_push(&stack, expression->map->values[i], NULL);
+        expression_stack_push(&stack, NULL, ": ");
+        expression_stack_push(&stack, expression->map->keys[i], NULL);
+        if (i > 0) {
+          expression_stack_push(&stack, NULL, ", ");
+        }
+      }
+      break;
+    default:
+      puts("Error: Unknown expression");
+      assert(false);
+    }
+    if (leaf != NULL) {
+      expression_str_append(&str, leaf);
+      free(leaf);
+    }
   }
+  expression_stack_free(&stack);
+  return str.data;
 }
 
 identifier_t *identifier_new(token_t *token) {
   assert(token);
-  assert(token->literal);
-  identifier_t *identifier = malloc(sizeof(identifier_t));
+  assert(token->symbol != SYMBOL_NONE);
+  identifier_t *identifier = mem_malloc_as(MEM_AST, sizeof(identifier_t));
   identifier->token = token;
-  identifier->value = strdup(token->literal);
+  identifier->symbol = token->symbol;
+  identifier->value = token->literal;
   return identifier;
 }
 
@@ -176,9 +387,7 @@ void identifier_destroy(identifier_t **i_p) {
   if (*i_p) {
     identifier_t *i = *i_p;
     token_destroy(&i->token);
-    assert(i->value);
-    free(i->value);
-    free(i);
+    mem_free(i, sizeof(identifier_t));
     *i_p = NULL;
   }
 }
@@ -190,7 +399,7 @@ char *identifier_to_string(identifier_t *identifier) {
 
 integer_t *integer_new(token_t *token) {
   assert(token);
-  integer_t *integer = malloc(sizeof(integer_t));
+  integer_t *integer = mem_malloc_as(MEM_AST, sizeof(integer_t));
   integer->token = token;
 
   int32_t value;
@@ -221,7 +430,7 @@ void integer_destroy(integer_t **i_p) {
   if (*i_p) {
     integer_t *integer = *i_p;
     token_destroy(&integer->token);
-    free(integer);
+    mem_free(integer, sizeof(integer_t));
     *i_p = NULL;
   }
 }
@@ -233,9 +442,36 @@ char *integer_to_string(integer_t *integer) {
   return str;
 }
 
+string_t *string_new(token_t *token) {
+  assert(token);
+  assert(token->literal);
+  string_t *string = mem_malloc_as(MEM_AST, sizeof(string_t));
+  assert(string);
+  string->token = token;
+  /* Literals are interned so that equal literals share one buffer */
+  string->value = intern(token->literal, strlen(token->literal));
+  return string;
+}
+
+void string_destroy(string_t **s_p) {
+  assert(s_p);
+  if (*s_p) {
+    string_t *string = *s_p;
+    token_destroy(&string->token);
+    /* `value` is owned by the intern table */
+    mem_free(string, sizeof(string_t));
+    *s_p = NULL;
+  }
+}
+
+char *string_to_string(string_t *string) {
+  assert(string);
+  return strdup(string->value->data);
+}
+
 boolean_t *boolean_new(token_t *token) {
   assert(token);
-  boolean_t *boolean = malloc(sizeof(boolean_t));
+  boolean_t *boolean = mem_malloc_as(MEM_AST, sizeof(boolean_t));
   boolean->token = token;
   boolean->value = token->type == TRUE_TOKEN;
   return boolean;
@@ -246,7 +482,7 @@ void boolean_destroy(boolean_t **b_p) {
   if (*b_p) {
     boolean_t *boolean = *b_p;
     token_destroy(&boolean->token);
-    free(boolean);
+    mem_free(boolean, sizeof(boolean_t));
     *b_p = NULL;
   }
 }
@@ -259,7 +495,7 @@ char *boolean_to_string(boolean_t *b) {
 prefix_t *prefix_new(token_t *operator, expression_t * operand) {
   assert(operator);
   assert(operand);
-  prefix_t *prefix = malloc(sizeof(prefix_t));
+  prefix_t *prefix = mem_malloc_as(MEM_AST, sizeof(prefix_t));
   assert(prefix);
   prefix->operator= operator;
   prefix->operand = operand;
@@ -272,7 +508,7 @@ void prefix_destroy(prefix_t **p_p) {
     prefix_t *prefix = *p_p;
     expression_destroy(&prefix->operand);
     token_destroy(&prefix->operator);
-    free(prefix);
+    mem_free(prefix, sizeof(prefix_t));
     *p_p = NULL;
   }
 }
@@ -291,7 +527,7 @@ infix_t *infix_new(token_t *operator, expression_t * left,
   assert(operator);
   assert(left);
   assert(right);
-  infix_t *infix = malloc(sizeof(infix_t));
+  infix_t *infix = mem_malloc_as(MEM_AST, sizeof(infix_t));
   assert(infix);
   infix->operator= operator;
   infix->left = left;
@@ -306,7 +542,7 @@ void infix_destroy(infix_t **i_p) {
     token_destroy(&infix->operator);
     expression_destroy(&infix->left);
     expression_destroy(&infix->right);
-    free(infix);
+    mem_free(infix, sizeof(infix_t));
     *i_p = NULL;
   }
 }
@@ -330,7 +566,7 @@ if_exp_t *if_exp_new(token_t *token, expression_t *condition,
   assert(consequence);
   /* else part is optional */
   /* assert(alternative); */
-  if_exp_t *if_exp = malloc(sizeof(if_exp_t));
+  if_exp_t *if_exp = mem_malloc_as(MEM_AST, sizeof(if_exp_t));
   if_exp->token = token;
   if_exp->condition = condition;
   if_exp->consequence = consequence;
@@ -346,7 +582,7 @@ void if_exp_destroy(if_exp_t **i_p) {
     expression_destroy(&if_exp->condition);
     block_statement_destroy(&if_exp->consequence);
     block_statement_destroy(&if_exp->alternative);
-    free(if_exp);
+    mem_free(if_exp, sizeof(if_exp_t));
     *i_p = NULL;
   }
 }
@@ -378,7 +614,7 @@ char *if_exp_to_string(if_exp_t *if_exp) {
 }
 
 param_t *param_new(void) {
-  param_t *params = malloc(sizeof(param_t));
+  param_t *params = mem_malloc_as(MEM_AST, sizeof(param_t));
   params->parameters = NULL;
   params->len = 0;
   return params;
@@ -388,7 +624,8 @@ void param_append(param_t *params, identifier_t *identifier) {
   assert(params);
   assert(identifier);
   params->parameters =
-      realloc(params->parameters, (params->len + 1) * sizeof(identifier_t *));
+      mem_reallocarray_as(MEM_AST, params->parameters, params->len,
+                          params->len + 1, sizeof(identifier_t *));
   assert(params->parameters);
   params->parameters[params->len++] = identifier;
 }
@@ -400,8 +637,8 @@ void param_destroy(param_t **p_p) {
     for (int i = 0; i < params->len; i++) {
       identifier_destroy(&params->parameters[i]);
     }
-    free(params->parameters);
-    free(params);
+    mem_free(params->parameters, params->len * sizeof(identifier_t *));
+    mem_free(params, sizeof(param_t));
     *p_p = NULL;
   }
 }
@@ -429,18 +666,25 @@ char *param_to_string(param_t *params) {
 }
 
 param_exp_t *param_exp_new(void) {
-  param_exp_t *param_exps = malloc(sizeof(param_exp_t));
+  param_exp_t *param_exps = mem_malloc_as(MEM_AST, sizeof(param_exp_t));
   param_exps->expressions = NULL;
   param_exps->len = 0;
+  param_exps->capacity = 0;
   return param_exps;
 }
 
 void param_exp_append(param_exp_t *param_exps, expression_t *expression) {
   assert(param_exps);
   assert(expression);
-  param_exps->expressions = realloc(
-      param_exps->expressions, (param_exps->len + 1) * sizeof(expression_t *));
-  assert(param_exps->expressions);
+  if (param_exps->len == param_exps->capacity) {
+    size_t capacity = param_exps->capacity == 0 ? 1 : param_exps->capacity * 2;
+    param_exps->expressions =
+        mem_reallocarray_as(MEM_AST, param_exps->expressions,
+                            param_exps->capacity, capacity,
+                            sizeof(expression_t *));
+    assert(param_exps->expressions);
+    param_exps->capacity = capacity;
+  }
   param_exps->expressions[param_exps->len++] = expression;
 }
 
@@ -451,8 +695,9 @@ void param_exp_destroy(param_exp_t **p_p) {
     for (int i = 0; i < param_exps->len; i++) {
       expression_destroy(&param_exps->expressions[i]);
     }
-    free(param_exps->expressions);
-    free(param_exps);
+    mem_free(param_exps->expressions,
+             param_exps->capacity * sizeof(expression_t *));
+    mem_free(param_exps, sizeof(param_exp_t));
     *p_p = NULL;
   }
 }
@@ -485,7 +730,7 @@ fn_t *fn_new(token_t *token, param_t *params, block_statement_t *body) {
   /* assert(params); */
   assert(body);
 
-  fn_t *function_literal = malloc(sizeof(fn_t));
+  fn_t *function_literal = mem_malloc_as(MEM_AST, sizeof(fn_t));
   function_literal->token = token;
   function_literal->params = params;
   function_literal->body = body;
@@ -500,7 +745,7 @@ void fn_destroy(fn_t **f_p) {
     token_destroy(&function_literal->token);
     param_destroy(&function_literal->params);
     block_statement_destroy(&function_literal->body);
-    free(function_literal);
+    mem_free(function_literal, sizeof(fn_t));
     *f_p = NULL;
     return;
   }
@@ -522,7 +767,7 @@ call_exp_t *call_exp_new(token_t *token, param_exp_t *param_exps,
   assert(token);
   assert(param_exps);
   assert(exp);
-  call_exp_t *call_exp = malloc(sizeof(call_exp_t));
+  call_exp_t *call_exp = mem_malloc_as(MEM_AST, sizeof(call_exp_t));
   call_exp->token = token;
   call_exp->call_exp = exp;
   call_exp->param_exps = param_exps;
@@ -536,7 +781,7 @@ void call_exp_destroy(call_exp_t **c_p) {
     token_destroy(&call_exp->token);
     expression_destroy(&call_exp->call_exp);
     param_exp_destroy(&call_exp->param_exps);
-    free(call_exp);
+    mem_free(call_exp, sizeof(call_exp_t));
     *c_p = NULL;
   }
 }
@@ -552,12 +797,155 @@ char *call_exp_to_string(call_exp_t *call_exp) {
   return str;
 }
 
+array_t *array_new(token_t *token, param_exp_t *elements) {
+  assert(token);
+  assert(elements);
+  array_t *array = mem_malloc_as(MEM_AST, sizeof(array_t));
+  assert(array);
+  array->token = token;
+  array->elements = elements;
+  return array;
+}
+
+void array_destroy(array_t **a_p) {
+  assert(a_p);
+  if (*a_p) {
+    array_t *array = *a_p;
+    token_destroy(&array->token);
+    param_exp_destroy(&array->elements);
+    mem_free(array, sizeof(array_t));
+    *a_p = NULL;
+  }
+}
+
+char *array_to_string(array_t *array) {
+  assert(array);
+  char *str = NULL;
+  asprintf(&str, "[");
+  for (int i = 0; i < array->elements->len; i++) {
+    char *tmp_str = NULL;
+    char *e_str = expression_to_string(array->elements->expressions[i]);
+    if (i == 0) {
+      asprintf(&tmp_str, "%s%s", str, e_str);
+    } else {
+      asprintf(&tmp_str, "%s, %s", str, e_str);
+    }
+    free(e_str);
+    free(str);
+    str = tmp_str;
+  }
+  char *str2 = NULL;
+  asprintf(&str2, "%s]", str);
+  free(str);
+  return str2;
+}
+
+index_exp_t *index_exp_new(token_t *token, expression_t *left,
+                           expression_t *index) {
+  assert(token);
+  assert(left);
+  assert(index);
+  index_exp_t *index_exp = mem_malloc_as(MEM_AST, sizeof(index_exp_t));
+  assert(index_exp);
+  index_exp->token = token;
+  index_exp->left = left;
+  index_exp->index = index;
+  return index_exp;
+}
+
+void index_exp_destroy(index_exp_t **i_p) {
+  assert(i_p);
+  if (*i_p) {
+    index_exp_t *index_exp = *i_p;
+    token_destroy(&index_exp->token);
+    expression_destroy(&index_exp->left);
+    expression_destroy(&index_exp->index);
+    mem_free(index_exp, sizeof(index_exp_t));
+    *i_p = NULL;
+  }
+}
+
+char *index_exp_to_string(index_exp_t *index_exp) {
+  assert(index_exp);
+  char *str = NULL;
+  char *left_str = expression_to_string(index_exp->left);
+  char *index_str = expression_to_string(index_exp->index);
+  asprintf(&str, "(%s[%s])", left_str, index_str);
+  free(left_str);
+  free(index_str);
+  return str;
+}
+
+map_literal_t *map_literal_new(token_t *token) {
+  assert(token);
+  map_literal_t *map = mem_malloc_as(MEM_AST, sizeof(map_literal_t));
+  assert(map);
+  map->token = token;
+  map->keys = NULL;
+  map->values = NULL;
+  map->len = 0;
+  return map;
+}
+
+void map_literal_append(map_literal_t *map, expression_t *key,
+                        expression_t *value) {
+  assert(map);
+  assert(key);
+  assert(value);
+  map->keys = mem_reallocarray_as(MEM_AST, map->keys, map->len,
+                                  map->len + 1, sizeof(expression_t *));
+  map->values = mem_reallocarray_as(MEM_AST, map->values, map->len,
+                                    map->len + 1, sizeof(expression_t *));
+  assert(map->keys);
+  assert(map->values);
+  map->keys[map->len] = key;
+  map->values[map->len] = value;
+  map->len++;
+}
+
+void map_literal_destroy(map_literal_t **m_p) {
+  assert(m_p);
+  if (*m_p) {
+    map_literal_t *map = *m_p;
+    token_destroy(&map->token);
+    for (size_t i = 0; i < map->len; i++) {
+      expression_destroy(&map->keys[i]);
+      expression_destroy(&map->values[i]);
+    }
+    mem_free(map->keys, map->len * sizeof(expression_t *));
+    mem_free(map->values, map->len * sizeof(expression_t *));
+    mem_free(map, sizeof(map_literal_t));
+    *m_p = NULL;
+  }
+}
+
+char *map_literal_to_string(map_literal_t *map) {
+  assert(map);
+  char *str = NULL;
+  asprintf(&str, "{");
+  for (size_t i = 0; i < map->len; i++) {
+    char *tmp_str = NULL;
+    char *key_str = expression_to_string(map->keys[i]);
+    char *value_str = expression_to_string(map->values[i]);
+    asprintf(&tmp_str, "%s%s%s: %s", str, i == 0 ? "" : ", ", key_str,
+             value_str);
+    free(key_str);
+    free(value_str);
+    free(str);
+    str = tmp_str;
+  }
+  char *str2 = NULL;
+  asprintf(&str2, "%s}", str);
+  free(str);
+  return str2;
+}
+
 let_statement_t *let_statement_new(token_t *token, identifier_t *name,
                                    expression_t *value) {
   assert(token);
   assert(name);
   assert(value);
-  let_statement_t *let = malloc(sizeof(let_statement_t));
+  let_statement_t *let = mem_malloc_as(MEM_AST, sizeof(let_statement_t));
   let->token = token;
   let->name = name;
   let->value = value;
@@ -574,7 +962,7 @@ void let_statement_destroy(let_statement_t **l_p) {
     identifier_destroy(&l->name);
     if (l->value != NULL)
       expression_destroy(&l->value);
-    free(l);
+    mem_free(l, sizeof(let_statement_t));
     *l_p = NULL;
   }
 }
@@ -593,7 +981,8 @@ return_statement_t *return_statement_new(token_t *token,
   assert(token);
   assert(return_value);
 
-  return_statement_t *return_statement = malloc(sizeof(return_statement_t));
+  return_statement_t *return_statement =
+      mem_malloc_as(MEM_AST, sizeof(return_statement_t));
   assert(return_statement);
   return_statement->token = token;
   return_statement->return_value = return_value;
@@ -609,7 +998,7 @@ void return_statement_destroy(return_statement_t **r_p) {
     token_destroy(&return_statement->token);
     if (return_statement->return_value != NULL)
       expression_destroy(&return_statement->return_value);
-    free(return_statement);
+    mem_free(return_statement, sizeof(return_statement_t));
     *r_p = NULL;
   }
 }
@@ -627,7 +1016,8 @@ expression_statement_t *expression_statement_new(token_t *token,
                                                  expression_t *expression) {
   assert(token);
   assert(expression);
-  expression_statement_t *est = malloc(sizeof(expression_statement_t));
+  expression_statement_t *est =
+      mem_malloc_as(MEM_AST, sizeof(expression_statement_t));
   assert(est);
   est->token = token;
   est->expression = expression;
@@ -639,7 +1029,7 @@ void expression_statement_destroy(expression_statement_t **e_p) {
   if (*e_p) {
     expression_statement_t *expression = *e_p;
     expression_destroy(&expression->expression);
-    free(expression);
+    mem_free(expression, sizeof(expression_statement_t));
     *e_p = NULL;
   }
 }
@@ -656,10 +1046,12 @@ block_statement_t *block_statement_new(token_t *token, statement_t **statements,
   /* Empty block statements */
   /* assert(statements); */
   /* assert(statements_len > 0); */
-  block_statement_t *block_statement = malloc(sizeof(block_statement_t));
+  block_statement_t *block_statement =
+      mem_malloc_as(MEM_AST, sizeof(block_statement_t));
   block_statement->token = token;
   block_statement->statements = statements;
   block_statement->statements_len = statements_len;
+  block_statement->id = 0;
   return block_statement;
 }
 
@@ -673,8 +1065,9 @@ void block_statement_destroy(block_statement_t **b_p) {
     for (int i = 0; i < statements_len; i++) {
       statement_destroy(&block_statement->statements[i]);
     }
-    free(block_statement->statements);
-    free(block_statement);
+    mem_free(block_statement->statements,
+             statements_len * sizeof(statement_t *));
+    mem_free(block_statement, sizeof(block_statement_t));
     *b_p = NULL;
   }
 }
@@ -698,10 +1091,161 @@ char *block_statement_to_string(block_statement_t *block_statement) {
   return str;
 }
 
+/* Moves the tokens `statement_destroy` would free by `delta` bytes */
+
+static void token_shift_offset(token_t *token, int64_t delta) {
+  if (token != NULL) {
+    token->offset += delta;
+  }
+}
+
+static void identifier_shift_offsets(identifier_t *identifier, int64_t delta) {
+  if (identifier != NULL) {
+    token_shift_offset(identifier->token, delta);
+  }
+}
+
+static void block_shift_offsets(block_statement_t *block, int64_t delta) {
+  if (block != NULL) {
+    token_shift_offset(block->token, delta);
+    for (size_t i = 0; i < block->statements_len; i++) {
+      statement_shift_offsets(block->statements[i], delta);
+    }
+  }
+}
+
+/* The token a node is reported at */
+token_t *expression_token(expression_t *expression) {
+  assert(expression);
+  switch (expression->type) {
+  case IDENT_EXP:
+    return expression->identifier->token;
+  case INT_EXP:
+    return expression->integer->token;
+  case STRING_EXP:
+    return expression->string->token;
+  case BOOLEAN_EXP:
+    return expression->boolean->token;
+  case PREFIX_EXP:
+    return expression->prefix->operator;
+  case INFIX_EXP:
+    return expression->infix->operator;
+  case IF_EXP:
+    return expression->if_exp->token;
+  case FN_EXP:
+    return expression->fn->token;
+  case CALL_EXP:
+    return expression->call_exp->token;
+  case ARRAY_EXP:
+    return expression->array->token;
+  case INDEX_EXP:
+    return expression->index_exp->token;
+  case MAP_EXP:
+    return expression->map->token;
+  }
+  return NULL;
+}
+
+static void expression_shift_offsets(expression_t *exp, int64_t delta) {
+  if (exp == NULL) {
+    return;
+  }
+  switch (exp->type) {
+  case IDENT_EXP:
+    identifier_shift_offsets(exp->identifier, delta);
+    break;
+  case INT_EXP:
+    token_shift_offset(exp->integer->token, delta);
+    break;
+  case STRING_EXP:
+    token_shift_offset(exp->string->token, delta);
+    break;
+  case BOOLEAN_EXP:
+    token_shift_offset(exp->boolean->token, delta);
+    break;
+  case PREFIX_EXP:
+    token_shift_offset(exp->prefix->operator, delta);
+    expression_shift_offsets(exp->prefix->operand, delta);
+    break;
+  case INFIX_EXP:
+    token_shift_offset(exp->infix->operator, delta);
+    expression_shift_offsets(exp->infix->left, delta);
+    expression_shift_offsets(exp->infix->right, delta);
+    break;
+  case IF_EXP:
+    token_shift_offset(exp->if_exp->token, delta);
+    expression_shift_offsets(exp->if_exp->condition, delta);
+    block_shift_offsets(exp->if_exp->consequence, delta);
+    block_shift_offsets(exp->if_exp->alternative, delta);
+    break;
+  case FN_EXP:
+    token_shift_offset(exp->fn->token, delta);
+    for (size_t i = 0; i < exp->fn->params->len; i++) {
+      identifier_shift_offsets(exp->fn->params->parameters[i], delta);
+    }
+    block_shift_offsets(exp->fn->body, delta);
+    break;
+  case CALL_EXP:
+    token_shift_offset(exp->call_exp->token, delta);
+    expression_shift_offsets(exp->call_exp->call_exp, delta);
+    for (size_t i = 0; i < exp->call_exp->param_exps->len; i++) {
+      expression_shift_offsets(exp->call_exp->param_exps->expressions[i],
+                               delta);
+    }
+    break;
+  case ARRAY_EXP:
+    token_shift_offset(exp->array->token, delta);
+    for (size_t i = 0; i < exp->array->elements->len; i++) {
+      expression_shift_offsets(exp->array->elements->expressions[i], delta);
+    }
+    break;
+  case INDEX_EXP:
+    token_shift_offset(exp->index_exp->token, delta);
+    expression_shift_offsets(exp->index_exp->left, delta);
+    expression_shift_offsets(exp->index_exp->index, delta);
+    break;
+  case MAP_EXP:
+    token_shift_offset(exp->map->token, delta);
+    for (size_t i = 0; i < exp->map->len; i++) {
+      expression_shift_offsets(exp->map->keys[i], delta);
+      expression_shift_offsets(exp->map->values[i], delta);
+    }
+    break;
+  }
+}
+
+void statement_shift_offsets(statement_t *statement, int64_t delta) {
+  assert(statement);
+  switch (statement->type) {
+  case LET_STATEMENT:
+    token_shift_offset(statement->let_statement->token, delta);
+    identifier_shift_offsets(statement->let_statement->name, delta);
+    expression_shift_offsets(statement->let_statement->value, delta);
+    break;
+  case RETURN_STATEMENT:
+    token_shift_offset(statement->return_statement->token, delta);
+    expression_shift_offsets(statement->return_statement->return_value,
+                             delta);
+    break;
+  case EXPRESSION_STATEMENT:
+    /* Its token belongs to the expression */
+    expression_shift_offsets(statement->expression_statement->expression,
+                             delta);
+    break;
+  case BLOCK_STATEMENT:
+    block_shift_offsets(statement->block_statement, delta);
+    break;
+  }
+}
+
 program_t *program_new(void) {
-  program_t *p = malloc(sizeof(program_t));
+  program_t *p = mem_malloc_as(MEM_AST, sizeof(program_t));
   p->statements = NULL;
   p->len = 0;
+  p->capacity = 0;
+  p->arena = NULL;
+  p->spans = NULL;
+  p->shifts = NULL;
   return p;
 }
 
@@ -710,38 +1254,61 @@ void program_destroy(program_t **p_p) {
   if (*p_p) {
     program_t *p = *p_p;
     assert(p);
+    mem_free(p->spans, p->capacity * sizeof(source_span_t));
+    mem_free(p->shifts, p->capacity * sizeof(int32_t));
+    if (p->arena != NULL) {
+      /* The statements, nodes and tokens are all in the arena */
+      ast_arena_destroy(&p->arena);
+      mem_free(p, sizeof(program_t));
+      *p_p = NULL;
+      return;
+    }
     for (int i = 0; i < p->len; i++) {
       statement_destroy(&p->statements[i]);
     }
-    free(p->statements);
-    free(p);
+    mem_free(p->statements, p->capacity * sizeof(statement_t *));
+    mem_free(p, sizeof(program_t));
     *p_p = NULL;
   }
 }
 
-void program_append_statement(program_t *program, statement_t *statement) {
+/*
+ * Moves the tokens of statements reused by `parser_reparse_program` to
+ * where they are now. Only errors read token offsets, so this waits
+ * until the program is evaluated instead of slowing down every edit.
+ */
+void program_apply_shifts(program_t *program) {
   assert(program);
-  assert(statement);
-
-  if (program->statements == NULL) {
-
-    program->statements = malloc(sizeof(statement_t *));
-    program->statements[0] = statement;
-    program->len += 1;
-
+  if (program->shifts == NULL) {
     return;
   }
+  for (size_t i = 0; i < program->len; i++) {
+    if (program->shifts[i] != 0) {
+      statement_shift_offsets(program->statements[i], program->shifts[i]);
+    }
+  }
+  mem_free(program->shifts, program->capacity * sizeof(int32_t));
+  program->shifts = NULL;
+}
 
-  statement_t **statements =
-      realloc(program->statements, sizeof(statement_t *) * (program->len + 1));
-  if (statements == NULL) {
-    /*
-     * TODO: Better error handling needed
-     */
-    puts("Cannot allocate for statements");
-    exit(1);
+void program_append_statement(program_t *program, statement_t *statement) {
+  assert(program);
+  assert(statement);
+
+  if (program->len == program->capacity) {
+    statement_t **statements =
+        mem_reallocarray_as(MEM_AST, program->statements, program->capacity,
+                            program->capacity + 1, sizeof(statement_t *));
+    if (statements == NULL) {
+      /*
+       * TODO: Better error handling needed
+       */
+      puts("Cannot allocate for statements");
+      exit(1);
+    }
+    program->statements = statements;
+    program->capacity++;
   }
-  program->statements = statements;
   program->statements[program->len] = statement;
   program->len += 1;
 }
@@ -784,16 +1351,26 @@ const char *expression_type_to_str(EXPRESSION_TYPE et) {
     return "IDENT_EXP";
   case INT_EXP:
     return "INT_EXP";
+  case STRING_EXP:
+    return "STRING_EXP";
   case BOOLEAN_EXP:
     return "BOOLEAN_EXP";
   case PREFIX_EXP:
     return "PREFIX_EXP";
   case INFIX_EXP:
     return "INFIX_EXP";
+  case IF_EXP:
+    return "IF_EXP";
   case FN_EXP:
     return "FN_EXP";
   case CALL_EXP:
     return "CALL_EXP";
+  case ARRAY_EXP:
+    return "ARRAY_EXP";
+  case INDEX_EXP:
+    return "INDEX_EXP";
+  case MAP_EXP:
+    return "MAP_EXP";
   default:
     assert("Unknown expression");
     return NULL;
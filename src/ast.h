@@ -1,6 +1,7 @@
 #ifndef AST_H
 #define AST_H
 
+#include "intern.h"
 #include "token.h"
 #include "utils.h"
 
@@ -12,17 +13,22 @@ typedef struct _block_statement_t block_statement_t;
 typedef enum {
   IDENT_EXP,
   INT_EXP,
+  STRING_EXP,
   BOOLEAN_EXP,
   PREFIX_EXP,
   INFIX_EXP,
   IF_EXP,
   FN_EXP,
   CALL_EXP,
+  ARRAY_EXP,
+  INDEX_EXP,
+  MAP_EXP,
 } EXPRESSION_TYPE;
 
 typedef struct _identifier_t {
   token_t *token;
-  char *value;
+  symbol_t symbol;
+  const char *value; /* interned name, owned by the intern table */
 } identifier_t;
 
 identifier_t *identifier_new(token_t *token);
@@ -38,6 +44,15 @@ integer_t *integer_new(token_t *token);
 void integer_destroy(integer_t **i_p);
 char *integer_to_string(integer_t *integer);
 
+typedef struct _string_t {
+  token_t *token;
+  str_buf_t *value; /* interned */
+} string_t;
+
+string_t *string_new(token_t *token);
+void string_destroy(string_t **s_p);
+char *string_to_string(string_t *string);
+
 typedef struct _boolean_t {
   token_t *token;
   bool value;
@@ -103,6 +118,7 @@ char *fn_to_string(fn_t *functional_literal);
 typedef struct _param_exp_t {
   expression_t **expressions;
   size_t len;
+  size_t capacity; /* doubles, so long lists append in linear time */
 } param_exp_t;
 
 param_exp_t *param_exp_new(void);
@@ -120,25 +136,68 @@ call_exp_t *call_exp_new(token_t *token, param_exp_t *param_exps, expression_t *
 void call_exp_destroy(call_exp_t **c_p);
 char *call_exp_to_string(call_exp_t *call_exp);
 
+typedef struct _array_t {
+  token_t *token; /* The '[' token */
+  param_exp_t *elements;
+} array_t;
+
+array_t *array_new(token_t *token, param_exp_t *elements);
+void array_destroy(array_t **a_p);
+char *array_to_string(array_t *array);
+
+typedef struct _index_exp_t {
+  token_t *token; /* The '[' token */
+  expression_t *left;
+  expression_t *index;
+} index_exp_t;
+
+index_exp_t *index_exp_new(token_t *token, expression_t *left,
+                           expression_t *index);
+void index_exp_destroy(index_exp_t **i_p);
+char *index_exp_to_string(index_exp_t *index_exp);
+
+/*
+ * {<key>: <value>, ...}
+ * Pairs are kept in source order.
+ */
+typedef struct _map_literal_t {
+  token_t *token; /* The '{' token */
+  expression_t **keys;
+  expression_t **values;
+  size_t len;
+} map_literal_t;
+
+map_literal_t *map_literal_new(token_t *token);
+void map_literal_append(map_literal_t *map, expression_t *key,
+                        expression_t *value);
+void map_literal_destroy(map_literal_t **m_p);
+char *map_literal_to_string(map_literal_t *map);
+
 /* forward declaration at the top */
 struct _expression_t {
   EXPRESSION_TYPE type;
+  uint32_t id; /* 0 until a counter visits it, see count.h */
   union {
     /* expressions */
     identifier_t *identifier;
     integer_t *integer;
+    string_t *string;
     boolean_t *boolean;
     prefix_t *prefix;
     infix_t *infix;
     if_exp_t *if_exp;
     fn_t *fn;
     call_exp_t *call_exp;
+    array_t *array;
+    index_exp_t *index_exp;
+    map_literal_t *map;
   };
 };
 
 expression_t *expression_new(EXPRESSION_TYPE type, void *expression);
 void expression_destroy(expression_t **e_p);
 char *expression_to_string(expression_t *expression);
+token_t *expression_token(expression_t *expression);
 
 typedef enum {
   LET_STATEMENT,
@@ -183,6 +242,7 @@ struct _block_statement_t {
   token_t *token; /* the '{' token */
   statement_t **statements;
   size_t statements_len;
+  uint32_t id; /* 0 until a counter visits it, see count.h */
 };
 
 block_statement_t *block_statement_new(token_t *token, statement_t **statements,
@@ -203,16 +263,37 @@ struct _statement_t {
 statement_t *statement_new(void *statement, STATEMENT_TYPE st);
 void statement_destroy(statement_t **s_p);
 char *statement_to_string(statement_t *statement);
+void statement_shift_offsets(statement_t *statement, int64_t delta);
+
+/* Backs every node of a program loaded from a compiled file, see mkc.c */
+typedef struct _ast_arena_t ast_arena_t;
+
+void ast_arena_destroy(ast_arena_t **arena_p);
+
+/* Where a top-level statement came from in its source */
+typedef struct {
+  uint32_t start; /* offset of its first token */
+  uint32_t end;   /* offset just past its last token */
+} source_span_t;
 
 typedef struct _program_t {
   statement_t **statements;
   size_t len;
+  size_t capacity;      /* of `statements`, and of `spans` and `shifts` */
+  ast_arena_t *arena;   /* NULL unless the nodes live in an arena */
+  source_span_t *spans; /* one per statement, NULL if unknown */
+  /*
+   * Bytes each statement's token offsets still have to move by after
+   * reparsing, NULL if none do. See `program_apply_shifts`.
+   */
+  int32_t *shifts;
 } program_t;
 
 program_t *program_new(void);
 void program_destroy(program_t **p_p);
 void program_append_statement(program_t *program, statement_t *statement);
 char *program_to_string(program_t *program);
+void program_apply_shifts(program_t *program);
 
 const char *expression_type_to_str(EXPRESSION_TYPE et);
 const char *statement_type_to_str(STATEMENT_TYPE st);
@@ -0,0 +1,198 @@
+#include "batch.h"
+#include "vm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Each worker owns a range of script indexes, packed as begin << 32 |
+ * end so that both ends move with one compare-and-swap. The owner takes
+ * scripts from the front; thieves take the back half.
+ */
+typedef struct {
+  _Atomic uint64_t range;
+  pthread_t thread;
+} batch_worker_t;
+
+typedef struct {
+  const char **scripts;
+  const eval_limits_t *limits;
+  char **results;
+  batch_worker_t *workers;
+  size_t threads;
+} batch_t;
+
+typedef struct {
+  batch_t *batch;
+  size_t id;
+} batch_arg_t;
+
+#define RANGE(begin, end) (((uint64_t)(begin) << 32) | (uint32_t)(end))
+#define RANGE_BEGIN(range) ((uint32_t)((range) >> 32))
+#define RANGE_END(range) ((uint32_t)(range))
+
+static bool batch_pop(batch_worker_t *worker, uint32_t *index) {
+  uint64_t range = atomic_load(&worker->range);
+  while (RANGE_BEGIN(range) < RANGE_END(range)) {
+    uint64_t next = RANGE(RANGE_BEGIN(range) + 1, RANGE_END(range));
+    if (atomic_compare_exchange_weak(&worker->range, &range, next)) {
+      *index = RANGE_BEGIN(range);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Moves the back half of a victim's range into the idle `thief` */
+static bool batch_steal(batch_t *batch, size_t thief) {
+  for (size_t i = 1; i < batch->threads; i++) {
+    batch_worker_t *victim = &batch->workers[(thief + i) % batch->threads];
+    uint64_t range = atomic_load(&victim->range);
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+      uint32_t begin = RANGE_BEGIN(range);
+      uint32_t end = RANGE_END(range);
+      uint32_t mid = begin + (end - begin) / 2;
+      if (atomic_compare_exchange_weak(&victim->range, &range,
+                                       RANGE(begin, mid))) {
+        atomic_store(&batch->workers[thief].range, RANGE(mid, end));
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Each worker keeps one VM, reset between scripts, so that a script seen
+ * before skips parsing. `baseline` is what the VM held when new: a
+ * memory quota does not count the programs and symbols kept from earlier
+ * scripts, so a script has the room it would have in a fresh VM, its
+ * own program aside when that was cached.
+ */
+typedef struct {
+  monkey_vm_t *vm;
+  size_t baseline;
+} batch_vm_t;
+
+static monkey_vm_t *batch_vm_take(batch_vm_t *worker_vm) {
+  if (worker_vm->vm == NULL) {
+    worker_vm->vm = monkey_vm_new();
+    monkey_vm_enable_cache(worker_vm->vm, BATCH_CACHE_BYTES);
+    worker_vm->baseline = worker_vm->vm->memory->current;
+  } else {
+    monkey_vm_reset(worker_vm->vm);
+  }
+  return worker_vm->vm;
+}
+
+static char *batch_eval_one(batch_vm_t *worker_vm, const char *script,
+                            const eval_limits_t *limits) {
+  monkey_vm_t *vm = batch_vm_take(worker_vm);
+  vm->limits = limits != NULL ? *limits : (eval_limits_t){0};
+  size_t current = vm->memory->current;
+  if (current > worker_vm->baseline) {
+    vm->limits.base_bytes += current - worker_vm->baseline;
+  }
+  obj_t *result = monkey_vm_eval(vm, script);
+  char *str = NULL;
+
+  if (vm->errors_len != 0) {
+    size_t len = 0;
+    for (size_t i = 0; i < vm->errors_len; i++) {
+      len += strlen(vm->errors[i]) + 1;
+    }
+    str = malloc(len);
+    assert(str);
+    char *cur = str;
+    for (size_t i = 0; i < vm->errors_len; i++) {
+      cur = stpcpy(cur, vm->errors[i]);
+      *cur++ = '\n';
+    }
+    cur[-1] = '\0';
+  } else if (result != NULL) {
+    /* Before the VM goes: the result may borrow its interned strings */
+    str = obj_to_string(result);
+    monkey_vm_result_destroy(vm, &result);
+  } else {
+    str = strdup("");
+  }
+  return str;
+}
+
+static void *batch_worker_run(void *ptr) {
+  batch_arg_t *arg = ptr;
+  batch_t *batch = arg->batch;
+  batch_worker_t *worker = &batch->workers[arg->id];
+  uint32_t index = 0;
+  batch_vm_t worker_vm = {0};
+
+  do {
+    while (batch_pop(worker, &index)) {
+      batch->results[index] =
+          batch_eval_one(&worker_vm, batch->scripts[index], batch->limits);
+    }
+  } while (batch_steal(batch, arg->id));
+  monkey_vm_destroy(&worker_vm.vm);
+  return NULL;
+}
+
+char **monkey_batch_eval(const char **scripts, size_t len, size_t threads) {
+  return monkey_batch_eval_limited(scripts, len, threads, NULL);
+}
+
+char **monkey_batch_eval_limited(const char **scripts, size_t len,
+                                 size_t threads, const eval_limits_t *limits) {
+  assert(scripts || len == 0);
+  assert(len <= UINT32_MAX);
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (threads > len) {
+    threads = len > 0 ? len : 1;
+  }
+
+  char **results = calloc(len > 0 ? len : 1, sizeof(char *));
+  batch_worker_t *workers = calloc(threads, sizeof(batch_worker_t));
+  batch_arg_t *args = calloc(threads, sizeof(batch_arg_t));
+  assert(results && workers && args);
+  batch_t batch = {.scripts = scripts,
+                   .limits = limits,
+                   .results = results,
+                   .workers = workers,
+                   .threads = threads};
+
+  /* Start with equal contiguous shares */
+  for (size_t i = 0; i < threads; i++) {
+    atomic_init(&workers[i].range,
+                RANGE(len * i / threads, len * (i + 1) / threads));
+    args[i] = (batch_arg_t){.batch = &batch, .id = i};
+  }
+
+  /* The calling thread works as worker 0 */
+  for (size_t i = 1; i < threads; i++) {
+    int rc = pthread_create(&workers[i].thread, NULL, batch_worker_run,
+                            &args[i]);
+    assert(rc == 0);
+    (void)rc;
+  }
+  batch_worker_run(&args[0]);
+  for (size_t i = 1; i < threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  free(args);
+  free(workers);
+  return results;
+}
+
+void monkey_batch_results_destroy(char ***results_p, size_t len) {
+  assert(results_p);
+  if (*results_p) {
+    char **results = *results_p;
+    for (size_t i = 0; i < len; i++) {
+      free(results[i]);
+    }
+    free(results);
+    *results_p = NULL;
+  }
+}
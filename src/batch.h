@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "evaluator.h"
+#include "utils.h"
+
+/* Cap of each worker's program cache */
+#define BATCH_CACHE_BYTES (4 << 20)
+
+/*
+ * Evaluates independent scripts on a pool of `threads` threads, each
+ * script with fresh globals. Idle threads steal work from busy ones, so
+ * a few slow scripts do not hold up the rest. A `threads` of 0 uses one
+ * thread per online CPU. Each thread caches the programs it parsed, so
+ * a script repeated in the batch is parsed once per thread.
+ *
+ * Returns one owned string per script, in input order: the inspected
+ * result, an empty string if the script produced no value, or its
+ * parser errors separated by newlines.
+ */
+char **monkey_batch_eval(const char **scripts, size_t len, size_t threads);
+/* Same, evaluating each script within `limits`, which may be NULL */
+char **monkey_batch_eval_limited(const char **scripts, size_t len,
+                                 size_t threads, const eval_limits_t *limits);
+void monkey_batch_results_destroy(char ***results_p, size_t len);
+
+#endif
@@ -0,0 +1,94 @@
+#include "builtins.h"
+#include "evaluator.h"
+#include "map.h"
+
+static const builtin_obj_t BUILTINS[] = {
+    {.name = "len", .fn = builtin_len},
+    {.name = "first", .fn = builtin_first},
+    {.name = "rest", .fn = builtin_rest},
+    {.name = "push", .fn = builtin_push},
+};
+
+#define BUILTINS_LEN (sizeof(BUILTINS) / sizeof(*BUILTINS))
+
+static obj_t BUILTIN_OBJS[] = {
+    {.type = BUILTIN_OBJ, .builtin_obj = &BUILTINS[0]},
+    {.type = BUILTIN_OBJ, .builtin_obj = &BUILTINS[1]},
+    {.type = BUILTIN_OBJ, .builtin_obj = &BUILTINS[2]},
+    {.type = BUILTIN_OBJ, .builtin_obj = &BUILTINS[3]},
+};
+
+obj_t *builtin_lookup(const char *name) {
+  assert(name);
+  for (size_t i = 0; i < BUILTINS_LEN; i++) {
+    if (strcmp(BUILTINS[i].name, name) == 0) {
+      return &BUILTIN_OBJS[i];
+    }
+  }
+  return NULL;
+}
+
+static obj_t *wrong_argc(size_t got, size_t want) {
+  char *str = NULL;
+  asprintf(&str, "wrong number of arguments. got=%zu, want=%zu", got, want);
+  obj_t *error_obj = make_error(str);
+  free(str);
+  return error_obj;
+}
+
+static obj_t *wrong_type(const char *builtin, obj_t *arg) {
+  char *str = NULL;
+  asprintf(&str, "argument to `%s` not supported, got %s", builtin,
+           obj_type_to_str(arg->type));
+  obj_t *error_obj = make_error(str);
+  free(str);
+  return error_obj;
+}
+
+obj_t *builtin_len(size_t argc, obj_t **argv) {
+  if (argc != 1) {
+    return wrong_argc(argc, 1);
+  }
+  switch (argv[0]->type) {
+  case STRING_OBJ:
+    return obj_new(INT_OBJ, int_obj_new(str_obj_len(argv[0]->str_obj)));
+  case ARRAY_OBJ:
+    return obj_new(INT_OBJ, int_obj_new(argv[0]->array_obj->len));
+  case MAP_OBJ:
+    return obj_new(INT_OBJ, int_obj_new(argv[0]->map_obj->len));
+  default:
+    return wrong_type("len", argv[0]);
+  }
+}
+
+obj_t *builtin_first(size_t argc, obj_t **argv) {
+  if (argc != 1) {
+    return wrong_argc(argc, 1);
+  }
+  if (argv[0]->type != ARRAY_OBJ) {
+    return wrong_type("first", argv[0]);
+  }
+  return array_obj_get(argv[0]->array_obj, 0);
+}
+
+obj_t *builtin_rest(size_t argc, obj_t **argv) {
+  if (argc != 1) {
+    return wrong_argc(argc, 1);
+  }
+  if (argv[0]->type != ARRAY_OBJ) {
+    return wrong_type("rest", argv[0]);
+  }
+  array_obj_t *rest = array_obj_rest(argv[0]->array_obj);
+  return rest != NULL ? obj_new(ARRAY_OBJ, rest) : &NULL_IMPL_OBJ;
+}
+
+obj_t *builtin_push(size_t argc, obj_t **argv) {
+  if (argc != 2) {
+    return wrong_argc(argc, 2);
+  }
+  if (argv[0]->type != ARRAY_OBJ) {
+    return wrong_type("push", argv[0]);
+  }
+  return obj_new(ARRAY_OBJ,
+                 array_obj_push(argv[0]->array_obj, obj_copy(argv[1])));
+}
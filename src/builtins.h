@@ -0,0 +1,14 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "object.h"
+#include "utils.h"
+
+obj_t *builtin_lookup(const char *name);
+
+obj_t *builtin_len(size_t argc, obj_t **argv);
+obj_t *builtin_first(size_t argc, obj_t **argv);
+obj_t *builtin_rest(size_t argc, obj_t **argv);
+obj_t *builtin_push(size_t argc, obj_t **argv);
+
+#endif
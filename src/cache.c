@@ -0,0 +1,223 @@
+#include "cache.h"
+#include "hash.h"
+#include "memory.h"
+
+/* Marks a slot whose entry was evicted, so probe chains stay intact */
+static program_cache_entry_t CACHE_TOMBSTONE;
+
+program_cache_t *program_cache_new(size_t max_bytes) {
+  program_cache_t *cache = mem_malloc(sizeof(program_cache_t));
+  assert(cache);
+  cache->capacity = PROGRAM_CACHE_MIN_CAPACITY;
+  cache->slots = mem_calloc(cache->capacity, sizeof(program_cache_entry_t *));
+  assert(cache->slots);
+  cache->used = 0;
+  cache->head = NULL;
+  cache->tail = NULL;
+  cache->max_bytes = max_bytes;
+  cache->retired = NULL;
+  cache->retired_len = 0;
+  cache->stats = (program_cache_stats_t){0};
+  return cache;
+}
+
+static void program_cache_entry_destroy(program_cache_entry_t **entry_p) {
+  program_cache_entry_t *entry = *entry_p;
+  program_destroy(&entry->program);
+  mem_free(entry->source, entry->source_len + 1);
+  mem_free(entry, sizeof(program_cache_entry_t));
+  *entry_p = NULL;
+}
+
+void program_cache_destroy(program_cache_t **cache_p) {
+  assert(cache_p);
+  if (*cache_p) {
+    program_cache_t *cache = *cache_p;
+    while (cache->head != NULL) {
+      program_cache_entry_t *next = cache->head->next;
+      program_cache_entry_destroy(&cache->head);
+      cache->head = next;
+    }
+    for (size_t i = 0; i < cache->retired_len; i++) {
+      program_destroy(&cache->retired[i]);
+    }
+    mem_free(cache->retired, cache->retired_len * sizeof(program_t *));
+    mem_free(cache->slots, cache->capacity * sizeof(program_cache_entry_t *));
+    mem_free(cache, sizeof(program_cache_t));
+    *cache_p = NULL;
+  }
+}
+
+/* Returns the index of `entry`'s slot, or of the first free slot */
+static size_t program_cache_find(program_cache_t *cache, uint64_t digest,
+                                 const char *source, size_t len) {
+  size_t mask = cache->capacity - 1;
+  size_t idx = digest & mask;
+  size_t free_idx = SIZE_MAX;
+  for (program_cache_entry_t *entry; (entry = cache->slots[idx]) != NULL;
+       idx = (idx + 1) & mask) {
+    if (entry == &CACHE_TOMBSTONE) {
+      free_idx = free_idx == SIZE_MAX ? idx : free_idx;
+    } else if (entry->digest == digest && entry->source_len == len &&
+               memcmp(entry->source, source, len) == 0) {
+      return idx;
+    }
+  }
+  return free_idx != SIZE_MAX ? free_idx : idx;
+}
+
+static void program_cache_unlink(program_cache_t *cache,
+                                 program_cache_entry_t *entry) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+static void program_cache_push_front(program_cache_t *cache,
+                                     program_cache_entry_t *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+program_t *program_cache_get(program_cache_t *cache, const char *source,
+                             size_t len) {
+  assert(cache);
+  assert(source);
+  uint64_t digest = hash_bytes64(source, len);
+  program_cache_entry_t *entry =
+      cache->slots[program_cache_find(cache, digest, source, len)];
+  if (entry == NULL || entry == &CACHE_TOMBSTONE) {
+    cache->stats.misses++;
+    return NULL;
+  }
+  cache->stats.hits++;
+  if (entry != cache->head) {
+    program_cache_unlink(cache, entry);
+    program_cache_push_front(cache, entry);
+  }
+  return entry->program;
+}
+
+static void program_cache_evict(program_cache_t *cache) {
+  program_cache_entry_t *entry = cache->tail;
+  assert(entry);
+  size_t idx =
+      program_cache_find(cache, entry->digest, entry->source, entry->source_len);
+  assert(cache->slots[idx] == entry);
+  cache->slots[idx] = &CACHE_TOMBSTONE;
+  program_cache_unlink(cache, entry);
+
+  if (entry->has_functions) {
+    cache->retired = mem_reallocarray(cache->retired, cache->retired_len,
+                                      cache->retired_len + 1,
+                                      sizeof(program_t *));
+    assert(cache->retired);
+    cache->retired[cache->retired_len++] = entry->program;
+    entry->program = NULL;
+    /* Its bytes stay charged until it is dropped */
+    entry->bytes -= entry->program_bytes;
+    cache->stats.retired += entry->program_bytes;
+  }
+  cache->stats.bytes -= entry->bytes;
+  cache->stats.entries--;
+  cache->stats.evictions++;
+  program_cache_entry_destroy(&entry);
+}
+
+/* Rebuilds the index, dropping tombstones and growing if it is full */
+static void program_cache_rehash(program_cache_t *cache) {
+  size_t capacity = cache->capacity;
+  while ((cache->stats.entries + 1) * 2 > capacity) {
+    capacity *= 2;
+  }
+  mem_free(cache->slots, cache->capacity * sizeof(program_cache_entry_t *));
+  cache->capacity = capacity;
+  cache->used = cache->stats.entries;
+  cache->slots = mem_calloc(capacity, sizeof(program_cache_entry_t *));
+  assert(cache->slots);
+  for (program_cache_entry_t *entry = cache->head; entry != NULL;
+       entry = entry->next) {
+    size_t idx = entry->digest & (capacity - 1);
+    while (cache->slots[idx] != NULL) {
+      idx = (idx + 1) & (capacity - 1);
+    }
+    cache->slots[idx] = entry;
+  }
+}
+
+/*
+ * Takes ownership of `program`, which must have been parsed from
+ * `source`, its offsets starting at `base`, and not be in the cache
+ * yet. `program_bytes` is what parsing it left allocated, as measured
+ * by the memory context it was parsed in. Least recently used entries
+ * are evicted to stay under the memory cap; a program larger than what
+ * retired programs leave of the cap is still kept, alone.
+ */
+void program_cache_put(program_cache_t *cache, const char *source, size_t len,
+                       uint32_t base, program_t *program,
+                       size_t program_bytes, bool has_functions) {
+  assert(cache);
+  assert(source);
+  assert(program);
+
+  size_t bytes = sizeof(program_cache_entry_t) + len + 1 + program_bytes;
+  while (cache->tail != NULL && cache->stats.bytes + bytes > cache->max_bytes) {
+    program_cache_evict(cache);
+  }
+
+  /* Tombstones count towards the load, or lookups could probe forever */
+  if ((cache->used + 1) * 2 > cache->capacity) {
+    program_cache_rehash(cache);
+  }
+
+  program_cache_entry_t *entry = mem_malloc(sizeof(program_cache_entry_t));
+  assert(entry);
+  entry->digest = hash_bytes64(source, len);
+  entry->source = mem_malloc(len + 1);
+  assert(entry->source);
+  memcpy(entry->source, source, len);
+  entry->source[len] = '\0';
+  entry->source_len = len;
+  entry->base = base;
+  entry->bytes = bytes;
+  entry->program_bytes = program_bytes;
+  entry->program = program;
+  entry->has_functions = has_functions;
+
+  size_t idx = program_cache_find(cache, entry->digest, source, len);
+  assert(cache->slots[idx] == NULL || cache->slots[idx] == &CACHE_TOMBSTONE);
+  cache->used += cache->slots[idx] == NULL;
+  cache->slots[idx] = entry;
+  program_cache_push_front(cache, entry);
+  cache->stats.bytes += bytes;
+  cache->stats.entries++;
+}
+
+/*
+ * Frees the retired programs, for when no function object they defined
+ * is left, e.g. once the globals were reset.
+ */
+void program_cache_drop_retired(program_cache_t *cache) {
+  assert(cache);
+  for (size_t i = 0; i < cache->retired_len; i++) {
+    program_destroy(&cache->retired[i]);
+  }
+  mem_free(cache->retired, cache->retired_len * sizeof(program_t *));
+  cache->retired = NULL;
+  cache->retired_len = 0;
+  cache->stats.bytes -= cache->stats.retired;
+  cache->stats.retired = 0;
+}
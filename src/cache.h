@@ -0,0 +1,66 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "ast.h"
+#include "utils.h"
+
+#define PROGRAM_CACHE_MIN_CAPACITY 16
+
+typedef struct _program_cache_entry_t {
+  uint64_t digest;
+  char *source;
+  size_t source_len;
+  uint32_t base;        /* offset of the source's first byte, see vm.h */
+  size_t bytes;         /* charged against the cap, the entry's own too */
+  size_t program_bytes; /* of `bytes`, held by `program` */
+  program_t *program;
+  bool has_functions;
+  struct _program_cache_entry_t *prev; /* towards the most recently used */
+  struct _program_cache_entry_t *next;
+} program_cache_entry_t;
+
+typedef struct {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  size_t entries;
+  size_t bytes;
+  size_t retired; /* of `bytes`, held by retired programs */
+} program_cache_stats_t;
+
+/*
+ * LRU cache of parsed programs keyed by the 64 bit digest of their
+ * source. The source is kept and compared on every hit, so a digest
+ * collision is a miss, never a wrong program.
+ *
+ * Parsed programs hold symbols of the intern table current when they
+ * were parsed, so a cache must only be used with that table, i.e. by a
+ * single monkey_vm_t.
+ */
+typedef struct {
+  program_cache_entry_t **slots; /* open addressing index by digest */
+  size_t capacity;               /* always a power of two */
+  size_t used;                   /* slots holding an entry or tombstone */
+  program_cache_entry_t *head;   /* most recently used */
+  program_cache_entry_t *tail;   /* least recently used */
+  size_t max_bytes;
+  /*
+   * Evicted programs that defined functions: function objects may still
+   * borrow their AST, so they are kept, and still charged against the
+   * cap, until `program_cache_drop_retired` or the cache is destroyed.
+   */
+  program_t **retired;
+  size_t retired_len;
+  program_cache_stats_t stats;
+} program_cache_t;
+
+program_cache_t *program_cache_new(size_t max_bytes);
+void program_cache_destroy(program_cache_t **cache_p);
+program_t *program_cache_get(program_cache_t *cache, const char *source,
+                             size_t len);
+void program_cache_put(program_cache_t *cache, const char *source, size_t len,
+                       uint32_t base, program_t *program,
+                       size_t program_bytes, bool has_functions);
+void program_cache_drop_retired(program_cache_t *cache);
+
+#endif
@@ -0,0 +1,174 @@
+#include "count.h"
+#include "ast.h"
+#include "source.h"
+#include "vm.h"
+
+/* Nodes in the hot spot report */
+#define COUNT_HOT_SPOTS 10
+
+_Thread_local count_t *count_active = NULL;
+
+count_t *count_new(void) {
+  count_t *count = malloc(sizeof(count_t));
+  assert(count);
+  count->capacity = 1024;
+  count->nodes = calloc(count->capacity, sizeof(count_node_t));
+  assert(count->nodes);
+  /* ID 0 is for nodes not visited yet */
+  count->len = 1;
+  return count;
+}
+
+void count_destroy(count_t **count_p) {
+  assert(count_p);
+  if (*count_p) {
+    count_t *count = *count_p;
+    assert(count_active != count);
+    free(count->nodes);
+    free(count);
+    *count_p = NULL;
+  }
+}
+
+/* Counts what the calling thread evaluates from now on */
+void count_start(count_t *count) {
+  assert(count);
+  assert(count_active == NULL);
+  count_active = count;
+}
+
+void count_stop(count_t *count) {
+  assert(count);
+  assert(count_active == count);
+  count_active = NULL;
+}
+
+uint32_t count_add_node(count_t *count, uint32_t offset, uint8_t kind) {
+  assert(count->len < UINT32_MAX);
+  if (count->len == count->capacity) {
+    count->nodes = reallocarray(count->nodes, count->capacity * 2,
+                                sizeof(count_node_t));
+    assert(count->nodes);
+    count->capacity *= 2;
+  }
+  count->nodes[count->len] = (count_node_t){.offset = offset, .kind = kind};
+  return (uint32_t)count->len++;
+}
+
+static const char *count_kind_to_str(uint8_t kind) {
+  return kind == COUNT_BLOCK ? "BLOCK" : expression_type_to_str(kind);
+}
+
+static int count_compare_offsets(const void *a, const void *b, void *arg) {
+  const count_node_t *nodes = arg;
+  uint32_t x = nodes[*(const uint32_t *)a].offset;
+  uint32_t y = nodes[*(const uint32_t *)b].offset;
+  return x < y ? -1 : x > y;
+}
+
+static int count_compare_times(const void *a, const void *b, void *arg) {
+  const count_node_t *nodes = arg;
+  uint64_t x = nodes[*(const uint32_t *)a].ns;
+  uint64_t y = nodes[*(const uint32_t *)b].ns;
+  return x > y ? -1 : x < y;
+}
+
+/* Lists `source` line by line, nodes from `*next` on as they come */
+static void count_write_source(count_t *count, source_t *source,
+                               const uint32_t *ids, size_t ids_len,
+                               size_t *next, FILE *out) {
+  fprintf(out, "-- %s\n%10s %10s %5s\n", source->name, "hits", "ms", "line");
+  uint32_t line = 1;
+  uint32_t start = 0;
+  while (start <= source->len) {
+    const char *text = source->text + start;
+    const char *newline = memchr(text, '\n', source->len - start);
+    uint32_t end = newline != NULL ? (uint32_t)(newline - source->text)
+                                   : source->len;
+
+    size_t first = *next;
+    /* The outermost node on a line has the most hits and time */
+    uint64_t hits = 0, ns = 0;
+    while (*next < ids_len &&
+           count->nodes[ids[*next]].offset - source->base <= end) {
+      const count_node_t *node = &count->nodes[ids[(*next)++]];
+      hits = node->hits > hits ? node->hits : hits;
+      ns = node->ns > ns ? node->ns : ns;
+    }
+    if (newline == NULL && start == end && *next == first && line > 1) {
+      /* Nothing after the last newline */
+      break;
+    }
+    if (*next > first) {
+      fprintf(out, "%10" PRIu64 " %10.3f", hits, ns / 1e6);
+    } else {
+      fprintf(out, "%10s %10s", "", "");
+    }
+    fprintf(out, " %5" PRIu32 " | %.*s\n", line, (int)(end - start), text);
+
+    for (size_t i = first; i < *next; i++) {
+      const count_node_t *node = &count->nodes[ids[i]];
+      if (node->kind == IF_EXP) {
+        source_location_t location = source_locate(source, node->offset);
+        fprintf(out, "%27s | if at %" PRIu32 ":%" PRIu32 " taken %" PRIu64
+                     " of %" PRIu64 " (%.1f%%)\n",
+                "", location.line, location.column, node->taken, node->hits,
+                node->hits != 0 ? 100.0 * node->taken / node->hits : 0.0);
+      }
+    }
+    if (newline == NULL) {
+      break;
+    }
+    start = end + 1;
+    line++;
+  }
+}
+
+/*
+ * Writes each of the VM's sources annotated with how often the nodes
+ * on each line ran and how long they took, how often each `if` took
+ * its consequence, and then the nodes that took longest. `vm` must be
+ * the VM that ran the counted code and must still hold its programs.
+ */
+void count_write_listing(count_t *count, monkey_vm_t *vm, FILE *out) {
+  assert(count);
+  assert(vm);
+  assert(out);
+  size_t ids_len = count->len - 1;
+  uint32_t *ids = malloc((ids_len > 0 ? ids_len : 1) * sizeof(uint32_t));
+  assert(ids);
+  for (size_t i = 0; i < ids_len; i++) {
+    ids[i] = (uint32_t)(i + 1);
+  }
+  /* Sources hold their line index in the VM's memory */
+  memory_t *previous = memory_swap(vm->memory);
+
+  qsort_r(ids, ids_len, sizeof(uint32_t), count_compare_offsets,
+          count->nodes);
+  size_t next = 0;
+  for (size_t i = 0; i < vm->sources_len; i++) {
+    source_t *source = vm->sources[i];
+    while (next < ids_len && count->nodes[ids[next]].offset < source->base) {
+      next++;
+    }
+    count_write_source(count, source, ids, ids_len, &next, out);
+  }
+
+  qsort_r(ids, ids_len, sizeof(uint32_t), count_compare_times, count->nodes);
+  fprintf(out, "-- hot spots\n%10s %10s  %s\n", "hits", "ms", "node");
+  for (size_t i = 0; i < ids_len && i < COUNT_HOT_SPOTS; i++) {
+    const count_node_t *node = &count->nodes[ids[i]];
+    fprintf(out, "%10" PRIu64 " %10.3f  %s", node->hits, node->ns / 1e6,
+            count_kind_to_str(node->kind));
+    source_t *source = monkey_vm_source_at(vm, node->offset);
+    if (source != NULL) {
+      source_location_t location = source_locate(source, node->offset);
+      fprintf(out, " at %s:%" PRIu32 ":%" PRIu32, source->name, location.line,
+              location.column);
+    }
+    fputc('\n', out);
+  }
+
+  memory_swap(previous);
+  free(ids);
+}
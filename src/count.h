@@ -0,0 +1,71 @@
+#ifndef COUNT_H
+#define COUNT_H
+
+#include "utils.h"
+#include <time.h>
+
+typedef struct _monkey_vm_t monkey_vm_t;
+
+/*
+ * Per node execution counts. While a counter runs on a thread, every
+ * expression and block the evaluator visits there is counted, with the
+ * time spent in it. Nodes are numbered the first time they are
+ * visited, so the counts sit in one array indexed by node ID, holding
+ * only nodes that ran, and the AST only carries the ID.
+ *
+ * IDs stay on the nodes, so a program is counted by one counter.
+ */
+
+/* A block, otherwise the node is an expression of its EXPRESSION_TYPE */
+#define COUNT_BLOCK UINT8_MAX
+
+typedef struct {
+  uint64_t hits;
+  uint64_t ns;          /* inclusive, of outermost visits, see `count_exit` */
+  uint64_t taken;       /* visits of an `if` that took the consequence */
+  uint32_t offset;      /* of the node's token */
+  uint32_t active : 24; /* visits in progress */
+  uint32_t kind : 8;
+} count_node_t; /* 32 bytes, 32 MB for a million nodes that ran */
+
+typedef struct {
+  count_node_t *nodes; /* by ID, from 1 */
+  size_t len;
+  size_t capacity;
+} count_t;
+
+/* Use `count_enter` and `count_exit` rather than this */
+extern _Thread_local count_t *count_active;
+
+count_t *count_new(void);
+void count_destroy(count_t **count_p);
+void count_start(count_t *count);
+void count_stop(count_t *count);
+uint32_t count_add_node(count_t *count, uint32_t offset, uint8_t kind);
+void count_write_listing(count_t *count, monkey_vm_t *vm, FILE *out);
+
+static inline uint64_t count_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Counts a visit of a node numbered with `count_add_node` */
+static inline void count_enter(count_t *count, uint32_t id) {
+  count_node_t *node = &count->nodes[id];
+  node->hits++;
+  node->active++;
+}
+
+/*
+ * Only the outermost of nested visits adds its time, so recursion does
+ * not count the same time over and over.
+ */
+static inline void count_exit(count_t *count, uint32_t id, uint64_t start) {
+  count_node_t *node = &count->nodes[id];
+  if (--node->active == 0) {
+    node->ns += count_clock_ns() - start;
+  }
+}
+
+#endif
@@ -0,0 +1,454 @@
+#include "environment.h"
+#include "map.h"
+#include "memory.h"
+
+static env_binding_t *env_store_new(uint32_t capacity) {
+  env_binding_t *store =
+      mem_malloc_as(MEM_ENV, capacity * sizeof(env_binding_t));
+  assert(store);
+  for (uint32_t i = 0; i < capacity; i++) {
+    store[i].symbol = SYMBOL_NONE;
+  }
+  return store;
+}
+
+static void env_store_clear(env_t *env) {
+  env_binding_t *store = env->store;
+  if (store == NULL) {
+    return;
+  }
+  /* Detached first: destroying a value may release this environment */
+  env->store = NULL;
+  for (uint32_t i = 0; i < env->capacity; i++) {
+    if (store[i].symbol != SYMBOL_NONE) {
+      obj_destroy(&store[i].value);
+    }
+  }
+  mem_free(store, env->capacity * sizeof(env_binding_t));
+}
+
+/* Fibonacci hashing: symbols are dense, so spread them over the table */
+static inline uint32_t env_slot(const env_t *env, symbol_t symbol) {
+  return (symbol * 2654435769u) & (env->capacity - 1);
+}
+
+static env_binding_t *env_find(const env_t *env, symbol_t symbol) {
+  uint32_t idx = env_slot(env, symbol);
+  for (;;) {
+    env_binding_t *binding = &env->store[idx];
+    if (binding->symbol == symbol || binding->symbol == SYMBOL_NONE) {
+      return binding;
+    }
+    idx = (idx + 1) & (env->capacity - 1);
+  }
+}
+
+static void env_grow(env_t *env) {
+  env_binding_t *old = env->store;
+  uint32_t old_capacity = env->capacity;
+  env->capacity *= 2;
+  env->store = env_store_new(env->capacity);
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old[i].symbol != SYMBOL_NONE) {
+      *env_find(env, old[i].symbol) = old[i];
+    }
+  }
+  mem_free(old, old_capacity * sizeof(env_binding_t));
+}
+
+static env_t *env_create(size_t size, env_t *outer) {
+  env_t *env = mem_malloc_as(MEM_ENV, sizeof(env_t));
+  assert(env);
+  env->store = env_store_new((uint32_t)size);
+  env->capacity = (uint32_t)size;
+  env->length = 0;
+  env->outer = outer != NULL ? env_retain(outer) : NULL;
+  env->refcount = 1;
+  env->suspects = NULL;
+  return env;
+}
+
+env_t *env_new(void) { return env_create(ENV_SIZE, NULL); }
+
+env_t *env_new_enclosed(env_t *outer) {
+  assert(outer);
+  return env_create(ENV_ENCLOSED_SIZE, outer);
+}
+
+env_t *env_retain(env_t *env) {
+  assert(env);
+  env->refcount++;
+  return env;
+}
+
+/*
+ * Drops a reference. The environment and its bindings are destroyed
+ * with the last reference.
+ */
+void env_release(env_t **env_p) {
+  assert(env_p);
+  if (*env_p) {
+    env_t *env = *env_p;
+    *env_p = NULL;
+    while (env != NULL && --env->refcount == 0) {
+      env_t *outer = env->outer;
+      env_store_clear(env);
+      if (env->suspects != NULL) {
+        /* Each would still hold this environment */
+        assert(env->suspects->len == 0);
+        free(env->suspects->envs);
+        free(env->suspects);
+      }
+      mem_free(env, sizeof(env_t));
+      env = outer;
+    }
+  }
+}
+
+/*
+ * Called by the owner of an environment when it is done evaluating in
+ * it. Closures bound in the environment may point back at it through
+ * their own enclosed environments, so the bindings are destroyed first
+ * to break those cycles before the owner's reference is dropped.
+ */
+void env_destroy(env_t **env_p) {
+  assert(env_p);
+  if (*env_p) {
+    env_t *env = *env_p;
+    env_store_clear(env);
+    env_suspects_t *suspects = env->suspects;
+    if (suspects != NULL) {
+      /* What only the bindings kept alive is garbage now */
+      env_collect_cycles(env);
+      while (suspects->len > 0) {
+        env_release(&suspects->envs[--suspects->len]);
+      }
+    }
+    env_release(env_p);
+  }
+}
+
+/*
+ * Returns the object bound to `symbol` in `env` or any enclosing
+ * environment, or NULL. The environment keeps ownership of the returned
+ * object.
+ */
+obj_t *env_get(env_t *env, symbol_t symbol) {
+  assert(env);
+  assert(symbol != SYMBOL_NONE);
+  for (; env != NULL; env = env->outer) {
+    if (env->store == NULL) {
+      /* Destroyed by its owner */
+      continue;
+    }
+    env_binding_t *binding = env_find(env, symbol);
+    if (binding->symbol == symbol) {
+      return binding->value;
+    }
+  }
+  return NULL;
+}
+
+void env_set(env_t *env, symbol_t symbol, obj_t *obj) {
+  assert(env);
+  assert(env->store);
+  assert(symbol != SYMBOL_NONE);
+  assert(obj);
+
+  if (obj->type == FUNCTION_OBJ && obj->fn_obj->env == env &&
+      !obj->fn_obj->weak) {
+    /*
+     * A function bound in the environment it closes over would keep
+     * that environment alive forever. The binding holds a weak
+     * reference instead; copies handed out by `env_get` callers are
+     * strong again.
+     */
+    obj->fn_obj->weak = true;
+    assert(env->refcount > 1);
+    env->refcount--;
+  }
+
+  env_binding_t *binding = env_find(env, symbol);
+  if (binding->symbol == symbol) {
+    /* Rebinding replaces the old value in place */
+    obj_destroy(&binding->value);
+    binding->value = obj;
+    return;
+  }
+
+  /* Keep the load factor at or under 3/4 */
+  if ((env->length + 1) * 4 > env->capacity * 3) {
+    env_grow(env);
+    binding = env_find(env, symbol);
+  }
+  binding->symbol = symbol;
+  binding->value = obj;
+  env->length++;
+}
+
+/* Cycle collection */
+
+static env_t *env_root(env_t *env) {
+  while (env->outer != NULL) {
+    env = env->outer;
+  }
+  return env;
+}
+
+/*
+ * Called when a call environment outlives its call. It is kept, with a
+ * reference, until a collection finds it is only alive through cycles.
+ */
+void env_suspect(env_t *env) {
+  assert(env);
+  assert(env->outer != NULL);
+  env_t *root = env_root(env);
+  env_suspects_t *suspects = root->suspects;
+  if (suspects == NULL) {
+    suspects = root->suspects = calloc(1, sizeof(env_suspects_t));
+    assert(suspects);
+    suspects->threshold = ENV_SUSPECTS_MIN;
+  }
+  if (suspects->len == suspects->capacity) {
+    suspects->capacity =
+        suspects->capacity == 0 ? ENV_SUSPECTS_MIN : suspects->capacity * 2;
+    suspects->envs =
+        reallocarray(suspects->envs, suspects->capacity, sizeof(env_t *));
+    assert(suspects->envs);
+  }
+  suspects->envs[suspects->len++] = env_retain(env);
+  if (suspects->len >= suspects->threshold) {
+    env_collect_cycles(root);
+  }
+}
+
+/* The reference counted blocks cycles go through */
+typedef enum {
+  ENV_NODE_ENV,
+  ENV_NODE_BUF,
+  ENV_NODE_MAP,
+} ENV_NODE;
+
+typedef struct {
+  void *ptr; /* NULL for an empty slot */
+  ENV_NODE kind;
+  uint32_t internal; /* references from blocks in the graph */
+  bool live;         /* reachable from outside the graph */
+} env_node_t;
+
+typedef struct {
+  ENV_NODE kind;
+  void *ptr;
+} env_node_ref_t;
+
+/*
+ * The blocks reachable from the suspects, by address, with open
+ * addressing. The outermost environment is left out: it is never
+ * garbage, and references from it are as good as any from outside.
+ */
+typedef struct {
+  env_node_t *nodes;
+  size_t capacity; /* always a power of two */
+  size_t len;
+  env_node_ref_t *stack; /* blocks whose references are yet to follow */
+  size_t stack_len;
+  size_t stack_capacity;
+  bool counting; /* counting references rather than marking live */
+} env_graph_t;
+
+static env_node_t *env_graph_find(env_graph_t *g, void *ptr) {
+  size_t idx = ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ull >> 32;
+  for (idx &= g->capacity - 1;; idx = (idx + 1) & (g->capacity - 1)) {
+    if (g->nodes[idx].ptr == ptr || g->nodes[idx].ptr == NULL) {
+      return &g->nodes[idx];
+    }
+  }
+}
+
+static void env_graph_push(env_graph_t *g, ENV_NODE kind, void *ptr) {
+  if (g->stack_len == g->stack_capacity) {
+    g->stack_capacity = g->stack_capacity == 0 ? 64 : g->stack_capacity * 2;
+    g->stack =
+        reallocarray(g->stack, g->stack_capacity, sizeof(env_node_ref_t));
+    assert(g->stack);
+  }
+  g->stack[g->stack_len++] = (env_node_ref_t){.kind = kind, .ptr = ptr};
+}
+
+static void env_graph_grow(env_graph_t *g) {
+  env_node_t *old = g->nodes;
+  size_t old_capacity = g->capacity;
+  g->capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+  g->nodes = calloc(g->capacity, sizeof(env_node_t));
+  assert(g->nodes);
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].ptr != NULL) {
+      *env_graph_find(g, old[i].ptr) = old[i];
+    }
+  }
+  free(old);
+}
+
+/* Follows a reference to `ptr` */
+static void env_graph_edge(env_graph_t *g, ENV_NODE kind, void *ptr) {
+  if (!g->counting) {
+    env_node_t *node = env_graph_find(g, ptr);
+    assert(node->ptr == ptr);
+    if (!node->live) {
+      node->live = true;
+      env_graph_push(g, kind, ptr);
+    }
+    return;
+  }
+  /* Keep the load factor at or under 1/2 */
+  if ((g->len + 1) * 2 > g->capacity) {
+    env_graph_grow(g);
+  }
+  env_node_t *node = env_graph_find(g, ptr);
+  if (node->ptr == NULL) {
+    *node = (env_node_t){.ptr = ptr, .kind = kind};
+    g->len++;
+    env_graph_push(g, kind, ptr);
+  }
+  node->internal++;
+}
+
+static void env_graph_obj(env_graph_t *g, obj_t *obj) {
+  switch (obj->type) {
+  case ARRAY_OBJ:
+    env_graph_edge(g, ENV_NODE_BUF, obj->array_obj->buf);
+    break;
+  case MAP_OBJ:
+    env_graph_edge(g, ENV_NODE_MAP, obj->map_obj);
+    break;
+  case FUNCTION_OBJ:
+    /* Weak references are not counted, see `env_set` */
+    if (!obj->fn_obj->weak && obj->fn_obj->env->outer != NULL) {
+      env_graph_edge(g, ENV_NODE_ENV, obj->fn_obj->env);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void env_graph_value(env_graph_t *g, array_value_t *value) {
+  switch (value->type) {
+  case INT_OBJ:
+  case BOOL_OBJ:
+  case NULL_OBJ:
+    break;
+  default:
+    env_graph_obj(g, value->obj);
+    break;
+  }
+}
+
+/* Follows the references held by the blocks on the stack */
+static void env_graph_walk(env_graph_t *g) {
+  while (g->stack_len > 0) {
+    env_node_ref_t ref = g->stack[--g->stack_len];
+    switch (ref.kind) {
+    case ENV_NODE_ENV: {
+      env_t *env = ref.ptr;
+      for (uint32_t i = 0; env->store != NULL && i < env->capacity; i++) {
+        if (env->store[i].symbol != SYMBOL_NONE) {
+          env_graph_obj(g, env->store[i].value);
+        }
+      }
+      if (env->outer->outer != NULL) {
+        env_graph_edge(g, ENV_NODE_ENV, env->outer);
+      }
+      break;
+    }
+    case ENV_NODE_BUF: {
+      array_buf_t *buf = ref.ptr;
+      for (size_t i = 0; i < buf->len; i++) {
+        env_graph_value(g, &buf->values[i]);
+      }
+      break;
+    }
+    case ENV_NODE_MAP: {
+      map_t *map = ref.ptr;
+      for (size_t i = 0; i < map->entries_len; i++) {
+        if (map->entries[i].hash != 0) {
+          env_graph_value(g, &map->entries[i].key);
+          env_graph_value(g, &map->entries[i].value);
+        }
+      }
+      break;
+    }
+    }
+  }
+}
+
+static uint32_t env_node_refcount(env_node_t *node) {
+  switch (node->kind) {
+  case ENV_NODE_ENV:
+    return ((env_t *)node->ptr)->refcount;
+  case ENV_NODE_BUF:
+    return ((array_buf_t *)node->ptr)->refcount;
+  case ENV_NODE_MAP:
+    return ((map_t *)node->ptr)->refcount;
+  }
+  return 0;
+}
+
+/*
+ * Frees the suspects of `env`'s outermost environment that are only
+ * alive through cycles, by trial deletion: every reference between the
+ * blocks reachable from the suspects is counted, the suspects' own
+ * references included. Blocks with more references than that are held
+ * from outside, and so is everything they reach. The other suspects
+ * are garbage: destroying their bindings breaks the cycles, and the
+ * reference counts free the rest.
+ */
+void env_collect_cycles(env_t *env) {
+  assert(env);
+  env_t *root = env_root(env);
+  env_suspects_t *suspects = root->suspects;
+  if (suspects == NULL || suspects->len == 0) {
+    return;
+  }
+
+  env_graph_t g = {.counting = true};
+  for (size_t i = 0; i < suspects->len; i++) {
+    env_graph_edge(&g, ENV_NODE_ENV, suspects->envs[i]);
+  }
+  env_graph_walk(&g);
+
+  g.counting = false;
+  for (size_t i = 0; i < g.capacity; i++) {
+    env_node_t *node = &g.nodes[i];
+    if (node->ptr != NULL && !node->live) {
+      assert(node->internal <= env_node_refcount(node));
+      if (node->internal < env_node_refcount(node)) {
+        node->live = true;
+        env_graph_push(&g, node->kind, node->ptr);
+        env_graph_walk(&g);
+      }
+    }
+  }
+
+  /* The live suspects first, the garbage after */
+  size_t live = 0;
+  for (size_t i = 0; i < suspects->len; i++) {
+    if (env_graph_find(&g, suspects->envs[i])->live) {
+      env_t *tmp = suspects->envs[live];
+      suspects->envs[live++] = suspects->envs[i];
+      suspects->envs[i] = tmp;
+    }
+  }
+  free(g.nodes);
+  free(g.stack);
+
+  for (size_t i = live; i < suspects->len; i++) {
+    env_store_clear(suspects->envs[i]);
+  }
+  for (size_t i = live; i < suspects->len; i++) {
+    env_release(&suspects->envs[i]);
+  }
+  suspects->len = live;
+  suspects->threshold =
+      live * 2 > ENV_SUSPECTS_MIN ? live * 2 : ENV_SUSPECTS_MIN;
+}
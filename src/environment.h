@@ -0,0 +1,59 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "intern.h"
+#include "object.h"
+#include "utils.h"
+
+#define ENV_SIZE 64
+#define ENV_ENCLOSED_SIZE 8
+
+typedef struct {
+  symbol_t symbol; /* SYMBOL_NONE for empty slots */
+  obj_t *value;    /* owned by the environment */
+} env_binding_t;
+
+#define ENV_SUSPECTS_MIN 64
+
+/*
+ * Call environments that outlived their call, each holding a reference.
+ * A closure kept in an array or map bound in the environment it closes
+ * over makes a cycle reference counting alone never frees; such cycles
+ * are looked for among these, see `env_collect_cycles`.
+ */
+typedef struct {
+  env_t **envs;
+  size_t len;
+  size_t capacity;
+  size_t threshold; /* collect once `len` reaches it */
+} env_suspects_t;
+
+/*
+ * Environments are reference counted: they are shared between the
+ * scope that created them and every closure defined in that scope.
+ *
+ * Bindings are keyed by symbol in a small open addressing table, so a
+ * lookup is a multiply, a mask and integer compares.
+ */
+struct _env_t {
+  env_binding_t *store; /* NULL once the owner has destroyed the
+                           environment */
+  uint32_t capacity;    /* always a power of two */
+  uint32_t length;
+  struct _env_t *outer;
+  uint32_t refcount;
+  env_suspects_t *suspects; /* of the environments enclosed in this one,
+                               set on the outermost only */
+};
+
+env_t *env_new(void);
+env_t *env_new_enclosed(env_t *outer);
+env_t *env_retain(env_t *env);
+void env_release(env_t **env_p);
+void env_destroy(env_t **env_p);
+obj_t *env_get(env_t *env, symbol_t symbol);
+void env_set(env_t *env, symbol_t symbol, obj_t *obj);
+void env_suspect(env_t *env);
+void env_collect_cycles(env_t *env);
+
+#endif
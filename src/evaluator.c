@@ -1,24 +1,256 @@
 #include "evaluator.h"
 #include "ast.h"
+#include "builtins.h"
+#include "count.h"
+#include "map.h"
+#include "memory.h"
 #include "object.h"
+#include "profile.h"
+#include <pthread.h>
+#include <time.h>
 
-obj_t *eval(program_t *program) {
-  return eval_statements(program->len, program->statements);
+/*
+ * The limits of the evaluation running on this thread. A call only
+ * decrements `countdown` and compares `depth`, and an expression its
+ * nesting and the live bytes; the other limits are looked at when the
+ * countdown runs out, so unbounded evaluations start it at UINT64_MAX
+ * and never get there. Whatever the limits, expressions nest at most
+ * `max_nesting` deep, which is what fits on the thread's stack.
+ */
+typedef struct {
+  const eval_limits_t *limits;
+  uint64_t countdown; /* calls until the next check */
+  uint64_t period;    /* the countdown at the last check */
+  uint64_t steps;     /* calls made up to the last check */
+  uint64_t deadline;  /* CLOCK_MONOTONIC ns, 0 if none */
+  size_t depth;
+  size_t max_depth;
+  size_t nesting; /* of `eval_expression` calls */
+  size_t max_nesting;
+  bool too_nested; /* whether ERROR_DEPTH_LIMIT is for `max_nesting` */
+  const memory_t *memory; /* NULL without a `max_bytes` */
+  size_t max_bytes;
+  ERROR_KIND spent; /* ERROR_RUNTIME while within the limits */
+} eval_budget_t;
+
+static _Thread_local eval_budget_t eval_budget = {
+    .countdown = UINT64_MAX, .period = UINT64_MAX, .max_depth = SIZE_MAX};
+
+/*
+ * How the evaluation running on this thread is completing. A `return`
+ * leaves its value as the result of its statement and sets
+ * EVAL_RETURN; everything between it and the function call or program
+ * it returns from passes the value straight up, as with errors, and
+ * the call or program takes it and clears the flag. So returning
+ * allocates nothing.
+ */
+typedef enum {
+  EVAL_NORMAL,
+  EVAL_RETURN,
+} EVAL_COMPLETION;
+
+static _Thread_local EVAL_COMPLETION eval_completion = EVAL_NORMAL;
+
+/* Whether `obj` must be passed straight up: an error or a return value */
+static inline bool eval_abrupt(obj_t *obj) {
+  return eval_completion != EVAL_NORMAL || is_error(obj);
+}
+
+static uint64_t eval_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Calls to make before looking at the limits again */
+static uint64_t eval_budget_period(const eval_budget_t *budget) {
+  const eval_limits_t *limits = budget->limits;
+  if (limits == NULL || (limits->max_steps == 0 && budget->deadline == 0)) {
+    return UINT64_MAX;
+  }
+  uint64_t period = EVAL_CHECK_STEPS;
+  /* Check on the first call past the limit */
+  if (limits->max_steps != 0 && limits->max_steps - budget->steps < period) {
+    period = limits->max_steps - budget->steps + 1;
+  }
+  return period;
+}
+
+static obj_t *eval_budget_error(void) {
+  const eval_limits_t *limits = eval_budget.limits;
+  char *str = NULL;
+  switch (eval_budget.spent) {
+  case ERROR_STEP_LIMIT:
+    asprintf(&str, "step limit exceeded: %llu steps",
+             (unsigned long long)limits->max_steps);
+    break;
+  case ERROR_DEADLINE:
+    asprintf(&str, "deadline exceeded: %llu ms",
+             (unsigned long long)(limits->timeout_ns / 1000000));
+    break;
+  case ERROR_MEMORY_LIMIT:
+    asprintf(&str, "memory limit exceeded: %zu bytes", limits->max_bytes);
+    break;
+  default:
+    if (eval_budget.too_nested) {
+      asprintf(&str, "expressions nested too deep: %zu levels",
+               eval_budget.max_nesting);
+      break;
+    }
+    asprintf(&str, "call depth limit exceeded: %zu", limits->max_depth);
+    break;
+  }
+  obj_t *error_obj = make_error(str);
+  error_obj->error_obj->kind = eval_budget.spent;
+  free(str);
+  return error_obj;
+}
+
+static inline bool eval_budget_over_memory(void) {
+  if (eval_budget.memory != NULL &&
+      eval_budget.memory->current > eval_budget.max_bytes) {
+    eval_budget.spent = ERROR_MEMORY_LIMIT;
+    return true;
+  }
+  return false;
+}
+
+/* Whether `bytes` more would not fit in `max_bytes` */
+static bool eval_budget_cannot_hold(size_t bytes) {
+  const memory_t *memory = eval_budget.memory;
+  if (memory != NULL && (memory->current > eval_budget.max_bytes ||
+                         bytes > eval_budget.max_bytes - memory->current)) {
+    eval_budget.spent = ERROR_MEMORY_LIMIT;
+    return true;
+  }
+  return false;
+}
+
+/* The countdown ran out: NULL to go on, an error once a limit is hit */
+static obj_t *eval_budget_check(void) {
+  eval_budget_t *budget = &eval_budget;
+  if (budget->spent != ERROR_RUNTIME) {
+    budget->countdown = 1;
+    return eval_budget_error();
+  }
+  budget->steps += budget->period;
+  const eval_limits_t *limits = budget->limits;
+  if (limits != NULL && limits->max_steps != 0 &&
+      budget->steps > limits->max_steps) {
+    budget->spent = ERROR_STEP_LIMIT;
+  } else if (budget->deadline != 0 && eval_clock_ns() >= budget->deadline) {
+    budget->spent = ERROR_DEADLINE;
+  }
+  if (budget->spent != ERROR_RUNTIME) {
+    budget->countdown = 1;
+    return eval_budget_error();
+  }
+  budget->period = budget->countdown = eval_budget_period(budget);
+  return NULL;
+}
+
+/*
+ * Expressions nest at most one level per EVAL_NESTING_BYTES of the
+ * stack left when evaluation starts, less EVAL_STACK_RESERVE for the
+ * builtins and the library calls made at the deepest level. A level
+ * takes up to about half of EVAL_NESTING_BYTES at -O0, calls included,
+ * and AddressSanitizer makes frames nearly twice as big. Threads whose
+ * stack cannot be looked up are taken to have EVAL_STACK_FALLBACK.
+ */
+#if defined(__SANITIZE_ADDRESS__)
+#define EVAL_NESTING_BYTES 2048
+#else
+#define EVAL_NESTING_BYTES 1024
+#endif
+#define EVAL_STACK_RESERVE (256 * 1024)
+#define EVAL_STACK_FALLBACK (1024 * 1024)
+
+/* The lowest address of this thread's stack, 0 until looked up */
+static _Thread_local uintptr_t eval_stack_low = 0;
+
+/* How deep expressions evaluated from here may nest */
+static size_t eval_nesting_cap(void) {
+  uintptr_t here = (uintptr_t)__builtin_frame_address(0);
+  if (eval_stack_low == 0) {
+    pthread_attr_t attr;
+    void *addr = NULL;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      pthread_attr_getstack(&attr, &addr, &size);
+      pthread_attr_destroy(&attr);
+    }
+    eval_stack_low = addr != NULL && (uintptr_t)addr < here
+                         ? (uintptr_t)addr
+                         : here - EVAL_STACK_FALLBACK;
+  }
+  if (here - eval_stack_low <= EVAL_STACK_RESERVE) {
+    return 1;
+  }
+  return (here - eval_stack_low - EVAL_STACK_RESERVE) / EVAL_NESTING_BYTES;
+}
+
+static obj_t *eval_program(program_t *program, env_t *env) {
+  /* Errors need the offsets of reparsed statements up to date */
+  program_apply_shifts(program);
+  return eval_statements(program->len, program->statements, env);
 }
 
-obj_t *eval_statements(size_t len, statement_t **statements) {
+obj_t *eval(program_t *program, env_t *env) {
+  return eval_limited(program, env, NULL);
+}
+
+obj_t *eval_limited(program_t *program, env_t *env,
+                    const eval_limits_t *limits) {
+  eval_budget_t saved = eval_budget;
+  eval_budget = (eval_budget_t){
+      .limits = limits,
+      .max_depth = SIZE_MAX,
+      .nesting = saved.nesting,
+      .max_nesting = saved.nesting + eval_nesting_cap(),
+  };
+  if (limits != NULL) {
+    if (limits->timeout_ns != 0) {
+      eval_budget.deadline = eval_clock_ns() + limits->timeout_ns;
+    }
+    if (limits->max_depth != 0) {
+      eval_budget.max_depth = limits->max_depth;
+    }
+    if (limits->max_bytes != 0) {
+      eval_budget.memory = memory_current();
+      eval_budget.max_bytes =
+          limits->base_bytes > SIZE_MAX - limits->max_bytes
+              ? SIZE_MAX
+              : limits->base_bytes + limits->max_bytes;
+    }
+  }
+  eval_budget.period = eval_budget.countdown = eval_budget_period(&eval_budget);
+  obj_t *result = eval_budget_over_memory() ? eval_budget_error()
+                                            : eval_program(program, env);
+  /* Calls whose closures are all gone by now are freed */
+  env_collect_cycles(env);
+  /* The last expression may have gone over */
+  if (eval_budget_over_memory() &&
+      (result == NULL || result->type != ERROR_OBJ)) {
+    if (result != NULL) {
+      obj_destroy(&result);
+    }
+    result = eval_budget_error();
+  }
+  eval_budget = saved;
+  return result;
+}
+
+obj_t *eval_statements(size_t len, statement_t **statements, env_t *env) {
   obj_t *obj = NULL;
   for (int i = 0; i < len; i++) {
-    obj = eval_statement(statements[i]);
-    if (obj->type == RETURN_VALUE_OBJ) {
-      obj_t *value = obj->return_obj->value;
-      /*
-       * Destroy return object but not its value
-       */
-      free(obj->return_obj);
-      free(obj);
-      obj = NULL;
-      return value;
+    obj = eval_statement(statements[i], env);
+    if (obj == NULL) {
+      /* `let` statements don't produce a value */
+      continue;
+    }
+    if (eval_completion == EVAL_RETURN) {
+      eval_completion = EVAL_NORMAL;
+      return obj;
     } else if (obj->type == ERROR_OBJ) {
       return obj;
     }
@@ -28,14 +260,16 @@ obj_t *eval_statements(size_t len, statement_t **statements) {
   return obj;
 }
 
-obj_t *eval_statement(statement_t *statement) {
+obj_t *eval_statement(statement_t *statement, env_t *env) {
   switch (statement->type) {
   case EXPRESSION_STATEMENT:
-    return eval_expression(statement->expression_statement->expression);
+    return eval_expression(statement->expression_statement->expression, env);
   case BLOCK_STATEMENT:
-    return eval_statements(statement->block_statement->statements_len, statement->block_statement->statements);
+    return eval_statements(statement->block_statement->statements_len, statement->block_statement->statements, env);
   case RETURN_STATEMENT:
-    return eval_return_statement(statement->return_statement);
+    return eval_return_statement(statement->return_statement, env);
+  case LET_STATEMENT:
+    return eval_let_statement(statement->let_statement, env);
   }
   return NULL;
 }
@@ -92,6 +326,17 @@ obj_t *eval_integer_infix_expression(const char *operator, obj_t *left, obj_t *r
   } else if (strcmp(operator, "*") == 0) {
     return obj_new(INT_OBJ, int_obj_new(left_value * right_value));
   } else if (strcmp(operator, "/") == 0) {
+    /* Either would trap and take the whole process down */
+    if (right_value == 0 || (left_value == INT32_MIN && right_value == -1)) {
+      char *str = NULL;
+      obj_t *error_obj = NULL;
+      asprintf(&str, "%s: %" PRId32 " / %" PRId32,
+               right_value == 0 ? "division by zero" : "integer overflow",
+               left_value, right_value);
+      error_obj = make_error(str);
+      free(str);
+      return error_obj;
+    }
     return obj_new(INT_OBJ, int_obj_new(left_value / right_value));
   } else if (strcmp (operator, ">") == 0) {
     return native_bool_to_boolean_obj(left_value > right_value);
@@ -104,20 +349,55 @@ obj_t *eval_integer_infix_expression(const char *operator, obj_t *left, obj_t *r
   } else {
     char *str = NULL;
     obj_t *error_obj = NULL;
-    asprintf(&str, "unknown operator: %s %s %s", obj_type_to_str(left->type), operator, obj_type_to_str(right->type));
-    obj_destroy(&left);
-    obj_destroy(&right);
+    /* Both operands are integers, and were destroyed above */
+    asprintf(&str, "unknown operator: %s %s %s", obj_type_to_str(INT_OBJ),
+             operator, obj_type_to_str(INT_OBJ));
     error_obj = make_error(str);
     free(str);
     return error_obj;
   }
 }
 
+obj_t *eval_string_infix_expression(const char *operator, obj_t *left, obj_t *right) {
+  obj_t *result = NULL;
+  if (strcmp(operator, "+") == 0) {
+    /*
+     * Concatenating allocates little, but the result takes its length
+     * once flattened, all at once.
+     */
+    if (eval_budget_cannot_hold(str_obj_len(left->str_obj) +
+                                str_obj_len(right->str_obj))) {
+      result = eval_budget_error();
+    } else {
+      result =
+          obj_new(STRING_OBJ, str_obj_concat(left->str_obj, right->str_obj));
+    }
+  } else if (strcmp(operator, "==") == 0) {
+    result = native_bool_to_boolean_obj(str_obj_equals(left->str_obj, right->str_obj));
+  } else if (strcmp(operator, "!=") == 0) {
+    result = native_bool_to_boolean_obj(!str_obj_equals(left->str_obj, right->str_obj));
+  } else if (strcmp(operator, "<") == 0) {
+    result = native_bool_to_boolean_obj(str_obj_compare(left->str_obj, right->str_obj) < 0);
+  } else if (strcmp(operator, ">") == 0) {
+    result = native_bool_to_boolean_obj(str_obj_compare(left->str_obj, right->str_obj) > 0);
+  } else {
+    char *str = NULL;
+    asprintf(&str, "unknown operator: %s %s %s", obj_type_to_str(left->type), operator, obj_type_to_str(right->type));
+    result = make_error(str);
+    free(str);
+  }
+  obj_destroy(&left);
+  obj_destroy(&right);
+  return result;
+}
+
 obj_t *eval_infix_operation(const char *operator, obj_t *left, obj_t *right) {
   char *str = NULL;
   obj_t *error_obj = NULL;
   if (left->type == INT_OBJ && right->type == INT_OBJ) {
     return eval_integer_infix_expression(operator, left, right);
+  } else if (left->type == STRING_OBJ && right->type == STRING_OBJ) {
+    return eval_string_infix_expression(operator, left, right);
   } else if (strcmp(operator, "==") == 0) {
     return native_bool_to_boolean_obj(left == right);
   } else if (strcmp(operator, "!=") == 0) {
@@ -136,15 +416,17 @@ obj_t *eval_infix_operation(const char *operator, obj_t *left, obj_t *right) {
   return error_obj;
 }
 
-obj_t *eval_block_statement(block_statement_t *block_statement) {
+static obj_t *eval_block_statement_node(block_statement_t *block_statement,
+                                        env_t *env) {
   size_t len = block_statement->statements_len;
   statement_t **statements = block_statement->statements;
   obj_t *obj = NULL;
   for (int i = 0; i < len; i++) {
-    obj = eval_statement(statements[i]);
-    if (obj->type == RETURN_VALUE_OBJ) {
-      return obj;
-    } else if (obj->type == ERROR_OBJ) {
+    obj = eval_statement(statements[i], env);
+    if (obj == NULL) {
+      continue;
+    }
+    if (eval_abrupt(obj)) {
       return obj;
     }
     if (i != (len - 1)) {
@@ -154,52 +436,482 @@ obj_t *eval_block_statement(block_statement_t *block_statement) {
   return obj;
 }
 
-obj_t *eval_if_expression(expression_t *expression) {
+/* Out of line, so the uncounted path stays a test and a jump */
+__attribute__((noinline)) static obj_t *
+eval_block_statement_counted(count_t *count, block_statement_t *block_statement,
+                             env_t *env) {
+  if (block_statement->id == 0) {
+    block_statement->id =
+        count_add_node(count, block_statement->token->offset, COUNT_BLOCK);
+  }
+  uint64_t start = count_clock_ns();
+  count_enter(count, block_statement->id);
+  obj_t *result = eval_block_statement_node(block_statement, env);
+  count_exit(count, block_statement->id, start);
+  return result;
+}
+
+obj_t *eval_block_statement(block_statement_t *block_statement, env_t *env) {
+  count_t *count = count_active;
+  if (count != NULL) {
+    return eval_block_statement_counted(count, block_statement, env);
+  }
+  return eval_block_statement_node(block_statement, env);
+}
+
+obj_t *eval_if_expression(expression_t *expression, env_t *env) {
   assert(expression);
   assert(expression->type == IF_EXP);
 
   if_exp_t *exp = expression->if_exp;
-  obj_t *condition = eval_expression(exp->condition);
+  obj_t *condition = eval_expression(exp->condition, env);
+  if (eval_abrupt(condition)) {
+    return condition;
+  }
 
+  obj_t *result = NULL;
   if (is_truthy(condition)) {
     obj_destroy(&condition);
-    return eval_block_statement(exp->consequence);
+    /* Visits are counted by `eval_expression`, which numbers the node */
+    if (count_active != NULL && expression->id != 0) {
+      count_active->nodes[expression->id].taken++;
+    }
+    result = eval_block_statement(exp->consequence, env);
   } else if (exp->alternative != NULL) {
     obj_destroy(&condition);
-    return eval_block_statement(exp->alternative);
+    result = eval_block_statement(exp->alternative, env);
   } else {
     obj_destroy(&condition);
-    return &NULL_IMPL_OBJ;
   }
+  /* A block ending in `let` has no value */
+  return result != NULL ? result : &NULL_IMPL_OBJ;
+}
+
+obj_t *eval_identifier(identifier_t *identifier, env_t *env) {
+  obj_t *value = env_get(env, identifier->symbol);
+  if (value == NULL) {
+    value = builtin_lookup(identifier->value);
+  }
+  if (value == NULL) {
+    char *str = NULL;
+    asprintf(&str, "identifier not found: %s", identifier->value);
+    obj_t *error_obj = make_error(str);
+    free(str);
+    return error_obj;
+  }
+  /* The environment keeps its own copy */
+  return obj_copy(value);
+}
+
+/*
+ * Errors are located at the innermost node that could not be evaluated;
+ * the nodes they propagate through leave the offset alone.
+ */
+static obj_t *error_at(obj_t *result, token_t *token) {
+  if (result != NULL && result->type == ERROR_OBJ &&
+      result->error_obj->offset == SOURCE_OFFSET_NONE) {
+    result->error_obj->offset = token->offset;
+  }
+  return result;
 }
 
-obj_t *eval_expression(expression_t *expression) {
+static obj_t *eval_expression_node(expression_t *expression, env_t *env) {
   obj_t *left = NULL;
   obj_t *right = NULL;
   switch (expression->type) {
   case INT_EXP:
     return obj_new(INT_OBJ, int_obj_new(expression->integer->value));
+  case STRING_EXP:
+    return obj_new(STRING_OBJ, str_obj_from_buf(expression->string->value));
   case BOOLEAN_EXP:
     return native_bool_to_boolean_obj(expression->boolean->value);
+  case IDENT_EXP:
+    return error_at(eval_identifier(expression->identifier, env),
+                    expression->identifier->token);
   case PREFIX_EXP:
-    right = eval_expression(expression->prefix->operand);
-    return eval_prefix_operation(expression->prefix->operator->literal, right);
+    right = eval_expression(expression->prefix->operand, env);
+    if (eval_abrupt(right)) {
+      return right;
+    }
+    return error_at(
+        eval_prefix_operation(expression->prefix->operator->literal, right),
+        expression->prefix->operator);
   case INFIX_EXP:
-    left = eval_expression(expression->infix->left);
-    right = eval_expression(expression->infix->right);
-    return eval_infix_operation(expression->infix->operator->literal, left, right);
+    left = eval_expression(expression->infix->left, env);
+    if (eval_abrupt(left)) {
+      return left;
+    }
+    right = eval_expression(expression->infix->right, env);
+    if (eval_abrupt(right)) {
+      obj_destroy(&left);
+      return right;
+    }
+    return error_at(
+        eval_infix_operation(expression->infix->operator->literal, left, right),
+        expression->infix->operator);
   case IF_EXP:
-    return eval_if_expression(expression);
+    return eval_if_expression(expression, env);
+  case FN_EXP:
+    return obj_new(FUNCTION_OBJ, fn_obj_new(expression->fn->params,
+                                            expression->fn->body, env));
+  case CALL_EXP:
+    return error_at(eval_call_expression(expression->call_exp, env),
+                    expression->call_exp->token);
+  case ARRAY_EXP:
+    return eval_array_literal(expression->array, env);
+  case MAP_EXP:
+    return error_at(eval_map_literal(expression->map, env),
+                    expression->map->token);
+  case INDEX_EXP:
+    left = eval_expression(expression->index_exp->left, env);
+    if (eval_abrupt(left)) {
+      return left;
+    }
+    right = eval_expression(expression->index_exp->index, env);
+    if (eval_abrupt(right)) {
+      obj_destroy(&left);
+      return right;
+    }
+    return error_at(eval_index_expression(left, right),
+                    expression->index_exp->token);
   }
   return &NULL_IMPL_OBJ;
 }
 
-obj_t *eval_return_statement(return_statement_t *return_statement) {
-  obj_t *value = eval_expression(return_statement->return_value);
-  return obj_new(RETURN_VALUE_OBJ, return_obj_new(value));
+__attribute__((noinline)) static obj_t *
+eval_expression_counted(count_t *count, expression_t *expression, env_t *env) {
+  if (expression->id == 0) {
+    expression->id = count_add_node(
+        count, expression_token(expression)->offset, expression->type);
+  }
+  uint64_t start = count_clock_ns();
+  count_enter(count, expression->id);
+  obj_t *result = eval_expression_node(expression, env);
+  count_exit(count, expression->id, start);
+  return result;
+}
+
+obj_t *eval_expression(expression_t *expression, env_t *env) {
+  if (eval_budget.nesting >= eval_budget.max_nesting) {
+    eval_budget.spent = ERROR_DEPTH_LIMIT;
+    eval_budget.too_nested = true;
+    eval_budget.countdown = 1;
+    return error_at(eval_budget_error(), expression_token(expression));
+  }
+  if (eval_budget_over_memory()) {
+    eval_budget.countdown = 1;
+    return error_at(eval_budget_error(), expression_token(expression));
+  }
+  eval_budget.nesting++;
+  obj_t *result = NULL;
+  count_t *count = count_active;
+  if (count != NULL) {
+    result = eval_expression_counted(count, expression, env);
+  } else {
+    result = eval_expression_node(expression, env);
+  }
+  eval_budget.nesting--;
+  return result;
+}
+
+/*
+ * Evaluates `expressions` into `argv`. On error every evaluated object
+ * is destroyed and the error is returned.
+ */
+static obj_t *eval_expressions(param_exp_t *expressions, obj_t **argv,
+                               env_t *env) {
+  for (size_t i = 0; i < expressions->len; i++) {
+    argv[i] = eval_expression(expressions->expressions[i], env);
+    if (eval_abrupt(argv[i])) {
+      obj_t *error_obj = argv[i];
+      while (i-- > 0) {
+        obj_destroy(&argv[i]);
+      }
+      return error_obj;
+    }
+  }
+  return NULL;
+}
+
+/* Pushes a frame for calling `fn` as `call_exp` does */
+static void eval_profile_push(profile_stack_t *stack, call_exp_t *call_exp,
+                              obj_t *fn) {
+  const char *name = call_exp->call_exp->type == IDENT_EXP
+                         ? call_exp->call_exp->identifier->value
+                         : NULL;
+  uint32_t offset = SOURCE_OFFSET_NONE;
+  if (fn->type == BUILTIN_OBJ) {
+    name = fn->builtin_obj->name;
+  } else if (fn->type == FUNCTION_OBJ) {
+    offset = fn->fn_obj->body->token->offset;
+  }
+  profile_push(stack, name, offset);
+}
+
+/* Arguments of calls with more than this many go on the heap */
+#define EVAL_INLINE_ARGS 8
+
+obj_t *eval_call_expression(call_exp_t *call_exp, env_t *env) {
+  obj_t *fn = eval_expression(call_exp->call_exp, env);
+  if (eval_abrupt(fn)) {
+    return fn;
+  }
+
+  size_t argc = call_exp->param_exps->len;
+  obj_t *inline_argv[EVAL_INLINE_ARGS];
+  obj_t **argv = inline_argv;
+  if (argc > EVAL_INLINE_ARGS) {
+    argv = mem_malloc(argc * sizeof(obj_t *));
+    assert(argv);
+  }
+  obj_t *error_obj = eval_expressions(call_exp->param_exps, argv, env);
+  if (error_obj != NULL) {
+    if (argv != inline_argv) {
+      mem_free(argv, argc * sizeof(obj_t *));
+    }
+    obj_destroy(&fn);
+    return error_obj;
+  }
+
+  profile_stack_t *stack = profile_stack;
+  if (stack != NULL) {
+    eval_profile_push(stack, call_exp, fn);
+  }
+  obj_t *result = apply_function(fn, argc, argv);
+  if (stack != NULL) {
+    profile_pop(stack);
+  }
+  for (size_t i = 0; i < argc; i++) {
+    obj_destroy(&argv[i]);
+  }
+  if (argv != inline_argv) {
+    mem_free(argv, argc * sizeof(obj_t *));
+  }
+  obj_destroy(&fn);
+  return result;
+}
+
+/* Values `eval_may_hold_function` looks at before it gives up */
+#define EVAL_ESCAPE_BUDGET 1024
+
+static bool eval_may_hold_function(obj_t *obj, size_t *budget);
+
+/* Unboxed values are plain integers, booleans or null */
+static bool eval_value_may_hold_function(array_value_t *value,
+                                         size_t *budget) {
+  if (*budget == 0) {
+    return true;
+  }
+  (*budget)--;
+  switch (value->type) {
+  case INT_OBJ:
+  case BOOL_OBJ:
+  case NULL_OBJ:
+    return false;
+  default:
+    return eval_may_hold_function(value->obj, budget);
+  }
+}
+
+/*
+ * Whether `obj` may hold a function, looking into arrays and maps.
+ * Past `*budget` values it gives up and answers true.
+ */
+static bool eval_may_hold_function(obj_t *obj, size_t *budget) {
+  switch (obj->type) {
+  case FUNCTION_OBJ:
+    return true;
+  case ARRAY_OBJ: {
+    array_obj_t *array = obj->array_obj;
+    array_value_t *values = array->buf->values + array->offset;
+    for (size_t i = 0; i < array->len; i++) {
+      if (eval_value_may_hold_function(&values[i], budget)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  case MAP_OBJ: {
+    map_t *map = obj->map_obj;
+    for (size_t i = 0; i < map->entries_len; i++) {
+      map_entry_t *entry = &map->entries[i];
+      /* Keys are never functions or containers */
+      if (entry->hash != 0 &&
+          eval_value_may_hold_function(&entry->value, budget)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  default:
+    return false;
+  }
+}
+
+/* Arguments are borrowed */
+obj_t *apply_function(obj_t *fn, size_t argc, obj_t **argv) {
+  char *str = NULL;
+  obj_t *error_obj = NULL;
+
+  if (fn->type == BUILTIN_OBJ) {
+    return fn->builtin_obj->fn(argc, argv);
+  }
+
+  if (fn->type != FUNCTION_OBJ) {
+    asprintf(&str, "not a function: %s", obj_type_to_str(fn->type));
+    error_obj = make_error(str);
+    free(str);
+    return error_obj;
+  }
+
+  fn_obj_t *function = fn->fn_obj;
+  size_t params_len = function->params != NULL ? function->params->len : 0;
+  if (params_len != argc) {
+    asprintf(&str, "wrong number of arguments: want=%zu, got=%zu", params_len,
+             argc);
+    error_obj = make_error(str);
+    free(str);
+    return error_obj;
+  }
+
+  if (--eval_budget.countdown == 0) {
+    error_obj = eval_budget_check();
+    if (error_obj != NULL) {
+      return error_obj;
+    }
+  }
+  if (eval_budget.depth >= eval_budget.max_depth) {
+    eval_budget.spent = ERROR_DEPTH_LIMIT;
+    return eval_budget_error();
+  }
+
+  env_t *env = env_new_enclosed(function->env);
+  for (size_t i = 0; i < argc; i++) {
+    env_set(env, function->params->parameters[i]->symbol, obj_copy(argv[i]));
+  }
+
+  eval_budget.depth++;
+  obj_t *result = eval_block_statement(function->body, env);
+  eval_budget.depth--;
+  eval_completion = EVAL_NORMAL;
+
+  /*
+   * Closures made during the call and kept in arrays or maps bound in
+   * its environment keep that environment alive, and it keeps them.
+   * Unless one may have escaped with the result, the bindings are
+   * destroyed to break those cycles. Otherwise they are left to
+   * `env_collect_cycles`.
+   */
+  size_t budget = EVAL_ESCAPE_BUDGET;
+  if (env->refcount > 1 &&
+      (result == NULL || !eval_may_hold_function(result, &budget))) {
+    env_destroy(&env);
+  } else {
+    if (env->refcount > 1) {
+      env_suspect(env);
+    }
+    env_release(&env);
+  }
+
+  return result != NULL ? result : &NULL_IMPL_OBJ;
+}
+
+obj_t *eval_array_literal(array_t *array, env_t *env) {
+  param_exp_t *elements = array->elements;
+  array_buf_t *buf = array_buf_new(elements->len);
+
+  for (size_t i = 0; i < elements->len; i++) {
+    obj_t *element = eval_expression(elements->expressions[i], env);
+    if (eval_abrupt(element)) {
+      array_buf_release(&buf);
+      return element;
+    }
+    buf->values[buf->len++] = array_value_from_obj(element);
+  }
+
+  return obj_new(ARRAY_OBJ, array_obj_new(buf, 0, buf->len));
+}
+
+static obj_t *make_unusable_key_error(obj_t *key) {
+  char *str = NULL;
+  asprintf(&str, "unusable as map key: %s", obj_type_to_str(key->type));
+  obj_t *error_obj = make_error(str);
+  free(str);
+  return error_obj;
+}
+
+obj_t *eval_map_literal(map_literal_t *map_literal, env_t *env) {
+  map_t *map = map_new(map_literal->len);
+
+  for (size_t i = 0; i < map_literal->len; i++) {
+    obj_t *key = eval_expression(map_literal->keys[i], env);
+    if (eval_abrupt(key)) {
+      map_release(&map);
+      return key;
+    }
+    if (!map_hashable(key->type)) {
+      obj_t *error_obj = make_unusable_key_error(key);
+      obj_destroy(&key);
+      map_release(&map);
+      return error_obj;
+    }
+    obj_t *value = eval_expression(map_literal->values[i], env);
+    if (eval_abrupt(value)) {
+      obj_destroy(&key);
+      map_release(&map);
+      return value;
+    }
+    map_set(map, array_value_from_obj(key), array_value_from_obj(value));
+  }
+
+  return obj_new(MAP_OBJ, map);
+}
+
+obj_t *eval_index_expression(obj_t *left, obj_t *index) {
+  obj_t *result = NULL;
+  if (left->type == ARRAY_OBJ && index->type == INT_OBJ) {
+    result = array_obj_get(left->array_obj, index->int_obj->value);
+  } else if (left->type == MAP_OBJ && !map_hashable(index->type)) {
+    result = make_unusable_key_error(index);
+  } else if (left->type == MAP_OBJ) {
+    array_value_t key = array_value_from_obj(index);
+    array_value_t *value = map_get(left->map_obj, &key);
+    result = value != NULL ? array_value_to_obj(value) : &NULL_IMPL_OBJ;
+    array_value_destroy(&key);
+    obj_destroy(&left);
+    return result;
+  } else {
+    char *str = NULL;
+    asprintf(&str, "index operator not supported: %s[%s]",
+             obj_type_to_str(left->type), obj_type_to_str(index->type));
+    result = make_error(str);
+    free(str);
+  }
+  obj_destroy(&left);
+  obj_destroy(&index);
+  return result;
+}
+
+obj_t *eval_return_statement(return_statement_t *return_statement, env_t *env) {
+  obj_t *value = eval_expression(return_statement->return_value, env);
+  if (!is_error(value)) {
+    eval_completion = EVAL_RETURN;
+  }
+  return value;
+}
+
+obj_t *eval_let_statement(let_statement_t *let_statement, env_t *env) {
+  obj_t *value = eval_expression(let_statement->value, env);
+  if (eval_abrupt(value)) {
+    return value;
+  }
+  env_set(env, let_statement->name->symbol, value);
+  return NULL;
 }
 
 obj_t *make_error(const char *str) {
   assert(str);
   return obj_new(ERROR_OBJ, error_obj_new(str));
 }
+
+bool is_error(obj_t *obj) { return obj != NULL && obj->type == ERROR_OBJ; }
@@ -3,22 +3,58 @@
 
 #include "utils.h"
 #include "ast.h"
+#include "environment.h"
 #include "object.h"
 
-obj_t *eval(program_t *program);
-obj_t *eval_statements(size_t len, statement_t **statements);
-obj_t *eval_statement(statement_t *statement);
-obj_t *eval_expression(expression_t *expression);
-obj_t *eval_if_expression(expression_t *expression);
+/*
+ * Bounds on one evaluation, 0 means unbounded. Monkey has no loops, so
+ * a step is a call of a Monkey function: every unbounded computation
+ * goes through one. The deadline is checked every EVAL_CHECK_STEPS
+ * steps and the depth on every call. The memory is checked before each
+ * expression and at the end, so a script overshoots `max_bytes` by at
+ * most what one expression allocates; as a string takes its length
+ * once flattened, concatenating is refused when the result would not
+ * fit. Running out yields an ERROR_OBJ of the matching ERROR_KIND.
+ * Without any limits, expressions, calls included, still nest no
+ * deeper than the thread's stack allows, failing with ERROR_DEPTH_LIMIT.
+ */
+typedef struct {
+  uint64_t max_steps;
+  uint64_t timeout_ns;
+  size_t max_depth;  /* of nested calls */
+  size_t max_bytes;  /* live in the current memory context, see memory.h */
+  size_t base_bytes; /* live already, not counted against `max_bytes` */
+} eval_limits_t;
+
+#define EVAL_CHECK_STEPS 1024
+
+/* Evaluates `program` with no limits */
+obj_t *eval(program_t *program, env_t *env);
+/* Evaluates `program` within `limits`, which may be NULL */
+obj_t *eval_limited(program_t *program, env_t *env,
+                    const eval_limits_t *limits);
+obj_t *eval_statements(size_t len, statement_t **statements, env_t *env);
+obj_t *eval_statement(statement_t *statement, env_t *env);
+obj_t *eval_expression(expression_t *expression, env_t *env);
+obj_t *eval_if_expression(expression_t *expression, env_t *env);
+obj_t *eval_identifier(identifier_t *identifier, env_t *env);
+obj_t *eval_call_expression(call_exp_t *call_exp, env_t *env);
+obj_t *eval_array_literal(array_t *array, env_t *env);
+obj_t *eval_map_literal(map_literal_t *map_literal, env_t *env);
+obj_t *eval_index_expression(obj_t *left, obj_t *index);
+obj_t *apply_function(obj_t *fn, size_t argc, obj_t **argv);
 
 obj_t *eval_bang_operator(obj_t *right);
 obj_t *eval_minus_operator(obj_t *right);
 obj_t *eval_prefix_operation(const char *operator, obj_t *right);
 obj_t *eval_infix_operation(const char *operator, obj_t *left, obj_t *right);
 obj_t *eval_integer_infix_expression(const char *operator, obj_t *left, obj_t *right);
+obj_t *eval_string_infix_expression(const char *operator, obj_t *left, obj_t *right);
 
-obj_t *eval_block_statement(block_statement_t *block_statement);
-obj_t *eval_return_statement(return_statement_t *return_statement);
+obj_t *eval_block_statement(block_statement_t *block_statement, env_t *env);
+obj_t *eval_return_statement(return_statement_t *return_statement, env_t *env);
+obj_t *eval_let_statement(let_statement_t *let_statement, env_t *env);
 
 obj_t *make_error(const char *str);
+bool is_error(obj_t *obj);
 #endif
@@ -1,8 +1,136 @@
 #include "hash.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <sys/random.h>
+#include <time.h>
+
+/* Written once before main, read only afterwards */
+static uint64_t process_seed;
+
+__attribute__((constructor)) static void hash_seed_init(void) {
+  const char *env = getenv("MONKEY_HASH_SEED");
+  if (env != NULL) {
+    process_seed = strtoull(env, NULL, 0);
+    return;
+  }
+  if (getrandom(&process_seed, sizeof(process_seed), GRND_NONBLOCK) !=
+      sizeof(process_seed)) {
+    process_seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32) ^
+                   (uint64_t)(uintptr_t)&process_seed;
+  }
+}
+
+uint64_t hash_seed(void) { return process_seed; }
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+#define WY_P3 0x589965cc75374cc3ull
+
+/* 64x64 -> 128 bit multiply, low half in `a` and high half in `b` */
+static inline void wy_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t wy_read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t wy_read4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/* Reads 1 to 3 bytes */
+static inline uint64_t wy_read3(const uint8_t *p, size_t len) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+static inline uint64_t wy_hash(const void *data, size_t len,
+                               uint64_t seed) {
+  const uint8_t *p = data;
+  uint64_t s = seed ^ wy_mix(seed ^ WY_P0, WY_P1);
+  uint64_t a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t mid = (len >> 3) << 2;
+      a = (wy_read4(p) << 32) | wy_read4(p + mid);
+      b = (wy_read4(p + len - 4) << 32) | wy_read4(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = wy_read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t s1 = s, s2 = s;
+      do {
+        s = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ s);
+        s1 = wy_mix(wy_read8(p + 16) ^ WY_P2, wy_read8(p + 24) ^ s1);
+        s2 = wy_mix(wy_read8(p + 32) ^ WY_P3, wy_read8(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      s ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      s = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ s);
+      p += 16;
+      i -= 16;
+    }
+    a = wy_read8(p + i - 16);
+    b = wy_read8(p + i - 8);
+  }
+
+  a ^= WY_P1;
+  b ^= s;
+  wy_mum(&a, &b);
+  return wy_mix(a ^ WY_P0 ^ len, b ^ WY_P1);
+}
+
+uint64_t hash_bytes64(const void *data, size_t len) {
+  return wy_hash(data, len, process_seed);
+}
+
+uint64_t hash_bytes_seeded(const void *data, size_t len, uint64_t seed) {
+  return wy_hash(data, len, seed);
+}
+
+uint32_t hash_bytes(const void *data, size_t len) {
+  uint64_t h = hash_bytes64(data, len);
+  return (uint32_t)(h ^ (h >> 32));
+}
+
 hd_t *hd_create(HD_DT dt, uintptr_t *data) {
   hd_t *hd = malloc(sizeof(hd_t));
   hd->dt = dt;
+  hd->ptr_destroy = NULL;
   switch (dt) {
   case HD_STRING_DT:
     hd->str = (char *)data;
@@ -13,6 +141,9 @@ hd_t *hd_create(HD_DT dt, uintptr_t *data) {
   case HD_BOOL_DT:
     hd->b = (bool)*data;
     break;
+  case HD_PTR_DT:
+    hd->ptr = (void *)data;
+    break;
   default:
     free(hd);
     assert("Unknown data type");
@@ -20,52 +151,95 @@ hd_t *hd_create(HD_DT dt, uintptr_t *data) {
   return hd;
 }
 
+/* Releases what `hd` owns, but not `hd` itself */
+static void hd_release(hd_t *hd) {
+  if (hd->dt == HD_STRING_DT) {
+    free(hd->str);
+  } else if (hd->dt == HD_PTR_DT && hd->ptr_destroy != NULL) {
+    hd->ptr_destroy(hd->ptr);
+  }
+}
+
 void hd_destroy(hd_t **h_p) {
   assert(h_p);
   if (*h_p) {
-    hd_t *hd = *h_p;
-    if (hd->dt == HD_STRING_DT) {
-      free(hd->str);
-    }
-    free(hd);
+    hd_release(*h_p);
+    free(*h_p);
     *h_p = NULL;
   }
 }
 
-he_t *he_create(const char *key, hd_t *data, he_t *next) {
-  assert(key);
-  assert(data);
+/* Bit i is set when byte i of the group matches */
+typedef uint32_t ht_mask_t;
 
-  he_t *he = malloc(sizeof(he_t));
-  he->key = strdup(key);
-  he->data = data;
-  he->next = next;
-  return he;
+#ifdef __SSE2__
+static inline ht_mask_t group_match(const int8_t *group, int8_t h2) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return (ht_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
 }
 
-void he_destroy(he_t **h_p) {
-  assert(h_p);
-  if (*h_p) {
-    he_t *he = *h_p;
-    free(he->key);
-    hd_destroy(&he->data);
-    if (he->next != NULL) {
-      he_destroy(&he->next);
-    }
-    free(he);
-    *h_p = NULL;
+/* EMPTY and DELETED are the only control bytes with the high bit set */
+static inline ht_mask_t group_match_empty_or_deleted(const int8_t *group) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return (ht_mask_t)_mm_movemask_epi8(ctrl);
+}
+#else
+static inline ht_mask_t group_match(const int8_t *group, int8_t h2) {
+  ht_mask_t mask = 0;
+  for (int i = 0; i < HT_GROUP_WIDTH; i++) {
+    mask |= (ht_mask_t)(group[i] == h2) << i;
+  }
+  return mask;
+}
+
+static inline ht_mask_t group_match_empty_or_deleted(const int8_t *group) {
+  ht_mask_t mask = 0;
+  for (int i = 0; i < HT_GROUP_WIDTH; i++) {
+    mask |= (ht_mask_t)(group[i] < 0) << i;
+  }
+  return mask;
+}
+#endif
+
+static inline ht_mask_t group_match_empty(const int8_t *group) {
+  return group_match(group, HT_CTRL_EMPTY);
+}
+
+static inline size_t ht_h1(uint32_t hash) { return hash >> 7; }
+static inline int8_t ht_h2(uint32_t hash) { return (int8_t)(hash & 0x7f); }
+
+static inline const char *he_key(const he_t *he) {
+  return he->key_len < HT_INLINE_KEY_LEN ? he->inline_key : he->heap_key;
+}
+
+static inline void ht_set_ctrl(ht_t *ht, size_t idx, int8_t ctrl) {
+  ht->ctrl[idx] = ctrl;
+  if (idx < HT_GROUP_WIDTH) {
+    ht->ctrl[ht->capacity + idx] = ctrl;
   }
 }
 
+static void ht_alloc(ht_t *ht, size_t capacity) {
+  ht->capacity = capacity;
+  ht->length = 0;
+  ht->growth_left = capacity * HT_MAX_LOAD_NUM / HT_MAX_LOAD_DEN;
+  ht->ctrl = malloc(capacity + HT_GROUP_WIDTH);
+  assert(ht->ctrl);
+  memset(ht->ctrl, HT_CTRL_EMPTY, capacity + HT_GROUP_WIDTH);
+  ht->slots = malloc(capacity * sizeof(he_t));
+  assert(ht->slots);
+}
+
+/* `n` is the number of entries the table should hold without growing */
 ht_t *ht_create(size_t n) {
   assert(n > 0);
   ht_t *ht = malloc(sizeof(ht_t));
   assert(ht);
-  ht->capacity = n;
-  ht->entries = calloc(sizeof(he_t *), n);
-  assert(ht->entries);
-  ht->length = 0;
-
+  size_t capacity = HT_GROUP_WIDTH;
+  while (n * HT_MAX_LOAD_DEN > capacity * HT_MAX_LOAD_NUM) {
+    capacity *= 2;
+  }
+  ht_alloc(ht, capacity);
   return ht;
 }
 
@@ -75,99 +249,189 @@ void ht_destroy(ht_t **ht_ptr) {
   if (*ht_ptr) {
     ht_t *ht = *ht_ptr;
     assert(ht);
-    for (int i = 0; i < ht->capacity; i++) {
-      if (ht->entries[i] != NULL) {
-        he_destroy(&ht->entries[i]);
+    for (size_t i = 0; i < ht->capacity; i++) {
+      if (ht->ctrl[i] >= 0) {
+        he_t *he = &ht->slots[i];
+        if (he->key_len >= HT_INLINE_KEY_LEN) {
+          free(he->heap_key);
+        }
+        hd_release(&he->data);
       }
     }
-    free(ht->entries);
+    free(ht->ctrl);
+    free(ht->slots);
     free(ht);
     *ht_ptr = NULL;
   }
 }
 
+/*
+ * Groups are probed quadratically: the distance between probed groups
+ * grows by one group each step, which visits every group of a power of
+ * two sized table.
+ */
+static ssize_t ht_find(ht_t *ht, const char *key, size_t key_len,
+                       uint32_t hash) {
+  size_t mask = ht->capacity - 1;
+  size_t pos = ht_h1(hash) & mask;
+  size_t stride = 0;
+  while (true) {
+    const int8_t *group = ht->ctrl + pos;
+    for (ht_mask_t match = group_match(group, ht_h2(hash)); match != 0;
+         match &= match - 1) {
+      size_t idx = (pos + __builtin_ctz(match)) & mask;
+      he_t *he = &ht->slots[idx];
+      if (he->hash == hash && he->key_len == key_len &&
+          memcmp(he_key(he), key, key_len) == 0) {
+        return (ssize_t)idx;
+      }
+    }
+    if (group_match_empty(group) != 0) {
+      return -1;
+    }
+    stride += HT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+/* First EMPTY or DELETED slot in the probe sequence of `hash` */
+static size_t ht_find_free(ht_t *ht, uint32_t hash) {
+  size_t mask = ht->capacity - 1;
+  size_t pos = ht_h1(hash) & mask;
+  size_t stride = 0;
+  while (true) {
+    ht_mask_t free_mask = group_match_empty_or_deleted(ht->ctrl + pos);
+    if (free_mask != 0) {
+      return (pos + __builtin_ctz(free_mask)) & mask;
+    }
+    stride += HT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+/*
+ * Rebuilds the table without tombstones, doubling it unless most of the
+ * used up growth was taken by deleted entries.
+ */
+static void ht_rehash(ht_t *ht) {
+  int8_t *ctrl = ht->ctrl;
+  he_t *slots = ht->slots;
+  size_t capacity = ht->capacity;
+  size_t length = ht->length;
+
+  size_t new_capacity =
+      length * 2 * HT_MAX_LOAD_DEN < capacity * HT_MAX_LOAD_NUM ? capacity
+                                                                 : capacity * 2;
+  ht_alloc(ht, new_capacity);
+  for (size_t i = 0; i < capacity; i++) {
+    if (ctrl[i] >= 0) {
+      size_t idx = ht_find_free(ht, slots[i].hash);
+      ht_set_ctrl(ht, idx, ht_h2(slots[i].hash));
+      ht->slots[idx] = slots[i];
+    }
+  }
+  ht->length = length;
+  ht->growth_left -= length;
+  free(ctrl);
+  free(slots);
+}
+
+/*
+ * Takes ownership of `data`, whose contents are moved into the table.
+ * Adding an existing key replaces its data and returns false.
+ */
 bool ht_add(ht_t *ht, char *key, hd_t *data) {
   assert(ht);
   assert(key);
   assert(data);
 
-  he_t *he = malloc(sizeof(he_t));
-  he->key = strdup(key);
-  he->data = data;
-  he->next = NULL;
-
-  uint32_t hash = gnu_hash((const uint8_t *)key);
+  size_t key_len = strlen(key);
+  uint32_t hash = hash_bytes(key, key_len);
+  ssize_t found = ht_find(ht, key, key_len, hash);
+  if (found >= 0) {
+    hd_release(&ht->slots[found].data);
+    ht->slots[found].data = *data;
+    free(data);
+    return false;
+  }
 
-  size_t entry_idx = hash % ht->capacity;
+  size_t idx = ht_find_free(ht, hash);
+  if (ht->growth_left == 0 && ht->ctrl[idx] == HT_CTRL_EMPTY) {
+    ht_rehash(ht);
+    idx = ht_find_free(ht, hash);
+  }
+  if (ht->ctrl[idx] == HT_CTRL_EMPTY) {
+    ht->growth_left--;
+  }
+  ht_set_ctrl(ht, idx, ht_h2(hash));
 
-  if (ht->entries[entry_idx] == NULL) {
-    ht->entries[entry_idx] = he;
+  he_t *he = &ht->slots[idx];
+  he->key_len = (uint32_t)key_len;
+  he->hash = hash;
+  if (key_len < HT_INLINE_KEY_LEN) {
+    memcpy(he->inline_key, key, key_len + 1);
   } else {
-    he_t *he_cur = ht->entries[entry_idx];
-    while (he_cur->next != NULL) {
-      he_cur = he_cur->next;
-    }
-    he_cur->next = he;
+    he->heap_key = strdup(key);
+    assert(he->heap_key);
   }
-
+  he->data = *data;
+  free(data);
+  ht->length++;
   return true;
 }
 
 bool ht_exists(ht_t *ht, char *key) {
   assert(ht);
   assert(key);
-
-  uint32_t hash = gnu_hash((const uint8_t *)key);
-  size_t entry_idx = hash % ht->capacity;
   size_t key_len = strlen(key);
-  he_t *he_cur = ht->entries[entry_idx];
-
-  while (he_cur != NULL) {
-    if (strncmp(he_cur->key, key, key_len) == 0) {
-      return true;
-    }
-    he_cur = he_cur->next;
-  }
-
-  return false;
+  return ht_find(ht, key, key_len, hash_bytes(key, key_len)) >= 0;
 }
 
+/* The returned data stays valid until the next `ht_add` or `ht_delete` */
 hd_t *ht_get(ht_t *ht, char *key) {
   assert(ht);
   assert(key);
 
-  uint32_t hash = gnu_hash((const uint8_t *)key);
-  size_t entry_idx = hash % ht->capacity;
   size_t key_len = strlen(key);
-  he_t *he_cur = ht->entries[entry_idx];
-
-  while (he_cur != NULL) {
-    if (strncmp(he_cur->key, key, key_len) == 0) {
-      return he_cur->data;
-    }
-    he_cur = he_cur->next;
-  }
-
-  return NULL;
+  ssize_t idx = ht_find(ht, key, key_len, hash_bytes(key, key_len));
+  return idx < 0 ? NULL : &ht->slots[idx].data;
 }
 
 bool ht_delete(ht_t *ht, char *key) {
   assert(ht);
   assert(key);
 
-  uint32_t hash = gnu_hash((const uint8_t *)key);
-  size_t entry_idx = hash % ht->capacity;
   size_t key_len = strlen(key);
+  ssize_t found = ht_find(ht, key, key_len, hash_bytes(key, key_len));
+  if (found < 0) {
+    return false;
+  }
 
-  he_t *he_cur = ht->entries[entry_idx];
-
-  while (he_cur != NULL) {
-    if (strncmp(he_cur->key, key, key_len) == 0) {
-      he_destroy(&ht->entries[entry_idx]);
-      return true;
-    }
-    he_cur = he_cur->next;
+  size_t idx = (size_t)found;
+  he_t *he = &ht->slots[idx];
+  if (he->key_len >= HT_INLINE_KEY_LEN) {
+    free(he->heap_key);
   }
+  hd_release(&he->data);
+  ht->length--;
 
-  return false;
+  /*
+   * If the slot lies in a run of fewer than a group's width of full
+   * slots, no probe could have passed over it looking for a later key,
+   * so it can become EMPTY again instead of a tombstone.
+   */
+  size_t mask = ht->capacity - 1;
+  ht_mask_t empty_after = group_match_empty(ht->ctrl + idx);
+  ht_mask_t empty_before =
+      group_match_empty(ht->ctrl + ((idx - HT_GROUP_WIDTH) & mask));
+  if (empty_after != 0 && empty_before != 0 &&
+      (size_t)__builtin_ctz(empty_after) +
+              (__builtin_clz(empty_before) - (32 - HT_GROUP_WIDTH)) <
+          HT_GROUP_WIDTH) {
+    ht_set_ctrl(ht, idx, HT_CTRL_EMPTY);
+    ht->growth_left++;
+  } else {
+    ht_set_ctrl(ht, idx, HT_CTRL_DELETED);
+  }
+  return true;
 }
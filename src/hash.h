@@ -3,13 +3,12 @@
 
 #include "utils.h"
 
-#define SIZE 10000
-
 /* Hash Data */
 typedef enum {
   HD_STRING_DT,
   HD_INT_DT,
   HD_BOOL_DT,
+  HD_PTR_DT, /* opaque pointer, released through `ptr_destroy` */
 } HD_DT;
 
 typedef struct {
@@ -18,27 +17,64 @@ typedef struct {
     char *str;
     int32_t num;
     bool b;
+    void *ptr;
   };
+  void (*ptr_destroy)(void *ptr);
 } hd_t;
 
+/*
+ * wyhash over `len` bytes, folded to 32 bits. The seed is chosen at
+ * random when the process starts (or taken from MONKEY_HASH_SEED), so
+ * scripts cannot precompute colliding keys. `hash_bytes64` is the full
+ * 64 bit digest, and `hash_bytes_seeded` the same digest under `seed`.
+ */
+uint32_t hash_bytes(const void *data, size_t len);
+uint64_t hash_bytes64(const void *data, size_t len);
+uint64_t hash_bytes_seeded(const void *data, size_t len, uint64_t seed);
+uint64_t hash_seed(void);
+
 hd_t *hd_create(HD_DT dt, uintptr_t *data);
 void hd_destroy(hd_t **h_p);
 
-/* Hash entry */
-typedef struct _he_t {
-  char *key;
-  hd_t *data;
-  struct _he_t *next;
-} he_t;
+/*
+ * Control bytes are probed a group at a time, with SSE2 when available.
+ * A full slot's control byte holds 7 bits of its key's hash.
+ */
+#define HT_GROUP_WIDTH 16
+#define HT_CTRL_EMPTY ((int8_t)-128)
+#define HT_CTRL_DELETED ((int8_t)-2)
+
+/* Keys shorter than this are stored in the slot itself */
+#define HT_INLINE_KEY_LEN 16
+
+/* The table grows once more than 7/8 of its slots are in use */
+#define HT_MAX_LOAD_NUM 7
+#define HT_MAX_LOAD_DEN 8
 
-he_t *he_create(const char *key, hd_t *data, he_t *next);
-void he_destroy(he_t **h_p);
+/* Hash entry, stored inline in the table */
+typedef struct {
+  union {
+    char inline_key[HT_INLINE_KEY_LEN]; /* NUL terminated */
+    char *heap_key;
+  };
+  uint32_t key_len;
+  uint32_t hash;
+  hd_t data;
+} he_t;
 
-/* Hash table */
+/*
+ * Hash table
+ *
+ * SwissTable style open addressing: `ctrl` has one byte per slot,
+ * followed by a copy of the first group so that a group can be loaded
+ * from any slot without wrapping.
+ */
 struct _ht_t {
-  he_t **entries;
-  size_t capacity;
+  int8_t *ctrl;
+  he_t *slots;
+  size_t capacity; /* always a power of two, at least HT_GROUP_WIDTH */
   size_t length;
+  size_t growth_left; /* EMPTY slots that may still be filled */
 };
 
 typedef struct _ht_t ht_t;
@@ -0,0 +1,367 @@
+#include "intern.h"
+#include "hash.h"
+#include "memory.h"
+
+struct _intern_table_t {
+  uint32_t *slots; /* symbol + 1, 0 for empty slots */
+  size_t capacity; /* always a power of two */
+  str_buf_t **symbols;
+  size_t length;
+  size_t symbols_capacity;
+};
+
+/*
+ * Each thread interns into its own default table unless it has made
+ * another one current, so threads never share a table.
+ */
+static _Thread_local intern_table_t intern_default = {.slots = NULL,
+                                                      .capacity = 0,
+                                                      .symbols = NULL,
+                                                      .length = 0,
+                                                      .symbols_capacity = 0};
+static _Thread_local intern_table_t *intern_current = NULL;
+
+static inline intern_table_t *intern_table(void) {
+  return intern_current != NULL ? intern_current : &intern_default;
+}
+
+uint32_t str_hash(const char *data, size_t len) {
+  uint32_t h = hash_bytes(data, len);
+  /* 0 is reserved for "not computed yet" */
+  return h == 0 ? 1 : h;
+}
+
+static inline size_t str_buf_size(const str_buf_t *buf) {
+  return sizeof(str_buf_t) + buf->flat_len;
+}
+
+str_buf_t *str_buf_new(const char *data, size_t len) {
+  str_buf_t *buf = mem_malloc_as(MEM_STRING, sizeof(str_buf_t) + len + 1);
+  assert(buf);
+  buf->refcount = 1;
+  buf->hash = 0;
+  buf->len = len;
+  buf->data = buf->flat;
+  buf->left = NULL;
+  buf->right = NULL;
+  buf->flat_len = len + 1;
+  if (data != NULL) {
+    memcpy(buf->data, data, len);
+  }
+  buf->data[len] = '\0';
+  return buf;
+}
+
+/*
+ * Both concatenation constructors take over the caller's references to
+ * their buffer arguments. They are O(1); the bytes are copied once when
+ * the result is flattened.
+ */
+str_buf_t *str_buf_concat(str_buf_t *left, str_buf_t *right) {
+  assert(left);
+  assert(right);
+  str_buf_t *buf = mem_malloc_as(MEM_STRING, sizeof(str_buf_t));
+  assert(buf);
+  buf->refcount = 1;
+  buf->hash = 0;
+  buf->len = left->len + right->len;
+  buf->data = NULL;
+  buf->left = left;
+  buf->right = right;
+  buf->flat_len = 0;
+  return buf;
+}
+
+str_buf_t *str_buf_append(str_buf_t *left, const char *tail, size_t len) {
+  assert(left);
+  assert(tail);
+  str_buf_t *buf = mem_malloc_as(MEM_STRING, sizeof(str_buf_t) + len);
+  assert(buf);
+  buf->refcount = 1;
+  buf->hash = 0;
+  buf->len = left->len + len;
+  buf->data = NULL;
+  buf->left = left;
+  buf->right = NULL;
+  buf->flat_len = len;
+  memcpy(buf->flat, tail, len);
+  return buf;
+}
+
+str_buf_t *str_buf_retain(str_buf_t *buf) {
+  assert(buf);
+  if (buf->refcount != STR_BUF_IMMORTAL) {
+    buf->refcount++;
+  }
+  return buf;
+}
+
+/*
+ * Ropes built by appending in a loop are as deep as the number of
+ * appends, so releasing is iterative. Dead rope nodes are chained
+ * through their (unused) `data` field until their children have been
+ * released.
+ */
+void str_buf_release(str_buf_t **buf_p) {
+  assert(buf_p);
+  str_buf_t *dead = NULL;
+  str_buf_t *buf = *buf_p;
+  *buf_p = NULL;
+
+  while (buf != NULL || dead != NULL) {
+    if (buf == NULL) {
+      /* Pop a dead rope node and release its children */
+      str_buf_t *node = dead;
+      dead = (str_buf_t *)node->data;
+      buf = node->left;
+      str_buf_t *right = node->right;
+      mem_free(node, str_buf_size(node));
+      if (right != NULL && right->refcount != STR_BUF_IMMORTAL &&
+          --right->refcount == 0) {
+        if (right->left == NULL) {
+          if (right->data != right->flat) {
+            mem_free(right->data, right->len + 1);
+          }
+          mem_free(right, str_buf_size(right));
+        } else {
+          right->data = (char *)dead;
+          dead = right;
+        }
+      }
+    }
+
+    if (buf->refcount != STR_BUF_IMMORTAL && --buf->refcount == 0) {
+      if (buf->data != NULL && buf->data != buf->flat) {
+        /* Flattened rope node */
+        mem_free(buf->data, buf->len + 1);
+      }
+      if (buf->left == NULL) {
+        mem_free(buf, str_buf_size(buf));
+      } else {
+        buf->data = (char *)dead;
+        dead = buf;
+      }
+    }
+    buf = NULL;
+  }
+}
+
+bool str_buf_is_interned(const str_buf_t *buf) {
+  assert(buf);
+  return buf->refcount == STR_BUF_IMMORTAL;
+}
+
+bool str_buf_is_rope(const str_buf_t *buf) {
+  assert(buf);
+  return buf->data == NULL;
+}
+
+/*
+ * Copies the leaves of a rope into one buffer. Leaves are written from
+ * the end towards the start so that left deep ropes (the result of
+ * repeated appends) only need a constant amount of stack.
+ */
+static void str_buf_flatten(str_buf_t *buf) {
+  char *data = mem_malloc_as(MEM_STRING, buf->len + 1);
+  assert(data);
+  data[buf->len] = '\0';
+
+  size_t stack_cap = 16;
+  size_t stack_len = 0;
+  str_buf_t **stack = malloc(stack_cap * sizeof(str_buf_t *));
+  assert(stack);
+
+  size_t pos = buf->len;
+  stack[stack_len++] = buf;
+  while (stack_len > 0) {
+    str_buf_t *node = stack[--stack_len];
+    if (node->data != NULL) {
+      pos -= node->len;
+      memcpy(data + pos, node->data, node->len);
+      continue;
+    }
+    if (node->right == NULL) {
+      size_t tail_len = node->len - node->left->len;
+      pos -= tail_len;
+      memcpy(data + pos, node->flat, tail_len);
+    }
+    if (stack_len + 2 > stack_cap) {
+      stack_cap *= 2;
+      stack = realloc(stack, stack_cap * sizeof(str_buf_t *));
+      assert(stack);
+    }
+    stack[stack_len++] = node->left;
+    if (node->right != NULL) {
+      stack[stack_len++] = node->right;
+    }
+  }
+  assert(pos == 0);
+  free(stack);
+
+  str_buf_t *left = buf->left;
+  str_buf_t *right = buf->right;
+  buf->data = data;
+  buf->left = NULL;
+  buf->right = NULL;
+  str_buf_release(&left);
+  str_buf_release(&right);
+}
+
+const char *str_buf_data(str_buf_t *buf) {
+  assert(buf);
+  if (buf->data == NULL) {
+    str_buf_flatten(buf);
+  }
+  return buf->data;
+}
+
+uint32_t str_buf_hash(str_buf_t *buf) {
+  assert(buf);
+  if (buf->hash == 0) {
+    buf->hash = str_hash(str_buf_data(buf), buf->len);
+  }
+  return buf->hash;
+}
+
+static void intern_table_grow(intern_table_t *table) {
+  size_t capacity =
+      table->capacity == 0 ? INTERN_INITIAL_CAPACITY : table->capacity * 2;
+  uint32_t *slots = mem_calloc(capacity, sizeof(uint32_t));
+  assert(slots);
+
+  for (size_t i = 0; i < table->capacity; i++) {
+    uint32_t slot = table->slots[i];
+    if (slot == 0) {
+      continue;
+    }
+    size_t idx = table->symbols[slot - 1]->hash & (capacity - 1);
+    while (slots[idx] != 0) {
+      idx = (idx + 1) & (capacity - 1);
+    }
+    slots[idx] = slot;
+  }
+
+  mem_free(table->slots, table->capacity * sizeof(uint32_t));
+  table->slots = slots;
+  table->capacity = capacity;
+}
+
+intern_table_t *intern_table_new(void) {
+  intern_table_t *table = mem_calloc(1, sizeof(intern_table_t));
+  assert(table);
+  return table;
+}
+
+static void intern_table_clear(intern_table_t *table) {
+  /* Interned buffers are always flat */
+  for (size_t i = 0; i < table->length; i++) {
+    mem_free(table->symbols[i], str_buf_size(table->symbols[i]));
+  }
+  mem_free(table->symbols, table->symbols_capacity * sizeof(str_buf_t *));
+  mem_free(table->slots, table->capacity * sizeof(uint32_t));
+  table->slots = NULL;
+  table->capacity = 0;
+  table->symbols = NULL;
+  table->length = 0;
+  table->symbols_capacity = 0;
+}
+
+void intern_table_destroy(intern_table_t **table_p) {
+  assert(table_p);
+  if (*table_p) {
+    intern_table_t *table = *table_p;
+    assert(table != intern_current);
+    intern_table_clear(table);
+    mem_free(table, sizeof(intern_table_t));
+    *table_p = NULL;
+  }
+}
+
+/*
+ * Makes `table` the calling thread's current table, or restores the
+ * thread's default table if `table` is NULL. Returns the table that
+ * was current before.
+ */
+intern_table_t *intern_table_swap(intern_table_t *table) {
+  intern_table_t *previous = intern_current;
+  intern_current = table;
+  return previous;
+}
+
+/*
+ * Interns every symbol of `from` into the current table, in symbol
+ * order. Returns the current table's symbol for each of them, indexed
+ * by their symbol in `from`, and sets `len_p` to how many there are.
+ */
+symbol_t *intern_table_merge(intern_table_t *from, size_t *len_p) {
+  assert(from);
+  assert(from != intern_table());
+  assert(len_p);
+  symbol_t *symbols = malloc((from->length > 0 ? from->length : 1) *
+                             sizeof(symbol_t));
+  assert(symbols);
+  for (size_t i = 0; i < from->length; i++) {
+    str_buf_t *buf = from->symbols[i];
+    symbols[i] = intern_symbol(buf->data, buf->len);
+  }
+  *len_p = from->length;
+  return symbols;
+}
+
+symbol_t intern_symbol(const char *data, size_t len) {
+  assert(data);
+  intern_table_t *table = intern_table();
+
+  /* Keep the load factor under 1/2 so probe sequences stay short */
+  if ((table->length + 1) * 2 > table->capacity) {
+    intern_table_grow(table);
+  }
+
+  uint32_t hash = str_hash(data, len);
+  size_t idx = hash & (table->capacity - 1);
+  uint32_t slot = 0;
+
+  while ((slot = table->slots[idx]) != 0) {
+    str_buf_t *buf = table->symbols[slot - 1];
+    if (buf->hash == hash && buf->len == len &&
+        memcmp(buf->data, data, len) == 0) {
+      return slot - 1;
+    }
+    idx = (idx + 1) & (table->capacity - 1);
+  }
+
+  if (table->length == table->symbols_capacity) {
+    size_t capacity = table->symbols_capacity == 0
+                          ? INTERN_INITIAL_CAPACITY
+                          : table->symbols_capacity * 2;
+    table->symbols = mem_reallocarray(table->symbols, table->symbols_capacity,
+                                      capacity, sizeof(str_buf_t *));
+    assert(table->symbols);
+    table->symbols_capacity = capacity;
+  }
+
+  str_buf_t *buf = str_buf_new(data, len);
+  buf->hash = hash;
+  buf->refcount = STR_BUF_IMMORTAL;
+  symbol_t symbol = (symbol_t)table->length++;
+  table->symbols[symbol] = buf;
+  table->slots[idx] = symbol + 1;
+  return symbol;
+}
+
+str_buf_t *intern(const char *data, size_t len) {
+  symbol_t symbol = intern_symbol(data, len);
+  return intern_table()->symbols[symbol];
+}
+
+str_buf_t *symbol_buf(symbol_t symbol) {
+  intern_table_t *table = intern_table();
+  assert(symbol < table->length);
+  return table->symbols[symbol];
+}
+
+const char *symbol_name(symbol_t symbol) { return symbol_buf(symbol)->data; }
+
+size_t intern_count(void) { return intern_table()->length; }
+
+void intern_destroy(void) { intern_table_clear(intern_table()); }
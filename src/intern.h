@@ -0,0 +1,75 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "utils.h"
+
+#define INTERN_INITIAL_CAPACITY 64
+
+/*
+ * Interned buffers are owned by the intern table and never freed
+ * through `str_buf_release`.
+ */
+#define STR_BUF_IMMORTAL UINT32_MAX
+
+/*
+ * Immutable, reference counted string storage.
+ *
+ * A buffer is either flat (`data` is set) or a rope node built by
+ * concatenation: `left` followed by `right`, or by the `len - left->len`
+ * tail bytes stored in `flat` when `right` is NULL. Rope nodes are
+ * flattened on first access to their bytes through `str_buf_data`.
+ */
+typedef struct _str_buf_t {
+  uint32_t refcount;
+  uint32_t hash; /* 0 until computed */
+  size_t len;
+  char *data; /* NUL terminated, NULL for unflattened rope nodes */
+  struct _str_buf_t *left;
+  struct _str_buf_t *right;
+  size_t flat_len; /* bytes allocated for `flat` */
+  char flat[];
+} str_buf_t;
+
+str_buf_t *str_buf_new(const char *data, size_t len);
+str_buf_t *str_buf_concat(str_buf_t *left, str_buf_t *right);
+str_buf_t *str_buf_append(str_buf_t *left, const char *tail, size_t len);
+str_buf_t *str_buf_retain(str_buf_t *buf);
+void str_buf_release(str_buf_t **buf_p);
+bool str_buf_is_interned(const str_buf_t *buf);
+bool str_buf_is_rope(const str_buf_t *buf);
+const char *str_buf_data(str_buf_t *buf);
+uint32_t str_buf_hash(str_buf_t *buf);
+
+uint32_t str_hash(const char *data, size_t len);
+
+/*
+ * Intern tables. Equal strings interned through `intern` share one
+ * buffer, so comparing two interned buffers is a pointer compare.
+ *
+ * Every interned string is also a symbol: a dense, stable index that
+ * identifiers are resolved to at lex time. Symbols are only meaningful
+ * in the table that produced them.
+ *
+ * The functions below work on the calling thread's current table, see
+ * `intern_table_swap`. `intern_destroy` empties it and invalidates all
+ * of its symbols.
+ */
+typedef uint32_t symbol_t;
+
+#define SYMBOL_NONE UINT32_MAX
+
+typedef struct _intern_table_t intern_table_t;
+
+intern_table_t *intern_table_new(void);
+void intern_table_destroy(intern_table_t **table_p);
+intern_table_t *intern_table_swap(intern_table_t *table);
+symbol_t *intern_table_merge(intern_table_t *from, size_t *len_p);
+
+symbol_t intern_symbol(const char *data, size_t len);
+str_buf_t *intern(const char *data, size_t len);
+str_buf_t *symbol_buf(symbol_t symbol);
+const char *symbol_name(symbol_t symbol);
+size_t intern_count(void);
+void intern_destroy(void);
+
+#endif
@@ -1,13 +1,16 @@
 #include "lexer.h"
-#include "hash.h"
+#include "memory.h"
 
 struct _lexer_t {
   const char *input;
+  uint32_t input_len;
   uint32_t position; /* current position in input (points to current char) */
   uint32_t read_position; /* current reading position in input (after current
                              char) */
   char ch;                /* current char under examination */
-  ht_t *keywords;
+  uint32_t token_start;   /* where the last token returned starts */
+  uint32_t base;          /* added to the offsets of tokens */
+  keywords_t keywords;
 };
 
 bool is_letter(char ch) {
@@ -16,13 +19,12 @@ bool is_letter(char ch) {
 
 bool is_digit(char ch) { return '0' <= ch && ch <= '9'; }
 
-TOKEN lexer_lookup_ident(lexer_t *l, char *ident) {
+TOKEN lexer_lookup_ident(lexer_t *l, symbol_t ident) {
   /*
-   * Lookup the the keywords dict to check whether `ident` is a
+   * Lookup the the keywords table to check whether `ident` is a
    * keyword. If not, we treat it as an `IDENT`.
    */
-  assert(ident);
-  TOKEN tok = keywords_get(l->keywords, ident);
+  TOKEN tok = keywords_get(&l->keywords, ident);
   return tok != ILLEGAL_TOKEN ? tok : IDENT_TOKEN;
 }
 
@@ -34,25 +36,58 @@ void lexer_skip_whitespace(lexer_t *l) {
 
 lexer_t *lexer_new(const char *input) {
   assert(input);
+  return lexer_new_range(input, 0, (uint32_t)strlen(input));
+}
+
+/*
+ * Lexes only input[start, end), as if the input ended there. Offsets
+ * stay relative to `input`.
+ */
+lexer_t *lexer_new_range(const char *input, uint32_t start, uint32_t end) {
+  assert(input);
+  assert(start <= end);
 
-  lexer_t *l = malloc(sizeof(lexer_t));
-  l->position = 0;
-  l->read_position = 0;
+  lexer_t *l = mem_malloc(sizeof(lexer_t));
+  l->position = start;
+  l->read_position = start;
   l->ch = 0;
+  l->token_start = start;
+  l->base = 0;
   l->input = input;
-  l->keywords = keywords_initialize();
+  l->input_len = end;
+  keywords_initialize(&l->keywords);
 
   lexer_read_char(l);
 
   return l;
 }
 
+const char *lexer_input(lexer_t *l, uint32_t *len) {
+  assert(l);
+  assert(len);
+  *len = l->input_len;
+  return l->input;
+}
+
+/*
+ * Offsets of tokens are input offsets plus `base`, to tell apart tokens
+ * of different inputs. Spans (`lexer_token_start`) stay input offsets.
+ */
+void lexer_set_base(lexer_t *l, uint32_t base) {
+  assert(l);
+  l->base = base;
+}
+
+uint32_t lexer_base(lexer_t *l) {
+  assert(l);
+  return l->base;
+}
+
 void lexer_destroy(lexer_t **l_p) {
   assert(l_p);
   if (*l_p) {
     lexer_t *l = *l_p;
-    keywords_destroy(&l->keywords);
-    free(l);
+    mem_free(l, sizeof(lexer_t));
     *l_p = NULL;
   }
 }
@@ -60,7 +95,7 @@ void lexer_destroy(lexer_t **l_p) {
 void lexer_read_char(lexer_t *l) {
   assert(l);
   assert(l->input);
-  if (l->read_position >= strlen(l->input)) {
+  if (l->read_position >= l->input_len) {
     l->ch = 0;
   } else {
     l->ch = l->input[l->read_position];
@@ -68,20 +103,15 @@ void lexer_read_char(lexer_t *l) {
   l->position = l->read_position++;
 }
 
-char *lexer_read_identifier(lexer_t *l) {
+/* Interns the identifier straight from the input, without a copy */
+symbol_t lexer_read_identifier(lexer_t *l) {
   assert(l);
   assert(l->input);
-  char var[255];
-  int i = 0;
+  uint32_t start = l->position;
   while (is_letter(l->ch)) {
-    if (i == 255) {
-      return NULL;
-    }
-    var[i++] = l->ch;
     lexer_read_char(l);
   }
-  var[i] = '\0';
-  return strdup(var);
+  return intern_symbol(l->input + start, l->position - start);
 }
 
 char *lexer_read_number(lexer_t *l) {
@@ -98,29 +128,65 @@ char *lexer_read_number(lexer_t *l) {
     lexer_read_char(l);
   }
   number[i] = '\0';
-  return strdup(number);
+  return mem_strdup(number);
+}
+
+/*
+ * Reads the contents of a string literal. `l->ch` is the opening quote
+ * on entry and the closing quote on exit. Returns NULL if the literal
+ * is not terminated.
+ */
+char *lexer_read_string(lexer_t *l) {
+  assert(l);
+  assert(l->ch == '"');
+  uint32_t start = l->position + 1;
+  do {
+    lexer_read_char(l);
+  } while (l->ch != '"' && l->ch != 0);
+
+  if (l->ch == 0) {
+    return NULL;
+  }
+  return mem_strndup(l->input + start, l->position - start);
+}
+
+/* Continues lexing from `offset`, which must be a token boundary */
+void lexer_seek(lexer_t *l, uint32_t offset) {
+  assert(l);
+  assert(offset <= l->input_len);
+  l->read_position = offset;
+  lexer_read_char(l);
+}
+
+/* Offsets past the end of the input are reported as the end */
+uint32_t lexer_token_start(lexer_t *l) {
+  return l->token_start < l->input_len ? l->token_start : l->input_len;
+}
+
+/* Just past the last token returned */
+uint32_t lexer_position(lexer_t *l) {
+  return l->position < l->input_len ? l->position : l->input_len;
 }
 
 char lexer_peek_char(lexer_t *l) {
-  if (l->read_position >= strlen(l->input)) {
+  if (l->read_position >= l->input_len) {
     return '\0';
   } else {
     return l->input[l->read_position];
   }
 }
 
-token_t *lexer_next_token(lexer_t *l) {
+static token_t *lexer_lex_token(lexer_t *l) {
 
   token_t *tok = NULL;
 
   lexer_skip_whitespace(l);
+  l->token_start = l->position;
 
   switch (l->ch) {
   case '=':
     if (lexer_peek_char(l) == '=') {
-      tok = malloc(sizeof(token_t));
-      tok->type = EQ_TOKEN;
-      tok->literal = strdup("==");
+      tok = token_new_literal(EQ_TOKEN, mem_strdup("=="));
       lexer_read_char(l);
     } else {
       tok = token_new(ASSIGN_TOKEN, l->ch);
@@ -140,9 +206,7 @@ token_t *lexer_next_token(lexer_t *l) {
     break;
   case '!':
     if (lexer_peek_char(l) == '=') {
-      tok = malloc(sizeof(token_t));
-      tok->type = NOT_EQ_TOKEN;
-      tok->literal = strdup("!=");
+      tok = token_new_literal(NOT_EQ_TOKEN, mem_strdup("!="));
       lexer_read_char(l);
     } else {
       tok = token_new(BANG_TOKEN, l->ch);
@@ -166,43 +230,59 @@ token_t *lexer_next_token(lexer_t *l) {
   case ';':
     tok = token_new(SEMICOLON_TOKEN, l->ch);
     break;
+  case ':':
+    tok = token_new(COLON_TOKEN, l->ch);
+    break;
   case '{':
     tok = token_new(LBRACE_TOKEN, l->ch);
     break;
   case '}':
     tok = token_new(RBRACE_TOKEN, l->ch);
     break;
+  case '[':
+    tok = token_new(LBRACKET_TOKEN, l->ch);
+    break;
+  case ']':
+    tok = token_new(RBRACKET_TOKEN, l->ch);
+    break;
+  case '"': {
+    char *literal = lexer_read_string(l);
+    if (literal == NULL) {
+      /* Unterminated string literal */
+      return token_new_literal(ILLEGAL_TOKEN, mem_strdup(""));
+    }
+    tok = token_new_literal(STRING_TOKEN, literal);
+    break;
+  }
   case 0:
-    tok = malloc(sizeof(token_t));
-    tok->literal = strdup("");
-    tok->type = EOF_TOKEN;
+    tok = token_new_literal(EOF_TOKEN, mem_strdup(""));
     break;
   default:
     if (is_letter(l->ch)) {
-      tok = malloc(sizeof(token_t));
-      tok->literal = lexer_read_identifier(l);
-      tok->type = lexer_lookup_ident(l, tok->literal);
+      symbol_t symbol = lexer_read_identifier(l);
+      tok = token_new_symbol(lexer_lookup_ident(l, symbol), symbol);
       /*
        * we call `lexer_read_char` in `lexer_read_identifier` so early
        * exit is required here.
        */
       return tok;
     } else if (is_digit(l->ch)) {
-      tok = malloc(sizeof(token_t));
-      tok->literal = lexer_read_number(l);
-      tok->type = INT_TOKEN;
+      tok = token_new_literal(INT_TOKEN, lexer_read_number(l));
       /*
        * we call `lexer_read_char` in `lexer_read_identifier` so early
        * exit is required here.
        */
       return tok;
     } else {
-      tok = malloc(sizeof(token_t));
-      tok->literal = malloc(sizeof(char));
-      tok->literal[0] = '\0';
-      tok->type = ILLEGAL_TOKEN;
+      tok = token_new_literal(ILLEGAL_TOKEN, mem_strdup(""));
     }
   }
   lexer_read_char(l);
   return tok;
 }
+
+token_t *lexer_next_token(lexer_t *l) {
+  token_t *tok = lexer_lex_token(l);
+  tok->offset = l->base + l->token_start;
+  return tok;
+}
@@ -7,16 +7,24 @@
 typedef struct _lexer_t lexer_t;
 
 lexer_t *lexer_new(const char *input);
+lexer_t *lexer_new_range(const char *input, uint32_t start, uint32_t end);
+const char *lexer_input(lexer_t *l, uint32_t *len);
+void lexer_set_base(lexer_t *l, uint32_t base);
+uint32_t lexer_base(lexer_t *l);
 void lexer_destroy(lexer_t **l_p);
 void lexer_read_char(lexer_t *l);
 char lexer_peek_char(lexer_t *l);
 char *lexer_read_number(lexer_t *l);
-char *lexer_read_identifier(lexer_t *l);
+symbol_t lexer_read_identifier(lexer_t *l);
+char *lexer_read_string(lexer_t *l);
 token_t *lexer_next_token(lexer_t *l);
+void lexer_seek(lexer_t *l, uint32_t offset);
+uint32_t lexer_token_start(lexer_t *l);
+uint32_t lexer_position(lexer_t *l);
 
 bool is_letter(char ch);
 bool is_digit(char ch);
-TOKEN lexer_lookup_ident(lexer_t *l, char *ident);
+TOKEN lexer_lookup_ident(lexer_t *l, symbol_t ident);
 void lexer_skip_whitespace(lexer_t *l);
 
 #endif
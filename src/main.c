@@ -1,6 +1,349 @@
+#include "batch.h"
+#include "count.h"
+#include "mkc.h"
+#include "profile.h"
 #include "repl.h"
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int main(void) {
+static char *read_file(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  char *data = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&data, &len);
+  assert(out);
+  char chunk[4096];
+  size_t n = 0;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    fwrite(chunk, 1, n, out);
+  }
+  fclose(out);
+  fclose(file);
+  return data;
+}
+
+/*
+ * monkey batch [-j threads] [-s steps] [-t ms] [-d depth] [-m bytes]
+ *              [script...]
+ *
+ * Evaluates each script file, or each line of stdin if no files are
+ * given, and prints one result per script in input order. Each script
+ * is stopped with an error after `steps` function calls, `ms`
+ * milliseconds, calls nested `depth` deep or once it holds more than
+ * `bytes` of memory.
+ */
+static int batch_main(int argc, char **argv) {
+  size_t threads = 0;
+  eval_limits_t limits = {0};
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "j:s:t:d:m:")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      limits.max_steps = strtoull(optarg, NULL, 10);
+      break;
+    case 't':
+      limits.timeout_ns = strtoull(optarg, NULL, 10) * 1000000;
+      break;
+    case 'd':
+      limits.max_depth = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      limits.max_bytes = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: monkey batch [-j threads] [-s steps] [-t ms] "
+                      "[-d depth] [-m bytes] [script...]\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  char **scripts = NULL;
+  size_t len = 0;
+  if (optind < argc) {
+    len = argc - optind;
+    scripts = calloc(len, sizeof(char *));
+    assert(scripts);
+    for (size_t i = 0; i < len; i++) {
+      scripts[i] = read_file(argv[optind + i]);
+      if (scripts[i] == NULL) {
+        fprintf(stderr, "monkey: cannot read %s\n", argv[optind + i]);
+        monkey_batch_results_destroy(&scripts, i);
+        return EXIT_FAILURE;
+      }
+    }
+  } else {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t nbytes = 0;
+    while ((nbytes = getline(&line, &cap, stdin)) != -1) {
+      scripts = reallocarray(scripts, len + 1, sizeof(char *));
+      assert(scripts);
+      scripts[len++] = strndup(line, nbytes);
+    }
+    free(line);
+  }
+
+  char **results = monkey_batch_eval_limited((const char **)scripts, len,
+                                             threads, &limits);
+  for (size_t i = 0; i < len; i++) {
+    puts(results[i]);
+  }
+  monkey_batch_results_destroy(&results, len);
+  monkey_batch_results_destroy(&scripts, len);
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Writes `program` to a temporary file next to `output`, then renames
+ * it over `output`: a failed write never leaves a partial program
+ * behind, nor clobbers the one already there.
+ */
+static bool write_compiled(program_t *program, const char *output) {
+  char *tmp = NULL;
+  asprintf(&tmp, "%s.XXXXXX", output);
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    free(tmp);
+    return false;
+  }
+  /* mkstemp creates it 0600, fopen would have honoured the umask */
+  mode_t mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+
+  FILE *out = fdopen(fd, "wb");
+  bool ok = out != NULL && mkc_write(program, out);
+  if (out != NULL) {
+    ok = fclose(out) == 0 && ok;
+  } else {
+    close(fd);
+  }
+  ok = ok && rename(tmp, output) == 0;
+  if (!ok) {
+    unlink(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+/* monkey compile <script> -o <output> */
+static int compile_main(int argc, char **argv) {
+  const char *output = NULL;
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    if (opt != 'o') {
+      break;
+    }
+    output = optarg;
+  }
+  if (output == NULL || optind != argc - 1) {
+    fprintf(stderr, "usage: monkey compile <script> -o <output>\n");
+    return EXIT_FAILURE;
+  }
+
+  char *input = read_file(argv[optind]);
+  if (input == NULL) {
+    fprintf(stderr, "monkey: cannot read %s\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  parser_set_source_name(parser, argv[optind]);
+  program_t *program = parser_parse_program(parser);
+  int status = EXIT_SUCCESS;
+
+  if (parser->errors_len != 0) {
+    for (size_t i = 0; i < parser->errors_len; i++) {
+      char *error = parser_format_error(parser, i);
+      fprintf(stderr, "%s\n", error);
+      free(error);
+    }
+    status = EXIT_FAILURE;
+  } else {
+    if (!write_compiled(program, output)) {
+      fprintf(stderr, "monkey: cannot write %s\n", output);
+      status = EXIT_FAILURE;
+    }
+  }
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+  free(input);
+  return status;
+}
+
+/*
+ * monkey run [-s steps] [-t ms] [-d depth] [-m bytes]
+ *            [--profile file [--profile-hz hz]] [--count] [--alloc-stats]
+ *            <script or compiled program>
+ *
+ * The limits are those of `monkey batch`.
+ * With --profile, samples the running script `hz` times per second of
+ * CPU time, 1000 by default, and writes the samples to `file` as
+ * folded stacks for flamegraph.pl. With --count, counts every node the
+ * script evaluates and lists the script annotated with the counts on
+ * stderr at exit. With --alloc-stats, writes the VM's allocations by
+ * category and their lifetimes to stderr before the VM is torn down;
+ * binaries configured without --enable-alloc-stats refuse it.
+ */
+static int run_main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"profile", required_argument, NULL, 'p'},
+      {"profile-hz", required_argument, NULL, 'f'},
+      {"count", no_argument, NULL, 'c'},
+      {"alloc-stats", no_argument, NULL, 'a'},
+      {NULL, 0, NULL, 0},
+  };
+  const char *profile_path = NULL;
+  bool counting = false;
+  bool alloc_stats = false;
+  unsigned hz = PROFILE_DEFAULT_HZ;
+  eval_limits_t limits = {0};
+  int opt = 0;
+  while ((opt = getopt_long(argc, argv, "s:t:d:m:", options, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      limits.max_steps = strtoull(optarg, NULL, 10);
+      break;
+    case 't':
+      limits.timeout_ns = strtoull(optarg, NULL, 10) * 1000000;
+      break;
+    case 'd':
+      limits.max_depth = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      limits.max_bytes = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      profile_path = optarg;
+      break;
+    case 'f':
+      hz = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      counting = true;
+      break;
+    case 'a':
+      alloc_stats = true;
+      break;
+    default:
+      optind = argc;
+      break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: monkey run [-s steps] [-t ms] [-d depth] "
+                    "[-m bytes] [--profile file [--profile-hz hz]] "
+                    "[--count] [--alloc-stats] <script>\n");
+    return EXIT_FAILURE;
+  }
+#ifndef MONKEY_ALLOC_STATS
+  if (alloc_stats) {
+    fprintf(stderr, "monkey: built without --enable-alloc-stats\n");
+    return EXIT_FAILURE;
+  }
+#endif
+  const char *path = argv[optind];
+
+  monkey_vm_t *vm = monkey_vm_new();
+  vm->source_name = path;
+  vm->limits = limits;
+  profile_t *profile = NULL;
+  if (profile_path != NULL) {
+    profile = profile_new(hz);
+    if (!profile_start(profile)) {
+      fprintf(stderr, "monkey: cannot start the profiler\n");
+      profile_destroy(&profile);
+    }
+  }
+  count_t *count = NULL;
+  if (counting) {
+    count = count_new();
+    count_start(count);
+  }
+  obj_t *result = NULL;
+  if (mkc_is_compiled(path)) {
+    result = monkey_vm_eval_compiled(vm, path);
+  } else {
+    char *input = read_file(path);
+    if (input == NULL) {
+      fprintf(stderr, "monkey: cannot read %s\n", path);
+      if (profile != NULL) {
+        profile_stop(profile);
+        profile_destroy(&profile);
+      }
+      if (count != NULL) {
+        count_stop(count);
+        count_destroy(&count);
+      }
+      monkey_vm_destroy(&vm);
+      return EXIT_FAILURE;
+    }
+    result = monkey_vm_eval(vm, input);
+    free(input);
+  }
+
+  if (profile != NULL) {
+    profile_stop(profile);
+    FILE *out = fopen(profile_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "monkey: cannot write %s\n", profile_path);
+    } else {
+      profile_write_folded(profile, vm, out);
+      fclose(out);
+    }
+    if (profile->dropped != 0) {
+      fprintf(stderr, "monkey: %zu samples did not fit\n", profile->dropped);
+    }
+    profile_destroy(&profile);
+  }
+  if (count != NULL) {
+    count_stop(count);
+    count_write_listing(count, vm, stderr);
+    count_destroy(&count);
+  }
+
+  int status = vm->errors_len == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  for (size_t i = 0; i < vm->errors_len; i++) {
+    fprintf(stderr, "%s\n", vm->errors[i]);
+  }
+  if (result != NULL) {
+    /* Runtime errors, limits and quotas included, fail the run too */
+    if (result->type == ERROR_OBJ) {
+      status = EXIT_FAILURE;
+    }
+    char *str = obj_to_string(result);
+    puts(str);
+    free(str);
+    monkey_vm_result_destroy(vm, &result);
+  }
+#ifdef MONKEY_ALLOC_STATS
+  if (alloc_stats) {
+    memory_write_stats(vm->memory, stderr);
+  }
+#endif
+  monkey_vm_destroy(&vm);
+  return status;
+}
+
+int main(int argc, char **argv) {
+
+  if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+    return batch_main(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "compile") == 0) {
+    return compile_main(argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "run") == 0) {
+    return run_main(argc - 1, argv + 1);
+  }
 
   char user[HOST_NAME_MAX];
   gethostname(user, HOST_NAME_MAX);
@@ -0,0 +1,258 @@
+#include "map.h"
+#include "hash.h"
+#include "memory.h"
+
+bool map_hashable(OBJ_TYPE type) {
+  return type == INT_OBJ || type == BOOL_OBJ || type == STRING_OBJ;
+}
+
+uint32_t map_hash(array_value_t *key) {
+  assert(key);
+  uint32_t h = 0;
+  switch (key->type) {
+  case INT_OBJ:
+    h = hash_bytes(&key->int_value, sizeof(key->int_value));
+    break;
+  case BOOL_OBJ:
+    h = hash_bytes(&key->bool_value, sizeof(key->bool_value));
+    break;
+  case STRING_OBJ:
+    h = str_obj_hash(key->obj->str_obj);
+    break;
+  default:
+    assert(map_hashable(key->type));
+  }
+  /* 0 marks empty slots */
+  return h == 0 ? 1 : h;
+}
+
+static bool map_key_equals(array_value_t *left, array_value_t *right) {
+  if (left->type != right->type) {
+    return false;
+  }
+  switch (left->type) {
+  case INT_OBJ:
+    return left->int_value == right->int_value;
+  case BOOL_OBJ:
+    return left->bool_value == right->bool_value;
+  case STRING_OBJ:
+    return str_obj_equals(left->obj->str_obj, right->obj->str_obj);
+  default:
+    return false;
+  }
+}
+
+static size_t map_capacity_for(size_t len) {
+  size_t capacity = MAP_MIN_CAPACITY;
+  while (len * MAP_MAX_LOAD_DEN > capacity * MAP_MAX_LOAD_NUM) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+/* Entries the slots of a map with `capacity` may index */
+static size_t map_entries_capacity(size_t capacity) {
+  return capacity * MAP_MAX_LOAD_NUM / MAP_MAX_LOAD_DEN;
+}
+
+static void map_alloc(map_t *map, size_t capacity) {
+  map->capacity = capacity;
+  map->slots = mem_calloc_as(MEM_MAP, capacity, sizeof(map_slot_t));
+  assert(map->slots);
+  map->entries = mem_malloc_as(
+      MEM_MAP, map_entries_capacity(capacity) * sizeof(map_entry_t));
+  assert(map->entries);
+  map->entries_len = 0;
+}
+
+static void map_free(map_t *map) {
+  mem_free(map->slots, map->capacity * sizeof(map_slot_t));
+  mem_free(map->entries,
+           map_entries_capacity(map->capacity) * sizeof(map_entry_t));
+}
+
+/* Sized so that `len` entries fit without resizing */
+map_t *map_new(size_t len) {
+  map_t *map = mem_malloc_as(MEM_MAP, sizeof(map_t));
+  assert(map);
+  map->refcount = 1;
+  map->len = 0;
+  map_alloc(map, map_capacity_for(len));
+  return map;
+}
+
+map_t *map_retain(map_t *map) {
+  assert(map);
+  map->refcount++;
+  return map;
+}
+
+void map_release(map_t **map_p) {
+  assert(map_p);
+  if (*map_p) {
+    map_t *map = *map_p;
+    *map_p = NULL;
+    if (--map->refcount != 0) {
+      return;
+    }
+    for (size_t i = 0; i < map->entries_len; i++) {
+      if (map->entries[i].hash != 0) {
+        array_value_destroy(&map->entries[i].key);
+        array_value_destroy(&map->entries[i].value);
+      }
+    }
+    map_free(map);
+    mem_free(map, sizeof(map_t));
+  }
+}
+
+static inline size_t map_distance(map_t *map, uint32_t hash, size_t idx) {
+  return (idx - (hash & (map->capacity - 1))) & (map->capacity - 1);
+}
+
+/*
+ * Places a slot whose key is known not to be in the table, displacing
+ * slots that are closer to their home.
+ */
+static void map_place(map_t *map, map_slot_t slot) {
+  size_t mask = map->capacity - 1;
+  size_t idx = slot.hash & mask;
+  size_t dist = 0;
+  while (map->slots[idx].hash != 0) {
+    size_t slot_dist = map_distance(map, map->slots[idx].hash, idx);
+    if (slot_dist < dist) {
+      map_slot_t tmp = map->slots[idx];
+      map->slots[idx] = slot;
+      slot = tmp;
+      dist = slot_dist;
+    }
+    idx = (idx + 1) & mask;
+    dist++;
+  }
+  map->slots[idx] = slot;
+}
+
+/* Reindexes the live entries, in order and without holes, for `len` */
+static void map_resize(map_t *map, size_t len) {
+  map_t old = *map;
+  map_alloc(map, map_capacity_for(len));
+  for (size_t i = 0; i < old.entries_len; i++) {
+    if (old.entries[i].hash != 0) {
+      uint32_t entry = (uint32_t)map->entries_len++;
+      map->entries[entry] = old.entries[i];
+      map_place(map, (map_slot_t){.hash = old.entries[i].hash,
+                                  .entry = entry});
+    }
+  }
+  map_free(&old);
+}
+
+/* Returns the slot holding `key` or -1 */
+static ssize_t map_find(map_t *map, uint32_t hash, array_value_t *key) {
+  size_t mask = map->capacity - 1;
+  size_t idx = hash & mask;
+  for (size_t dist = 0;; dist++) {
+    map_slot_t *slot = &map->slots[idx];
+    if (slot->hash == 0 || map_distance(map, slot->hash, idx) < dist) {
+      return -1;
+    }
+    if (slot->hash == hash &&
+        map_key_equals(&map->entries[slot->entry].key, key)) {
+      return (ssize_t)idx;
+    }
+    idx = (idx + 1) & mask;
+  }
+}
+
+/* The returned value is owned by the map, NULL if `key` is not present */
+array_value_t *map_get(map_t *map, array_value_t *key) {
+  assert(map);
+  assert(key);
+  ssize_t idx = map_find(map, map_hash(key), key);
+  return idx < 0 ? NULL : &map->entries[map->slots[idx].entry].value;
+}
+
+/*
+ * Takes ownership of `key` and `value`. An existing binding for `key`
+ * keeps its key and its place in the order, and has its value replaced.
+ */
+void map_set(map_t *map, array_value_t key, array_value_t value) {
+  assert(map);
+  uint32_t hash = map_hash(&key);
+  ssize_t idx = map_find(map, hash, &key);
+  if (idx >= 0) {
+    map_entry_t *entry = &map->entries[map->slots[idx].entry];
+    array_value_destroy(&entry->value);
+    entry->value = value;
+    array_value_destroy(&key);
+    return;
+  }
+
+  /* Growing, or only dropping the holes deletions left */
+  if (map->entries_len == map_entries_capacity(map->capacity)) {
+    map_resize(map, map->len + 1);
+  }
+  uint32_t entry = (uint32_t)map->entries_len++;
+  map->entries[entry] =
+      (map_entry_t){.hash = hash, .key = key, .value = value};
+  map_place(map, (map_slot_t){.hash = hash, .entry = entry});
+  map->len++;
+}
+
+bool map_delete(map_t *map, array_value_t *key) {
+  assert(map);
+  assert(key);
+  ssize_t found = map_find(map, map_hash(key), key);
+  if (found < 0) {
+    return false;
+  }
+
+  size_t mask = map->capacity - 1;
+  size_t idx = (size_t)found;
+  map_entry_t *entry = &map->entries[map->slots[idx].entry];
+  array_value_destroy(&entry->key);
+  array_value_destroy(&entry->value);
+  entry->hash = 0;
+
+  /* Backward shift until an empty slot or a slot at its home */
+  size_t next = (idx + 1) & mask;
+  while (map->slots[next].hash != 0 &&
+         map_distance(map, map->slots[next].hash, next) != 0) {
+    map->slots[idx] = map->slots[next];
+    idx = next;
+    next = (next + 1) & mask;
+  }
+  map->slots[idx].hash = 0;
+  map->len--;
+  return true;
+}
+
+/* In insertion order */
+char *map_to_string(map_t *map) {
+  assert(map);
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  assert(out);
+  fputc('{', out);
+  bool first = true;
+  for (size_t i = 0; i < map->entries_len; i++) {
+    map_entry_t *entry = &map->entries[i];
+    if (entry->hash == 0) {
+      continue;
+    }
+    obj_t *key = array_value_to_obj(&entry->key);
+    obj_t *value = array_value_to_obj(&entry->value);
+    char *key_str = obj_to_string(key);
+    char *value_str = obj_to_string(value);
+    fprintf(out, "%s%s: %s", first ? "" : ", ", key_str, value_str);
+    free(key_str);
+    free(value_str);
+    obj_destroy(&key);
+    obj_destroy(&value);
+    first = false;
+  }
+  fputc('}', out);
+  fclose(out);
+  return str;
+}
@@ -0,0 +1,63 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "object.h"
+#include "utils.h"
+
+#define MAP_MIN_CAPACITY 8
+
+/* The table grows once more than 7/8 of its slots are in use */
+#define MAP_MAX_LOAD_NUM 7
+#define MAP_MAX_LOAD_DEN 8
+
+/*
+ * Keys and values are stored unboxed like array elements. An entry with
+ * `hash == 0` was deleted; `map_hash` never returns 0. Hashes are cached
+ * so probing, comparing and resizing never hash a key twice.
+ */
+typedef struct {
+  uint32_t hash;
+  array_value_t key;
+  array_value_t value;
+} map_entry_t;
+
+/* A slot with `hash == 0` is empty */
+typedef struct {
+  uint32_t hash;
+  uint32_t entry; /* index in `entries` */
+} map_slot_t;
+
+/*
+ * Entries are kept in insertion order, so maps print the same way in
+ * every process whatever the hash seed. The slots index them with open
+ * addressing and Robin Hood probing: a slot is never further from its
+ * home (`hash & (capacity - 1)`) than the slot that follows it is from
+ * its own. Lookups stop as soon as they are further from home than the
+ * slot they probe, and deletion shifts the following slots back by one
+ * instead of leaving tombstones. Deleted entries leave a hole in
+ * `entries` until the map is next resized.
+ *
+ * Maps are immutable once built by the evaluator, so copies of a map
+ * object share the table.
+ */
+struct _map_t {
+  uint32_t refcount;
+  size_t len;             /* live entries */
+  size_t entries_len;     /* used entries, deleted ones included */
+  map_entry_t *entries;   /* room for the most `capacity` slots may hold */
+  size_t capacity;        /* slots, always a power of two */
+  map_slot_t *slots;
+};
+
+map_t *map_new(size_t len);
+map_t *map_retain(map_t *map);
+void map_release(map_t **map_p);
+char *map_to_string(map_t *map);
+
+bool map_hashable(OBJ_TYPE type);
+uint32_t map_hash(array_value_t *key);
+array_value_t *map_get(map_t *map, array_value_t *key);
+void map_set(map_t *map, array_value_t key, array_value_t value);
+bool map_delete(map_t *map, array_value_t *key);
+
+#endif
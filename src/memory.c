@@ -0,0 +1,303 @@
+#include "memory.h"
+
+_Thread_local memory_t *memory_active = NULL;
+
+memory_t *memory_new(void) {
+  memory_t *memory = calloc(1, sizeof(memory_t));
+  assert(memory);
+  return memory;
+}
+
+void memory_destroy(memory_t **memory_p) {
+  assert(memory_p);
+  if (*memory_p) {
+    assert(memory_active != *memory_p);
+    free(*memory_p);
+    *memory_p = NULL;
+  }
+}
+
+/*
+ * Makes `memory` the calling thread's current context, NULL for none,
+ * and returns the previous one so that it can be restored.
+ */
+memory_t *memory_swap(memory_t *memory) {
+  memory_t *previous = memory_active;
+  memory_active = memory;
+  return previous;
+}
+
+memory_t *memory_current(void) { return memory_active; }
+
+#ifdef MONKEY_ALLOC_STATS
+static void memory_adopt_stats(memory_t *memory);
+#endif
+
+/*
+ * Charges what `memory` holds to the current context instead, for work
+ * done on other threads with contexts of their own, stats included.
+ */
+void memory_adopt(memory_t *memory) {
+  assert(memory);
+  memory_charge(memory->current);
+  memory->current = 0;
+#ifdef MONKEY_ALLOC_STATS
+  memory_adopt_stats(memory);
+#endif
+}
+
+#ifndef MONKEY_ALLOC_STATS
+void *mem_reallocarray(void *ptr, size_t old_n, size_t n, size_t size) {
+  void *moved = reallocarray(ptr, n, size);
+  if (moved != NULL) {
+    memory_credit(ptr != NULL ? old_n * size : 0);
+    memory_charge(n * size);
+  }
+  return moved;
+}
+
+char *mem_strdup(const char *str) {
+  char *copy = strdup(str);
+  if (copy != NULL) {
+    memory_charge(strlen(copy) + 1);
+  }
+  return copy;
+}
+
+char *mem_strndup(const char *str, size_t n) {
+  char *copy = strndup(str, n);
+  if (copy != NULL) {
+    memory_charge(strlen(copy) + 1);
+  }
+  return copy;
+}
+#endif
+
+/* For strings from `mem_strdup` and `mem_strndup` */
+void mem_free_str(char *str) {
+  if (str != NULL) {
+    mem_free(str, strlen(str) + 1);
+  }
+}
+
+const char *mem_category_to_str(MEM_CATEGORY category) {
+  switch (category) {
+  case MEM_OTHER:
+    return "other";
+  case MEM_TOKEN:
+    return "token";
+  case MEM_AST:
+    return "ast";
+  case MEM_ENV:
+    return "env";
+  case MEM_MAP:
+    return "map";
+  case MEM_INT:
+    return "int";
+  case MEM_ERROR:
+    return "error";
+  case MEM_STRING:
+    return "string";
+  case MEM_ARRAY:
+    return "array";
+  case MEM_FUNCTION:
+    return "function";
+  case MEM_CATEGORIES:
+    break;
+  }
+  return "unknown";
+}
+
+#ifdef MONKEY_ALLOC_STATS
+/* Kept in front of each block, 16 bytes so the block stays aligned */
+typedef struct {
+  uint64_t birth; /* on the allocating context's clock */
+  uint64_t category;
+} mem_header_t;
+
+/* The birth of blocks allocated with no context current, never taken */
+#define MEM_BIRTH_NONE UINT64_MAX
+
+/* Bars in the lifetime histograms, at their longest */
+#define MEM_HISTOGRAM_WIDTH 40
+
+static void *mem_stats_alloc(MEM_CATEGORY category, size_t size, bool zero) {
+  if (size > SIZE_MAX - sizeof(mem_header_t)) {
+    return NULL;
+  }
+  size_t total = sizeof(mem_header_t) + size;
+  mem_header_t *header = zero ? calloc(1, total) : malloc(total);
+  if (header == NULL) {
+    return NULL;
+  }
+  memory_t *memory = memory_active;
+  header->category = category;
+  header->birth = MEM_BIRTH_NONE;
+  if (memory != NULL) {
+    mem_category_stats_t *stats = &memory->stats.categories[category];
+    header->birth = memory->stats.clock++;
+    stats->allocs++;
+    stats->bytes += size;
+    stats->live += size;
+    memory_charge(size);
+  }
+  return header + 1;
+}
+
+void *mem_malloc_as(MEM_CATEGORY category, size_t size) {
+  return mem_stats_alloc(category, size, false);
+}
+
+void *mem_calloc_as(MEM_CATEGORY category, size_t n, size_t size) {
+  if (size != 0 && n > SIZE_MAX / size) {
+    return NULL;
+  }
+  return mem_stats_alloc(category, n * size, true);
+}
+
+/* Resizing keeps a block's category and birth */
+void *mem_reallocarray_as(MEM_CATEGORY category, void *ptr, size_t old_n,
+                          size_t n, size_t size) {
+  if (size != 0 && n > (SIZE_MAX - sizeof(mem_header_t)) / size) {
+    return NULL;
+  }
+  if (ptr == NULL) {
+    return mem_stats_alloc(category, n * size, false);
+  }
+  mem_header_t *header = (mem_header_t *)ptr - 1;
+  header = realloc(header, sizeof(mem_header_t) + n * size);
+  if (header == NULL) {
+    return NULL;
+  }
+  memory_t *memory = memory_active;
+  if (memory != NULL) {
+    mem_category_stats_t *stats = &memory->stats.categories[header->category];
+    size_t old_size = old_n * size;
+    stats->bytes += n * size > old_size ? n * size - old_size : 0;
+    stats->live -= old_size < stats->live ? old_size : stats->live;
+    stats->live += n * size;
+    memory_credit(old_size);
+    memory_charge(n * size);
+  }
+  return header + 1;
+}
+
+char *mem_strndup_as(MEM_CATEGORY category, const char *str, size_t n) {
+  size_t len = strnlen(str, n);
+  char *copy = mem_stats_alloc(category, len + 1, false);
+  if (copy != NULL) {
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+static unsigned mem_lifetime_bucket(uint64_t lifetime) {
+  unsigned bucket = lifetime != 0 ? 64 - __builtin_clzll(lifetime) : 0;
+  return bucket < MEM_LIFETIME_BUCKETS ? bucket : MEM_LIFETIME_BUCKETS - 1;
+}
+
+void mem_free(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+  mem_header_t *header = (mem_header_t *)ptr - 1;
+  memory_t *memory = memory_active;
+  if (memory != NULL) {
+    mem_category_stats_t *stats = &memory->stats.categories[header->category];
+    stats->frees++;
+    stats->live -= size < stats->live ? size : stats->live;
+    /* Births on other clocks are only taken when they can be right */
+    if (header->birth < memory->stats.clock) {
+      uint64_t lifetime = memory->stats.clock - header->birth - 1;
+      stats->lifetimes[mem_lifetime_bucket(lifetime)]++;
+    }
+    memory_credit(size);
+  }
+  free(header);
+}
+
+static void memory_adopt_stats(memory_t *memory) {
+  memory_t *current = memory_active;
+  if (current != NULL) {
+    current->stats.clock += memory->stats.clock;
+    for (size_t i = 0; i < MEM_CATEGORIES; i++) {
+      mem_category_stats_t *to = &current->stats.categories[i];
+      const mem_category_stats_t *from = &memory->stats.categories[i];
+      to->allocs += from->allocs;
+      to->frees += from->frees;
+      to->bytes += from->bytes;
+      to->live += from->live;
+      for (size_t j = 0; j < MEM_LIFETIME_BUCKETS; j++) {
+        to->lifetimes[j] += from->lifetimes[j];
+      }
+    }
+  }
+  memory->stats = (alloc_stats_t){0};
+}
+
+static void memory_write_histogram(const mem_category_stats_t *stats,
+                                   MEM_CATEGORY category, FILE *out) {
+  size_t first = MEM_LIFETIME_BUCKETS, last = 0;
+  uint64_t most = 0;
+  for (size_t i = 0; i < MEM_LIFETIME_BUCKETS; i++) {
+    if (stats->lifetimes[i] != 0) {
+      first = first < i ? first : i;
+      last = i;
+      most = stats->lifetimes[i] > most ? stats->lifetimes[i] : most;
+    }
+  }
+  if (most == 0) {
+    return;
+  }
+  fprintf(out, "-- %s lifetimes, in allocations made meanwhile\n",
+          mem_category_to_str(category));
+  for (size_t i = first; i <= last; i++) {
+    char range[32];
+    if (i < 2) {
+      snprintf(range, sizeof(range), "%zu", i);
+    } else if (i == MEM_LIFETIME_BUCKETS - 1) {
+      snprintf(range, sizeof(range), "%" PRIu64 "+", (uint64_t)1 << (i - 1));
+    } else {
+      snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64,
+               (uint64_t)1 << (i - 1), ((uint64_t)1 << i) - 1);
+    }
+    uint64_t count = stats->lifetimes[i];
+    int width = (int)((count * MEM_HISTOGRAM_WIDTH + most - 1) / most);
+    fprintf(out, "%21s %10" PRIu64 " |%.*s\n", range, count, width,
+            "########################################");
+  }
+}
+
+/*
+ * Writes how many blocks of each category were allocated and freed
+ * with `memory` current, the bytes they took in total and still hold,
+ * and then a histogram of each category's lifetimes.
+ */
+void memory_write_stats(const memory_t *memory, FILE *out) {
+  assert(memory);
+  assert(out);
+  const alloc_stats_t *stats = &memory->stats;
+  mem_category_stats_t total = {0};
+  fprintf(out, "-- allocations\n%-10s %12s %12s %14s %12s\n", "category",
+          "allocs", "frees", "bytes", "live bytes");
+  for (size_t i = 0; i < MEM_CATEGORIES; i++) {
+    const mem_category_stats_t *category = &stats->categories[i];
+    if (category->allocs == 0 && category->frees == 0) {
+      continue;
+    }
+    fprintf(out, "%-10s %12" PRIu64 " %12" PRIu64 " %14" PRIu64 " %12zu\n",
+            mem_category_to_str(i), category->allocs, category->frees,
+            category->bytes, category->live);
+    total.allocs += category->allocs;
+    total.frees += category->frees;
+    total.bytes += category->bytes;
+    total.live += category->live;
+  }
+  fprintf(out, "%-10s %12" PRIu64 " %12" PRIu64 " %14" PRIu64 " %12zu\n",
+          "total", total.allocs, total.frees, total.bytes, total.live);
+  for (size_t i = 0; i < MEM_CATEGORIES; i++) {
+    memory_write_histogram(&stats->categories[i], i, out);
+  }
+}
+#endif
@@ -0,0 +1,158 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "utils.h"
+
+/*
+ * Memory contexts. Allocations made through the `mem_*` functions are
+ * charged to the calling thread's current context, see `memory_swap`,
+ * and freeing through `mem_free` credits it, so a context kept current
+ * around all the work done for one VM knows how many heap bytes that
+ * work holds. Nothing is counted while no context is current.
+ *
+ * The counts are of requested bytes. Frees and reallocs are sized:
+ * the caller passes the size it allocated, which it always knows, so
+ * nothing is looked up or stored per block, stats builds aside, see
+ * `alloc_stats_t`. Memory must be freed with the context it was
+ * allocated with current for the counts to stay exact; freeing more
+ * than a context holds stops at 0.
+ */
+
+/*
+ * What allocations are for, for the stats below. Objects are counted
+ * by type, their `obj_t` with what it holds.
+ */
+typedef enum {
+  MEM_OTHER,
+  MEM_TOKEN,
+  MEM_AST,
+  MEM_ENV,
+  MEM_MAP, /* map objects, their tables and entries */
+  MEM_INT,
+  MEM_ERROR,
+  MEM_STRING,
+  MEM_ARRAY,
+  MEM_FUNCTION,
+  MEM_CATEGORIES,
+} MEM_CATEGORY;
+
+#ifdef MONKEY_ALLOC_STATS
+/*
+ * Allocation stats, built with --enable-alloc-stats only. Each block
+ * then carries a header with its category and its birth on the
+ * context's allocation clock, so frees find both without the caller's
+ * help. Lifetimes are measured in allocations made meanwhile and kept
+ * as a histogram of their log2: bucket 0 counts blocks freed before
+ * anything else was allocated, bucket b those that saw [2^(b-1), 2^b).
+ */
+#define MEM_LIFETIME_BUCKETS 32
+
+typedef struct {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t bytes; /* allocated in total */
+  size_t live;    /* bytes */
+  uint64_t lifetimes[MEM_LIFETIME_BUCKETS];
+} mem_category_stats_t;
+
+typedef struct {
+  uint64_t clock; /* allocations so far */
+  mem_category_stats_t categories[MEM_CATEGORIES];
+} alloc_stats_t;
+#endif
+
+typedef struct {
+  size_t current; /* live bytes */
+  size_t peak;    /* most live bytes so far */
+#ifdef MONKEY_ALLOC_STATS
+  alloc_stats_t stats;
+#endif
+} memory_t;
+
+/* Use `memory_swap` and `memory_current` rather than this */
+extern _Thread_local memory_t *memory_active;
+
+memory_t *memory_new(void);
+void memory_destroy(memory_t **memory_p);
+memory_t *memory_swap(memory_t *memory);
+memory_t *memory_current(void);
+void memory_adopt(memory_t *memory);
+const char *mem_category_to_str(MEM_CATEGORY category);
+#ifdef MONKEY_ALLOC_STATS
+void memory_write_stats(const memory_t *memory, FILE *out);
+#endif
+
+static inline void memory_charge(size_t size) {
+  memory_t *memory = memory_active;
+  if (memory != NULL) {
+    memory->current += size;
+    if (memory->current > memory->peak) {
+      memory->peak = memory->current;
+    }
+  }
+}
+
+static inline void memory_credit(size_t size) {
+  memory_t *memory = memory_active;
+  if (memory != NULL) {
+    memory->current -= size < memory->current ? size : memory->current;
+  }
+}
+
+#ifdef MONKEY_ALLOC_STATS
+void *mem_malloc_as(MEM_CATEGORY category, size_t size);
+void *mem_calloc_as(MEM_CATEGORY category, size_t n, size_t size);
+void *mem_reallocarray_as(MEM_CATEGORY category, void *ptr, size_t old_n,
+                          size_t n, size_t size);
+char *mem_strndup_as(MEM_CATEGORY category, const char *str, size_t n);
+void mem_free(void *ptr, size_t size);
+
+#define mem_malloc(size) mem_malloc_as(MEM_OTHER, size)
+#define mem_calloc(n, size) mem_calloc_as(MEM_OTHER, n, size)
+#define mem_reallocarray(ptr, old_n, n, size)                                  \
+  mem_reallocarray_as(MEM_OTHER, ptr, old_n, n, size)
+#define mem_strdup_as(category, str) mem_strndup_as(category, str, SIZE_MAX)
+#define mem_strdup(str) mem_strdup_as(MEM_OTHER, str)
+#define mem_strndup(str, n) mem_strndup_as(MEM_OTHER, str, n)
+#else
+/* Inline, they are on every object's way in and out */
+static inline void *mem_malloc(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr != NULL) {
+    memory_charge(size);
+  }
+  return ptr;
+}
+
+static inline void *mem_calloc(size_t n, size_t size) {
+  void *ptr = calloc(n, size);
+  if (ptr != NULL) {
+    memory_charge(n * size);
+  }
+  return ptr;
+}
+
+static inline void mem_free(void *ptr, size_t size) {
+  if (ptr != NULL) {
+    memory_credit(size);
+    free(ptr);
+  }
+}
+
+void *mem_reallocarray(void *ptr, size_t old_n, size_t n, size_t size);
+/* Charged the length of the copy plus its NUL */
+char *mem_strdup(const char *str);
+char *mem_strndup(const char *str, size_t n);
+
+/* Categories only matter to the stats */
+#define mem_malloc_as(category, size) mem_malloc(size)
+#define mem_calloc_as(category, n, size) mem_calloc(n, size)
+#define mem_reallocarray_as(category, ptr, old_n, n, size)                     \
+  mem_reallocarray(ptr, old_n, n, size)
+#define mem_strdup_as(category, str) mem_strdup(str)
+#define mem_strndup_as(category, str, n) mem_strndup(str, n)
+#endif
+
+void mem_free_str(char *str);
+
+#endif
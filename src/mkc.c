@@ -0,0 +1,965 @@
+#include "mkc.h"
+#include "hash.h"
+#include "memory.h"
+#include "source.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AST_ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef enum {
+  MKC_IDENT = 1,
+  MKC_INT,
+  MKC_STRING,
+  MKC_BOOLEAN,
+  MKC_PREFIX,
+  MKC_INFIX,
+  MKC_IF,
+  MKC_FN,
+  MKC_CALL,
+  MKC_ARRAY,
+  MKC_INDEX,
+  MKC_MAP,
+  MKC_LET,
+  MKC_RETURN,
+  MKC_EXPRESSION_STATEMENT,
+  MKC_BLOCK,
+  MKC_PROGRAM,
+} MKC_NODE;
+
+/* Words before the kind specific part of every record */
+#define MKC_RECORD_HEADER 2
+
+/*
+ * Which AST type a record stands for. Trees are walked with explicit
+ * stacks of these rather than recursion, so that deep nesting costs
+ * heap rather than C stack.
+ */
+typedef enum {
+  MKC_PART_EXPRESSION,
+  MKC_PART_STATEMENT,
+  MKC_PART_BLOCK,
+  MKC_PART_IDENTIFIER,
+} MKC_PART;
+
+/*
+ * A bump allocator: nodes of a loaded program are carved out of a few
+ * large chunks and freed all at once. It also owns the mapping the
+ * program's token literals point into.
+ */
+typedef struct {
+  char *data;
+  size_t size;
+} ast_arena_chunk_t;
+
+struct _ast_arena_t {
+  ast_arena_chunk_t *chunks;
+  size_t chunks_len;
+  char *cur;
+  size_t left;
+  void *map;
+  size_t map_len;
+};
+
+static ast_arena_t *ast_arena_new(void) {
+  ast_arena_t *arena = mem_calloc(1, sizeof(ast_arena_t));
+  assert(arena);
+  return arena;
+}
+
+static void *ast_arena_alloc(ast_arena_t *arena, size_t size) {
+  /* Nodes hold nothing wider than pointers and 64 bit integers */
+  size = (size + alignof(int64_t) - 1) & ~(alignof(int64_t) - 1);
+  if (size > arena->left) {
+    size_t chunk_size = size > AST_ARENA_CHUNK_SIZE ? size : AST_ARENA_CHUNK_SIZE;
+    arena->chunks =
+        mem_reallocarray(arena->chunks, arena->chunks_len,
+                         arena->chunks_len + 1, sizeof(ast_arena_chunk_t));
+    assert(arena->chunks);
+    arena->cur = mem_malloc(chunk_size);
+    assert(arena->cur);
+    arena->chunks[arena->chunks_len++] =
+        (ast_arena_chunk_t){arena->cur, chunk_size};
+    arena->left = chunk_size;
+  }
+  void *ptr = arena->cur;
+  arena->cur += size;
+  arena->left -= size;
+  return ptr;
+}
+
+void ast_arena_destroy(ast_arena_t **arena_p) {
+  assert(arena_p);
+  if (*arena_p) {
+    ast_arena_t *arena = *arena_p;
+    for (size_t i = 0; i < arena->chunks_len; i++) {
+      mem_free(arena->chunks[i].data, arena->chunks[i].size);
+    }
+    mem_free(arena->chunks, arena->chunks_len * sizeof(ast_arena_chunk_t));
+    if (arena->map != NULL) {
+      munmap(arena->map, arena->map_len);
+    }
+    mem_free(arena, sizeof(ast_arena_t));
+    *arena_p = NULL;
+  }
+}
+
+/* Writing */
+
+typedef struct {
+  MKC_PART kind;
+  bool expanded; /* its children are pushed */
+  void *node;    /* NULL for a missing child, written as 0 */
+} mkc_write_item_t;
+
+typedef struct {
+  uint32_t *words;
+  size_t len;
+  size_t capacity;
+  ht_t *string_index; /* literal -> index in `strings` */
+  char **strings;
+  size_t strings_len;
+  /* Nodes to write, the next on top, see `mkc_write_pushed` */
+  mkc_write_item_t *items;
+  size_t items_len;
+  size_t items_capacity;
+  /* Offsets of the records written for nodes still to be referenced */
+  uint32_t *offsets;
+  size_t offsets_len;
+  size_t offsets_capacity;
+} mkc_writer_t;
+
+static uint32_t mkc_emit(mkc_writer_t *w, uint32_t word) {
+  if (w->len == w->capacity) {
+    w->capacity = w->capacity == 0 ? 1024 : w->capacity * 2;
+    w->words = reallocarray(w->words, w->capacity, sizeof(uint32_t));
+    assert(w->words);
+  }
+  w->words[w->len] = word;
+  return (uint32_t)w->len++;
+}
+
+static uint32_t mkc_string(mkc_writer_t *w, const char *str) {
+  if (str == NULL) {
+    return MKC_NO_STRING;
+  }
+  hd_t *hd = ht_get(w->string_index, (char *)str);
+  if (hd != NULL) {
+    return (uint32_t)hd->num;
+  }
+  w->strings =
+      reallocarray(w->strings, w->strings_len + 1, sizeof(char *));
+  assert(w->strings);
+  w->strings[w->strings_len] = (char *)str;
+  ht_add(w->string_index, (char *)str,
+         hd_create(HD_INT_DT, (uintptr_t *)w->strings_len));
+  return (uint32_t)w->strings_len++;
+}
+
+/* Starts a record; its first word's index is the record's offset */
+static uint32_t mkc_record(mkc_writer_t *w, MKC_NODE kind, token_t *token) {
+  uint32_t self = mkc_emit(w, kind | (token != NULL ? token->type : 0) << 8);
+  mkc_emit(w, mkc_string(w, token != NULL ? token->literal : NULL));
+  return self;
+}
+
+static void mkc_child(mkc_writer_t *w, uint32_t self, uint32_t child) {
+  mkc_emit(w, child == 0 ? 0 : self - child);
+}
+
+static void mkc_emit_list(mkc_writer_t *w, uint32_t self,
+                          const uint32_t *children, size_t len) {
+  mkc_emit(w, (uint32_t)len);
+  for (size_t i = 0; i < len; i++) {
+    mkc_child(w, self, children[i]);
+  }
+}
+
+/*
+ * A node is visited twice: first its children are pushed, to be
+ * written before it, then it is written, taking their offsets off the
+ * top of `offsets`.
+ */
+static void mkc_push(mkc_writer_t *w, MKC_PART kind, void *node) {
+  if (w->items_len == w->items_capacity) {
+    w->items_capacity = w->items_capacity == 0 ? 64 : w->items_capacity * 2;
+    w->items = reallocarray(w->items, w->items_capacity,
+                            sizeof(mkc_write_item_t));
+    assert(w->items);
+  }
+  w->items[w->items_len++] = (mkc_write_item_t){.kind = kind, .node = node};
+}
+
+/* Pushed last first, so that they are written in order */
+static void mkc_push_list(mkc_writer_t *w, MKC_PART kind, void **nodes,
+                          size_t len) {
+  for (size_t i = len; i-- > 0;) {
+    mkc_push(w, kind, nodes[i]);
+  }
+}
+
+static void mkc_push_offset(mkc_writer_t *w, uint32_t offset) {
+  if (w->offsets_len == w->offsets_capacity) {
+    w->offsets_capacity =
+        w->offsets_capacity == 0 ? 64 : w->offsets_capacity * 2;
+    w->offsets = reallocarray(w->offsets, w->offsets_capacity,
+                              sizeof(uint32_t));
+    assert(w->offsets);
+  }
+  w->offsets[w->offsets_len++] = offset;
+}
+
+static void mkc_push_children(mkc_writer_t *w, mkc_write_item_t *item) {
+  expression_t *exp = item->node;
+  statement_t *statement = item->node;
+  switch (item->kind) {
+  case MKC_PART_IDENTIFIER:
+    return;
+  case MKC_PART_BLOCK: {
+    block_statement_t *block = item->node;
+    mkc_push_list(w, MKC_PART_STATEMENT, (void **)block->statements,
+                  block->statements_len);
+    return;
+  }
+  case MKC_PART_STATEMENT:
+    switch (statement->type) {
+    case LET_STATEMENT:
+      mkc_push(w, MKC_PART_EXPRESSION, statement->let_statement->value);
+      mkc_push(w, MKC_PART_IDENTIFIER, statement->let_statement->name);
+      return;
+    case RETURN_STATEMENT:
+      mkc_push(w, MKC_PART_EXPRESSION,
+               statement->return_statement->return_value);
+      return;
+    case EXPRESSION_STATEMENT:
+      mkc_push(w, MKC_PART_EXPRESSION,
+               statement->expression_statement->expression);
+      return;
+    case BLOCK_STATEMENT:
+      mkc_push(w, MKC_PART_BLOCK, statement->block_statement);
+      return;
+    }
+    return;
+  case MKC_PART_EXPRESSION:
+    break;
+  }
+
+  switch (exp->type) {
+  case IDENT_EXP:
+  case INT_EXP:
+  case STRING_EXP:
+  case BOOLEAN_EXP:
+    return;
+  case PREFIX_EXP:
+    mkc_push(w, MKC_PART_EXPRESSION, exp->prefix->operand);
+    return;
+  case INFIX_EXP:
+    mkc_push(w, MKC_PART_EXPRESSION, exp->infix->right);
+    mkc_push(w, MKC_PART_EXPRESSION, exp->infix->left);
+    return;
+  case IF_EXP:
+    mkc_push(w, MKC_PART_BLOCK, exp->if_exp->alternative);
+    mkc_push(w, MKC_PART_BLOCK, exp->if_exp->consequence);
+    mkc_push(w, MKC_PART_EXPRESSION, exp->if_exp->condition);
+    return;
+  case FN_EXP:
+    mkc_push(w, MKC_PART_BLOCK, exp->fn->body);
+    mkc_push_list(w, MKC_PART_IDENTIFIER, (void **)exp->fn->params->parameters,
+                  exp->fn->params->len);
+    return;
+  case CALL_EXP:
+    mkc_push_list(w, MKC_PART_EXPRESSION,
+                  (void **)exp->call_exp->param_exps->expressions,
+                  exp->call_exp->param_exps->len);
+    mkc_push(w, MKC_PART_EXPRESSION, exp->call_exp->call_exp);
+    return;
+  case ARRAY_EXP:
+    mkc_push_list(w, MKC_PART_EXPRESSION,
+                  (void **)exp->array->elements->expressions,
+                  exp->array->elements->len);
+    return;
+  case INDEX_EXP:
+    mkc_push(w, MKC_PART_EXPRESSION, exp->index_exp->index);
+    mkc_push(w, MKC_PART_EXPRESSION, exp->index_exp->left);
+    return;
+  case MAP_EXP:
+    for (size_t i = exp->map->len; i-- > 0;) {
+      mkc_push(w, MKC_PART_EXPRESSION, exp->map->values[i]);
+      mkc_push(w, MKC_PART_EXPRESSION, exp->map->keys[i]);
+    }
+    return;
+  }
+}
+
+/* Writes the record of `item`, whose children's offsets are on top */
+static uint32_t mkc_write_record(mkc_writer_t *w, mkc_write_item_t *item) {
+  expression_t *exp = item->node;
+  statement_t *statement = item->node;
+  uint32_t self = 0;
+  size_t len = 0;
+
+  switch (item->kind) {
+  case MKC_PART_IDENTIFIER: {
+    identifier_t *identifier = item->node;
+    return mkc_record(w, MKC_IDENT, identifier->token);
+  }
+  case MKC_PART_BLOCK: {
+    block_statement_t *block = item->node;
+    len = block->statements_len;
+    self = mkc_record(w, MKC_BLOCK, block->token);
+    mkc_emit_list(w, self, &w->offsets[w->offsets_len - len], len);
+    w->offsets_len -= len;
+    return self;
+  }
+  case MKC_PART_STATEMENT:
+    switch (statement->type) {
+    case LET_STATEMENT:
+      self = mkc_record(w, MKC_LET, statement->let_statement->token);
+      len = 2;
+      break;
+    case RETURN_STATEMENT:
+      self = mkc_record(w, MKC_RETURN, statement->return_statement->token);
+      len = 1;
+      break;
+    case EXPRESSION_STATEMENT:
+      self = mkc_record(w, MKC_EXPRESSION_STATEMENT,
+                        statement->expression_statement->token);
+      len = 1;
+      break;
+    case BLOCK_STATEMENT:
+      /* Written as its block */
+      return w->offsets[--w->offsets_len];
+    }
+    break;
+  case MKC_PART_EXPRESSION:
+    switch (exp->type) {
+    case IDENT_EXP:
+      return mkc_record(w, MKC_IDENT, exp->identifier->token);
+    case INT_EXP:
+      self = mkc_record(w, MKC_INT, exp->integer->token);
+      mkc_emit(w, (uint32_t)exp->integer->value);
+      return self;
+    case STRING_EXP: {
+      uint32_t value = mkc_string(w, str_buf_data(exp->string->value));
+      self = mkc_record(w, MKC_STRING, exp->string->token);
+      mkc_emit(w, value);
+      return self;
+    }
+    case BOOLEAN_EXP:
+      self = mkc_record(w, MKC_BOOLEAN, exp->boolean->token);
+      mkc_emit(w, exp->boolean->value);
+      return self;
+    case PREFIX_EXP:
+      self = mkc_record(w, MKC_PREFIX, exp->prefix->operator);
+      len = 1;
+      break;
+    case INFIX_EXP:
+      self = mkc_record(w, MKC_INFIX, exp->infix->operator);
+      len = 2;
+      break;
+    case IF_EXP:
+      self = mkc_record(w, MKC_IF, exp->if_exp->token);
+      len = 3;
+      break;
+    case INDEX_EXP:
+      self = mkc_record(w, MKC_INDEX, exp->index_exp->token);
+      len = 2;
+      break;
+    case FN_EXP: {
+      /* The parameters, then the body */
+      len = exp->fn->params->len;
+      uint32_t *children = &w->offsets[w->offsets_len - len - 1];
+      self = mkc_record(w, MKC_FN, exp->fn->token);
+      mkc_child(w, self, children[len]);
+      mkc_emit_list(w, self, children, len);
+      w->offsets_len -= len + 1;
+      return self;
+    }
+    case CALL_EXP: {
+      /* The callee, then the arguments */
+      len = exp->call_exp->param_exps->len;
+      uint32_t *children = &w->offsets[w->offsets_len - len - 1];
+      self = mkc_record(w, MKC_CALL, exp->call_exp->token);
+      mkc_child(w, self, children[0]);
+      mkc_emit_list(w, self, children + 1, len);
+      w->offsets_len -= len + 1;
+      return self;
+    }
+    case ARRAY_EXP:
+      len = exp->array->elements->len;
+      self = mkc_record(w, MKC_ARRAY, exp->array->token);
+      mkc_emit_list(w, self, &w->offsets[w->offsets_len - len], len);
+      w->offsets_len -= len;
+      return self;
+    case MAP_EXP:
+      len = exp->map->len * 2;
+      self = mkc_record(w, MKC_MAP, exp->map->token);
+      mkc_emit_list(w, self, &w->offsets[w->offsets_len - len], len);
+      w->offsets_len -= len;
+      return self;
+    }
+    break;
+  }
+
+  /* A fixed number of children, each a word */
+  for (size_t i = w->offsets_len - len; i < w->offsets_len; i++) {
+    mkc_child(w, self, w->offsets[i]);
+  }
+  w->offsets_len -= len;
+  return self;
+}
+
+/* Writes what is pushed, leaving the offsets of the bottom items */
+static void mkc_write_pushed(mkc_writer_t *w) {
+  while (w->items_len > 0) {
+    mkc_write_item_t item = w->items[--w->items_len];
+    if (item.node == NULL) {
+      mkc_push_offset(w, 0);
+    } else if (item.expanded) {
+      mkc_push_offset(w, mkc_write_record(w, &item));
+    } else {
+      item.expanded = true;
+      w->items[w->items_len++] = item;
+      mkc_push_children(w, &item);
+    }
+  }
+}
+
+/* Writes `program` to `out`. Returns false if writing failed. */
+bool mkc_write(program_t *program, FILE *out) {
+  assert(program);
+  assert(out);
+  mkc_writer_t w = {.string_index = ht_create(1)};
+
+  /*
+   * A relative offset of 0 means "no child", so no child may sit at
+   * index 0: start with an empty placeholder record.
+   */
+  mkc_record(&w, MKC_PROGRAM, NULL);
+  mkc_emit(&w, 0);
+  mkc_push_list(&w, MKC_PART_STATEMENT, (void **)program->statements,
+                program->len);
+  mkc_write_pushed(&w);
+  uint32_t root = mkc_record(&w, MKC_PROGRAM, NULL);
+  mkc_emit_list(&w, root, w.offsets, program->len);
+
+  mkc_header_t header = {.version = MKC_VERSION,
+                         .strings_len = (uint32_t)w.strings_len,
+                         .nodes_len = (uint32_t)w.len,
+                         .string_bytes = 0,
+                         .root = root};
+  memcpy(header.magic, MKC_MAGIC, sizeof(header.magic));
+
+  mkc_string_t *index = malloc((w.strings_len + 1) * sizeof(mkc_string_t));
+  assert(index);
+  for (size_t i = 0; i < w.strings_len; i++) {
+    index[i].offset = header.string_bytes;
+    index[i].len = (uint32_t)strlen(w.strings[i]);
+    header.string_bytes += index[i].len + 1;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(index, sizeof(mkc_string_t), w.strings_len, out) ==
+                w.strings_len &&
+            fwrite(w.words, sizeof(uint32_t), w.len, out) == w.len;
+  for (size_t i = 0; ok && i < w.strings_len; i++) {
+    ok = fwrite(w.strings[i], 1, index[i].len + 1, out) == index[i].len + 1;
+  }
+
+  free(index);
+  free(w.items);
+  free(w.offsets);
+  free(w.strings);
+  free(w.words);
+  ht_destroy(&w.string_index);
+  return ok && fflush(out) == 0;
+}
+
+/* Loading */
+
+typedef struct {
+  MKC_PART part;
+  uint32_t self; /* the record, 0 for none */
+  bool required; /* whether a missing record makes the file invalid */
+  void **slot;   /* where the node built for it goes */
+} mkc_load_item_t;
+
+typedef struct {
+  const uint32_t *words;
+  uint32_t nodes_len;
+  const mkc_string_t *strings;
+  uint32_t strings_len;
+  const char *bytes;
+  symbol_t *symbols; /* interned on first use, by string index */
+  uint64_t *used;    /* a bit per word, set once its record is loaded */
+  ast_arena_t *arena;
+  /* Records to load, parents before children */
+  mkc_load_item_t *items;
+  size_t items_len;
+  size_t items_capacity;
+  bool ok;
+} mkc_loader_t;
+
+static uint32_t mkc_word(mkc_loader_t *l, uint32_t self, uint32_t i) {
+  if ((uint64_t)self + i >= l->nodes_len) {
+    l->ok = false;
+    return 0;
+  }
+  return l->words[self + i];
+}
+
+/* The record `self`'s `i`th word refers to, or 0 */
+static uint32_t mkc_child_of(mkc_loader_t *l, uint32_t self, uint32_t i) {
+  uint32_t rel = mkc_word(l, self, i);
+  if (rel > self) {
+    /* Children always come first, which also rules out cycles */
+    l->ok = false;
+    return 0;
+  }
+  return rel == 0 ? 0 : self - rel;
+}
+
+static symbol_t mkc_symbol(mkc_loader_t *l, uint32_t string) {
+  if (l->symbols[string] == SYMBOL_NONE) {
+    const mkc_string_t *s = &l->strings[string];
+    l->symbols[string] = intern_symbol(l->bytes + s->offset, s->len);
+  }
+  return l->symbols[string];
+}
+
+static bool mkc_token_is_symbol(TokenType type) {
+  return type == IDENT_TOKEN || type >= FUNCTION_TOKEN;
+}
+
+static token_t *mkc_load_token(mkc_loader_t *l, uint32_t self) {
+  uint32_t type = mkc_word(l, self, 0) >> 8 & 0xff;
+  uint32_t string = mkc_word(l, self, 1);
+  if (string >= l->strings_len || type >= TOKEN_COUNT) {
+    l->ok = false;
+    return NULL;
+  }
+  token_t *token = ast_arena_alloc(l->arena, sizeof(token_t));
+  token->type = type;
+  /* There is no source text to locate anything in */
+  token->offset = SOURCE_OFFSET_NONE;
+  if (mkc_token_is_symbol(type)) {
+    token->symbol = mkc_symbol(l, string);
+    token->literal = (char *)symbol_name(token->symbol);
+  } else {
+    /* Borrowed from the mapping; never freed through token_destroy */
+    token->symbol = SYMBOL_NONE;
+    token->literal = (char *)l->bytes + l->strings[string].offset;
+  }
+  return token;
+}
+
+static MKC_NODE mkc_kind(mkc_loader_t *l, uint32_t self) {
+  return mkc_word(l, self, 0) & 0xff;
+}
+
+/* Queues `self` to be loaded into `*slot` */
+static void mkc_load_push(mkc_loader_t *l, MKC_PART part, uint32_t self,
+                          void **slot, bool required) {
+  if (l->items_len == l->items_capacity) {
+    l->items_capacity = l->items_capacity == 0 ? 64 : l->items_capacity * 2;
+    l->items = reallocarray(l->items, l->items_capacity,
+                            sizeof(mkc_load_item_t));
+    assert(l->items);
+  }
+  l->items[l->items_len++] = (mkc_load_item_t){
+      .part = part, .self = self, .required = required, .slot = slot};
+}
+
+/* Queues the child at word `i` of `self` */
+static void mkc_load_child(mkc_loader_t *l, MKC_PART part, uint32_t self,
+                           uint32_t i, void *slot, bool required) {
+  mkc_load_push(l, part, mkc_child_of(l, self, i), slot, required);
+}
+
+/* The length of the list starting at word `i` of `self`, 0 if corrupt */
+static uint32_t mkc_list_len(mkc_loader_t *l, uint32_t self, uint32_t i) {
+  uint32_t len = mkc_word(l, self, i);
+  if ((uint64_t)self + i + len >= l->nodes_len) {
+    l->ok = false;
+    return 0;
+  }
+  return len;
+}
+
+/* An arena array for the list at word `i` of `self`, its nodes queued */
+static void **mkc_load_list(mkc_loader_t *l, uint32_t self, uint32_t i,
+                            size_t *len_p, MKC_PART part) {
+  uint32_t len = mkc_list_len(l, self, i);
+  void **nodes = ast_arena_alloc(l->arena, (len > 0 ? len : 1) * sizeof(void *));
+  for (uint32_t j = 0; j < len; j++) {
+    mkc_load_child(l, part, self, i + 1 + j, &nodes[j], true);
+  }
+  *len_p = len;
+  return nodes;
+}
+
+static identifier_t *mkc_make_identifier(mkc_loader_t *l, token_t *token) {
+  if (token == NULL || token->symbol == SYMBOL_NONE) {
+    l->ok = false;
+    return NULL;
+  }
+  identifier_t *identifier = ast_arena_alloc(l->arena, sizeof(identifier_t));
+  identifier->token = token;
+  identifier->symbol = token->symbol;
+  identifier->value = token->literal;
+  return identifier;
+}
+
+static identifier_t *mkc_load_identifier(mkc_loader_t *l, uint32_t self) {
+  if (mkc_kind(l, self) != MKC_IDENT) {
+    l->ok = false;
+    return NULL;
+  }
+  return mkc_make_identifier(l, mkc_load_token(l, self));
+}
+
+static param_exp_t *mkc_load_param_exps(mkc_loader_t *l, uint32_t self,
+                                        uint32_t i) {
+  param_exp_t *param_exps = ast_arena_alloc(l->arena, sizeof(param_exp_t));
+  param_exps->expressions = (expression_t **)mkc_load_list(
+      l, self, i, &param_exps->len, MKC_PART_EXPRESSION);
+  param_exps->capacity = param_exps->len;
+  return param_exps;
+}
+
+/* Builds the expression `self`, queueing its children */
+static expression_t *mkc_load_expression(mkc_loader_t *l, uint32_t self) {
+  token_t *token = mkc_load_token(l, self);
+  if (token == NULL) {
+    return NULL;
+  }
+  expression_t *exp = ast_arena_alloc(l->arena, sizeof(expression_t));
+  exp->id = 0;
+  uint32_t word = MKC_RECORD_HEADER;
+
+  switch (mkc_kind(l, self)) {
+  case MKC_IDENT:
+    exp->type = IDENT_EXP;
+    exp->identifier = mkc_make_identifier(l, token);
+    break;
+  case MKC_INT:
+    exp->type = INT_EXP;
+    exp->integer = ast_arena_alloc(l->arena, sizeof(integer_t));
+    exp->integer->token = token;
+    exp->integer->value = (int32_t)mkc_word(l, self, word);
+    break;
+  case MKC_STRING: {
+    uint32_t string = mkc_word(l, self, word);
+    if (string >= l->strings_len) {
+      l->ok = false;
+      return NULL;
+    }
+    exp->type = STRING_EXP;
+    exp->string = ast_arena_alloc(l->arena, sizeof(string_t));
+    exp->string->token = token;
+    exp->string->value = symbol_buf(mkc_symbol(l, string));
+    break;
+  }
+  case MKC_BOOLEAN:
+    exp->type = BOOLEAN_EXP;
+    exp->boolean = ast_arena_alloc(l->arena, sizeof(boolean_t));
+    exp->boolean->token = token;
+    exp->boolean->value = mkc_word(l, self, word) != 0;
+    break;
+  case MKC_PREFIX:
+    exp->type = PREFIX_EXP;
+    exp->prefix = ast_arena_alloc(l->arena, sizeof(prefix_t));
+    exp->prefix->operator = token;
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word, &exp->prefix->operand,
+                   true);
+    break;
+  case MKC_INFIX:
+    exp->type = INFIX_EXP;
+    exp->infix = ast_arena_alloc(l->arena, sizeof(infix_t));
+    exp->infix->operator = token;
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word, &exp->infix->left,
+                   true);
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word + 1,
+                   &exp->infix->right, true);
+    break;
+  case MKC_IF:
+    exp->type = IF_EXP;
+    exp->if_exp = ast_arena_alloc(l->arena, sizeof(if_exp_t));
+    exp->if_exp->token = token;
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word,
+                   &exp->if_exp->condition, true);
+    mkc_load_child(l, MKC_PART_BLOCK, self, word + 1,
+                   &exp->if_exp->consequence, true);
+    mkc_load_child(l, MKC_PART_BLOCK, self, word + 2,
+                   &exp->if_exp->alternative, false);
+    break;
+  case MKC_FN:
+    exp->type = FN_EXP;
+    exp->fn = ast_arena_alloc(l->arena, sizeof(fn_t));
+    exp->fn->token = token;
+    mkc_load_child(l, MKC_PART_BLOCK, self, word, &exp->fn->body, true);
+    exp->fn->params = ast_arena_alloc(l->arena, sizeof(param_t));
+    exp->fn->params->parameters = (identifier_t **)mkc_load_list(
+        l, self, word + 1, &exp->fn->params->len, MKC_PART_IDENTIFIER);
+    break;
+  case MKC_CALL:
+    exp->type = CALL_EXP;
+    exp->call_exp = ast_arena_alloc(l->arena, sizeof(call_exp_t));
+    exp->call_exp->token = token;
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word,
+                   &exp->call_exp->call_exp, true);
+    exp->call_exp->param_exps = mkc_load_param_exps(l, self, word + 1);
+    break;
+  case MKC_ARRAY:
+    exp->type = ARRAY_EXP;
+    exp->array = ast_arena_alloc(l->arena, sizeof(array_t));
+    exp->array->token = token;
+    exp->array->elements = mkc_load_param_exps(l, self, word);
+    break;
+  case MKC_INDEX:
+    exp->type = INDEX_EXP;
+    exp->index_exp = ast_arena_alloc(l->arena, sizeof(index_exp_t));
+    exp->index_exp->token = token;
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word,
+                   &exp->index_exp->left, true);
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word + 1,
+                   &exp->index_exp->index, true);
+    break;
+  case MKC_MAP: {
+    /* Keys and values alternate */
+    size_t len = mkc_list_len(l, self, word) / 2;
+    exp->type = MAP_EXP;
+    exp->map = ast_arena_alloc(l->arena, sizeof(map_literal_t));
+    exp->map->token = token;
+    exp->map->len = len;
+    exp->map->keys =
+        ast_arena_alloc(l->arena, (len > 0 ? len : 1) * sizeof(expression_t *));
+    exp->map->values =
+        ast_arena_alloc(l->arena, (len > 0 ? len : 1) * sizeof(expression_t *));
+    for (size_t i = 0; i < len; i++) {
+      mkc_load_child(l, MKC_PART_EXPRESSION, self, word + 1 + 2 * i,
+                     &exp->map->keys[i], true);
+      mkc_load_child(l, MKC_PART_EXPRESSION, self, word + 2 + 2 * i,
+                     &exp->map->values[i], true);
+    }
+    break;
+  }
+  default:
+    l->ok = false;
+    return NULL;
+  }
+  return exp;
+}
+
+static block_statement_t *mkc_load_block(mkc_loader_t *l, uint32_t self) {
+  if (mkc_kind(l, self) != MKC_BLOCK) {
+    l->ok = false;
+    return NULL;
+  }
+  block_statement_t *block = ast_arena_alloc(l->arena, sizeof(block_statement_t));
+  block->token = mkc_load_token(l, self);
+  block->id = 0;
+  block->statements = (statement_t **)mkc_load_list(
+      l, self, MKC_RECORD_HEADER, &block->statements_len, MKC_PART_STATEMENT);
+  return block;
+}
+
+static statement_t *mkc_load_statement(mkc_loader_t *l, uint32_t self) {
+  uint32_t word = MKC_RECORD_HEADER;
+  statement_t *statement = ast_arena_alloc(l->arena, sizeof(statement_t));
+
+  switch (mkc_kind(l, self)) {
+  case MKC_LET:
+    statement->type = LET_STATEMENT;
+    statement->let_statement = ast_arena_alloc(l->arena, sizeof(let_statement_t));
+    statement->let_statement->token = mkc_load_token(l, self);
+    mkc_load_child(l, MKC_PART_IDENTIFIER, self, word,
+                   &statement->let_statement->name, true);
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word + 1,
+                   &statement->let_statement->value, true);
+    break;
+  case MKC_RETURN:
+    statement->type = RETURN_STATEMENT;
+    statement->return_statement =
+        ast_arena_alloc(l->arena, sizeof(return_statement_t));
+    statement->return_statement->token = mkc_load_token(l, self);
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word,
+                   &statement->return_statement->return_value, false);
+    break;
+  case MKC_EXPRESSION_STATEMENT:
+    statement->type = EXPRESSION_STATEMENT;
+    statement->expression_statement =
+        ast_arena_alloc(l->arena, sizeof(expression_statement_t));
+    statement->expression_statement->token = mkc_load_token(l, self);
+    mkc_load_child(l, MKC_PART_EXPRESSION, self, word,
+                   &statement->expression_statement->expression, true);
+    break;
+  case MKC_BLOCK:
+    statement->type = BLOCK_STATEMENT;
+    statement->block_statement = mkc_load_block(l, self);
+    break;
+  default:
+    l->ok = false;
+    return NULL;
+  }
+  return statement;
+}
+
+/*
+ * Loads what is queued. Each record may be loaded once: the writer
+ * never shares one, and a crafted file that did could make a small
+ * file expand into an exponentially large tree.
+ */
+static void mkc_load_pushed(mkc_loader_t *l) {
+  while (l->ok && l->items_len > 0) {
+    mkc_load_item_t item = l->items[--l->items_len];
+    *item.slot = NULL;
+    if (item.self == 0) {
+      l->ok = !item.required;
+      continue;
+    }
+    uint64_t bit = 1ull << (item.self % 64);
+    if (l->used[item.self / 64] & bit) {
+      l->ok = false;
+      break;
+    }
+    l->used[item.self / 64] |= bit;
+
+    switch (item.part) {
+    case MKC_PART_EXPRESSION:
+      *item.slot = mkc_load_expression(l, item.self);
+      break;
+    case MKC_PART_STATEMENT:
+      *item.slot = mkc_load_statement(l, item.self);
+      break;
+    case MKC_PART_BLOCK:
+      *item.slot = mkc_load_block(l, item.self);
+      break;
+    case MKC_PART_IDENTIFIER:
+      *item.slot = mkc_load_identifier(l, item.self);
+      break;
+    }
+  }
+}
+
+static program_t *mkc_fail(char **error, const char *message) {
+  if (error != NULL) {
+    *error = strdup(message);
+  }
+  return NULL;
+}
+
+/*
+ * Maps a compiled program and builds its nodes in an arena owned by the
+ * returned program. Identifiers and string literals are interned into
+ * the calling thread's current intern table. Returns NULL and sets
+ * `*error` if the file is not a valid compiled program.
+ */
+program_t *mkc_load_fd(int fd, char **error) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return mkc_fail(error, strerror(errno));
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(mkc_header_t)) {
+    return mkc_fail(error, "not a compiled monkey program");
+  }
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return mkc_fail(error, strerror(errno));
+  }
+
+  const mkc_header_t *header = map;
+  uint64_t expected = sizeof(mkc_header_t) +
+                      (uint64_t)header->strings_len * sizeof(mkc_string_t) +
+                      (uint64_t)header->nodes_len * sizeof(uint32_t) +
+                      header->string_bytes;
+  const char *message = NULL;
+  if (memcmp(header->magic, MKC_MAGIC, sizeof(header->magic)) != 0) {
+    message = "not a compiled monkey program";
+  } else if (header->version != MKC_VERSION) {
+    message = "unsupported compiled program version";
+  } else if (expected != size || header->root >= header->nodes_len) {
+    message = "truncated compiled program";
+  }
+
+  mkc_loader_t l = {
+      .strings = (const mkc_string_t *)(header + 1),
+      .strings_len = header->strings_len,
+      .nodes_len = header->nodes_len,
+      .ok = message == NULL,
+  };
+  l.words = (const uint32_t *)(l.strings + l.strings_len);
+  l.bytes = (const char *)(l.words + l.nodes_len);
+
+  for (uint32_t i = 0; l.ok && i < l.strings_len; i++) {
+    const mkc_string_t *s = &l.strings[i];
+    if ((uint64_t)s->offset + s->len >= header->string_bytes ||
+        l.bytes[s->offset + s->len] != '\0') {
+      message = "corrupt string table";
+      l.ok = false;
+    }
+  }
+  if (!l.ok) {
+    munmap(map, size);
+    return mkc_fail(error, message);
+  }
+
+  l.symbols = malloc((l.strings_len > 0 ? l.strings_len : 1) * sizeof(symbol_t));
+  assert(l.symbols);
+  for (uint32_t i = 0; i < l.strings_len; i++) {
+    l.symbols[i] = SYMBOL_NONE;
+  }
+  l.arena = ast_arena_new();
+  l.arena->map = map;
+  l.arena->map_len = size;
+
+  l.used = calloc(l.nodes_len / 64 + 1, sizeof(uint64_t));
+  assert(l.used);
+
+  program_t *program = program_new();
+  program->arena = l.arena;
+  if (mkc_kind(&l, header->root) == MKC_PROGRAM) {
+    program->statements = (statement_t **)mkc_load_list(
+        &l, header->root, MKC_RECORD_HEADER, &program->len,
+        MKC_PART_STATEMENT);
+    mkc_load_pushed(&l);
+  } else {
+    l.ok = false;
+  }
+  free(l.items);
+  free(l.used);
+  free(l.symbols);
+
+  if (!l.ok) {
+    program_destroy(&program);
+    return mkc_fail(error, "corrupt compiled program");
+  }
+  return program;
+}
+
+program_t *mkc_load(const char *path, char **error) {
+  assert(path);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return mkc_fail(error, strerror(errno));
+  }
+  program_t *program = mkc_load_fd(fd, error);
+  close(fd);
+  return program;
+}
+
+bool mkc_is_compiled(const char *path) {
+  char magic[4];
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  bool compiled = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                  memcmp(magic, MKC_MAGIC, sizeof(magic)) == 0;
+  fclose(file);
+  return compiled;
+}
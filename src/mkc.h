@@ -0,0 +1,52 @@
+#ifndef MKC_H
+#define MKC_H
+
+#include "ast.h"
+#include "utils.h"
+
+/*
+ * Compiled Monkey programs (.mkc): a parsed program_t serialized so that
+ * it can be mmap'd and turned back into a program without lexing,
+ * parsing or allocating nodes one by one.
+ *
+ * Layout, all words little endian uint32_t:
+ *
+ *   mkc_header_t
+ *   mkc_string_t[strings_len]   string table index
+ *   uint32_t[nodes_len]         node records
+ *   char[string_bytes]          NUL terminated string data
+ *
+ * A node record is its kind, its token type, the string index of its
+ * token literal and then kind specific words. Children are written
+ * before their parent and referenced by relative offset: the parent's
+ * word index minus the child's, 0 for no child. Each record is the
+ * child of one parent only.
+ *
+ * Token offsets are not kept: without the source text there is nothing
+ * to locate them in, so loaded tokens have SOURCE_OFFSET_NONE.
+ */
+
+#define MKC_MAGIC "MKC\x1a"
+#define MKC_VERSION 1
+#define MKC_NO_STRING UINT32_MAX
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t strings_len;
+  uint32_t nodes_len;
+  uint32_t string_bytes;
+  uint32_t root; /* word index of the program record */
+} mkc_header_t;
+
+typedef struct {
+  uint32_t offset; /* into the string data */
+  uint32_t len;
+} mkc_string_t;
+
+bool mkc_write(program_t *program, FILE *out);
+program_t *mkc_load_fd(int fd, char **error);
+program_t *mkc_load(const char *path, char **error);
+bool mkc_is_compiled(const char *path);
+
+#endif
@@ -1,4 +1,15 @@
 #include "object.h"
+#include "environment.h"
+#include "map.h"
+#include "memory.h"
+#include "pool.h"
+
+static bool_obj_t TRUE_IMPL_BOOL_OBJ = {.value = true};
+static bool_obj_t FALSE_IMPL_BOOL_OBJ = {.value = false};
+
+obj_t TRUE_IMPL_OBJ = {.type = BOOL_OBJ, .bool_obj = &TRUE_IMPL_BOOL_OBJ};
+obj_t FALSE_IMPL_OBJ = {.type = BOOL_OBJ, .bool_obj = &FALSE_IMPL_BOOL_OBJ};
+obj_t NULL_IMPL_OBJ = {.type = NULL_OBJ};
 
 const char *obj_type_to_str(OBJ_TYPE ot) {
   switch (ot) {
@@ -8,15 +19,23 @@ const char *obj_type_to_str(OBJ_TYPE ot) {
     return "BOOLEAN";
   case NULL_OBJ:
     return "NULL";
-  case RETURN_VALUE_OBJ:
-    return "RETURN";
   case ERROR_OBJ:
     return "ERROR";
+  case STRING_OBJ:
+    return "STRING";
+  case ARRAY_OBJ:
+    return "ARRAY";
+  case FUNCTION_OBJ:
+    return "FUNCTION";
+  case BUILTIN_OBJ:
+    return "BUILTIN";
+  case MAP_OBJ:
+    return "MAP";
   }
 }
 
 int_obj_t *int_obj_new(int32_t value) {
-  int_obj_t *obj = malloc(sizeof(*obj));
+  int_obj_t *obj = pool_alloc(POOL_INT, MEM_INT);
   assert(obj);
   obj->value = value;
   return obj;
@@ -25,8 +44,7 @@ int_obj_t *int_obj_new(int32_t value) {
 void int_obj_destroy(int_obj_t **obj_p) {
   assert(obj_p);
   if (*obj_p) {
-    int_obj_t *obj = *obj_p;
-    free(obj);
+    pool_free(POOL_INT, *obj_p);
     *obj_p = NULL;
   }
 }
@@ -51,32 +69,12 @@ char *bool_obj_to_string(bool_obj_t *obj) {
   return strdup(get_bool_literal(obj->value));
 }
 
-return_obj_t *return_obj_new(obj_t *value) {
-  assert(value);
-  return_obj_t *obj = malloc(sizeof(return_obj_t));
-  obj->value = value;
-  return obj;
-}
-
-void return_obj_destroy(return_obj_t **r_obj_p) {
-  assert(r_obj_p);
-  if (*r_obj_p) {
-    return_obj_t *r_obj = *r_obj_p;
-    obj_destroy(&r_obj->value);
-    free(r_obj);
-    *r_obj_p = NULL;
-  }
-}
-
-char *return_obj_to_string(return_obj_t *r_obj) {
-  assert(r_obj);
-  return obj_to_string(r_obj->value);
-}
-
 error_obj_t *error_obj_new(const char *message) {
   assert(message);
-  error_obj_t *error_obj = malloc(sizeof(error_obj_t));
-  error_obj->message = strdup(message);
+  error_obj_t *error_obj = pool_alloc(POOL_ERROR, MEM_ERROR);
+  error_obj->kind = ERROR_RUNTIME;
+  error_obj->message = mem_strdup_as(MEM_ERROR, message);
+  error_obj->offset = SOURCE_OFFSET_NONE;
   return error_obj;
 }
 
@@ -84,8 +82,8 @@ void error_obj_destroy(error_obj_t **e_obj_p) {
   assert(e_obj_p);
   if (*e_obj_p) {
     error_obj_t *obj = *e_obj_p;
-    free(obj->message);
-    free(obj);
+    mem_free_str(obj->message);
+    pool_free(POOL_ERROR, obj);
     *e_obj_p = NULL;
   }
 }
@@ -97,11 +95,405 @@ char *error_obj_to_string(error_obj_t *e_obj) {
   return str;
 }
 
+str_obj_t *str_obj_new(const char *data, size_t len) {
+  assert(data);
+  str_obj_t *obj = mem_malloc_as(MEM_STRING, sizeof(str_obj_t));
+  assert(obj);
+  if (len <= STR_OBJ_INLINE_CAP) {
+    memcpy(obj->inline_data, data, len);
+    obj->inline_data[len] = '\0';
+    obj->inline_len = (uint8_t)len;
+  } else {
+    obj->buf = str_buf_new(data, len);
+    obj->inline_len = STR_OBJ_HEAP;
+  }
+  return obj;
+}
+
+str_obj_t *str_obj_from_buf(str_buf_t *buf) {
+  assert(buf);
+  if (buf->len <= STR_OBJ_INLINE_CAP) {
+    return str_obj_new(str_buf_data(buf), buf->len);
+  }
+  str_obj_t *obj = mem_malloc_as(MEM_STRING, sizeof(str_obj_t));
+  assert(obj);
+  obj->buf = str_buf_retain(buf);
+  obj->inline_len = STR_OBJ_HEAP;
+  return obj;
+}
+
+str_obj_t *str_obj_copy(str_obj_t *obj) {
+  assert(obj);
+  str_obj_t *copy = mem_malloc_as(MEM_STRING, sizeof(str_obj_t));
+  assert(copy);
+  *copy = *obj;
+  if (obj->inline_len == STR_OBJ_HEAP) {
+    str_buf_retain(obj->buf);
+  }
+  return copy;
+}
+
+void str_obj_destroy(str_obj_t **obj_p) {
+  assert(obj_p);
+  if (*obj_p) {
+    str_obj_t *obj = *obj_p;
+    if (obj->inline_len == STR_OBJ_HEAP) {
+      str_buf_release(&obj->buf);
+    }
+    mem_free(obj, sizeof(str_obj_t));
+    *obj_p = NULL;
+  }
+}
+
+const char *str_obj_data(str_obj_t *obj) {
+  assert(obj);
+  return obj->inline_len == STR_OBJ_HEAP ? str_buf_data(obj->buf)
+                                         : obj->inline_data;
+}
+
+size_t str_obj_len(str_obj_t *obj) {
+  assert(obj);
+  return obj->inline_len == STR_OBJ_HEAP ? obj->buf->len : obj->inline_len;
+}
+
+char *str_obj_to_string(str_obj_t *obj) {
+  assert(obj);
+  return strndup(str_obj_data(obj), str_obj_len(obj));
+}
+
+bool str_obj_equals(str_obj_t *left, str_obj_t *right) {
+  assert(left);
+  assert(right);
+  if (left->inline_len != STR_OBJ_HEAP || right->inline_len != STR_OBJ_HEAP) {
+    /* A short string can never be equal to a heap string */
+    return left->inline_len == right->inline_len &&
+           memcmp(left->inline_data, right->inline_data, left->inline_len) ==
+               0;
+  }
+  str_buf_t *l = left->buf;
+  str_buf_t *r = right->buf;
+  if (l == r) {
+    return true;
+  }
+  if (str_buf_is_interned(l) && str_buf_is_interned(r)) {
+    /* Equal interned strings always share a buffer */
+    return false;
+  }
+  if (l->len != r->len) {
+    return false;
+  }
+  if (l->hash != 0 && r->hash != 0 && l->hash != r->hash) {
+    return false;
+  }
+  return memcmp(str_buf_data(l), str_buf_data(r), l->len) == 0;
+}
+
+/* Heap strings cache their hash in the shared buffer */
+uint32_t str_obj_hash(str_obj_t *obj) {
+  assert(obj);
+  if (obj->inline_len == STR_OBJ_HEAP) {
+    return str_buf_hash(obj->buf);
+  }
+  return str_hash(obj->inline_data, obj->inline_len);
+}
+
+int str_obj_compare(str_obj_t *left, str_obj_t *right) {
+  size_t left_len = str_obj_len(left);
+  size_t right_len = str_obj_len(right);
+  int cmp = memcmp(str_obj_data(left), str_obj_data(right),
+                   left_len < right_len ? left_len : right_len);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return left_len < right_len ? -1 : left_len > right_len;
+}
+
+static str_obj_t *str_obj_wrap_buf(str_buf_t *buf) {
+  str_obj_t *obj = mem_malloc_as(MEM_STRING, sizeof(str_obj_t));
+  assert(obj);
+  obj->buf = buf;
+  obj->inline_len = STR_OBJ_HEAP;
+  return obj;
+}
+
+/*
+ * Short results are copied. Longer results become rope nodes that
+ * reference both operands, so building a string by appending pieces is
+ * linear in its final length. The rope is flattened the first time its
+ * bytes are needed (`str_obj_data`).
+ */
+str_obj_t *str_obj_concat(str_obj_t *left, str_obj_t *right) {
+  size_t left_len = str_obj_len(left);
+  size_t right_len = str_obj_len(right);
+  size_t len = left_len + right_len;
+
+  if (len <= STR_OBJ_INLINE_CAP) {
+    str_obj_t *obj = str_obj_new(str_obj_data(left), left_len);
+    memcpy(obj->inline_data + left_len, str_obj_data(right), right_len);
+    obj->inline_data[len] = '\0';
+    obj->inline_len = (uint8_t)len;
+    return obj;
+  }
+
+  if (len < STR_OBJ_ROPE_MIN_LEN) {
+    str_buf_t *buf = str_buf_new(NULL, len);
+    memcpy(buf->data, str_obj_data(left), left_len);
+    memcpy(buf->data + left_len, str_obj_data(right), right_len);
+    return str_obj_wrap_buf(buf);
+  }
+
+  str_buf_t *left_buf = left->inline_len == STR_OBJ_HEAP
+                            ? str_buf_retain(left->buf)
+                            : str_buf_new(left->inline_data, left_len);
+  if (right->inline_len != STR_OBJ_HEAP) {
+    return str_obj_wrap_buf(
+        str_buf_append(left_buf, right->inline_data, right_len));
+  }
+  return str_obj_wrap_buf(str_buf_concat(left_buf, str_buf_retain(right->buf)));
+}
+
+array_value_t array_value_from_obj(obj_t *obj) {
+  assert(obj);
+  array_value_t value = {.type = obj->type};
+  switch (obj->type) {
+  case INT_OBJ:
+    value.int_value = obj->int_obj->value;
+    obj_destroy(&obj);
+    break;
+  case BOOL_OBJ:
+    value.bool_value = obj->bool_obj->value;
+    break;
+  case NULL_OBJ:
+    break;
+  default:
+    value.obj = obj;
+  }
+  return value;
+}
+
+obj_t *array_value_to_obj(array_value_t *value) {
+  assert(value);
+  switch (value->type) {
+  case INT_OBJ:
+    return obj_new(INT_OBJ, int_obj_new(value->int_value));
+  case BOOL_OBJ:
+    return native_bool_to_boolean_obj(value->bool_value);
+  case NULL_OBJ:
+    return &NULL_IMPL_OBJ;
+  default:
+    return obj_copy(value->obj);
+  }
+}
+
+static array_value_t array_value_copy(array_value_t *value) {
+  array_value_t copy = *value;
+  if (value->type != INT_OBJ && value->type != BOOL_OBJ &&
+      value->type != NULL_OBJ) {
+    copy.obj = obj_copy(value->obj);
+  }
+  return copy;
+}
+
+void array_value_destroy(array_value_t *value) {
+  assert(value);
+  if (value->type != INT_OBJ && value->type != BOOL_OBJ &&
+      value->type != NULL_OBJ) {
+    obj_destroy(&value->obj);
+  }
+}
+
+array_buf_t *array_buf_new(size_t capacity) {
+  array_buf_t *buf = mem_malloc_as(MEM_ARRAY, sizeof(array_buf_t));
+  assert(buf);
+  buf->refcount = 1;
+  buf->len = 0;
+  buf->capacity = capacity < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY : capacity;
+  buf->values = mem_malloc_as(MEM_ARRAY, buf->capacity * sizeof(array_value_t));
+  assert(buf->values);
+  return buf;
+}
+
+array_buf_t *array_buf_retain(array_buf_t *buf) {
+  assert(buf);
+  buf->refcount++;
+  return buf;
+}
+
+void array_buf_release(array_buf_t **buf_p) {
+  assert(buf_p);
+  if (*buf_p) {
+    array_buf_t *buf = *buf_p;
+    if (--buf->refcount == 0) {
+      for (size_t i = 0; i < buf->len; i++) {
+        array_value_destroy(&buf->values[i]);
+      }
+      mem_free(buf->values, buf->capacity * sizeof(array_value_t));
+      mem_free(buf, sizeof(array_buf_t));
+    }
+    *buf_p = NULL;
+  }
+}
+
+/* Takes over the caller's reference to `buf` */
+array_obj_t *array_obj_new(array_buf_t *buf, size_t offset, size_t len) {
+  assert(buf);
+  assert(offset + len <= buf->len);
+  array_obj_t *obj = mem_malloc_as(MEM_ARRAY, sizeof(array_obj_t));
+  assert(obj);
+  obj->buf = buf;
+  obj->offset = offset;
+  obj->len = len;
+  return obj;
+}
+
+array_obj_t *array_obj_copy(array_obj_t *obj) {
+  assert(obj);
+  return array_obj_new(array_buf_retain(obj->buf), obj->offset, obj->len);
+}
+
+void array_obj_destroy(array_obj_t **obj_p) {
+  assert(obj_p);
+  if (*obj_p) {
+    array_obj_t *obj = *obj_p;
+    array_buf_release(&obj->buf);
+    mem_free(obj, sizeof(array_obj_t));
+    *obj_p = NULL;
+  }
+}
+
+char *array_obj_to_string(array_obj_t *obj) {
+  assert(obj);
+  size_t len = 1;
+  size_t cap = 16;
+  char *str = malloc(cap);
+  assert(str);
+  str[0] = '[';
+  for (size_t i = 0; i < obj->len; i++) {
+    obj_t *value = array_value_to_obj(&obj->buf->values[obj->offset + i]);
+    char *value_str = obj_to_string(value);
+    obj_destroy(&value);
+    size_t value_len = strlen(value_str);
+    while (len + value_len + 4 > cap) {
+      cap *= 2;
+      str = realloc(str, cap);
+      assert(str);
+    }
+    if (i != 0) {
+      str[len++] = ',';
+      str[len++] = ' ';
+    }
+    memcpy(str + len, value_str, value_len);
+    len += value_len;
+    free(value_str);
+  }
+  str[len++] = ']';
+  str[len] = '\0';
+  return str;
+}
+
+/* Returns the null object if `index` is out of bounds */
+obj_t *array_obj_get(array_obj_t *obj, int64_t index) {
+  assert(obj);
+  if (index < 0 || index >= (int64_t)obj->len) {
+    return &NULL_IMPL_OBJ;
+  }
+  return array_value_to_obj(&obj->buf->values[obj->offset + index]);
+}
+
+/*
+ * Returns a new array with `value` (owned) appended. If this view ends
+ * where the buffer ends, the value is appended to the shared buffer
+ * and the result is a longer view over it, which makes repeated
+ * `let a = push(a, x)` amortized O(1). Otherwise the view is copied.
+ * Arrays and maps are never appended in place: they may hold a view of
+ * the buffer, which would then retain itself.
+ */
+array_obj_t *array_obj_push(array_obj_t *obj, obj_t *value) {
+  assert(obj);
+  assert(value);
+  array_buf_t *buf = obj->buf;
+  size_t offset = obj->offset;
+
+  bool container = value->type == ARRAY_OBJ || value->type == MAP_OBJ;
+  if (offset + obj->len == buf->len && !container) {
+    array_buf_retain(buf);
+  } else {
+    buf = array_buf_new(obj->len * 2);
+    for (size_t i = 0; i < obj->len; i++) {
+      buf->values[i] = array_value_copy(&obj->buf->values[obj->offset + i]);
+    }
+    buf->len = obj->len;
+    offset = 0;
+  }
+
+  if (buf->len == buf->capacity) {
+    buf->values =
+        mem_reallocarray_as(MEM_ARRAY, buf->values, buf->capacity,
+                            buf->capacity * 2, sizeof(array_value_t));
+    assert(buf->values);
+    buf->capacity *= 2;
+  }
+  buf->values[buf->len++] = array_value_from_obj(value);
+
+  return array_obj_new(buf, offset, obj->len + 1);
+}
+
+/* O(1): the result is a view over the same buffer */
+array_obj_t *array_obj_rest(array_obj_t *obj) {
+  assert(obj);
+  if (obj->len == 0) {
+    return NULL;
+  }
+  return array_obj_new(array_buf_retain(obj->buf), obj->offset + 1,
+                       obj->len - 1);
+}
+
+fn_obj_t *fn_obj_new(param_t *params, block_statement_t *body, env_t *env) {
+  assert(body);
+  assert(env);
+  fn_obj_t *obj = mem_malloc_as(MEM_FUNCTION, sizeof(fn_obj_t));
+  assert(obj);
+  obj->params = params;
+  obj->body = body;
+  obj->env = env_retain(env);
+  obj->weak = false;
+  return obj;
+}
+
+fn_obj_t *fn_obj_copy(fn_obj_t *obj) {
+  assert(obj);
+  return fn_obj_new(obj->params, obj->body, obj->env);
+}
+
+void fn_obj_destroy(fn_obj_t **obj_p) {
+  assert(obj_p);
+  if (*obj_p) {
+    fn_obj_t *obj = *obj_p;
+    if (!obj->weak) {
+      env_release(&obj->env);
+    }
+    mem_free(obj, sizeof(fn_obj_t));
+    *obj_p = NULL;
+  }
+}
+
+char *fn_obj_to_string(fn_obj_t *obj) {
+  assert(obj);
+  char *str = NULL;
+  char *params_str = obj->params != NULL ? param_to_string(obj->params)
+                                         : strdup("()");
+  char *body_str = block_statement_to_string(obj->body);
+  asprintf(&str, "fn%s %s", params_str, body_str);
+  free(params_str);
+  free(body_str);
+  return str;
+}
+
 obj_t *obj_new(OBJ_TYPE ot, void *value) {
   obj_t *obj = NULL;
   switch (ot) {
   case INT_OBJ:
-    obj = malloc(sizeof(*obj));
+    obj = pool_alloc(POOL_OBJ, MEM_INT);
     obj->type = ot;
     obj->int_obj = (int_obj_t *)value;
     break;
@@ -111,21 +503,69 @@ obj_t *obj_new(OBJ_TYPE ot, void *value) {
   /* case BOOL_OBJ: */
   /*   obj->bool_obj = (bool_obj_t *)value; */
     /* break; */
-  case RETURN_VALUE_OBJ:
-    obj = malloc(sizeof(*obj));
-    obj->type = ot;
-    obj->return_obj = (return_obj_t *)value;
-    break;
   case ERROR_OBJ:
-    obj = malloc(sizeof(*obj));
+    obj = pool_alloc(POOL_OBJ, MEM_ERROR);
     obj->type = ot;
     obj->error_obj = (error_obj_t *)value;
+    break;
+  case STRING_OBJ:
+    obj = pool_alloc(POOL_OBJ, MEM_STRING);
+    obj->type = ot;
+    obj->str_obj = (str_obj_t *)value;
+    break;
+  case ARRAY_OBJ:
+    obj = pool_alloc(POOL_OBJ, MEM_ARRAY);
+    obj->type = ot;
+    obj->array_obj = (array_obj_t *)value;
+    break;
+  case FUNCTION_OBJ:
+    obj = pool_alloc(POOL_OBJ, MEM_FUNCTION);
+    obj->type = ot;
+    obj->fn_obj = (fn_obj_t *)value;
+    break;
+  case MAP_OBJ:
+    obj = pool_alloc(POOL_OBJ, MEM_MAP);
+    obj->type = ot;
+    obj->map_obj = (map_t *)value;
+    break;
   default:
     assert("Unknown object");
   }
   return obj;
 }
 
+/*
+ * Objects are owned by whoever evaluated them. Values that outlive an
+ * expression (bindings in an environment) hand out copies.
+ */
+obj_t *obj_copy(obj_t *obj) {
+  assert(obj);
+  switch (obj->type) {
+  case INT_OBJ:
+    return obj_new(INT_OBJ, int_obj_new(obj->int_obj->value));
+  case STRING_OBJ:
+    return obj_new(STRING_OBJ, str_obj_copy(obj->str_obj));
+  case ARRAY_OBJ:
+    return obj_new(ARRAY_OBJ, array_obj_copy(obj->array_obj));
+  case FUNCTION_OBJ:
+    return obj_new(FUNCTION_OBJ, fn_obj_copy(obj->fn_obj));
+  case MAP_OBJ:
+    return obj_new(MAP_OBJ, map_retain(obj->map_obj));
+  case ERROR_OBJ: {
+    error_obj_t *error_obj = error_obj_new(obj->error_obj->message);
+    error_obj->kind = obj->error_obj->kind;
+    error_obj->offset = obj->error_obj->offset;
+    return obj_new(ERROR_OBJ, error_obj);
+  }
+  case NULL_OBJ:
+  case BOOL_OBJ:
+  case BUILTIN_OBJ:
+    /* Singletons */
+    return obj;
+  }
+  return NULL;
+}
+
 void obj_destroy(obj_t **obj_p) {
   assert(obj_p);
   if (*obj_p) {
@@ -133,15 +573,32 @@ void obj_destroy(obj_t **obj_p) {
     switch (obj->type) {
     case INT_OBJ:
       int_obj_destroy(&obj->int_obj);
-      free(obj);
-      break;
-    case RETURN_VALUE_OBJ:
-      return_obj_destroy(&obj->return_obj);
-      free(obj);
+      pool_free(POOL_OBJ, obj);
       break;
     case ERROR_OBJ:
       error_obj_destroy(&obj->error_obj);
-      free(obj);
+      pool_free(POOL_OBJ, obj);
+      break;
+    case STRING_OBJ:
+      str_obj_destroy(&obj->str_obj);
+      pool_free(POOL_OBJ, obj);
+      break;
+    case ARRAY_OBJ:
+      array_obj_destroy(&obj->array_obj);
+      pool_free(POOL_OBJ, obj);
+      break;
+    case FUNCTION_OBJ:
+      fn_obj_destroy(&obj->fn_obj);
+      pool_free(POOL_OBJ, obj);
+      break;
+    case MAP_OBJ:
+      map_release(&obj->map_obj);
+      pool_free(POOL_OBJ, obj);
+      break;
+    case BUILTIN_OBJ:
+      /*
+       * Do nothing. Builtins are statically allocated.
+       */
       break;
     case NULL_OBJ:
       /*
@@ -167,10 +624,18 @@ char *obj_to_string(obj_t *obj) {
     return strdup("null");
   case BOOL_OBJ:
     return bool_obj_to_string(obj->bool_obj);
-  case RETURN_VALUE_OBJ:
-    return return_obj_to_string(obj->return_obj);
   case ERROR_OBJ:
     return error_obj_to_string(obj->error_obj);
+  case STRING_OBJ:
+    return str_obj_to_string(obj->str_obj);
+  case ARRAY_OBJ:
+    return array_obj_to_string(obj->array_obj);
+  case FUNCTION_OBJ:
+    return fn_obj_to_string(obj->fn_obj);
+  case MAP_OBJ:
+    return map_to_string(obj->map_obj);
+  case BUILTIN_OBJ:
+    return strdup("builtin function");
   }
   return NULL;
 }
@@ -1,16 +1,25 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include "ast.h"
+#include "intern.h"
+#include "source.h"
 #include "utils.h"
 
 typedef struct _obj_t obj_t;
+typedef struct _env_t env_t;
+typedef struct _map_t map_t;
 
 typedef enum {
   INT_OBJ,
   NULL_OBJ,
   BOOL_OBJ,
-  RETURN_VALUE_OBJ,
   ERROR_OBJ,
+  STRING_OBJ,
+  ARRAY_OBJ,
+  FUNCTION_OBJ,
+  BUILTIN_OBJ,
+  MAP_OBJ,
 } OBJ_TYPE;
 
 const char *obj_type_to_str(OBJ_TYPE ot);
@@ -27,47 +36,155 @@ typedef struct {
   bool value;
 } bool_obj_t;
 
-static bool_obj_t TRUE_IMPL_BOOL_OBJ = {.value=true};
-static bool_obj_t FALSE_IMPL_BOOL_OBJ = {.value=false};
-
 bool bool_obj_to_value(bool_obj_t *obj);
 char *bool_obj_to_string(bool_obj_t *obj);
 obj_t *native_bool_to_boolean_obj(bool input);
 
 typedef struct {} null_obj_t;
 
-typedef struct {
-  obj_t *value;
-} return_obj_t;
-
-return_obj_t *return_obj_new(obj_t *value);
-void return_obj_destroy(return_obj_t **r_obj_p);
-char *return_obj_to_string(return_obj_t *r_obj);
+typedef enum {
+  ERROR_RUNTIME,     /* the script did something invalid */
+  ERROR_STEP_LIMIT,  /* evaluation ran out of steps, see eval_limits_t */
+  ERROR_DEADLINE,    /* evaluation ran past its deadline */
+  ERROR_DEPTH_LIMIT, /* calls or expressions nested too deep */
+  ERROR_MEMORY_LIMIT, /* too many bytes live */
+} ERROR_KIND;
 
 typedef struct {
+  ERROR_KIND kind;
   char *message;
+  uint32_t offset; /* in the source, SOURCE_OFFSET_NONE if unknown */
 } error_obj_t;
 
 error_obj_t *error_obj_new(const char *message);
 void error_obj_destroy(error_obj_t **e_obj_p);
 char *error_obj_to_string(error_obj_t *e_obj);
 
+#define STR_OBJ_INLINE_CAP 22
+#define STR_OBJ_HEAP UINT8_MAX
+#define STR_OBJ_ROPE_MIN_LEN 128 /* shorter concatenations are copied */
+#define ARRAY_MIN_CAPACITY 4
+
+/*
+ * Strings up to `STR_OBJ_INLINE_CAP` bytes are stored inline. Longer
+ * strings live in an immutable, reference counted `str_buf_t` which is
+ * shared between copies.
+ */
+typedef struct {
+  union {
+    char inline_data[STR_OBJ_INLINE_CAP + 1]; /* NUL terminated */
+    str_buf_t *buf;
+  };
+  uint8_t inline_len; /* STR_OBJ_HEAP if the string lives in `buf` */
+} str_obj_t;
+
+str_obj_t *str_obj_new(const char *data, size_t len);
+str_obj_t *str_obj_from_buf(str_buf_t *buf);
+str_obj_t *str_obj_copy(str_obj_t *obj);
+void str_obj_destroy(str_obj_t **obj_p);
+char *str_obj_to_string(str_obj_t *obj);
+const char *str_obj_data(str_obj_t *obj);
+size_t str_obj_len(str_obj_t *obj);
+bool str_obj_equals(str_obj_t *left, str_obj_t *right);
+uint32_t str_obj_hash(str_obj_t *obj);
+int str_obj_compare(str_obj_t *left, str_obj_t *right);
+str_obj_t *str_obj_concat(str_obj_t *left, str_obj_t *right);
+
+/*
+ * Array elements and map entries are stored unboxed: integers, booleans
+ * and null live directly in the element, every other type keeps an
+ * owned obj_t.
+ */
+typedef struct {
+  OBJ_TYPE type;
+  union {
+    int32_t int_value;
+    bool bool_value;
+    obj_t *obj;
+  };
+} array_value_t;
+
+array_value_t array_value_from_obj(obj_t *obj);
+obj_t *array_value_to_obj(array_value_t *value);
+void array_value_destroy(array_value_t *value);
+
+/*
+ * Contiguous, geometrically growing storage shared by array views.
+ * Values below `len` are never modified, so views over a prefix of the
+ * buffer are unaffected by later appends.
+ */
+typedef struct {
+  uint32_t refcount;
+  size_t len;
+  size_t capacity;
+  array_value_t *values;
+} array_buf_t;
+
+array_buf_t *array_buf_new(size_t capacity);
+array_buf_t *array_buf_retain(array_buf_t *buf);
+void array_buf_release(array_buf_t **buf_p);
+
+/* A view of `len` values starting at `offset` in `buf` */
+typedef struct {
+  array_buf_t *buf;
+  size_t offset;
+  size_t len;
+} array_obj_t;
+
+array_obj_t *array_obj_new(array_buf_t *buf, size_t offset, size_t len);
+array_obj_t *array_obj_copy(array_obj_t *obj);
+void array_obj_destroy(array_obj_t **obj_p);
+char *array_obj_to_string(array_obj_t *obj);
+obj_t *array_obj_get(array_obj_t *obj, int64_t index);
+array_obj_t *array_obj_push(array_obj_t *obj, obj_t *value);
+array_obj_t *array_obj_rest(array_obj_t *obj);
+
+typedef struct {
+  param_t *params;         /* borrowed from the AST */
+  block_statement_t *body; /* borrowed from the AST */
+  env_t *env;
+  bool weak; /* `env` is not retained, see `env_set` */
+} fn_obj_t;
+
+fn_obj_t *fn_obj_new(param_t *params, block_statement_t *body, env_t *env);
+fn_obj_t *fn_obj_copy(fn_obj_t *obj);
+void fn_obj_destroy(fn_obj_t **obj_p);
+char *fn_obj_to_string(fn_obj_t *obj);
+
+/* Arguments are borrowed, the returned object is owned by the caller */
+typedef obj_t *(*builtin_fn)(size_t argc, obj_t **argv);
+
+typedef struct {
+  const char *name;
+  builtin_fn fn;
+} builtin_obj_t;
+
 struct _obj_t {
   OBJ_TYPE type;
   union {
     int_obj_t *int_obj;
     null_obj_t *null_obj;
     bool_obj_t *bool_obj;
-    return_obj_t *return_obj;
     error_obj_t *error_obj;
+    str_obj_t *str_obj;
+    array_obj_t *array_obj;
+    fn_obj_t *fn_obj;
+    const builtin_obj_t *builtin_obj;
+    map_t *map_obj;
   };
 };
 
-static obj_t TRUE_IMPL_OBJ = {.type=BOOL_OBJ, .bool_obj=&TRUE_IMPL_BOOL_OBJ};
-static obj_t FALSE_IMPL_OBJ = {.type=BOOL_OBJ, .bool_obj=&FALSE_IMPL_BOOL_OBJ};
-static obj_t NULL_IMPL_OBJ = {.type=NULL_OBJ};
+/*
+ * Shared singletons, defined once in object.c so identity compares hold
+ * across translation units. They are never written to, which makes them
+ * safe to share between threads.
+ */
+extern obj_t TRUE_IMPL_OBJ;
+extern obj_t FALSE_IMPL_OBJ;
+extern obj_t NULL_IMPL_OBJ;
 
 obj_t *obj_new(OBJ_TYPE ot, void *value);
+obj_t *obj_copy(obj_t *obj);
 void obj_destroy(obj_t **obj_p);
 char *obj_to_string(obj_t *obj);
 
@@ -0,0 +1,364 @@
+#include "parallel_parser.h"
+#include "memory.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Smaller chunks don't pay for the threads they keep busy */
+#define PARALLEL_PARSE_MIN_CHUNK (64 * 1024)
+/* Chunks per thread, so a slow chunk doesn't hold up the rest */
+#define PARALLEL_PARSE_CHUNKS_PER_THREAD 4
+
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+  uint32_t base; /* the caller's lexer's, for token offsets */
+  intern_table_t *symbols; /* private to the chunk until merged */
+  program_t *program;
+  bool failed;
+  size_t fn_literals;
+  symbol_t *map;     /* chunk symbol -> symbol in the caller's table */
+  str_buf_t **bufs;  /* chunk symbol -> buffer in the caller's table */
+  memory_t memory;   /* private to the chunk until adopted */
+} parse_chunk_t;
+
+typedef struct {
+  const char *input;
+  parse_chunk_t *chunks;
+  size_t chunks_len;
+  _Atomic size_t next;
+  void (*run)(parse_chunk_t *chunk, const char *input);
+} parse_pool_t;
+
+/*
+ * Offsets just past `;`s at bracket depth 0 outside string literals,
+ * the first at or after each of `wanted` evenly spaced targets.
+ */
+static size_t parse_find_splits(const char *input, uint32_t start,
+                                uint32_t end, uint32_t *splits,
+                                size_t wanted) {
+  size_t len = 0;
+  uint64_t stride = (end - start) / (wanted + 1);
+  uint64_t target = start + stride;
+  int64_t depth = 0;
+  bool in_string = false;
+
+  for (uint32_t i = start; i < end && len < wanted; i++) {
+    char ch = input[i];
+    if (in_string) {
+      in_string = ch != '"';
+      continue;
+    }
+    switch (ch) {
+    case '"':
+      in_string = true;
+      break;
+    case '(':
+    case '[':
+    case '{':
+      depth++;
+      break;
+    case ')':
+    case ']':
+    case '}':
+      depth--;
+      break;
+    case ';':
+      if (depth == 0 && i + 1 >= target && i + 1 < end) {
+        splits[len++] = i + 1;
+        target = i + 1 + stride;
+      }
+      break;
+    }
+  }
+  return len;
+}
+
+static void parse_chunk(parse_chunk_t *chunk, const char *input) {
+  memory_t *memory = memory_swap(&chunk->memory);
+  chunk->symbols = intern_table_new();
+  intern_table_t *previous = intern_table_swap(chunk->symbols);
+
+  lexer_t *lexer = lexer_new_range(input, chunk->start, chunk->end);
+  lexer_set_base(lexer, chunk->base);
+  parser_t *parser = parser_new(lexer);
+  chunk->program = parser_parse_program(parser);
+  chunk->failed = parser->errors_len != 0;
+  chunk->fn_literals = parser->fn_literals;
+  parser_destroy(&parser);
+
+  intern_table_swap(previous);
+  memory_swap(memory);
+}
+
+/* Points the nodes of a chunk at the caller's table instead */
+
+static void remap_token(parse_chunk_t *chunk, token_t *token) {
+  if (token != NULL && token->symbol != SYMBOL_NONE) {
+    token->literal = (char *)chunk->bufs[token->symbol]->data;
+    token->symbol = chunk->map[token->symbol];
+  }
+}
+
+static void remap_identifier(parse_chunk_t *chunk, identifier_t *identifier) {
+  if (identifier != NULL) {
+    identifier->value = chunk->bufs[identifier->symbol]->data;
+    identifier->symbol = chunk->map[identifier->symbol];
+    remap_token(chunk, identifier->token);
+  }
+}
+
+static void remap_statement(parse_chunk_t *chunk, statement_t *statement);
+
+static void remap_block(parse_chunk_t *chunk, block_statement_t *block) {
+  if (block != NULL) {
+    for (size_t i = 0; i < block->statements_len; i++) {
+      remap_statement(chunk, block->statements[i]);
+    }
+  }
+}
+
+/* Visits the same tokens `expression_destroy` would free */
+static void remap_expression(parse_chunk_t *chunk, expression_t *exp) {
+  if (exp == NULL) {
+    return;
+  }
+  switch (exp->type) {
+  case IDENT_EXP:
+    remap_identifier(chunk, exp->identifier);
+    break;
+  case STRING_EXP: {
+    /* Still interned in the chunk's table, current while remapping */
+    str_buf_t *value = exp->string->value;
+    exp->string->value = chunk->bufs[intern_symbol(value->data, value->len)];
+    break;
+  }
+  case BOOLEAN_EXP:
+    remap_token(chunk, exp->boolean->token);
+    break;
+  case PREFIX_EXP:
+    remap_expression(chunk, exp->prefix->operand);
+    break;
+  case INFIX_EXP:
+    remap_expression(chunk, exp->infix->left);
+    remap_expression(chunk, exp->infix->right);
+    break;
+  case IF_EXP:
+    remap_token(chunk, exp->if_exp->token);
+    remap_expression(chunk, exp->if_exp->condition);
+    remap_block(chunk, exp->if_exp->consequence);
+    remap_block(chunk, exp->if_exp->alternative);
+    break;
+  case FN_EXP:
+    remap_token(chunk, exp->fn->token);
+    for (size_t i = 0; i < exp->fn->params->len; i++) {
+      remap_identifier(chunk, exp->fn->params->parameters[i]);
+    }
+    remap_block(chunk, exp->fn->body);
+    break;
+  case CALL_EXP:
+    remap_expression(chunk, exp->call_exp->call_exp);
+    for (size_t i = 0; i < exp->call_exp->param_exps->len; i++) {
+      remap_expression(chunk, exp->call_exp->param_exps->expressions[i]);
+    }
+    break;
+  case ARRAY_EXP:
+    for (size_t i = 0; i < exp->array->elements->len; i++) {
+      remap_expression(chunk, exp->array->elements->expressions[i]);
+    }
+    break;
+  case INDEX_EXP:
+    remap_expression(chunk, exp->index_exp->left);
+    remap_expression(chunk, exp->index_exp->index);
+    break;
+  case MAP_EXP:
+    for (size_t i = 0; i < exp->map->len; i++) {
+      remap_expression(chunk, exp->map->keys[i]);
+      remap_expression(chunk, exp->map->values[i]);
+    }
+    break;
+  case INT_EXP:
+    break;
+  }
+}
+
+static void remap_statement(parse_chunk_t *chunk, statement_t *statement) {
+  switch (statement->type) {
+  case LET_STATEMENT:
+    remap_token(chunk, statement->let_statement->token);
+    remap_identifier(chunk, statement->let_statement->name);
+    remap_expression(chunk, statement->let_statement->value);
+    break;
+  case RETURN_STATEMENT:
+    remap_token(chunk, statement->return_statement->token);
+    remap_expression(chunk, statement->return_statement->return_value);
+    break;
+  case EXPRESSION_STATEMENT:
+    /* Its token belongs to the expression */
+    remap_expression(chunk, statement->expression_statement->expression);
+    break;
+  case BLOCK_STATEMENT:
+    remap_block(chunk, statement->block_statement);
+    break;
+  }
+}
+
+static void remap_chunk(parse_chunk_t *chunk, const char *input) {
+  (void)input;
+  memory_t *memory = memory_swap(&chunk->memory);
+  intern_table_t *previous = intern_table_swap(chunk->symbols);
+  for (size_t i = 0; i < chunk->program->len; i++) {
+    remap_statement(chunk, chunk->program->statements[i]);
+  }
+  intern_table_swap(previous);
+  /* Nothing refers to it any more */
+  intern_table_destroy(&chunk->symbols);
+  memory_swap(memory);
+}
+
+static void *parse_pool_run(void *ptr) {
+  parse_pool_t *pool = ptr;
+  size_t i;
+  while ((i = atomic_fetch_add(&pool->next, 1)) < pool->chunks_len) {
+    pool->run(&pool->chunks[i], pool->input);
+  }
+  return NULL;
+}
+
+/* Runs `run` on the first `len` chunks; the calling thread helps */
+static void parse_pool(parse_pool_t *pool, pthread_t *threads,
+                       size_t threads_len, size_t len,
+                       void (*run)(parse_chunk_t *, const char *)) {
+  pool->chunks_len = len;
+  pool->run = run;
+  atomic_init(&pool->next, 0);
+  for (size_t i = 0; i < threads_len; i++) {
+    int rc = pthread_create(&threads[i], NULL, parse_pool_run, pool);
+    assert(rc == 0);
+    (void)rc;
+  }
+  parse_pool_run(pool);
+  for (size_t i = 0; i < threads_len; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+program_t *parser_parse_program_parallel(parser_t *parser, size_t threads) {
+  assert(parser);
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+
+  uint32_t end = 0;
+  const char *input = lexer_input(parser->l, &end);
+  uint32_t start = parser->cur_span.start;
+  size_t wanted = threads * PARALLEL_PARSE_CHUNKS_PER_THREAD;
+  if (wanted > (end - start) / PARALLEL_PARSE_MIN_CHUNK) {
+    wanted = (end - start) / PARALLEL_PARSE_MIN_CHUNK;
+  }
+  if (threads < 2 || wanted < 2) {
+    return parser_parse_program(parser);
+  }
+
+  uint32_t *splits = malloc((wanted - 1) * sizeof(uint32_t));
+  assert(splits);
+  size_t chunks_len = parse_find_splits(input, start, end, splits, wanted - 1) + 1;
+  parse_chunk_t *chunks = calloc(chunks_len, sizeof(parse_chunk_t));
+  assert(chunks);
+  for (size_t i = 0; i < chunks_len; i++) {
+    chunks[i].start = i == 0 ? start : splits[i - 1];
+    chunks[i].end = i == chunks_len - 1 ? end : splits[i];
+    chunks[i].base = lexer_base(parser->l);
+  }
+  free(splits);
+
+  parse_pool_t pool = {.input = input, .chunks = chunks};
+  pthread_t *workers = calloc(threads - 1, sizeof(pthread_t));
+  assert(workers);
+  parse_pool(&pool, workers, threads - 1, chunks_len, parse_chunk);
+
+  /* In order, so symbols are numbered as a sequential parse would */
+  size_t good = 0;
+  while (good < chunks_len && !chunks[good].failed) {
+    parse_chunk_t *chunk = &chunks[good++];
+    size_t symbols_len = 0;
+    chunk->map = intern_table_merge(chunk->symbols, &symbols_len);
+    chunk->bufs = malloc((symbols_len > 0 ? symbols_len : 1) *
+                         sizeof(str_buf_t *));
+    assert(chunk->bufs);
+    for (size_t i = 0; i < symbols_len; i++) {
+      chunk->bufs[i] = symbol_buf(chunk->map[i]);
+    }
+    parser->fn_literals += chunk->fn_literals;
+  }
+  /* The caller's table is only read from here on */
+  parse_pool(&pool, workers, threads - 1, good, remap_chunk);
+  free(workers);
+
+  size_t len = 0;
+  for (size_t i = 0; i < good; i++) {
+    len += chunks[i].program->len;
+  }
+  program_t *program = program_new();
+  if (len > 0) {
+    program->statements = mem_malloc(len * sizeof(statement_t *));
+    program->spans = mem_malloc(len * sizeof(source_span_t));
+    assert(program->statements && program->spans);
+    program->capacity = len;
+  }
+  for (size_t i = 0; i < good; i++) {
+    program_t *part = chunks[i].program;
+    if (part->len > 0) {
+      memcpy(program->statements + program->len, part->statements,
+             part->len * sizeof(statement_t *));
+      memcpy(program->spans + program->len, part->spans,
+             part->len * sizeof(source_span_t));
+      program->len += part->len;
+    }
+    /* Only the shell, the statements moved */
+    part->len = 0;
+  }
+
+  if (good < chunks_len) {
+    parser_seek(parser, chunks[good].start);
+    program_t *rest = parser_parse_program(parser);
+    size_t capacity = program->len + rest->len;
+    if (rest->len > 0) {
+      program->statements =
+          mem_reallocarray(program->statements, program->capacity, capacity,
+                           sizeof(statement_t *));
+      assert(program->statements);
+      memcpy(program->statements + program->len, rest->statements,
+             rest->len * sizeof(statement_t *));
+    }
+    if (rest->spans != NULL) {
+      program->spans = mem_reallocarray(program->spans, program->capacity,
+                                        capacity, sizeof(source_span_t));
+      assert(program->spans);
+      memcpy(program->spans + program->len, rest->spans,
+             rest->len * sizeof(source_span_t));
+    } else {
+      mem_free(program->spans, program->capacity * sizeof(source_span_t));
+      program->spans = NULL;
+    }
+    program->capacity = capacity;
+    program->len += rest->len;
+    rest->len = 0;
+    program_destroy(&rest);
+  } else {
+    parser_seek(parser, end);
+  }
+
+  for (size_t i = 0; i < chunks_len; i++) {
+    memory_t *memory = memory_swap(&chunks[i].memory);
+    program_destroy(&chunks[i].program);
+    intern_table_destroy(&chunks[i].symbols);
+    memory_swap(memory);
+    /* The statements that moved to `program` are the caller's now */
+    memory_adopt(&chunks[i].memory);
+    free(chunks[i].map);
+    free(chunks[i].bufs);
+  }
+  free(chunks);
+  return program;
+}
@@ -0,0 +1,23 @@
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include "parser.h"
+
+/*
+ * Parses the rest of `parser`'s input like `parser_parse_program`, on
+ * `threads` threads (0 for one per online CPU).
+ *
+ * A prescan splits the input after `;`s outside of any brackets or
+ * string literals, where a top-level statement always ends. The chunks
+ * are parsed independently, each into a private intern table, and
+ * stitched back together in order. Symbols end up exactly as a
+ * sequential parse would have numbered them in the current table.
+ *
+ * Spans are offsets into the whole input. If a chunk has errors,
+ * everything from that chunk on is parsed again sequentially with
+ * `parser`, so its errors are the ones a sequential parse reports.
+ * Small inputs are always parsed sequentially.
+ */
+program_t *parser_parse_program_parallel(parser_t *parser, size_t threads);
+
+#endif
@@ -1,41 +1,54 @@
 #include "parser.h"
+#include "memory.h"
+
+/*
+ * The Pratt table, shared by every parser: how a token starts an
+ * operand and how tightly it binds as an infix operator. Operators
+ * whose operands nest get a frame instead of a prefix parselet, see
+ * `parser_begin_operand`.
+ */
+static const parselet_t parselets[TOKEN_COUNT] = {
+    [IDENT_TOKEN] = {parser_parse_identifier, LOWEST_PRECEDENCE},
+    [INT_TOKEN] = {parser_parse_integer, LOWEST_PRECEDENCE},
+    [STRING_TOKEN] = {parser_parse_string, LOWEST_PRECEDENCE},
+    [TRUE_TOKEN] = {parser_parse_boolean, LOWEST_PRECEDENCE},
+    [FALSE_TOKEN] = {parser_parse_boolean, LOWEST_PRECEDENCE},
+    [IF_TOKEN] = {parser_parse_if_expression, LOWEST_PRECEDENCE},
+    [FUNCTION_TOKEN] = {parser_parse_fn_literal, LOWEST_PRECEDENCE},
+    [PLUS_TOKEN] = {NULL, SUM_PRECEDENCE},
+    [MINUS_TOKEN] = {NULL, SUM_PRECEDENCE},
+    [SLASH_TOKEN] = {NULL, PRODUCT_PRECEDENCE},
+    [ASTERISK_TOKEN] = {NULL, PRODUCT_PRECEDENCE},
+    [EQ_TOKEN] = {NULL, EQUALS_PRECEDENCE},
+    [NOT_EQ_TOKEN] = {NULL, EQUALS_PRECEDENCE},
+    [LT_TOKEN] = {NULL, LESSGREATER_PRECEDENCE},
+    [GT_TOKEN] = {NULL, LESSGREATER_PRECEDENCE},
+    [LPAREN_TOKEN] = {NULL, CALL_PRECEDENCE},
+    [LBRACKET_TOKEN] = {NULL, INDEX_PRECEDENCE},
+};
 
 parser_t *parser_new(lexer_t *l) {
-  parser_t *p = malloc(sizeof(parser_t));
+  parser_t *p = mem_malloc(sizeof(parser_t));
   assert(p);
   assert(l);
   p->l = l;
   p->cur_token = NULL;
   p->peek_token = NULL;
+  p->cur_span = p->peek_span = (source_span_t){0, 0};
   p->errors = NULL;
   p->errors_len = 0;
+  p->errors_capacity = 0;
+  p->max_errors = PARSER_MAX_ERRORS;
+  p->cur_unclaimed = false;
+  p->source_name = NULL;
+  p->source = NULL;
+  p->fn_literals = 0;
+  p->blocks = 0;
+  p->frames = NULL;
+  p->frames_len = 0;
+  p->frames_capacity = 0;
   parser_next_token(p);
   parser_next_token(p);
-
-  p->prefix_parselets = calloc(RETURN_TOKEN + 1, sizeof(prefix_parse_fn));
-  assert(p->prefix_parselets);
-  p->prefix_parselets[IDENT_TOKEN] = parser_parse_identifier;
-  p->prefix_parselets[INT_TOKEN] = parser_parse_integer;
-  p->prefix_parselets[BANG_TOKEN] = parser_parse_prefix;
-  p->prefix_parselets[MINUS_TOKEN] = parser_parse_prefix;
-  p->prefix_parselets[TRUE_TOKEN] = parser_parse_boolean;
-  p->prefix_parselets[FALSE_TOKEN] = parser_parse_boolean;
-  p->prefix_parselets[LPAREN_TOKEN] = parser_parse_grouped_expression;
-  p->prefix_parselets[IF_TOKEN] = parser_parse_if_expression;
-  p->prefix_parselets[FUNCTION_TOKEN] = parser_parse_fn_literal;
-
-  p->infix_parselets = calloc(RETURN_TOKEN + 1, sizeof(infix_parse_fn));
-  assert(p->infix_parselets);
-  p->infix_parselets[PLUS_TOKEN] = parser_parse_infix;
-  p->infix_parselets[MINUS_TOKEN] = parser_parse_infix;
-  p->infix_parselets[SLASH_TOKEN] = parser_parse_infix;
-  p->infix_parselets[ASTERISK_TOKEN] = parser_parse_infix;
-  p->infix_parselets[EQ_TOKEN] = parser_parse_infix;
-  p->infix_parselets[NOT_EQ_TOKEN] = parser_parse_infix;
-  p->infix_parselets[LT_TOKEN] = parser_parse_infix;
-  p->infix_parselets[GT_TOKEN] = parser_parse_infix;
-  p->infix_parselets[LPAREN_TOKEN] = parser_parse_call_expression;
-
   return p;
 }
 
@@ -46,7 +59,21 @@ parser_t *parser_new(lexer_t *l) {
 void parser_next_token(parser_t *p) {
   assert(p);
   p->cur_token = p->peek_token;
+  p->cur_span = p->peek_span;
+  p->cur_unclaimed = false;
   p->peek_token = lexer_next_token(p->l);
+  p->peek_span.start = lexer_token_start(p->l);
+  p->peek_span.end = lexer_position(p->l);
+}
+
+/* Drops the lookahead and continues from the token boundary `offset` */
+void parser_seek(parser_t *p, uint32_t offset) {
+  assert(p);
+  token_destroy(&p->cur_token);
+  token_destroy(&p->peek_token);
+  lexer_seek(p->l, offset);
+  parser_next_token(p);
+  parser_next_token(p);
 }
 
 void parser_destroy(parser_t **p_p) {
@@ -61,73 +88,210 @@ void parser_destroy(parser_t **p_p) {
       token_destroy(&p->peek_token);
     }
 
-    while (p->errors_len != 0) {
-      free(p->errors[--p->errors_len]);
-    }
-    free(p->errors);
+    mem_free(p->errors, p->errors_capacity * sizeof(parse_error_t));
+    source_destroy(&p->source);
 
-    free(p->prefix_parselets);
-    free(p->infix_parselets);
+    mem_free(p->frames, p->frames_capacity * sizeof(parse_frame_t));
     assert(p->l);
     lexer_destroy(&p->l);
-    free(p);
+    mem_free(p, sizeof(parser_t));
     *p_p = NULL;
   }
 }
 
-void parser_append_error(parser_t *parser, char *error) {
+/*
+ * Names the input in error positions, SOURCE_DEFAULT_NAME if never set.
+ * `name` is borrowed.
+ */
+void parser_set_source_name(parser_t *parser, const char *name) {
   assert(parser);
-  assert(error);
+  parser->source_name = name;
+  /* Made again with the new name when an error is formatted */
+  source_destroy(&parser->source);
+}
+
+static bool parser_gave_up(parser_t *parser) {
+  if (parser->errors_len == 0) {
+    return false;
+  }
+  PARSE_ERROR kind = parser->errors[parser->errors_len - 1].kind;
+  return kind == PARSE_ERROR_TOO_MANY || kind == PARSE_ERROR_TOO_DEEP;
+}
 
-  if (parser->errors == NULL) {
-    parser->errors = malloc(sizeof(char *));
-    parser->errors[0] = strdup(error);
-    parser->errors_len = 1;
+/* Records an error about the token at `span` */
+static void parser_error(parser_t *parser, PARSE_ERROR kind, TokenType expected,
+                         token_t *got, source_span_t span) {
+  if (parser_gave_up(parser)) {
     return;
   }
+  if (parser->max_errors != 0 && parser->errors_len == parser->max_errors) {
+    kind = PARSE_ERROR_TOO_MANY;
+  }
+  if (parser->errors_len == parser->errors_capacity) {
+    size_t capacity =
+        parser->errors_capacity == 0 ? 8 : parser->errors_capacity * 2;
+    parser->errors = mem_reallocarray(parser->errors, parser->errors_capacity,
+                                      capacity, sizeof(parse_error_t));
+    assert(parser->errors);
+    parser->errors_capacity = capacity;
+  }
+  parser->errors[parser->errors_len++] = (parse_error_t){
+      kind, expected, got->type, got->offset, span.end - span.start};
+}
 
-  char **errors =
-      realloc(parser->errors, sizeof(char *) * (parser->errors_len + 1));
+/* The message for `error`, located in `source` unless it is NULL */
+char *parse_error_format(const parse_error_t *error, source_t *source) {
+  assert(error);
+  char *message = NULL;
+  switch (error->kind) {
+  case PARSE_ERROR_EXPECTED_TOKEN:
+    asprintf(&message, "expected next token to be %s, got %s instead",
+             token_to_str(error->expected), token_to_str(error->got));
+    break;
+  case PARSE_ERROR_EXPECTED_EXPRESSION: {
+    /* Quoted from the source, the token itself is long gone */
+    const char *text = "";
+    int len = 0;
+    if (source != NULL && source_contains(source, error->offset) &&
+        error->offset - source->base + error->len <= source->len) {
+      text = source->text + (error->offset - source->base);
+      len = (int)error->len;
+    }
+    asprintf(&message, "Expected expression, got=%s(%.*s).",
+             token_to_str(error->got), len, text);
+    break;
+  }
+  case PARSE_ERROR_TOO_MANY:
+    asprintf(&message, "too many errors, stopped parsing");
+    break;
+  case PARSE_ERROR_TOO_DEEP:
+    asprintf(&message, "blocks nested deeper than %d, stopped parsing",
+             PARSER_MAX_BLOCKS);
+    break;
+  }
+  assert(message);
+  if (source == NULL) {
+    return message;
+  }
+  char *str = source_format_error(source, error->offset, message);
+  free(message);
+  return str;
+}
 
-  if (errors == NULL) {
-    /*
-     * TODO: Better error handling needed
-     */
-    puts("Cannot allocate memory for errors");
-    exit(1);
+/* The i-th error as "name:line:column: message" */
+char *parser_format_error(parser_t *parser, size_t i) {
+  assert(parser);
+  assert(i < parser->errors_len);
+  if (parser->source == NULL) {
+    uint32_t len = 0;
+    const char *input = lexer_input(parser->l, &len);
+    parser->source =
+        source_new(parser->source_name, input, len, lexer_base(parser->l));
   }
-  parser->errors = errors;
-  parser->errors[parser->errors_len] = strdup(error);
-  parser->errors_len += 1;
+  return parse_error_format(&parser->errors[i], parser->source);
 }
 
+/* Every error formatted, NULL if there are none */
 char **parser_get_errors(parser_t *parser, size_t *error_len) {
   assert(parser);
   assert(error_len);
 
   *error_len = parser->errors_len;
-
-  if (*error_len == 0)
+  if (*error_len == 0) {
     return NULL;
-
-  char **errors = malloc(sizeof(char *) * (*error_len));
-
-  size_t i = 0;
-  while (i != parser->errors_len) {
-    errors[i] = strdup(parser->errors[i]);
-    ;
-    i++;
+  }
+  char **errors = malloc(sizeof(char *) * parser->errors_len);
+  assert(errors);
+  for (size_t i = 0; i < parser->errors_len; i++) {
+    errors[i] = parser_format_error(parser, i);
   }
   return errors;
 }
 
 void parser_peek_error(parser_t *parser, TOKEN token_type) {
-  char error[100];
-  const char *expected_token_str = token_to_str(token_type);
-  const char *actual_token_str = token_to_str(parser->peek_token->type);
-  sprintf(error, "expected next token to be %s, got %s instead",
-          expected_token_str, actual_token_str);
-  parser_append_error(parser, error);
+  parser_error(parser, PARSE_ERROR_EXPECTED_TOKEN, token_type,
+               parser->peek_token, parser->peek_span);
+}
+
+/*
+ * Panic mode: after a statement failed, drops tokens up to and
+ * including the next `;` or unmatched `}`, but stops before the `}`
+ * closing the block being parsed. Once parsing gave up, drops
+ * everything.
+ *
+ * The failed statement's nodes own or freed cur_token, unless it could
+ * not start an expression: then it is lexed again, to be looked at too.
+ */
+static void parser_synchronize(parser_t *parser, bool in_block) {
+  uint32_t end = 0;
+  lexer_input(parser->l, &end);
+  if (parser->cur_unclaimed || parser_gave_up(parser)) {
+    uint32_t offset = parser_gave_up(parser) ? end : parser->cur_span.start;
+    if (parser->cur_unclaimed) {
+      token_destroy(&parser->cur_token);
+    }
+    token_destroy(&parser->peek_token);
+    lexer_seek(parser->l, offset);
+    parser_next_token(parser);
+  }
+  parser->cur_token = NULL;
+
+  size_t depth = 0;
+  for (;;) {
+    TOKEN type = parser->peek_token->type;
+    if (type == EOF_TOKEN || (type == RBRACE_TOKEN && depth == 0 && in_block)) {
+      return;
+    }
+    parser_next_token(parser);
+    token_destroy(&parser->cur_token);
+    if (type == LBRACE_TOKEN) {
+      depth++;
+    } else if (type == RBRACE_TOKEN && depth > 0) {
+      depth--;
+    } else if (type == SEMICOLON_TOKEN && depth == 0) {
+      return;
+    } else if (type == RBRACE_TOKEN) {
+      /* A stray `}` at the top level, with the `;` usually after it */
+      if (parser_peek_token_is(parser, SEMICOLON_TOKEN)) {
+        parser_next_token(parser);
+        token_destroy(&parser->cur_token);
+      }
+      return;
+    }
+  }
+}
+
+/*
+ * Destroys the `;` ending the statement just parsed. Anything else
+ * current belongs to the statement.
+ */
+static void parser_end_statement(parser_t *parser) {
+  if (parser->cur_token != NULL &&
+      parser_cur_token_is(parser, SEMICOLON_TOKEN)) {
+    token_destroy(&parser->cur_token);
+  }
+}
+
+/* Parses the statement at cur_token into `program`, noting its span */
+static void parser_parse_top_level(parser_t *parser, program_t *program) {
+  source_span_t span = {parser->cur_span.start, 0};
+  statement_t *statement = parser_parse_statement(parser);
+  if (statement != NULL) {
+    size_t capacity = program->capacity;
+    program_append_statement(program, statement);
+    span.end = parser->cur_span.end;
+    if (program->capacity != capacity) {
+      program->spans = mem_reallocarray(program->spans, capacity,
+                                        program->capacity,
+                                        sizeof(source_span_t));
+      assert(program->spans);
+    }
+    program->spans[program->len - 1] = span;
+    parser_end_statement(parser);
+  } else {
+    parser_synchronize(parser, false);
+  }
+  parser_next_token(parser);
 }
 
 program_t *parser_parse_program(parser_t *parser) {
@@ -135,27 +299,155 @@ program_t *parser_parse_program(parser_t *parser) {
   program_t *program = program_new();
 
   while (parser->cur_token->type != EOF_TOKEN) {
-    statement_t *statement = parser_parse_statement(parser);
-    if (statement != NULL) {
-      program_append_statement(program, statement);
+    parser_parse_top_level(parser, program);
+  }
+
+  if (parser->errors_len != 0) {
+    /* Statements were skipped, so spans don't line up with them */
+    mem_free(program->spans, program->capacity * sizeof(source_span_t));
+    program->spans = NULL;
+  }
+  return program;
+}
+
+/*
+ * Brings `program`, parsed from the text before `edit`, up to date with
+ * the parser's input, the text after it.
+ *
+ * Top-level statements are independent apart from one token of
+ * lookahead, so the statements ending before the edit are kept, except
+ * the last of them whose lookahead may have changed. Parsing restarts
+ * after the kept ones and stops at the first statement that starts past
+ * the edit where an old one started: the rest of the old statements
+ * are reused with their spans shifted.
+ *
+ * Replaced statements are destroyed, so nothing may borrow from them.
+ * Without spans, or once the new text has errors, this degrades to
+ * parsing everything from the restart point on.
+ */
+void parser_reparse_program(parser_t *parser, program_t *program,
+                            const source_edit_t *edit) {
+  assert(parser);
+  assert(program);
+  assert(edit);
+
+  if (program->arena != NULL) {
+    /* Nodes in an arena can't be freed one at a time */
+    ast_arena_destroy(&program->arena);
+    mem_free(program->spans, program->capacity * sizeof(source_span_t));
+    mem_free(program->shifts, program->capacity * sizeof(int32_t));
+    program->statements = NULL;
+    program->spans = NULL;
+    program->shifts = NULL;
+    program->len = 0;
+    program->capacity = 0;
+  }
+
+  size_t first = 0;
+  if (program->spans != NULL) {
+    size_t lo = 0, hi = program->len;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (program->spans[mid].end < edit->offset) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
     }
-    /*
-     * We are skipping a token here and won't be using it anywhere. So
-     * we must free the allocated memory of the skipping token.
-     */
-    token_t *tok = parser->cur_token;
-    if (tok != NULL) {
-      if (parser->errors_len == 0) {
-        assert(tok->type == SEMICOLON_TOKEN);
-        token_destroy(&tok);
-        parser->cur_token = NULL;
+    first = lo > 0 ? lo - 1 : 0;
+  }
+
+  parser_seek(parser, first > 0 ? program->spans[first - 1].end : 0);
+
+  int64_t delta = (int64_t)edit->inserted - edit->deleted;
+  uint64_t edit_end = (uint64_t)edit->offset + edit->inserted;
+  program_t *fresh = program_new();
+  size_t reuse = program->len;
+  size_t j = first;
+  while (parser->cur_token->type != EOF_TOKEN) {
+    uint32_t start = parser->cur_span.start;
+    if (program->spans != NULL && parser->errors_len == 0 &&
+        start >= edit_end) {
+      while (j < program->len && program->spans[j].start + delta < start) {
+        j++;
+      }
+      if (j < program->len && program->spans[j].start + delta == start) {
+        reuse = j;
+        break;
       }
     }
+    parser_parse_top_level(parser, fresh);
+  }
 
-    parser_next_token(parser);
+  /* Splice: program[0, first) + fresh + program[reuse, len) */
+  for (size_t i = first; i < reuse; i++) {
+    statement_destroy(&program->statements[i]);
+  }
+  size_t tail = program->len - reuse;
+  size_t len = first + fresh->len + tail;
+  if (len > program->capacity) {
+    program->statements = mem_reallocarray(
+        program->statements, program->capacity, len, sizeof(statement_t *));
+    assert(program->statements);
+    if (program->spans != NULL) {
+      program->spans = mem_reallocarray(program->spans, program->capacity,
+                                        len, sizeof(source_span_t));
+      assert(program->spans);
+    }
+    if (program->shifts != NULL) {
+      program->shifts = mem_reallocarray(program->shifts, program->capacity,
+                                         len, sizeof(int32_t));
+      assert(program->shifts);
+    }
+    program->capacity = len;
+  }
+  memmove(program->statements + first + fresh->len,
+          program->statements + reuse, tail * sizeof(statement_t *));
+  if (fresh->len > 0) {
+    memcpy(program->statements + first, fresh->statements,
+           fresh->len * sizeof(statement_t *));
   }
 
-  return program;
+  if (parser->errors_len != 0 || len == 0) {
+    mem_free(program->spans, program->capacity * sizeof(source_span_t));
+    program->spans = NULL;
+  } else {
+    /* Without spans nothing was reused, tail is 0 */
+    if (program->spans == NULL) {
+      program->spans =
+          mem_malloc(program->capacity * sizeof(source_span_t));
+      assert(program->spans);
+    }
+    memmove(program->spans + first + fresh->len, program->spans + reuse,
+            tail * sizeof(source_span_t));
+    if (fresh->len > 0) {
+      memcpy(program->spans + first, fresh->spans,
+             fresh->len * sizeof(source_span_t));
+    }
+    for (size_t i = first + fresh->len; i < len; i++) {
+      program->spans[i].start += delta;
+      program->spans[i].end += delta;
+    }
+  }
+  if (program->shifts != NULL || (delta != 0 && tail > 0)) {
+    /* The reused statements' tokens moved too, see `program_apply_shifts` */
+    if (program->shifts == NULL) {
+      program->shifts = mem_calloc(program->capacity, sizeof(int32_t));
+    }
+    assert(program->shifts);
+    memmove(program->shifts + first + fresh->len, program->shifts + reuse,
+            tail * sizeof(int32_t));
+    memset(program->shifts + first, 0, fresh->len * sizeof(int32_t));
+    for (size_t i = first + fresh->len; i < len; i++) {
+      program->shifts[i] += delta;
+    }
+  }
+  program->len = len;
+
+  /* The statements moved, only the shell and its arrays are left */
+  mem_free(fresh->statements, fresh->capacity * sizeof(statement_t *));
+  mem_free(fresh->spans, fresh->capacity * sizeof(source_span_t));
+  mem_free(fresh, sizeof(program_t));
 }
 
 statement_t *parser_parse_statement(parser_t *parser) {
@@ -163,18 +455,20 @@ statement_t *parser_parse_statement(parser_t *parser) {
 
   TOKEN cur_token_type = parser->cur_token->type;
 
+  void *statement = NULL;
+  STATEMENT_TYPE type;
   if (cur_token_type == LET_TOKEN) {
-    let_statement_t *let_statement = parser_parse_let_statement(parser);
-    return statement_new((void *)let_statement, LET_STATEMENT);
+    statement = parser_parse_let_statement(parser);
+    type = LET_STATEMENT;
   } else if (cur_token_type == RETURN_TOKEN) {
-    return statement_new((void *)parser_parse_return_statement(parser),
-                         RETURN_STATEMENT);
+    statement = parser_parse_return_statement(parser);
+    type = RETURN_STATEMENT;
   } else {
-    expression_statement_t *expression_statement =
-        parser_parse_expression_statement(parser);
-    return statement_new(expression_statement, EXPRESSION_STATEMENT);
+    statement = parser_parse_expression_statement(parser);
+    type = EXPRESSION_STATEMENT;
   }
-  /* Never reaches here */
+  /* Errors are recorded, the caller resynchronizes */
+  return statement != NULL ? statement_new(statement, type) : NULL;
 }
 
 let_statement_t *parser_parse_let_statement(parser_t *parser) {
@@ -206,6 +500,11 @@ let_statement_t *parser_parse_let_statement(parser_t *parser) {
   parser_next_token(parser);
 
   expression_t *value = parser_parse_expression(parser, LOWEST_PRECEDENCE);
+  if (value == NULL) {
+    token_destroy(&let_token);
+    identifier_destroy(&name);
+    return NULL;
+  }
 
   if (parser_peek_token_is(parser, SEMICOLON_TOKEN)) {
     parser_next_token(parser);
@@ -224,17 +523,25 @@ return_statement_t *parser_parse_return_statement(parser_t *parser) {
   parser_next_token(parser);
 
   expression_t *return_value = parser_parse_expression(parser, LOWEST_PRECEDENCE);
+  if (return_value == NULL) {
+    token_destroy(&return_token);
+    return NULL;
+  }
 
-  parser_next_token(parser);
+  if (parser_peek_token_is(parser, SEMICOLON_TOKEN)) {
+    parser_next_token(parser);
+  }
 
   return return_statement_new(return_token, return_value);
 }
 
 expression_statement_t *parser_parse_expression_statement(parser_t *parser) {
   assert(parser);
-  token_t *token = parser->cur_token;
   /* GIVE PRECEDENCE */
   expression_t *expression = parser_parse_expression(parser, LOWEST_PRECEDENCE);
+  if (expression == NULL) {
+    return NULL;
+  }
   if (parser_peek_token_is(parser, SEMICOLON_TOKEN)) {
 
     /*
@@ -247,8 +554,12 @@ expression_statement_t *parser_parse_expression_statement(parser_t *parser) {
     token_destroy(&parser->cur_token);
   }
 
+  /*
+   * The statement borrows the expression's token: the one it started at
+   * may be gone, as a grouping '(' is destroyed once parsed.
+   */
   expression_statement_t *expression_statement =
-      expression_statement_new(token, expression);
+      expression_statement_new(expression_token(expression), expression);
   return expression_statement;
 }
 
@@ -257,6 +568,20 @@ block_statement_t *parser_parse_block_statement(parser_t *parser) {
   token_t *block_token = parser->cur_token;
   statement_t **statements = NULL;
   size_t statements_len = 0;
+  if (parser->blocks == PARSER_MAX_BLOCKS) {
+    parser_error(parser, PARSE_ERROR_TOO_DEEP, ILLEGAL_TOKEN, block_token,
+                 parser->cur_span);
+    /* Skips the rest, leaving this block empty */
+    uint32_t end = 0;
+    lexer_input(parser->l, &end);
+    token_destroy(&parser->peek_token);
+    lexer_seek(parser->l, end);
+    /* cur_token is the block's, and the next one is the end */
+    parser->cur_token = NULL;
+    parser_next_token(parser);
+    return block_statement_new(block_token, NULL, 0);
+  }
+  parser->blocks++;
   parser_next_token(parser);
 
   while (!parser_cur_token_is(parser, RBRACE_TOKEN) &&
@@ -264,12 +589,13 @@ block_statement_t *parser_parse_block_statement(parser_t *parser) {
     statement_t *statement = parser_parse_statement(parser);
     if (statement != NULL) {
       if (statements == NULL) {
-        statements = malloc(sizeof(statement_t *));
+        statements = mem_malloc(sizeof(statement_t *));
         statements[0] = statement;
         statements_len += 1;
       } else {
-        statements =
-            realloc(statements, sizeof(statement_t *) * (statements_len + 1));
+        statements = mem_reallocarray(statements, statements_len,
+                                      statements_len + 1,
+                                      sizeof(statement_t *));
         if (statements == NULL) {
           /*
            * TODO: Better error handling needed
@@ -280,6 +606,8 @@ block_statement_t *parser_parse_block_statement(parser_t *parser) {
         statements[statements_len] = statement;
         statements_len += 1;
       }
+    } else {
+      parser_synchronize(parser, true);
     }
     if (parser->cur_token != NULL && parser_cur_token_is(parser, SEMICOLON_TOKEN)) {
       token_destroy(&parser->cur_token);
@@ -293,53 +621,302 @@ block_statement_t *parser_parse_block_statement(parser_t *parser) {
       parser_cur_token_is(parser, EOF_TOKEN)) {
     token_destroy(&parser->cur_token);
   }
+  parser->blocks--;
   return block_statement;
 }
 
-expression_t *parser_parse_expression(parser_t *parser, PRECEDENCE precedence) {
-  token_t *token = parser->cur_token;
-  prefix_parse_fn prefix = parser->prefix_parselets[token->type];
-
-  if (prefix == NULL) {
-    char *err_str = NULL;
-    asprintf(&err_str, "Expected expression, got=%s(%s).", token_to_str(token->type), token->literal);
-    parser_append_error(parser, err_str);
-    free(err_str);
-    /* printf("Error: %s(%d)\n", token->literal, token->type); */
-    /* assert("Couldn't find a prefix for token"); */
-    return NULL;
+static void parser_push_frame(parser_t *parser, parse_frame_t frame) {
+  if (parser->frames_len == parser->frames_capacity) {
+    size_t capacity =
+        parser->frames_capacity == 0 ? 16 : parser->frames_capacity * 2;
+    parser->frames = mem_reallocarray(parser->frames, parser->frames_capacity,
+                                      capacity, sizeof(parse_frame_t));
+    assert(parser->frames);
+    parser->frames_capacity = capacity;
   }
+  parser->frames[parser->frames_len++] = frame;
+}
 
-  expression_t *left_expression = prefix(parser, token, precedence);
-
-  while (!parser_peek_token_is(parser, SEMICOLON_TOKEN) &&
-         precedence < parser_peek_precedence(parser)) {
-    parser_next_token(parser);
-
-    token = parser->cur_token;
-
-    infix_parse_fn infix = parser->infix_parselets[token->type];
+/* Frees what the frames above `base` hold, after an error */
+static void parser_unwind(parser_t *parser, size_t base) {
+  while (parser->frames_len > base) {
+    parse_frame_t *frame = &parser->frames[--parser->frames_len];
+    token_destroy(&frame->token);
+    expression_destroy(&frame->left);
+    if (frame->kind == PARSE_FRAME_ARRAY || frame->kind == PARSE_FRAME_CALL) {
+      param_exp_t *list = frame->node;
+      param_exp_destroy(&list);
+    } else if (frame->kind == PARSE_FRAME_MAP_KEY ||
+               frame->kind == PARSE_FRAME_MAP_VALUE) {
+      map_literal_t *map = frame->node;
+      map_literal_destroy(&map);
+    }
+  }
+}
 
-    if (infix == NULL) {
-      return left_expression;
+/*
+ * Starts the operand at cur_token. Returns true if it pushed a frame
+ * and the operand inside is next, otherwise `*left` is the operand, or
+ * NULL after an error.
+ */
+static bool parser_begin_operand(parser_t *parser, PRECEDENCE *precedence,
+                                 expression_t **left) {
+  token_t *token = parser->cur_token;
+  switch (token->type) {
+  case BANG_TOKEN:
+  case MINUS_TOKEN:
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_PREFIX,
+                                              .precedence = *precedence,
+                                              .token = token});
+    *precedence = PREFIX_PRECEDENCE;
+    break;
+  case LPAREN_TOKEN:
+    /* Destroy LPAREN token */
+    token_destroy(&parser->cur_token);
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_GROUP,
+                                              .precedence = *precedence});
+    *precedence = LOWEST_PRECEDENCE;
+    break;
+  case LBRACKET_TOKEN:
+    if (parser_peek_token_is(parser, RBRACKET_TOKEN)) {
+      parser_next_token(parser);
+      token_destroy(&parser->cur_token);
+      *left = expression_new(ARRAY_EXP, array_new(token, param_exp_new()));
+      return false;
     }
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_ARRAY,
+                                              .precedence = *precedence,
+                                              .token = token,
+                                              .node = param_exp_new()});
+    *precedence = LOWEST_PRECEDENCE;
+    break;
+  case LBRACE_TOKEN: {
+    map_literal_t *map = map_literal_new(token);
+    if (parser_peek_token_is(parser, RBRACE_TOKEN)) {
+      parser_next_token(parser);
+      token_destroy(&parser->cur_token);
+      *left = expression_new(MAP_EXP, map);
+      return false;
+    }
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_MAP_KEY,
+                                              .precedence = *precedence,
+                                              .node = map});
+    *precedence = LOWEST_PRECEDENCE;
+    break;
+  }
+  default: {
+    prefix_parse_fn prefix = parselets[token->type].prefix;
+    if (prefix == NULL) {
+      parser_error(parser, PARSE_ERROR_EXPECTED_EXPRESSION, ILLEGAL_TOKEN,
+                   token, parser->cur_span);
+      /* Left for `parser_synchronize`, it may end the statement */
+      parser->cur_unclaimed = true;
+      *left = NULL;
+    } else {
+      *left = prefix(parser, token, *precedence);
+    }
+    return false;
+  }
+  }
+  parser_next_token(parser);
+  return true;
+}
 
-    left_expression = infix(parser, token, precedence, left_expression);
+/*
+ * Starts the infix operator at peek_token, applied to `*left`. Returns
+ * true if it pushed a frame and its right side is next, otherwise
+ * `*left` is the whole expression.
+ */
+static bool parser_begin_infix(parser_t *parser, PRECEDENCE *precedence,
+                               expression_t **left) {
+  parser_next_token(parser);
+  token_t *token = parser->cur_token;
+  switch (token->type) {
+  case LPAREN_TOKEN:
+    if (parser_peek_token_is(parser, RPAREN_TOKEN)) {
+      parser_next_token(parser);
+      token_destroy(&parser->cur_token);
+      *left = expression_new(CALL_EXP,
+                             call_exp_new(token, param_exp_new(), *left));
+      return false;
+    }
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_CALL,
+                                              .precedence = *precedence,
+                                              .token = token,
+                                              .left = *left,
+                                              .node = param_exp_new()});
+    *precedence = LOWEST_PRECEDENCE;
+    break;
+  case LBRACKET_TOKEN:
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_INDEX,
+                                              .precedence = *precedence,
+                                              .token = token,
+                                              .left = *left});
+    *precedence = LOWEST_PRECEDENCE;
+    break;
+  default:
+    parser_push_frame(parser, (parse_frame_t){.kind = PARSE_FRAME_INFIX,
+                                              .precedence = *precedence,
+                                              .token = token,
+                                              .left = *left});
+    *precedence = parselets[token->type].precedence;
+    break;
   }
+  *left = NULL;
+  parser_next_token(parser);
+  return true;
+}
 
-  /* If we have already reached EOF TOKEN, just destroy it and return */
-  if (parser->cur_token != NULL && parser_cur_token_is(parser, EOF_TOKEN)) {
+/*
+ * Puts the operand `*left` into the frame on top. Returns true if the
+ * frame wants another operand, otherwise pops it and `*left` is what
+ * it built, or NULL after an error, with the frame left to unwind.
+ */
+static bool parser_end_frame(parser_t *parser, PRECEDENCE *precedence,
+                             expression_t **left) {
+  parse_frame_t *frame = &parser->frames[parser->frames_len - 1];
+  expression_t *operand = *left;
+  switch (frame->kind) {
+  case PARSE_FRAME_PREFIX:
+    *left = expression_new(PREFIX_EXP, prefix_new(frame->token, operand));
+    break;
+  case PARSE_FRAME_INFIX:
+    *left = expression_new(INFIX_EXP,
+                           infix_new(frame->token, frame->left, operand));
+    break;
+  case PARSE_FRAME_GROUP:
+    if (!parser_expect_peek(parser, RPAREN_TOKEN)) {
+      expression_destroy(left);
+      return false;
+    }
+    /* Destroy RPAREN token */
+    token_destroy(&parser->cur_token);
+    break;
+  case PARSE_FRAME_INDEX:
+    if (!parser_expect_peek(parser, RBRACKET_TOKEN)) {
+      expression_destroy(left);
+      return false;
+    }
+    /* Destroy RBRACKET token */
+    token_destroy(&parser->cur_token);
+    *left = expression_new(INDEX_EXP,
+                           index_exp_new(frame->token, frame->left, operand));
+    break;
+  case PARSE_FRAME_ARRAY:
+  case PARSE_FRAME_CALL: {
+    param_exp_append(frame->node, operand);
+    *left = NULL;
+    if (parser_peek_token_is(parser, COMMA_TOKEN)) {
+      parser_next_token(parser);
+      token_destroy(&parser->cur_token); /* Delete 'COMMA' token */
+      parser_next_token(parser);
+      *precedence = LOWEST_PRECEDENCE;
+      return true;
+    }
+    bool array = frame->kind == PARSE_FRAME_ARRAY;
+    if (!parser_expect_peek(parser, array ? RBRACKET_TOKEN : RPAREN_TOKEN)) {
+      return false;
+    }
+    /* Destroy the closing token */
     token_destroy(&parser->cur_token);
-    return left_expression;
+    if (array) {
+      *left = expression_new(ARRAY_EXP, array_new(frame->token, frame->node));
+    } else {
+      *left = expression_new(
+          CALL_EXP, call_exp_new(frame->token, frame->node, frame->left));
+    }
+    break;
   }
-
-  /* Should check for semicolon too? */
-  if (parser_peek_token_is(parser, EOF_TOKEN)) {
+  case PARSE_FRAME_MAP_KEY:
+    if (!parser_expect_peek(parser, COLON_TOKEN)) {
+      expression_destroy(left);
+      return false;
+    }
+    /* Destroy COLON token */
+    token_destroy(&parser->cur_token);
+    parser_next_token(parser);
+    frame->kind = PARSE_FRAME_MAP_VALUE;
+    frame->left = operand;
+    *left = NULL;
+    *precedence = LOWEST_PRECEDENCE;
+    return true;
+  case PARSE_FRAME_MAP_VALUE:
+    map_literal_append(frame->node, frame->left, operand);
+    frame->left = NULL;
+    *left = NULL;
+    if (!parser_peek_token_is(parser, RBRACE_TOKEN)) {
+      if (!parser_expect_peek(parser, COMMA_TOKEN)) {
+        return false;
+      }
+      /* Destroy COMMA token */
+      token_destroy(&parser->cur_token);
+      if (!parser_peek_token_is(parser, RBRACE_TOKEN)) {
+        parser_next_token(parser);
+        frame->kind = PARSE_FRAME_MAP_KEY;
+        *precedence = LOWEST_PRECEDENCE;
+        return true;
+      }
+    }
     parser_next_token(parser);
+    /* Destroy RBRACE token */
     token_destroy(&parser->cur_token);
+    *left = expression_new(MAP_EXP, frame->node);
+    break;
+  }
+  *precedence = frame->precedence;
+  parser->frames_len--;
+  return false;
+}
+
+/*
+ * Pratt parsing with an explicit stack of frames instead of recursion,
+ * so nesting costs heap rather than C stack. Every operand that becomes
+ * part of a bigger expression -- of a prefix or infix operator, inside
+ * parentheses, a list, an index or a map -- has a frame saying what to
+ * build once it is parsed. The frames above `base` are this call's;
+ * `if` and `fn` bodies hold statements, which call in again on top.
+ */
+expression_t *parser_parse_expression(parser_t *parser, PRECEDENCE precedence) {
+  size_t base = parser->frames_len;
+  expression_t *left = NULL;
+  bool want_operand = true;
+
+  for (;;) {
+    if (want_operand) {
+      want_operand = parser_begin_operand(parser, &precedence, &left);
+      if (want_operand) {
+        continue;
+      }
+      if (left == NULL) {
+        break;
+      }
+    }
+
+    if (!parser_peek_token_is(parser, SEMICOLON_TOKEN) &&
+        precedence < parselets[parser->peek_token->type].precedence) {
+      want_operand = parser_begin_infix(parser, &precedence, &left);
+      continue;
+    }
+
+    /* If we have already reached EOF TOKEN, just destroy it */
+    if (parser->cur_token != NULL && parser_cur_token_is(parser, EOF_TOKEN)) {
+      token_destroy(&parser->cur_token);
+    } else if (parser_peek_token_is(parser, EOF_TOKEN)) {
+      parser_next_token(parser);
+      token_destroy(&parser->cur_token);
+    }
+
+    if (parser->frames_len == base) {
+      return left;
+    }
+    want_operand = parser_end_frame(parser, &precedence, &left);
+    if (!want_operand && left == NULL) {
+      break;
+    }
   }
 
-  return left_expression;
+  parser_unwind(parser, base);
+  return NULL;
 }
 
 expression_t *parser_parse_identifier(parser_t *parser, token_t *token,
@@ -358,30 +935,19 @@ expression_t *parser_parse_integer(parser_t *parser, token_t *token,
   return expression;
 }
 
-expression_t *parser_parse_boolean(parser_t *parser, token_t *token,
-                                   PRECEDENCE precedence) {
+expression_t *parser_parse_string(parser_t *parser, token_t *token,
+                                  PRECEDENCE precedence) {
   assert(token);
-  boolean_t *boolean = boolean_new(token);
-  expression_t *expression = expression_new(BOOLEAN_EXP, boolean);
+  string_t *string = string_new(token);
+  expression_t *expression = expression_new(STRING_EXP, string);
   return expression;
 }
 
-expression_t *parser_parse_grouped_expression(parser_t *parser, token_t *token,
-                                              PRECEDENCE precedence) {
+expression_t *parser_parse_boolean(parser_t *parser, token_t *token,
+                                   PRECEDENCE precedence) {
   assert(token);
-  /* Destroy LPAREN TOKEN */
-  token_destroy(&parser->cur_token);
-  parser_next_token(parser);
-
-  expression_t *expression = parser_parse_expression(parser, LOWEST_PRECEDENCE);
-
-  if (!parser_expect_peek(parser, RPAREN_TOKEN)) {
-    return NULL;
-  }
-
-  /* Destroy RPAREN token */
-  token_destroy(&parser->cur_token);
-
+  boolean_t *boolean = boolean_new(token);
+  expression_t *expression = expression_new(BOOLEAN_EXP, boolean);
   return expression;
 }
 
@@ -391,7 +957,7 @@ expression_t *parser_parse_if_expression(parser_t *parser, token_t *token,
   token_t *if_token = token;
 
   if (!parser_expect_peek(parser, LPAREN_TOKEN)) {
-    assert("Expected LPAREN");
+    token_destroy(&if_token);
     return NULL;
   }
   /* Destroy LPAREN */
@@ -399,16 +965,22 @@ expression_t *parser_parse_if_expression(parser_t *parser, token_t *token,
   parser_next_token(parser);
 
   expression_t *condition = parser_parse_expression(parser, LOWEST_PRECEDENCE);
+  if (condition == NULL) {
+    token_destroy(&if_token);
+    return NULL;
+  }
 
   if (!parser_expect_peek(parser, RPAREN_TOKEN)) {
-    assert("Expected RPAREN");
+    token_destroy(&if_token);
+    expression_destroy(&condition);
     return NULL;
   }
   /* Destroy RPAREN */
   token_destroy(&parser->cur_token);
 
   if (!parser_expect_peek(parser, LBRACE_TOKEN)) {
-    assert("Expected LBRACE");
+    token_destroy(&if_token);
+    expression_destroy(&condition);
     return NULL;
   }
 
@@ -419,7 +991,9 @@ expression_t *parser_parse_if_expression(parser_t *parser, token_t *token,
     /* Destroy `ELSE_TOKEN` */
     token_destroy(&parser->cur_token);
     if (!parser_expect_peek(parser, LBRACE_TOKEN)) {
-      assert("Else requires LBRACE");
+      token_destroy(&if_token);
+      expression_destroy(&condition);
+      block_statement_destroy(&consequence);
       return NULL;
     }
     alternative = parser_parse_block_statement(parser);
@@ -442,7 +1016,10 @@ param_t *parser_parse_params(parser_t *parser) {
     return params;
   }
 
-  parser_next_token(parser);
+  if (!parser_expect_peek(parser, IDENT_TOKEN)) {
+    param_destroy(&params);
+    return NULL;
+  }
 
   identifier_t *identifier = identifier_new(parser->cur_token);
   param_append(params, identifier);
@@ -452,45 +1029,17 @@ param_t *parser_parse_params(parser_t *parser) {
     parser_next_token(parser);
     assert(parser->cur_token->type == COMMA_TOKEN);
     token_destroy(&parser->cur_token); /* delete COMMA token */
-    parser_next_token(parser);
+    if (!parser_expect_peek(parser, IDENT_TOKEN)) {
+      param_destroy(&params);
+      return NULL;
+    }
 
     identifier = identifier_new(parser->cur_token);
     param_append(params, identifier);
   }
 
   if (!parser_expect_peek(parser, RPAREN_TOKEN)) {
-    assert("Expected RPAREN");
-    return NULL;
-  }
-
-  return params;
-}
-
-param_exp_t *parser_parse_param_exps(parser_t *parser) {
-  param_exp_t *params = param_exp_new();
-
-  if (parser_peek_token_is(parser, RPAREN_TOKEN)) {
-    parser_next_token(parser);
-    return params;
-  }
-  parser_next_token(parser);
-
-  expression_t *expression = parser_parse_expression(parser, LOWEST_PRECEDENCE);
-  param_exp_append(params, expression);
-
-  while (parser_peek_token_is(parser, COMMA_TOKEN)) {
-    /* expression_token */
-    parser_next_token(parser);
-    assert(parser->cur_token->type == COMMA_TOKEN);
-    token_destroy(&parser->cur_token); /* Delete 'COMMA' token */
-
-    parser_next_token(parser);
-    expression = parser_parse_expression(parser, LOWEST_PRECEDENCE);
-    param_exp_append(params, expression);
-  }
-
-  if (!parser_expect_peek(parser, RPAREN_TOKEN)) {
-    assert("Expected RPAREN");
+    param_destroy(&params);
     return NULL;
   }
 
@@ -501,19 +1050,25 @@ expression_t *parser_parse_fn_literal(parser_t *parser, token_t *token,
                                       PRECEDENCE precedence) {
 
   token_t *fn_token = parser->cur_token;
+  parser->fn_literals++;
 
   if (!parser_expect_peek(parser, LPAREN_TOKEN)) {
-    assert("Expected LPAREN");
+    token_destroy(&fn_token);
     return NULL;
   }
 
   param_t *params = parser_parse_params(parser);
+  if (params == NULL) {
+    token_destroy(&fn_token);
+    return NULL;
+  }
 
   assert(parser->cur_token->type == RPAREN_TOKEN);
   token_destroy(&parser->cur_token);
 
   if (!parser_expect_peek(parser, LBRACE_TOKEN)) {
-    assert("Expected LBRACE");
+    token_destroy(&fn_token);
+    param_destroy(&params);
     return NULL;
   }
 
@@ -524,56 +1079,6 @@ expression_t *parser_parse_fn_literal(parser_t *parser, token_t *token,
   return expression_new(FN_EXP, fn);
 }
 
-expression_t *parser_parse_prefix(parser_t *parser, token_t *token,
-                                  PRECEDENCE precedence) {
-  assert(parser);
-  assert(token);
-  token_t *operator= token;
-
-  parser_next_token(parser);
-
-  expression_t *operand = parser_parse_expression(parser, PREFIX_PRECEDENCE);
-  return expression_new(PREFIX_EXP, prefix_new(operator, operand));
-}
-
-expression_t *parser_parse_infix(parser_t *parser, token_t *token,
-                                 PRECEDENCE precedence, expression_t *left) {
-  assert(parser);
-  assert(token);
-  assert(left);
-
-  token_t *operator= token;
-  PRECEDENCE cur_precedence = token_get_precedence(operator);
-
-  parser_next_token(parser);
-
-  expression_t *right = parser_parse_expression(parser, cur_precedence);
-  infix_t *infix = infix_new(operator, left, right);
-  expression_t *expression = expression_new(INFIX_EXP, infix);
-  return expression;
-}
-
-expression_t *parser_parse_call_expression(parser_t *parser, token_t *token,
-                                           PRECEDENCE precedence, expression_t *left) {
-  assert(parser);
-  assert(token);
-  assert(left);
-
-  assert(token->type == LPAREN_TOKEN);
-  token_t *lparen = token;
-  PRECEDENCE cur_precedence = token_get_precedence(lparen);
-
-  /* parser_next_token(parser); */
-
-  param_exp_t *params = parser_parse_param_exps(parser);
-
-  assert(parser->cur_token->type == RPAREN_TOKEN);
-  token_destroy(&parser->cur_token);
-
-  call_exp_t *call_exp = call_exp_new(lparen, params, left);
-  return expression_new(CALL_EXP, call_exp);
-}
-
 bool parser_cur_token_is(parser_t *parser, TOKEN token_type) {
   assert(parser);
   return parser->cur_token->type == token_type;
@@ -593,35 +1098,3 @@ bool parser_expect_peek(parser_t *parser, TOKEN token_type) {
     return false;
   }
 }
-
-PRECEDENCE token_get_precedence(token_t *token) {
-  assert(token);
-  switch (token->type) {
-  case PLUS_TOKEN:
-  case MINUS_TOKEN:
-    return SUM_PRECEDENCE;
-  case SLASH_TOKEN:
-  case ASTERISK_TOKEN:
-    return PRODUCT_PRECEDENCE;
-  case EQ_TOKEN:
-  case NOT_EQ_TOKEN:
-    return EQUALS_PRECEDENCE;
-  case LT_TOKEN:
-  case GT_TOKEN:
-    return LESSGREATER_PRECEDENCE;
-  case LPAREN_TOKEN:
-    return CALL_PRECEDENCE;
-  default:
-    return LOWEST_PRECEDENCE;
-  }
-}
-
-PRECEDENCE parser_cur_precedence(parser_t *parser) {
-  assert(parser);
-  return token_get_precedence(parser->cur_token);
-}
-
-PRECEDENCE parser_peek_precedence(parser_t *parser) {
-  assert(parser);
-  return token_get_precedence(parser->peek_token);
-}
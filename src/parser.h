@@ -3,6 +3,7 @@
 
 #include "ast.h"
 #include "lexer.h"
+#include "source.h"
 #include "token.h"
 #include "utils.h"
 
@@ -14,34 +15,111 @@ typedef enum {
   PRODUCT_PRECEDENCE,
   PREFIX_PRECEDENCE,
   CALL_PRECEDENCE,
+  INDEX_PRECEDENCE,
 } PRECEDENCE;
 
+/* Parsing stops after this many errors, see `parser_t.max_errors` */
+#define PARSER_MAX_ERRORS 100
+/*
+ * Parsing stops at a block nested deeper than this: blocks are parsed
+ * recursively, so they must not reach the end of the C stack.
+ */
+#define PARSER_MAX_BLOCKS 1024
+
+typedef enum {
+  PARSE_ERROR_EXPECTED_TOKEN,      /* `expected` was wanted, not `got` */
+  PARSE_ERROR_EXPECTED_EXPRESSION, /* `got` can't start an expression */
+  PARSE_ERROR_TOO_MANY,            /* parsing stopped here */
+  PARSE_ERROR_TOO_DEEP,            /* parsing stopped at this block */
+} PARSE_ERROR;
+
+/*
+ * Errors are recorded as they are found and only turned into messages
+ * when someone asks for them, see `parse_error_format`. `offset` and
+ * `len` are where `got` is, so the message can quote it.
+ */
+typedef struct {
+  PARSE_ERROR kind;
+  TokenType expected;
+  TokenType got;
+  uint32_t offset;
+  uint32_t len;
+} parse_error_t;
+
+/* What the operand being parsed becomes part of */
+typedef enum {
+  PARSE_FRAME_PREFIX,    /* `-x`, `!x` */
+  PARSE_FRAME_INFIX,     /* the right side of `a + b` */
+  PARSE_FRAME_GROUP,     /* `(x)` */
+  PARSE_FRAME_ARRAY,     /* an element of `[a, b]` */
+  PARSE_FRAME_CALL,      /* an argument of `f(a, b)` */
+  PARSE_FRAME_INDEX,     /* `a[i]` */
+  PARSE_FRAME_MAP_KEY,   /* a key of `{k: v}` */
+  PARSE_FRAME_MAP_VALUE, /* a value of `{k: v}`, the key is `left` */
+} PARSE_FRAME;
+
+/* See `parser_parse_expression` */
+typedef struct {
+  PARSE_FRAME kind;
+  PRECEDENCE precedence; /* to go back to once the frame is done */
+  token_t *token;        /* operator, `(` or `[` */
+  expression_t *left;    /* left side, callee, indexed or map key */
+  void *node;            /* param_exp_t of a list, map_literal_t of a map */
+} parse_frame_t;
+
 /* forward declaration */
 typedef struct _parser_t parser_t;
 
 typedef expression_t *(*prefix_parse_fn)(parser_t *parser, token_t *token,
                                          PRECEDENCE precedence);
-typedef expression_t *(*infix_parse_fn)(parser_t *parser, token_t *token,
-                                        PRECEDENCE precedence,
-                                        expression_t *left_expression);
+
+/* An entry of the Pratt table, see parser.c */
+typedef struct {
+  prefix_parse_fn prefix;
+  PRECEDENCE precedence; /* as an infix operator */
+} parselet_t;
 
 struct _parser_t {
   lexer_t *l;
   token_t *cur_token;
   token_t *peek_token;
-  char **errors;
+  /* Source offsets of cur_token and peek_token, kept once they are freed */
+  source_span_t cur_span;
+  source_span_t peek_span;
+  parse_error_t *errors;
   size_t errors_len;
-  prefix_parse_fn *prefix_parselets;
-  infix_parse_fn *infix_parselets;
+  size_t errors_capacity;
+  size_t max_errors;       /* 0 for no limit */
+  bool cur_unclaimed;      /* cur_token failed to start an expression */
+  const char *source_name; /* borrowed, see `parser_set_source_name` */
+  source_t *source;        /* locates errors; created on first use */
+  size_t fn_literals; /* function literals parsed so far */
+  size_t blocks;      /* being parsed, see PARSER_MAX_BLOCKS */
+  /* Operands being parsed, innermost last */
+  parse_frame_t *frames;
+  size_t frames_len;
+  size_t frames_capacity;
 };
 
+/* Replaces `deleted` bytes at `offset` with `inserted` bytes */
+typedef struct {
+  uint32_t offset;
+  uint32_t deleted;
+  uint32_t inserted;
+} source_edit_t;
+
 parser_t *parser_new(lexer_t *l);
 void parser_next_token(parser_t *p);
+void parser_seek(parser_t *p, uint32_t offset);
 void parser_destroy(parser_t **p_p);
-void parser_append_error(parser_t *parser, char *error);
+void parser_set_source_name(parser_t *parser, const char *name);
+char *parse_error_format(const parse_error_t *error, source_t *source);
+char *parser_format_error(parser_t *parser, size_t i);
 char **parser_get_errors(parser_t *parser, size_t *error_len);
 void parser_peek_error(parser_t *parser, TOKEN token_type);
 program_t *parser_parse_program(parser_t *p);
+void parser_reparse_program(parser_t *p, program_t *program,
+                            const source_edit_t *edit);
 statement_t *parser_parse_statement(parser_t *p);
 let_statement_t *parser_parse_let_statement(parser_t *p);
 return_statement_t *parser_parse_return_statement(parser_t *p);
@@ -57,27 +135,14 @@ expression_t *parser_parse_identifier(parser_t *parser, token_t *token,
                                       PRECEDENCE precedence);
 expression_t *parser_parse_integer(parser_t *parser, token_t *token,
                                    PRECEDENCE precedence);
+expression_t *parser_parse_string(parser_t *parser, token_t *token,
+                                  PRECEDENCE precedence);
 expression_t *parser_parse_boolean(parser_t *parser, token_t *token,
                                    PRECEDENCE precedence);
-expression_t *parser_parse_grouped_expression(parser_t *parser, token_t *token,
-                                              PRECEDENCE precedence);
 expression_t *parser_parse_if_expression(parser_t *parser, token_t *token,
                                          PRECEDENCE precedence);
 param_t *parser_parse_params(parser_t *parser);
-param_exp_t *parser_parse_param_exps(parser_t *parser);
 expression_t *parser_parse_fn_literal(parser_t *parser, token_t *token,
                                       PRECEDENCE precedence);
 
-expression_t *parser_parse_prefix(parser_t *parser, token_t *token,
-                                  PRECEDENCE precedence);
-
-expression_t *parser_parse_infix(parser_t *parser, token_t *token,
-                                 PRECEDENCE precedence, expression_t *left);
-expression_t *parser_parse_call_expression(parser_t *parser, token_t *token,
-                                           PRECEDENCE precedence, expression_t *left);
-
-PRECEDENCE token_get_precedence(token_t *token);
-PRECEDENCE parser_cur_precedence(parser_t *parser);
-PRECEDENCE parser_peek_precedence(parser_t *parser);
-
 #endif
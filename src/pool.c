@@ -0,0 +1,142 @@
+#include "pool.h"
+
+#ifdef MONKEY_POOLS
+#include <pthread.h>
+
+/* Blocks carved from each slab */
+#define POOL_SLAB_BLOCKS (POOL_BATCH * 16)
+
+typedef struct _pool_slab_t {
+  struct _pool_slab_t *next;
+  _Alignas(16) char blocks[];
+} pool_slab_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pool_block_t *batches; /* linked by `next_batch` */
+  pool_slab_t *slabs;    /* all of them, so they stay reachable */
+  size_t carved;         /* blocks of the newest slab handed out */
+} pool_t;
+
+#define POOL_INIT                                                              \
+  { .lock = PTHREAD_MUTEX_INITIALIZER, .carved = POOL_SLAB_BLOCKS }
+
+static pool_t pools[POOL_KINDS] = {POOL_INIT, POOL_INIT, POOL_INIT};
+
+_Thread_local pool_cache_t pool_caches[POOL_KINDS];
+
+/* Gives a thread's free lists back when it exits */
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local bool pool_registered = false;
+
+/* Keeps blocks aligned for any of the objects and big enough to link */
+static size_t pool_block_size(POOL_KIND kind) {
+  size_t size = (pool_object_size(kind) + 7) & ~(size_t)7;
+  return size > sizeof(pool_block_t) ? size : sizeof(pool_block_t);
+}
+
+static void pool_give(POOL_KIND kind, pool_block_t *batch) {
+  pool_t *pool = &pools[kind];
+  pthread_mutex_lock(&pool->lock);
+  batch->next_batch = pool->batches;
+  pool->batches = batch;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_flush(void *unused) {
+  (void)unused;
+  for (size_t kind = 0; kind < POOL_KINDS; kind++) {
+    pool_cache_t *cache = &pool_caches[kind];
+    if (cache->free != NULL) {
+      pool_give(kind, cache->free);
+      cache->free = NULL;
+      cache->len = 0;
+    }
+  }
+}
+
+static void pool_make_key(void) {
+  int rc = pthread_key_create(&pool_key, pool_flush);
+  assert(rc == 0);
+  (void)rc;
+}
+
+static void pool_register(void) {
+  pthread_once(&pool_key_once, pool_make_key);
+  /* Destructors only run for keys with a value */
+  pthread_setspecific(pool_key, pool_caches);
+  pool_registered = true;
+}
+
+/* Links a batch out of the newest slab, with the pool locked */
+static pool_block_t *pool_carve(pool_t *pool, POOL_KIND kind) {
+  size_t block_size = pool_block_size(kind);
+  if (pool->carved == POOL_SLAB_BLOCKS) {
+    pool_slab_t *slab =
+        malloc(sizeof(pool_slab_t) + POOL_SLAB_BLOCKS * block_size);
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->carved = 0;
+  }
+  char *start = pool->slabs->blocks + pool->carved * block_size;
+  pool->carved += POOL_BATCH;
+  for (size_t i = 0; i < POOL_BATCH; i++) {
+    pool_block_t *block = (pool_block_t *)(start + i * block_size);
+    block->next = i + 1 < POOL_BATCH
+                      ? (pool_block_t *)(start + (i + 1) * block_size)
+                      : NULL;
+  }
+  return (pool_block_t *)start;
+}
+
+/*
+ * Refills the calling thread's empty list of `kind` with a batch and
+ * returns the batch's first block, which the list does not keep.
+ */
+pool_block_t *pool_refill(POOL_KIND kind) {
+  if (!pool_registered) {
+    pool_register();
+  }
+  pool_t *pool = &pools[kind];
+  pthread_mutex_lock(&pool->lock);
+  pool_block_t *batch = pool->batches;
+  if (batch != NULL) {
+    pool->batches = batch->next_batch;
+  } else {
+    batch = pool_carve(pool, kind);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (batch == NULL) {
+    return NULL;
+  }
+
+  /* Batches from exiting threads may be of any length */
+  pool_cache_t *cache = &pool_caches[kind];
+  cache->free = batch->next;
+  cache->len = 0;
+  for (pool_block_t *block = cache->free; block != NULL; block = block->next) {
+    cache->len++;
+  }
+  return batch;
+}
+
+/*
+ * Gives the shared pool a batch from the calling thread's list of
+ * `kind`, which holds more than two. The blocks freed last stay.
+ */
+void pool_spill(POOL_KIND kind) {
+  pool_cache_t *cache = &pool_caches[kind];
+  pool_block_t *last = cache->free;
+  for (size_t i = 1; i < cache->len - POOL_BATCH; i++) {
+    last = last->next;
+  }
+  pool_block_t *batch = last->next;
+  last->next = NULL;
+  cache->len -= POOL_BATCH;
+  pool_give(kind, batch);
+}
+#endif
@@ -0,0 +1,112 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "memory.h"
+#include "object.h"
+
+/*
+ * Pools for the fixed-size objects evaluation makes and drops the
+ * most: `obj_t` and the int and error payloads. Each thread keeps a
+ * free list per kind and allocates from it without locking.
+ * An empty list takes a batch of blocks from the kind's shared pool,
+ * which carves a new slab when it has no batch left, and a list grown
+ * past two batches gives one back, so blocks freed on one thread are
+ * reused on others. Slabs are kept for the life of the process and
+ * recycled block by block.
+ *
+ * Blocks are charged to the current memory context as the objects
+ * they hold, as `mem_malloc` would charge them. Configure with
+ * --disable-pools to allocate with the system allocator instead, to
+ * compare. Builds with allocation stats or AddressSanitizer never
+ * pool: both want each object to be a block of its own.
+ */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define POOL_ASAN
+#endif
+#endif
+#if !defined(MONKEY_NO_POOLS) && !defined(MONKEY_ALLOC_STATS) &&             \
+    !defined(__SANITIZE_ADDRESS__) && !defined(POOL_ASAN)
+#define MONKEY_POOLS
+#endif
+
+typedef enum {
+  POOL_OBJ,
+  POOL_INT,
+  POOL_ERROR,
+  POOL_KINDS,
+} POOL_KIND;
+
+static inline size_t pool_object_size(POOL_KIND kind) {
+  switch (kind) {
+  case POOL_OBJ:
+    return sizeof(obj_t);
+  case POOL_INT:
+    return sizeof(int_obj_t);
+  case POOL_ERROR:
+    return sizeof(error_obj_t);
+  case POOL_KINDS:
+    break;
+  }
+  return 0;
+}
+
+#ifdef MONKEY_POOLS
+/* Blocks a thread takes from or gives back to a shared pool at once */
+#define POOL_BATCH 64
+
+typedef struct _pool_block_t {
+  struct _pool_block_t *next;       /* in a free list */
+  struct _pool_block_t *next_batch; /* on a shared batch's first block */
+} pool_block_t;
+
+typedef struct {
+  pool_block_t *free;
+  size_t len;
+} pool_cache_t;
+
+/* Use `pool_alloc` and `pool_free` rather than this */
+extern _Thread_local pool_cache_t pool_caches[POOL_KINDS];
+
+pool_block_t *pool_refill(POOL_KIND kind);
+void pool_spill(POOL_KIND kind);
+
+/* `category` is for builds without pools */
+static inline void *pool_alloc(POOL_KIND kind, MEM_CATEGORY category) {
+  (void)category;
+  pool_cache_t *cache = &pool_caches[kind];
+  pool_block_t *block = cache->free;
+  if (block != NULL) {
+    cache->free = block->next;
+    cache->len--;
+  } else if ((block = pool_refill(kind)) == NULL) {
+    return NULL;
+  }
+  memory_charge(pool_object_size(kind));
+  return block;
+}
+
+static inline void pool_free(POOL_KIND kind, void *ptr) {
+  if (ptr != NULL) {
+    pool_cache_t *cache = &pool_caches[kind];
+    pool_block_t *block = ptr;
+    memory_credit(pool_object_size(kind));
+    block->next = cache->free;
+    cache->free = block;
+    if (++cache->len > 2 * POOL_BATCH) {
+      pool_spill(kind);
+    }
+  }
+}
+#else
+static inline void *pool_alloc(POOL_KIND kind, MEM_CATEGORY category) {
+  (void)category;
+  return mem_malloc_as(category, pool_object_size(kind));
+}
+
+static inline void pool_free(POOL_KIND kind, void *ptr) {
+  mem_free(ptr, pool_object_size(kind));
+}
+#endif
+
+#endif
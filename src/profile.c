@@ -0,0 +1,177 @@
+#include "profile.h"
+#include "source.h"
+#include "vm.h"
+#include <sys/time.h>
+
+_Thread_local profile_stack_t *profile_stack = NULL;
+
+/* The running profiler, read by the signal handler */
+static profile_t *volatile profile_running = NULL;
+
+profile_t *profile_new(unsigned hz) {
+  profile_t *profile = calloc(1, sizeof(profile_t));
+  assert(profile);
+  profile->hz = hz != 0 ? hz : PROFILE_DEFAULT_HZ;
+  profile->frames = malloc(PROFILE_BUFFER_FRAMES * sizeof(profile_frame_t));
+  assert(profile->frames);
+  /* Top-level samples take no frames, so they get their own room */
+  profile->samples_capacity = PROFILE_BUFFER_FRAMES;
+  profile->depths = malloc(profile->samples_capacity * sizeof(uint32_t));
+  assert(profile->depths);
+  return profile;
+}
+
+void profile_destroy(profile_t **profile_p) {
+  assert(profile_p);
+  if (*profile_p) {
+    profile_t *profile = *profile_p;
+    assert(profile_running != profile);
+    free(profile->frames);
+    free(profile->depths);
+    free(profile);
+    *profile_p = NULL;
+  }
+}
+
+/* Only copies: it may interrupt anything, malloc included */
+static void profile_on_sigprof(int sig) {
+  (void)sig;
+  profile_t *profile = profile_running;
+  /* Other threads have no shadow stack to sample */
+  if (profile == NULL || profile_stack != &profile->stack) {
+    return;
+  }
+  size_t depth = profile->stack.depth;
+  atomic_signal_fence(memory_order_acquire);
+  size_t len = depth < PROFILE_MAX_DEPTH ? depth : PROFILE_MAX_DEPTH;
+  if (profile->samples_len == profile->samples_capacity ||
+      PROFILE_BUFFER_FRAMES - profile->frames_len < len) {
+    profile->dropped++;
+    return;
+  }
+  memcpy(profile->frames + profile->frames_len, profile->stack.frames,
+         len * sizeof(profile_frame_t));
+  profile->frames_len += len;
+  profile->depths[profile->samples_len++] =
+      depth < UINT32_MAX ? (uint32_t)depth : UINT32_MAX;
+}
+
+/*
+ * Starts sampling calls made on the calling thread. Returns false if
+ * another profiler is running or the timer cannot be set up.
+ */
+bool profile_start(profile_t *profile) {
+  assert(profile);
+  if (profile_running != NULL) {
+    return false;
+  }
+  struct sigaction action = {.sa_handler = profile_on_sigprof,
+                             .sa_flags = SA_RESTART};
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, NULL) != 0) {
+    return false;
+  }
+
+  profile->stack.depth = 0;
+  profile_stack = &profile->stack;
+  profile_running = profile;
+  long interval = 1000000 / profile->hz;
+  struct itimerval timer = {
+      .it_interval = {0, interval > 0 ? interval : 1},
+      .it_value = {0, interval > 0 ? interval : 1},
+  };
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+    profile_running = NULL;
+    profile_stack = NULL;
+    return false;
+  }
+  return true;
+}
+
+/* Stops sampling, on the thread that started it */
+void profile_stop(profile_t *profile) {
+  assert(profile);
+  assert(profile_running == profile);
+  /* The handler stays installed for a signal that is already pending */
+  struct itimerval timer = {0};
+  setitimer(ITIMER_PROF, &timer, NULL);
+  profile_running = NULL;
+  profile_stack = NULL;
+}
+
+/* Frames are separated by ';' and the count follows a space */
+static void profile_write_label(FILE *out, const char *label) {
+  for (; *label != '\0'; label++) {
+    fputc(*label == ';' || *label == '\n' ? '_' : *label, out);
+  }
+}
+
+static void profile_write_frame(FILE *out, const profile_frame_t *frame,
+                                monkey_vm_t *vm) {
+  profile_write_label(out, frame->name != NULL ? frame->name : "fn");
+  source_t *source = frame->offset != SOURCE_OFFSET_NONE
+                         ? monkey_vm_source_at(vm, frame->offset)
+                         : NULL;
+  if (source != NULL) {
+    source_location_t location = source_locate(source, frame->offset);
+    fputs(" (", out);
+    profile_write_label(out, source->name);
+    fprintf(out, ":%" PRIu32 ":%" PRIu32 ")", location.line,
+            location.column);
+  }
+}
+
+static int profile_compare_stacks(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Writes one line per distinct stack: its frames from the root, named
+ * after the VM's source and the functions called, then the number of
+ * samples taken in it. Positions are looked up in `vm`, which must be
+ * the VM that ran the profiled code and must still hold its programs.
+ */
+void profile_write_folded(profile_t *profile, monkey_vm_t *vm, FILE *out) {
+  assert(profile);
+  assert(vm);
+  assert(out);
+  const char *root =
+      vm->source_name != NULL ? vm->source_name : SOURCE_DEFAULT_NAME;
+  char **stacks = calloc(profile->samples_len + 1, sizeof(char *));
+  assert(stacks);
+  const profile_frame_t *frames = profile->frames;
+  /* Sources hold their line index in the VM's memory */
+  memory_t *previous = memory_swap(vm->memory);
+
+  for (size_t i = 0; i < profile->samples_len; i++) {
+    size_t depth = profile->depths[i];
+    size_t len = depth < PROFILE_MAX_DEPTH ? depth : PROFILE_MAX_DEPTH;
+    size_t stack_len = 0;
+    FILE *stack = open_memstream(&stacks[i], &stack_len);
+    assert(stack);
+    profile_write_label(stack, root);
+    for (size_t j = 0; j < len; j++) {
+      fputc(';', stack);
+      profile_write_frame(stack, &frames[j], vm);
+    }
+    if (depth > len) {
+      fputs(";...", stack);
+    }
+    fclose(stack);
+    frames += len;
+  }
+  memory_swap(previous);
+
+  qsort(stacks, profile->samples_len, sizeof(char *), profile_compare_stacks);
+  size_t count = 0;
+  for (size_t i = 0; i < profile->samples_len; i++) {
+    count++;
+    if (i + 1 == profile->samples_len ||
+        strcmp(stacks[i], stacks[i + 1]) != 0) {
+      fprintf(out, "%s %zu\n", stacks[i], count);
+      count = 0;
+    }
+    free(stacks[i]);
+  }
+  free(stacks);
+}
@@ -0,0 +1,73 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "utils.h"
+#include <stdatomic.h>
+
+typedef struct _monkey_vm_t monkey_vm_t;
+
+/*
+ * A sampling profiler for Monkey code. While one runs, calls made on
+ * the thread that started it keep a shadow stack of what is being
+ * called, and a SIGPROF timer copies that stack into a preallocated
+ * buffer `hz` times per second of CPU time. The signal handler only
+ * copies frames; `profile_write_folded` names them afterwards, in the
+ * folded stack format flamegraph.pl reads.
+ *
+ * With no profiler running a call pays one test of a thread local.
+ * One profiler can run at a time, since the timer is per process.
+ */
+
+/* What a call in progress was calling */
+typedef struct {
+  const char *name; /* as called, NULL for an anonymous function */
+  uint32_t offset;  /* of the function's body, SOURCE_OFFSET_NONE if builtin */
+} profile_frame_t;
+
+/* Deeper calls are counted but not recorded */
+#define PROFILE_MAX_DEPTH 256
+/* Frames kept over all samples, 4 MB on 64 bit */
+#define PROFILE_BUFFER_FRAMES (256 * 1024)
+#define PROFILE_DEFAULT_HZ 1000
+
+typedef struct {
+  profile_frame_t frames[PROFILE_MAX_DEPTH];
+  volatile size_t depth;
+} profile_stack_t;
+
+typedef struct {
+  unsigned hz;
+  profile_stack_t stack;
+  profile_frame_t *frames; /* every sample's frames, outermost first */
+  size_t frames_len;
+  uint32_t *depths; /* of each sample, which may exceed the frames kept */
+  size_t samples_len;
+  size_t samples_capacity;
+  size_t dropped; /* samples the buffer had no room for */
+} profile_t;
+
+/* Use `profile_push` and `profile_pop` rather than this */
+extern _Thread_local profile_stack_t *profile_stack;
+
+profile_t *profile_new(unsigned hz);
+void profile_destroy(profile_t **profile_p);
+bool profile_start(profile_t *profile);
+void profile_stop(profile_t *profile);
+void profile_write_folded(profile_t *profile, monkey_vm_t *vm, FILE *out);
+
+static inline void profile_push(profile_stack_t *stack, const char *name,
+                                uint32_t offset) {
+  size_t depth = stack->depth;
+  if (depth < PROFILE_MAX_DEPTH) {
+    stack->frames[depth] = (profile_frame_t){name, offset};
+  }
+  /* The handler must not see the depth before the frame */
+  atomic_signal_fence(memory_order_release);
+  stack->depth = depth + 1;
+}
+
+static inline void profile_pop(profile_stack_t *stack) {
+  stack->depth = stack->depth - 1;
+}
+
+#endif
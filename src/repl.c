@@ -1,15 +1,11 @@
 #include "repl.h"
 
-void print_parser_errors(parser_t *parser) {
-  for (int i = 0; i < parser->errors_len; i++) {
-    puts(parser->errors[i]);
-  }
-}
-
 void start(FILE *in, FILE *out) {
 
   char *line = NULL;
   size_t len = 0;
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, REPL_CACHE_BYTES);
 
   while (true) {
     printf("%s", PROMPT);
@@ -25,27 +21,21 @@ void start(FILE *in, FILE *out) {
     if (line == NULL || strlen(line) == 0) {
       break;
     }
-    lexer_t *l = lexer_new(line);
-    parser_t *parser = parser_new(l);
-    assert(parser);
-    program_t *program = parser_parse_program(parser);
 
-    if (parser->errors_len != 0) {
-      print_parser_errors(parser);
-    } else {
-      obj_t *evaluated = eval(program);
-      if (evaluated != NULL) {
-        char *evaluated_str = obj_to_string(evaluated);
-        puts(evaluated_str);
-        free(evaluated_str);
-        obj_destroy(&evaluated);
-      }
+    obj_t *evaluated = monkey_vm_eval(vm, line);
+    for (size_t i = 0; i < vm->errors_len; i++) {
+      puts(vm->errors[i]);
+    }
+    if (evaluated != NULL) {
+      char *evaluated_str = obj_to_string(evaluated);
+      puts(evaluated_str);
+      free(evaluated_str);
+      obj_destroy(&evaluated);
     }
-
-    program_destroy(&program);
-    parser_destroy(&parser);
 
     free(line);
     line = NULL;
   }
+
+  monkey_vm_destroy(&vm);
 }
@@ -5,9 +5,12 @@
 #include "token.h"
 #include "parser.h"
 #include "evaluator.h"
+#include "vm.h"
 #include "utils.h"
 
 #define PROMPT ">> "
+/* Lines typed again, or recalled from history, are not parsed again */
+#define REPL_CACHE_BYTES (1 << 20)
 
 void start(FILE *in, FILE *out);
 
@@ -0,0 +1,106 @@
+#include "source.h"
+#include "memory.h"
+
+/* `text` is borrowed; a NULL `name` is SOURCE_DEFAULT_NAME */
+source_t *source_new(const char *name, const char *text, uint32_t len,
+                     uint32_t base) {
+  assert(text);
+  source_t *source = mem_malloc(sizeof(source_t));
+  assert(source);
+  source->name = mem_strdup(name != NULL ? name : SOURCE_DEFAULT_NAME);
+  source->text = text;
+  source->owned_text = NULL;
+  source->base = base;
+  source->len = len;
+  source->line_starts = NULL;
+  source->lines = 0;
+  return source;
+}
+
+/* Like `source_new`, keeping a copy of `text` */
+source_t *source_new_copy(const char *name, const char *text, uint32_t len,
+                          uint32_t base) {
+  char *copy = mem_malloc(len + 1);
+  assert(copy);
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+  source_t *source = source_new(name, copy, len, base);
+  source->owned_text = copy;
+  return source;
+}
+
+void source_destroy(source_t **source_p) {
+  assert(source_p);
+  if (*source_p) {
+    source_t *source = *source_p;
+    mem_free_str(source->name);
+    mem_free(source->owned_text, source->len + 1);
+    mem_free(source->line_starts, source->lines * sizeof(uint32_t));
+    mem_free(source, sizeof(source_t));
+    *source_p = NULL;
+  }
+}
+
+static void source_index_lines(source_t *source) {
+  uint32_t lines = 1;
+  for (const char *cur = source->text;
+       (cur = memchr(cur, '\n', source->text + source->len - cur)) != NULL;
+       cur++) {
+    lines++;
+  }
+  source->line_starts = mem_malloc(lines * sizeof(uint32_t));
+  assert(source->line_starts);
+  source->line_starts[0] = 0;
+  source->lines = 1;
+  for (uint32_t i = 0; i < source->len; i++) {
+    if (source->text[i] == '\n') {
+      source->line_starts[source->lines++] = i + 1;
+    }
+  }
+}
+
+/* The end of the text counts, it is where EOF is reported */
+bool source_contains(source_t *source, uint32_t offset) {
+  assert(source);
+  return offset >= source->base && offset - source->base <= source->len;
+}
+
+/* Offsets outside of the source are located at its closest end */
+source_location_t source_locate(source_t *source, uint32_t offset) {
+  assert(source);
+  if (source->line_starts == NULL) {
+    source_index_lines(source);
+  }
+  offset = offset > source->base ? offset - source->base : 0;
+  if (offset > source->len) {
+    offset = source->len;
+  }
+  /* The last line starting at or before `offset` */
+  uint32_t low = 0, high = source->lines;
+  while (high - low > 1) {
+    uint32_t mid = low + (high - low) / 2;
+    if (source->line_starts[mid] <= offset) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return (source_location_t){low + 1, offset - source->line_starts[low] + 1};
+}
+
+/* "name:line:column: message", or "name: message" without an offset */
+char *source_format_error(source_t *source, uint32_t offset,
+                          const char *message) {
+  assert(source);
+  assert(message);
+  char *str = NULL;
+  if (offset == SOURCE_OFFSET_NONE) {
+    asprintf(&str, "%s: %s", source->name, message);
+  } else {
+    source_location_t location = source_locate(source, offset);
+    asprintf(&str, "%s:%" PRIu32 ":%" PRIu32 ": %s", source->name,
+             location.line, location.column, message);
+  }
+  assert(str);
+  return str;
+}
@@ -0,0 +1,44 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "utils.h"
+
+/* Offset of something that has no place in the source */
+#define SOURCE_OFFSET_NONE UINT32_MAX
+#define SOURCE_DEFAULT_NAME "<input>"
+
+typedef struct {
+  uint32_t line;   /* 1 based */
+  uint32_t column; /* 1 based, in bytes */
+} source_location_t;
+
+/*
+ * Maps the 32 bit offsets kept on tokens, AST nodes and errors back to
+ * lines and columns. Nothing is counted while lexing: the line start
+ * index is built on the first lookup, once per source, and every
+ * lookup after that is a binary search.
+ *
+ * The offset of text[0] is `base`, so that several sources can share
+ * one offset space (see monkey_vm_t).
+ */
+typedef struct {
+  char *name;
+  const char *text;
+  char *owned_text; /* NULL if `text` is borrowed */
+  uint32_t base;
+  uint32_t len;
+  uint32_t *line_starts; /* NULL until the first lookup */
+  uint32_t lines;
+} source_t;
+
+source_t *source_new(const char *name, const char *text, uint32_t len,
+                     uint32_t base);
+source_t *source_new_copy(const char *name, const char *text, uint32_t len,
+                          uint32_t base);
+void source_destroy(source_t **source_p);
+bool source_contains(source_t *source, uint32_t offset);
+source_location_t source_locate(source_t *source, uint32_t offset);
+char *source_format_error(source_t *source, uint32_t offset,
+                          const char *message);
+
+#endif
@@ -1,30 +1,32 @@
 #include "token.h"
+#include "memory.h"
 
-ht_t *keywords_initialize(void) {
-  ht_t *ht = ht_create(KEYWORDS_SIZE);
-  ht_add(ht, "fn", hd_create(HD_INT_DT, (uintptr_t *)FUNCTION_TOKEN));
-  ht_add(ht, "let", hd_create(HD_INT_DT, (uintptr_t *)LET_TOKEN));
-  ht_add(ht, "true", hd_create(HD_INT_DT, (uintptr_t *)TRUE_TOKEN));
-  ht_add(ht, "false", hd_create(HD_INT_DT, (uintptr_t *)FALSE_TOKEN));
-  ht_add(ht, "if", hd_create(HD_INT_DT, (uintptr_t *)IF_TOKEN));
-  ht_add(ht, "else", hd_create(HD_INT_DT, (uintptr_t *)ELSE_TOKEN));
-  ht_add(ht, "return", hd_create(HD_INT_DT, (uintptr_t *)RETURN_TOKEN));
-  return ht;
-}
-
-TOKEN keywords_get(ht_t *keywords, char *str) {
+void keywords_initialize(keywords_t *keywords) {
   assert(keywords);
-  return ht_exists(keywords, str) ? ht_get(keywords, str)->num : 0;
+  static const struct {
+    const char *name;
+    TOKEN type;
+  } KEYWORDS[KEYWORDS_LEN] = {
+      {"fn", FUNCTION_TOKEN}, {"let", LET_TOKEN},   {"true", TRUE_TOKEN},
+      {"false", FALSE_TOKEN}, {"if", IF_TOKEN},     {"else", ELSE_TOKEN},
+      {"return", RETURN_TOKEN},
+  };
+  for (size_t i = 0; i < KEYWORDS_LEN; i++) {
+    keywords->symbols[i] =
+        intern_symbol(KEYWORDS[i].name, strlen(KEYWORDS[i].name));
+    keywords->types[i] = KEYWORDS[i].type;
+  }
 }
 
-void keywords_destroy(ht_t **ht_p) {
-  assert(ht_p);
-  if (*ht_p) {
-    ht_t *ht = *ht_p;
-    assert(ht);
-    ht_destroy(&ht);
-    *ht_p = NULL;
+/* Returns the keyword `symbol` stands for, or ILLEGAL_TOKEN */
+TOKEN keywords_get(const keywords_t *keywords, symbol_t symbol) {
+  assert(keywords);
+  for (size_t i = 0; i < KEYWORDS_LEN; i++) {
+    if (keywords->symbols[i] == symbol) {
+      return keywords->types[i];
+    }
   }
+  return ILLEGAL_TOKEN;
 }
 
 const char *token_to_str(TokenType t) {
@@ -37,6 +39,8 @@ const char *token_to_str(TokenType t) {
     return "IDENT_TOKEN";
   case INT_TOKEN:
     return "INT_TOKEN";
+  case STRING_TOKEN:
+    return "STRING_TOKEN";
   case ASSIGN_TOKEN:
     return "ASSIGN_TOKEN";
   case PLUS_TOKEN:
@@ -59,6 +63,8 @@ const char *token_to_str(TokenType t) {
     return "NOT_EQ_TOKEN";
   case COMMA_TOKEN:
     return "COMMA_TOKEN";
+  case COLON_TOKEN:
+    return "COLON_TOKEN";
   case SEMICOLON_TOKEN:
     return "SEMICOLON_TOKEN";
   case LPAREN_TOKEN:
@@ -69,6 +75,10 @@ const char *token_to_str(TokenType t) {
     return "LBRACE_TOKEN";
   case RBRACE_TOKEN:
     return "RBRACE_TOKEN";
+  case LBRACKET_TOKEN:
+    return "LBRACKET_TOKEN";
+  case RBRACKET_TOKEN:
+    return "RBRACKET_TOKEN";
   case FUNCTION_TOKEN:
     return "FUNCTION_TOKEN";
   case LET_TOKEN:
@@ -83,20 +93,40 @@ const char *token_to_str(TokenType t) {
     return "ELSE_TOKEN";
   case RETURN_TOKEN:
     return "RETURN_TOKEN";
+  case TOKEN_COUNT:
+    break;
   }
 
   return NULL;
 }
 
 token_t *token_new(TokenType type, char ch) {
-  token_t *tok = malloc(sizeof(token_t));
-  assert(tok);
-  char *literal = malloc(sizeof(char) * 2);
+  char *literal = mem_malloc_as(MEM_TOKEN, sizeof(char) * 2);
   assert(literal);
   literal[0] = ch;
   literal[1] = '\0';
+  return token_new_literal(type, literal);
+}
+
+/* Takes ownership of `literal` */
+token_t *token_new_literal(TokenType type, char *literal) {
+  assert(literal);
+  token_t *tok = mem_malloc_as(MEM_TOKEN, sizeof(token_t));
+  assert(tok);
   tok->type = type;
   tok->literal = literal;
+  tok->symbol = SYMBOL_NONE;
+  tok->offset = 0;
+  return tok;
+}
+
+token_t *token_new_symbol(TokenType type, symbol_t symbol) {
+  token_t *tok = mem_malloc_as(MEM_TOKEN, sizeof(token_t));
+  assert(tok);
+  tok->type = type;
+  tok->literal = (char *)symbol_name(symbol);
+  tok->symbol = symbol;
+  tok->offset = 0;
   return tok;
 }
 
@@ -106,8 +136,10 @@ void token_destroy(token_t **tok_p) {
     token_t *tok = *tok_p;
     assert(tok);
     assert(tok->literal);
-    free(tok->literal);
-    free(tok);
+    if (tok->symbol == SYMBOL_NONE) {
+      mem_free_str(tok->literal);
+    }
+    mem_free(tok, sizeof(token_t));
     *tok_p = NULL;
   }
 }
@@ -1,10 +1,10 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
-#include "hash.h"
+#include "intern.h"
 #include "utils.h"
 
-#define KEYWORDS_SIZE 50
+#define KEYWORDS_LEN 7
 
 typedef enum {
   ILLEGAL_TOKEN,
@@ -13,6 +13,7 @@ typedef enum {
   /* Identifiers + literals */
   IDENT_TOKEN, /* add, foobar, x, y, .... */
   INT_TOKEN,
+  STRING_TOKEN,
 
   /* Operators */
   ASSIGN_TOKEN,
@@ -31,11 +32,14 @@ typedef enum {
   /* Delimiters */
   COMMA_TOKEN,
   SEMICOLON_TOKEN,
+  COLON_TOKEN,
 
   LPAREN_TOKEN,
   RPAREN_TOKEN,
   LBRACE_TOKEN,
   RBRACE_TOKEN,
+  LBRACKET_TOKEN,
+  RBRACKET_TOKEN,
 
   FUNCTION_TOKEN,
   LET_TOKEN,
@@ -44,23 +48,42 @@ typedef enum {
   IF_TOKEN,
   ELSE_TOKEN,
   RETURN_TOKEN,
+
+  TOKEN_COUNT, /* not a token: the number of token types */
 } TOKEN;
 
 typedef TOKEN TokenType;
 
+/*
+ * Identifiers and keywords are interned when they are lexed: `symbol`
+ * is their symbol and `literal` borrows the interned name. For every
+ * other token `symbol` is SYMBOL_NONE and the token owns `literal`.
+ *
+ * `offset` is where the token starts in its source; line and column
+ * are only worked out from it when something is reported (source.h).
+ */
 struct _token_t {
   TokenType type;
+  symbol_t symbol;
+  uint32_t offset;
   char *literal;
 };
 
 typedef struct _token_t token_t;
 
+/* Keyword symbols, resolved once per lexer against the intern table */
+typedef struct {
+  symbol_t symbols[KEYWORDS_LEN];
+  TOKEN types[KEYWORDS_LEN];
+} keywords_t;
+
 const char *token_to_str(TokenType t);
 token_t *token_new(TokenType type, char ch);
+token_t *token_new_literal(TokenType type, char *literal);
+token_t *token_new_symbol(TokenType type, symbol_t symbol);
 void token_destroy(token_t **tok_p);
 
-ht_t *keywords_initialize(void);
-void keywords_destroy(ht_t **ht_p);
-TOKEN keywords_get(ht_t *keywords, char *str);
+void keywords_initialize(keywords_t *keywords);
+TOKEN keywords_get(const keywords_t *keywords, symbol_t symbol);
 
 #endif
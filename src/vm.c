@@ -0,0 +1,319 @@
+#include "vm.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "memory.h"
+#include "mkc.h"
+#include "parser.h"
+
+monkey_vm_t *monkey_vm_new(void) {
+  monkey_vm_t *vm = malloc(sizeof(monkey_vm_t));
+  assert(vm);
+  vm->memory = memory_new();
+  memory_t *previous = memory_swap(vm->memory);
+  vm->symbols = intern_table_new();
+  vm->globals = env_new();
+  memory_swap(previous);
+  vm->programs = NULL;
+  vm->programs_len = 0;
+  vm->errors = NULL;
+  vm->errors_len = 0;
+  vm->source_name = NULL;
+  vm->sources = NULL;
+  vm->sources_len = 0;
+  vm->next_base = 0;
+  vm->cache = NULL;
+  vm->limits = (eval_limits_t){0};
+  return vm;
+}
+
+/*
+ * Keeps parsed programs for reuse, so evaluating the same source again
+ * skips lexing and parsing. Each program is charged against `max_bytes`
+ * for what parsing it added to the VM's memory.
+ */
+void monkey_vm_enable_cache(monkey_vm_t *vm, size_t max_bytes) {
+  assert(vm);
+  assert(vm->cache == NULL);
+  memory_t *previous = memory_swap(vm->memory);
+  vm->cache = program_cache_new(max_bytes);
+  memory_swap(previous);
+}
+
+static void monkey_vm_clear_errors(monkey_vm_t *vm) {
+  for (size_t i = 0; i < vm->errors_len; i++) {
+    free(vm->errors[i]);
+  }
+  free(vm->errors);
+  vm->errors = NULL;
+  vm->errors_len = 0;
+}
+
+void monkey_vm_destroy(monkey_vm_t **vm_p) {
+  assert(vm_p);
+  if (*vm_p) {
+    monkey_vm_t *vm = *vm_p;
+    memory_t *previous = memory_swap(vm->memory);
+    env_destroy(&vm->globals);
+    for (size_t i = 0; i < vm->programs_len; i++) {
+      program_destroy(&vm->programs[i]);
+    }
+    mem_free(vm->programs, vm->programs_len * sizeof(program_t *));
+    program_cache_destroy(&vm->cache);
+    monkey_vm_clear_errors(vm);
+    for (size_t i = 0; i < vm->sources_len; i++) {
+      source_destroy(&vm->sources[i]);
+    }
+    mem_free(vm->sources, vm->sources_len * sizeof(source_t *));
+    /* Last: the programs' tokens borrow their names from it */
+    intern_table_destroy(&vm->symbols);
+    memory_swap(previous);
+    memory_destroy(&vm->memory);
+    free(vm);
+    *vm_p = NULL;
+  }
+}
+
+static int monkey_vm_compare_bases(const void *a, const void *b) {
+  uint32_t left = *(const uint32_t *)a;
+  uint32_t right = *(const uint32_t *)b;
+  return left < right ? -1 : left > right;
+}
+
+/* Frees the sources no cached program was parsed from */
+static void monkey_vm_drop_sources(monkey_vm_t *vm) {
+  size_t bases_len = vm->cache != NULL ? vm->cache->stats.entries : 0;
+  uint32_t *bases = malloc((bases_len > 0 ? bases_len : 1) * sizeof(uint32_t));
+  assert(bases);
+  size_t i = 0;
+  for (program_cache_entry_t *entry = bases_len > 0 ? vm->cache->head : NULL;
+       entry != NULL; entry = entry->next) {
+    bases[i++] = entry->base;
+  }
+  qsort(bases, bases_len, sizeof(uint32_t), monkey_vm_compare_bases);
+
+  /* Both in increasing order of base */
+  size_t kept = 0;
+  size_t next = 0;
+  for (i = 0; i < vm->sources_len; i++) {
+    while (next < bases_len && bases[next] < vm->sources[i]->base) {
+      next++;
+    }
+    if (next < bases_len && bases[next] == vm->sources[i]->base) {
+      vm->sources[kept++] = vm->sources[i];
+    } else {
+      source_destroy(&vm->sources[i]);
+    }
+  }
+  free(bases);
+
+  if (kept == 0) {
+    mem_free(vm->sources, vm->sources_len * sizeof(source_t *));
+    vm->sources = NULL;
+  } else {
+    vm->sources = mem_reallocarray(vm->sources, vm->sources_len, kept,
+                                   sizeof(source_t *));
+    assert(vm->sources);
+  }
+  vm->sources_len = kept;
+}
+
+/*
+ * Gives the VM fresh globals, as if it were new, but keeps its intern
+ * table and program cache. What only the old globals needed is freed:
+ * programs outside the cache, retired ones, and the sources of all but
+ * the cached programs. Results of earlier calls must be destroyed
+ * first.
+ */
+void monkey_vm_reset(monkey_vm_t *vm) {
+  assert(vm);
+  monkey_vm_clear_errors(vm);
+  memory_t *previous = memory_swap(vm->memory);
+  env_destroy(&vm->globals);
+  vm->globals = env_new();
+  for (size_t i = 0; i < vm->programs_len; i++) {
+    program_destroy(&vm->programs[i]);
+  }
+  mem_free(vm->programs, vm->programs_len * sizeof(program_t *));
+  vm->programs = NULL;
+  vm->programs_len = 0;
+  if (vm->cache != NULL) {
+    program_cache_drop_retired(vm->cache);
+  }
+  monkey_vm_drop_sources(vm);
+  memory_swap(previous);
+}
+
+/*
+ * Keeps a copy of `input` and returns the base of its offsets. Once 4
+ * GB of input have used up the offset space, runtime errors are no
+ * longer located.
+ */
+static uint32_t monkey_vm_add_source(monkey_vm_t *vm, const char *input,
+                                     size_t input_len) {
+  if (input_len >= SOURCE_OFFSET_NONE - vm->next_base) {
+    vm->next_base = SOURCE_OFFSET_NONE;
+    return 0;
+  }
+  uint32_t base = vm->next_base;
+  vm->sources = mem_reallocarray(vm->sources, vm->sources_len,
+                                 vm->sources_len + 1, sizeof(source_t *));
+  assert(vm->sources);
+  vm->sources[vm->sources_len++] =
+      source_new_copy(vm->source_name, input, (uint32_t)input_len, base);
+  /* One past the end, where EOF is */
+  vm->next_base = base + (uint32_t)input_len + 1;
+  return base;
+}
+
+/* The input `offset` is in, NULL if none or offsets ran out */
+source_t *monkey_vm_source_at(monkey_vm_t *vm, uint32_t offset) {
+  assert(vm);
+  if (offset == SOURCE_OFFSET_NONE || vm->next_base == SOURCE_OFFSET_NONE) {
+    return NULL;
+  }
+  size_t lo = 0, hi = vm->sources_len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (vm->sources[mid]->base <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0 || !source_contains(vm->sources[lo - 1], offset)) {
+    return NULL;
+  }
+  return vm->sources[lo - 1];
+}
+
+/* Prefixes a runtime error with where it happened */
+static void monkey_vm_locate_error(monkey_vm_t *vm, obj_t *result) {
+  if (result == NULL || result->type != ERROR_OBJ) {
+    return;
+  }
+  uint32_t offset = result->error_obj->offset;
+  source_t *source = monkey_vm_source_at(vm, offset);
+  if (source == NULL) {
+    return;
+  }
+  char *message = source_format_error(source, offset,
+                                      result->error_obj->message);
+  mem_free_str(result->error_obj->message);
+  result->error_obj->message = mem_strdup(message);
+  free(message);
+}
+
+/*
+ * Parses and evaluates `input` in the VM's global environment. Returns
+ * the owned result, or NULL if `input` produced no value or did not
+ * parse; the parser errors are then in `vm->errors` until the next
+ * call. Results may borrow interned strings from the VM and must not
+ * outlive it. Parser and runtime errors are prefixed with
+ * "name:line:column", the name being `vm->source_name`.
+ */
+obj_t *monkey_vm_eval(monkey_vm_t *vm, const char *input) {
+  assert(vm);
+  assert(input);
+  monkey_vm_clear_errors(vm);
+  memory_t *previous_memory = memory_swap(vm->memory);
+  intern_table_t *previous = intern_table_swap(vm->symbols);
+  size_t input_len = strlen(input);
+  obj_t *result = NULL;
+
+  program_t *program = vm->cache != NULL
+                           ? program_cache_get(vm->cache, input, input_len)
+                           : NULL;
+  if (program != NULL) {
+    result = eval_limited(program, vm->globals, &vm->limits);
+    monkey_vm_locate_error(vm, result);
+    intern_table_swap(previous);
+    memory_swap(previous_memory);
+    return result;
+  }
+
+  uint32_t base = monkey_vm_add_source(vm, input, input_len);
+  size_t before = vm->memory->current;
+  lexer_t *lexer = lexer_new(input);
+  lexer_set_base(lexer, base);
+  parser_t *parser = parser_new(lexer);
+  parser_set_source_name(parser, vm->source_name);
+  program = parser_parse_program(parser);
+  bool has_functions = parser->fn_literals != 0;
+  if (parser->errors_len != 0) {
+    vm->errors = parser_get_errors(parser, &vm->errors_len);
+  }
+  parser_destroy(&parser);
+  /* The program, and the symbols it was the first to use */
+  size_t program_bytes =
+      vm->memory->current > before ? vm->memory->current - before : 0;
+
+  if (vm->errors_len == 0) {
+    result = eval_limited(program, vm->globals, &vm->limits);
+    monkey_vm_locate_error(vm, result);
+  }
+
+  if (vm->cache != NULL && vm->errors_len == 0) {
+    program_cache_put(vm->cache, input, input_len, base, program,
+                      program_bytes, has_functions);
+  } else {
+    /*
+     * Function objects bound in the globals borrow their parameters and
+     * body from the program they were defined in, so programs live as
+     * long as the VM.
+     */
+    vm->programs = mem_reallocarray(vm->programs, vm->programs_len,
+                                    vm->programs_len + 1, sizeof(program_t *));
+    assert(vm->programs);
+    vm->programs[vm->programs_len++] = program;
+  }
+
+  intern_table_swap(previous);
+  memory_swap(previous_memory);
+  return result;
+}
+
+/*
+ * Destroys a result of `monkey_vm_eval`, crediting its memory back to
+ * the VM.
+ */
+void monkey_vm_result_destroy(monkey_vm_t *vm, obj_t **result_p) {
+  assert(vm);
+  memory_t *previous = memory_swap(vm->memory);
+  obj_destroy(result_p);
+  memory_swap(previous);
+}
+
+/*
+ * Like `monkey_vm_eval`, for a program compiled with `monkey compile`.
+ * If it cannot be loaded, the reason is the only entry in `vm->errors`.
+ */
+obj_t *monkey_vm_eval_compiled(monkey_vm_t *vm, const char *path) {
+  assert(vm);
+  assert(path);
+  monkey_vm_clear_errors(vm);
+  memory_t *previous_memory = memory_swap(vm->memory);
+  intern_table_t *previous = intern_table_swap(vm->symbols);
+
+  char *error = NULL;
+  program_t *program = mkc_load(path, &error);
+  obj_t *result = NULL;
+  if (program == NULL) {
+    vm->errors = malloc(sizeof(char *));
+    assert(vm->errors);
+    asprintf(&vm->errors[0], "%s: %s", path, error);
+    vm->errors_len = 1;
+    free(error);
+  } else {
+    result = eval_limited(program, vm->globals, &vm->limits);
+    /* Only errors in code from source inputs have a position */
+    monkey_vm_locate_error(vm, result);
+    vm->programs = mem_reallocarray(vm->programs, vm->programs_len,
+                                    vm->programs_len + 1, sizeof(program_t *));
+    assert(vm->programs);
+    vm->programs[vm->programs_len++] = program;
+  }
+
+  intern_table_swap(previous);
+  memory_swap(previous_memory);
+  return result;
+}
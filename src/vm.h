@@ -0,0 +1,59 @@
+#ifndef VM_H
+#define VM_H
+
+#include "ast.h"
+#include "cache.h"
+#include "environment.h"
+#include "evaluator.h"
+#include "intern.h"
+#include "memory.h"
+#include "object.h"
+#include "source.h"
+#include "utils.h"
+
+/*
+ * An interpreter context. Everything a script mutates while it is
+ * parsed and evaluated is owned by its VM: the intern table its
+ * identifiers and literals resolve to, its global environment and the
+ * programs whose AST its functions borrow. The only state shared
+ * between VMs is immutable (the object singletons, builtins and the
+ * hash seed), so each thread can run its own VM without locking.
+ *
+ * Each input gets its own range of token offsets, and a copy of it is
+ * kept, so runtime errors are located in the input that defined the
+ * failing code even when it is called from a later one.
+ *
+ * The VM's memory context is current while it parses, evaluates and
+ * tears down, so `memory` counts the heap bytes held for its scripts
+ * and `limits.max_bytes` can cap them. Results handed back by
+ * `monkey_vm_eval` are still charged to the VM; destroy them with
+ * `monkey_vm_result_destroy` to give the bytes back.
+ *
+ * A VM must only be used by one thread at a time.
+ */
+typedef struct _monkey_vm_t {
+  intern_table_t *symbols;
+  env_t *globals;
+  program_t **programs;
+  size_t programs_len;
+  char **errors; /* parser errors of the last `monkey_vm_eval` call */
+  size_t errors_len;
+  const char *source_name; /* borrowed, names inputs in errors, may be NULL */
+  source_t **sources;      /* every input parsed, by increasing base */
+  size_t sources_len;
+  uint32_t next_base;      /* where the next input's offsets start */
+  program_cache_t *cache; /* NULL unless enabled */
+  eval_limits_t limits;   /* apply to each `monkey_vm_eval` call, unbounded */
+  memory_t *memory;       /* everything above, live and peak bytes */
+} monkey_vm_t;
+
+monkey_vm_t *monkey_vm_new(void);
+void monkey_vm_enable_cache(monkey_vm_t *vm, size_t max_bytes);
+void monkey_vm_destroy(monkey_vm_t **vm_p);
+void monkey_vm_reset(monkey_vm_t *vm);
+obj_t *monkey_vm_eval(monkey_vm_t *vm, const char *input);
+obj_t *monkey_vm_eval_compiled(monkey_vm_t *vm, const char *path);
+void monkey_vm_result_destroy(monkey_vm_t *vm, obj_t **result_p);
+source_t *monkey_vm_source_at(monkey_vm_t *vm, uint32_t offset);
+
+#endif
@@ -1,20 +1,30 @@
+#include "../src/batch.h"
+#include "../src/count.h"
 #include "../src/evaluator.h"
 #include "../src/lexer.h"
+#include "../src/map.h"
 #include "../src/object.h"
 #include "../src/parser.h"
+#include "../src/pool.h"
+#include "../src/profile.h"
+#include "../src/vm.h"
 #include "utils.h"
 #include <check.h>
+#include <pthread.h>
 
 typedef struct {
   parser_t *parser;
   program_t *program;
+  env_t *env;
   obj_t *obj;
 } test_eval_t;
 
-test_eval_t *make_eval(parser_t *parser, program_t *program, obj_t *obj) {
+test_eval_t *make_eval(parser_t *parser, program_t *program, env_t *env,
+                       obj_t *obj) {
   test_eval_t *eval_obj = malloc(sizeof(*eval_obj));
   eval_obj->parser = parser;
   eval_obj->program = program;
+  eval_obj->env = env;
   eval_obj->obj = obj;
   return eval_obj;
 }
@@ -24,6 +34,7 @@ void eval_destroy(test_eval_t **eval_obj_p) {
   if (*eval_obj_p) {
     test_eval_t *eval_obj = *eval_obj_p;
     obj_destroy(&eval_obj->obj);
+    env_destroy(&eval_obj->env);
     program_destroy(&eval_obj->program);
     parser_destroy(&eval_obj->parser);
     free(eval_obj);
@@ -35,10 +46,11 @@ test_eval_t *_test_eval(const char *input) {
   lexer_t *lexer = lexer_new(input);
   parser_t *parser = parser_new(lexer);
   program_t *program = parser_parse_program(parser);
+  env_t *env = env_new();
 
-  obj_t *obj = eval(program);
+  obj_t *obj = eval(program, env);
 
-  return make_eval(parser, program, obj);
+  return make_eval(parser, program, env, obj);
 }
 
 void _test_obj_type(obj_t *obj, OBJ_TYPE ot) {
@@ -235,6 +247,23 @@ test_error_obj_t t_d_error_obj[] = {
   {"5; true + false; 5", "unknown operator: BOOLEAN + BOOLEAN"},
   {"if (10 > 1) { true + false; }", "unknown operator: BOOLEAN + BOOLEAN"},
   {"if (10 > 1) { if (10 > 1) { return true + false; } return 1; }", "unknown operator: BOOLEAN + BOOLEAN"},
+  {"foobar", "identifier not found: foobar"},
+  {"\"Hello\" - \"World\"", "unknown operator: STRING - STRING"},
+  {"\"Hello\" + 1", "type mismatch: STRING + INTEGER"},
+  {"5(1)", "not a function: INTEGER"},
+  {"fn(x) { x; }(1, 2)", "wrong number of arguments: want=1, got=2"},
+  {"len(1)", "argument to `len` not supported, got INTEGER"},
+  {"len(\"one\", \"two\")", "wrong number of arguments. got=2, want=1"},
+  {"first(1)", "argument to `first` not supported, got INTEGER"},
+  {"push(1, 1)", "argument to `push` not supported, got INTEGER"},
+  {"[1, 2][true]", "index operator not supported: ARRAY[BOOLEAN]"},
+  {"[1, foobar]", "identifier not found: foobar"},
+  {"{\"name\": \"Monkey\"}[fn(x) { x }];", "unusable as map key: FUNCTION"},
+  {"{[1]: 2}", "unusable as map key: ARRAY"},
+  {"{\"a\": foobar}", "identifier not found: foobar"},
+  {"10 / (5 - 5)", "division by zero: 10 / 0"},
+  {"let f = fn(x) { 1 / x }; f(0) + 1", "division by zero: 1 / 0"},
+  {"(-2147483647 - 1) / -1", "integer overflow: -2147483648 / -1"},
 };
 
 _test_error_obj(char *expected_message, obj_t *error_obj) {
@@ -254,6 +283,1097 @@ START_TEST(test_error_obj_loop)
 }
 END_TEST
 
+test_int_obj_t t_d_let_statement[] = {
+  {"let a = 5; a;", 5},
+  {"let a = 5 * 5; a;", 25},
+  {"let a = 5; let b = a; b;", 5},
+  {"let a = 5; let b = a; let c = a + b + 5; c;", 15},
+  {"let a = 5; let a = a + 1; a;", 6},
+  {"let x = 1; let xy = 2; x;", 1},
+};
+
+START_TEST(test_let_statement_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_let_statement[_i].input);
+
+  _test_int_obj(eval_obj->obj, t_d_let_statement[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+test_int_obj_t t_d_function[] = {
+  {"let identity = fn(x) { x; }; identity(5);", 5},
+  {"let identity = fn(x) { return x; }; identity(5);", 5},
+  {"let double = fn(x) { x * 2; }; double(5);", 10},
+  {"let add = fn(x, y) { x + y; }; add(5, 5);", 10},
+  {"let add = fn(x, y) { x + y; }; add(5 + 5, add(5, 5));", 20},
+  {"fn(x) { x; }(5)", 5},
+  {"let adder = fn(x) { fn(y) { x + y } }; let addTwo = adder(2); addTwo(3);", 5},
+  {"let f = fn(n) { if (n < 2) { return n; } f(n - 1) + f(n - 2) }; f(15);", 610},
+  {"let f = fn() { return 1; }; f() + f();", 2},
+  /* A return leaves everything up to its function unfinished */
+  {"let f = fn() { let x = if (true) { return 1; }; 2 }; f();", 1},
+  {"let f = fn() { 1 + if (true) { return 5; } }; f() + 1;", 6},
+  {"let f = fn() { [1, if (true) { return 3; }] }; f();", 3},
+  /* Closures kept in a container still see the call they came from */
+  {"let f = fn(n) { [fn() { n }] }; f(5)[0]();", 5},
+  {"let f = fn(n) { let k = 1; {k: fn() { n + k }} }; f(3)[1]();", 4},
+};
+
+START_TEST(test_function_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_function[_i].input);
+
+  _test_int_obj(eval_obj->obj, t_d_function[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+test_int_obj_t t_d_array_index[] = {
+  {"[1, 2, 3][0]", 1},
+  {"[1, 2, 3][1]", 2},
+  {"[1, 2, 3][2]", 3},
+  {"let i = 0; [1][i];", 1},
+  {"[1, 2, 3][1 + 1];", 3},
+  {"let a = [1, 2, 3]; a[2];", 3},
+  {"let a = [1, 2, 3]; a[0] + a[1] + a[2];", 6},
+  {"let a = [1, 2, 3]; let i = a[0]; a[i]", 2},
+  {"[[1, 2], [3]][0][1]", 2},
+};
+
+START_TEST(test_array_index_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_array_index[_i].input);
+
+  _test_int_obj(eval_obj->obj, t_d_array_index[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+const char *t_d_array_index_null[] = {
+  "[1, 2, 3][3]",
+  "[1, 2, 3][-1]",
+  "[][0]",
+  "rest([1])[0]",
+};
+
+START_TEST(test_array_index_null_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_array_index_null[_i]);
+
+  _test_null_obj(eval_obj->obj);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+test_int_obj_t t_d_builtin[] = {
+  {"len(\"\")", 0},
+  {"len(\"four\")", 4},
+  {"len(\"hello world\")", 11},
+  {"len([])", 0},
+  {"len([1, 2, 3])", 3},
+  {"first([1, 2, 3])", 1},
+  {"rest([1, 2, 3])[0]", 2},
+  {"len(rest(rest([1, 2, 3])))", 1},
+  {"len(push([], 1))", 1},
+  {"push([1, 2], 3)[2]", 3},
+  {"let a = [1, 2]; let b = push(a, 3); len(a) + len(b)", 5},
+  {"let a = [1, 2, 3]; let b = push(rest(a), 4); a[1] + b[2]", 6},
+  {"let a = [1]; let b = push(a, 2); let c = push(a, 3); b[1] * 10 + c[1]", 23},
+};
+
+START_TEST(test_builtin_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_builtin[_i].input);
+
+  _test_int_obj(eval_obj->obj, t_d_builtin[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+test_int_obj_t t_d_map_index[] = {
+  {"{\"foo\": 5}[\"foo\"]", 5},
+  {"let key = \"foo\"; {\"foo\": 5}[key]", 5},
+  {"{5: 5}[5]", 5},
+  {"{true: 5}[true]", 5},
+  {"{false: 5}[false]", 5},
+  {"let two = \"two\"; {\"one\": 10 - 9, two: 1 + 1, \"thr\" + \"ee\": 6 / 2}[\"three\"]", 3},
+  {"{\"a\": 1, \"a\": 2}[\"a\"]", 2},
+  {"len({1: 1, 2: 2, 1: 3})", 2},
+  {"let m = {\"f\": fn(x) { x * 2 }, \"a\": [1, 2]}; m[\"f\"](m[\"a\"][1])", 4},
+  {"{\"a very long key that is stored on the heap\": 7}[\"a very long key \" + \"that is stored on the heap\"]", 7},
+};
+
+START_TEST(test_map_index_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_map_index[_i].input);
+
+  _test_int_obj(eval_obj->obj, t_d_map_index[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+const char *t_d_map_index_null[] = {
+  "{\"foo\": 5}[\"bar\"]",
+  "{}[\"foo\"]",
+  "{1: 5}[true]",
+  "{true: 5}[1]",
+};
+
+START_TEST(test_map_index_null_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_map_index_null[_i]);
+
+  _test_null_obj(eval_obj->obj);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+void _test_str_obj(obj_t *obj, const char *expected) {
+  _test_obj_type(obj, STRING_OBJ);
+
+  const char *actual = str_obj_data(obj->str_obj);
+  ck_assert_msg(strcmp(actual, expected) == 0, "Expected=%s, got=%s", expected,
+                actual);
+  ck_assert_msg(str_obj_len(obj->str_obj) == strlen(expected),
+                "Expected length=%zu, got=%zu", strlen(expected),
+                str_obj_len(obj->str_obj));
+}
+
+typedef struct {
+  char *input;
+  char *expected;
+} test_str_obj_t;
+
+test_str_obj_t t_d_string[] = {
+  {"\"Hello World!\"", "Hello World!"},
+  {"\"\"", ""},
+  {"\"Hello\" + \" \" + \"World!\"", "Hello World!"},
+  {"let s = \"a string that does not fit inline\"; s",
+   "a string that does not fit inline"},
+  {"\"a string that \" + \"does not fit inline\"",
+   "a string that does not fit inline"},
+  {"let a = \"0123456789\"; let b = a + a + a; b",
+   "012345678901234567890123456789"},
+  {"let a = \"0123456789012345678901234567890123456789012345678901234567890123456789\"; let b = a + a; let c = b + \"!\" + b; c",
+   "01234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789!01234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"},
+};
+
+START_TEST(test_string_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_string[_i].input);
+
+  _test_str_obj(eval_obj->obj, t_d_string[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+test_booj_obj_t t_d_string_compare[] = {
+  {"\"abc\" == \"abc\"", true},
+  {"\"abc\" != \"abc\"", false},
+  {"\"abc\" == \"abd\"", false},
+  {"\"abc\" < \"abd\"", true},
+  {"\"abc\" > \"ab\"", true},
+  {"\"a string that does not fit inline\" == \"a string that does not fit inline\"", true},
+  {"\"a string that does not fit inline\" == \"a string that does not fit in\"", false},
+  {"let a = \"a string that does \"; a + \"not fit inline\" == \"a string that does not fit inline\"", true},
+  {"let a = \"a string that does not fit inline\"; let b = a; a == b", true},
+  {"let a = \"0123456789012345678901234567890123456789012345678901234567890123456789\"; let b = a + a; b == \"01234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789\"", true},
+  {"let a = \"0123456789012345678901234567890123456789012345678901234567890123456789\"; (a + a + a) == (a + (a + a))", true},
+  {"let a = \"0123456789012345678901234567890123456789012345678901234567890123456789\"; (a + a + \"x\") == (a + a + \"y\")", false},
+};
+
+START_TEST(test_string_compare_loop)
+{
+  test_eval_t *eval_obj = _test_eval(t_d_string_compare[_i].input);
+
+  _test_bool_obj(eval_obj->obj, t_d_string_compare[_i].expected);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+START_TEST(test_string_rope)
+{
+  const char *piece = "0123456789";
+  size_t pieces = 100000;
+  str_obj_t *str = str_obj_new("", 0);
+
+  for (size_t i = 0; i < pieces; i++) {
+    str_obj_t *tail = str_obj_new(piece, strlen(piece));
+    str_obj_t *next = str_obj_concat(str, tail);
+    str_obj_destroy(&tail);
+    str_obj_destroy(&str);
+    str = next;
+  }
+
+  ck_assert_msg(str_obj_len(str) == pieces * strlen(piece),
+                "Expected length=%zu, got=%zu", pieces * strlen(piece),
+                str_obj_len(str));
+  ck_assert_msg(str_buf_is_rope(str->buf), "Expected a rope");
+
+  str_obj_t *copy = str_obj_copy(str);
+  const char *data = str_obj_data(str);
+  ck_assert_msg(!str_buf_is_rope(str->buf), "Expected a flat string");
+  ck_assert_msg(strlen(data) == pieces * strlen(piece),
+                "Flattened string has the wrong length");
+  for (size_t i = 0; i < pieces; i++) {
+    ck_assert_msg(memcmp(data + i * strlen(piece), piece, strlen(piece)) == 0,
+                  "Wrong contents at piece %zu", i);
+  }
+
+  str_obj_destroy(&str);
+  ck_assert_msg(str_obj_equals(copy, copy), "String is not equal to itself");
+  str_obj_destroy(&copy);
+}
+END_TEST
+
+START_TEST(test_string_rope_release)
+{
+  /* Releasing a deep rope that was never flattened must not recurse */
+  str_obj_t *str = str_obj_new("", 0);
+  for (size_t i = 0; i < 1000000; i++) {
+    str_obj_t *tail = str_obj_new("x", 1);
+    str_obj_t *next = str_obj_concat(str, tail);
+    str_obj_destroy(&tail);
+    str_obj_destroy(&str);
+    str = next;
+  }
+  ck_assert_msg(str_obj_len(str) == 1000000, "Wrong rope length");
+  str_obj_destroy(&str);
+}
+END_TEST
+
+START_TEST(test_string_interning)
+{
+  test_eval_t *first = _test_eval("\"a string that does not fit inline\"");
+  test_eval_t *second = _test_eval("\"a string that does not fit inline\"");
+
+  _test_obj_type(first->obj, STRING_OBJ);
+  _test_obj_type(second->obj, STRING_OBJ);
+  ck_assert_msg(first->obj->str_obj->inline_len == STR_OBJ_HEAP,
+                "Expected a heap string");
+  ck_assert_msg(first->obj->str_obj->buf == second->obj->str_obj->buf,
+                "Equal literals are not interned");
+
+  test_eval_t *small = _test_eval("\"short\"");
+  ck_assert_msg(small->obj->str_obj->inline_len == strlen("short"),
+                "Expected an inline string");
+
+  eval_destroy(&small);
+  eval_destroy(&second);
+  eval_destroy(&first);
+}
+END_TEST
+
+START_TEST(test_array_literal)
+{
+  test_eval_t *eval_obj = _test_eval("[1, 2 * 2, 3 + 3, \"four\", true]");
+
+  _test_obj_type(eval_obj->obj, ARRAY_OBJ);
+  array_obj_t *array = eval_obj->obj->array_obj;
+  ck_assert_msg(array->len == 5, "Expected length=5, got=%zu", array->len);
+
+  obj_t *element = array_obj_get(array, 1);
+  _test_int_obj(element, 4);
+  obj_destroy(&element);
+  element = array_obj_get(array, 3);
+  _test_str_obj(element, "four");
+  obj_destroy(&element);
+
+  char *str = obj_to_string(eval_obj->obj);
+  ck_assert_msg(strcmp(str, "[1, 4, 6, four, true]") == 0,
+                "Expected=[1, 4, 6, four, true], got=%s", str);
+  free(str);
+
+  eval_destroy(&eval_obj);
+}
+END_TEST
+
+/* Maps print in insertion order, whatever the hash seed */
+START_TEST(test_map_to_string)
+{
+  test_eval_t *eval_obj =
+      _test_eval("{1: 1, 2: 2, 3: 3, 4: 4, \"a\": 5, true: 6, 1: 7}");
+  _test_obj_type(eval_obj->obj, MAP_OBJ);
+  char *str = obj_to_string(eval_obj->obj);
+  ck_assert_str_eq(str, "{1: 7, 2: 2, 3: 3, 4: 4, a: 5, true: 6}");
+  free(str);
+  eval_destroy(&eval_obj);
+
+  /* Deleted keys leave the order, added ones go last, across resizes */
+  map_t *map = map_new(0);
+  for (int32_t i = 0; i < 100; i++) {
+    map_set(map, (array_value_t){.type = INT_OBJ, .int_value = i},
+            (array_value_t){.type = INT_OBJ, .int_value = i});
+  }
+  for (int32_t i = 1; i < 100; i++) {
+    array_value_t key = {.type = INT_OBJ, .int_value = i};
+    ck_assert(map_delete(map, &key));
+  }
+  for (int32_t i = 3; i > 0; i--) {
+    map_set(map, (array_value_t){.type = INT_OBJ, .int_value = i},
+            (array_value_t){.type = BOOL_OBJ, .bool_value = true});
+  }
+  ck_assert_uint_eq(map->len, 4);
+  str = map_to_string(map);
+  ck_assert_str_eq(str, "{0: 0, 3: true, 2: true, 1: true}");
+  free(str);
+  array_value_t key = {.type = INT_OBJ, .int_value = 2};
+  ck_assert(map_get(map, &key)->bool_value);
+  map_release(&map);
+}
+END_TEST
+
+START_TEST(test_vm_isolation)
+{
+  monkey_vm_t *first = monkey_vm_new();
+  monkey_vm_t *second = monkey_vm_new();
+
+  obj_t *obj = monkey_vm_eval(first, "let answer = 42; answer");
+  _test_int_obj(obj, 42);
+  obj_destroy(&obj);
+
+  /* Globals persist across calls on the same VM only */
+  obj = monkey_vm_eval(first, "answer == 42");
+  ck_assert_msg(obj == &TRUE_IMPL_OBJ, "Expected the shared true object");
+  obj = monkey_vm_eval(second, "answer");
+  _test_obj_type(obj, ERROR_OBJ);
+  obj_destroy(&obj);
+
+  obj = monkey_vm_eval(second, "let x 5;");
+  ck_assert_msg(obj == NULL && second->errors_len > 0,
+                "Expected parser errors");
+
+  monkey_vm_destroy(&second);
+  monkey_vm_destroy(&first);
+}
+END_TEST
+
+/* What a cache is charged for `scripts`, evaluated in a fresh VM */
+static size_t cached_bytes(const char **scripts, size_t len) {
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, SIZE_MAX);
+  for (size_t i = 0; i < len; i++) {
+    obj_t *obj = monkey_vm_eval(vm, scripts[i]);
+    monkey_vm_result_destroy(vm, &obj);
+  }
+  size_t bytes = vm->cache->stats.bytes;
+  monkey_vm_destroy(&vm);
+  return bytes;
+}
+
+START_TEST(test_vm_program_cache)
+{
+  const char *scripts[] = {"let double = fn(x) { x * 2 };", "double(21)"};
+  /* Measured, so more than the entries and their 39 bytes of source */
+  size_t max_bytes = cached_bytes(scripts, 2);
+  ck_assert_msg(max_bytes > 2 * sizeof(program_cache_entry_t) + 39 * 4,
+                "Only %zu bytes charged", max_bytes);
+  monkey_vm_t *vm = monkey_vm_new();
+  /* Room for those two scripts only */
+  monkey_vm_enable_cache(vm, max_bytes);
+
+  obj_t *obj = monkey_vm_eval(vm, scripts[0]);
+  obj_destroy(&obj);
+  for (int i = 0; i < 3; i++) {
+    obj = monkey_vm_eval(vm, "double(21)");
+    _test_int_obj(obj, 42);
+    obj_destroy(&obj);
+  }
+  program_cache_stats_t *stats = &vm->cache->stats;
+  ck_assert_msg(stats->hits == 2 && stats->misses == 2,
+                "Expected 2 hits and 2 misses, got %zu and %zu", stats->hits,
+                stats->misses);
+
+  /* Evicts the program `double` was defined in, which must stay usable */
+  obj = monkey_vm_eval(vm, "1 + 1");
+  obj_destroy(&obj);
+  obj = monkey_vm_eval(vm, "2 + 2");
+  obj_destroy(&obj);
+  ck_assert_msg(stats->evictions > 0, "Expected evictions");
+  ck_assert_msg(stats->bytes <= vm->cache->max_bytes, "Cache is over its cap");
+  /* The retired program still counts */
+  ck_assert_msg(stats->retired > 0 && stats->retired < stats->bytes,
+                "Expected %zu retired bytes in %zu", stats->retired,
+                stats->bytes);
+  obj = monkey_vm_eval(vm, "double(4)");
+  _test_int_obj(obj, 8);
+  obj_destroy(&obj);
+
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Functions from evicted programs crowd out the entries, not the cap */
+START_TEST(test_vm_cache_retired)
+{
+  const char *first[] = {"let fa = fn(x) { x + 1 };"};
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, 3 * cached_bytes(first, 1));
+  program_cache_stats_t *stats = &vm->cache->stats;
+
+  char script[64];
+  for (char c = 'a'; c <= 'z'; c++) {
+    snprintf(script, sizeof(script), "let f%c = fn(x) { x + 1 };", c);
+    obj_t *obj = monkey_vm_eval(vm, script);
+    ck_assert_msg(obj == NULL, "Expected no value");
+  }
+  ck_assert_msg(stats->retired > vm->cache->max_bytes,
+                "Expected the retired programs over the cap, got %zu",
+                stats->retired);
+  ck_assert_uint_eq(stats->entries, 1);
+  obj_t *obj = monkey_vm_eval(vm, "fa(1) + fz(2)");
+  _test_int_obj(obj, 5);
+  monkey_vm_result_destroy(vm, &obj);
+
+  /* Without the globals that used them, they go */
+  monkey_vm_reset(vm);
+  ck_assert_uint_eq(stats->retired, 0);
+  ck_assert_msg(stats->bytes <= vm->cache->max_bytes, "Cache is over its cap");
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Fresh globals; cached programs still hit and locate their errors */
+START_TEST(test_vm_reset)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, 1 << 20);
+  vm->source_name = "script.mk";
+  const char *script = "let f = fn(x) {\n  x + true\n};\nf(1)";
+
+  size_t live = 0;
+  for (size_t i = 0; i < 10; i++) {
+    obj_t *obj = monkey_vm_eval(vm, script);
+    _test_obj_type(obj, ERROR_OBJ);
+    ck_assert_str_eq(obj->error_obj->message,
+                     "script.mk:2:5: type mismatch: INTEGER + BOOLEAN");
+    monkey_vm_result_destroy(vm, &obj);
+
+    obj = monkey_vm_eval(vm, "let g = 1; 1(2)");
+    _test_obj_type(obj, ERROR_OBJ);
+    ck_assert_str_eq(obj->error_obj->message,
+                     "script.mk:1:13: not a function: INTEGER");
+    monkey_vm_result_destroy(vm, &obj);
+
+    monkey_vm_reset(vm);
+    obj = monkey_vm_eval(vm, "f");
+    _test_obj_type(obj, ERROR_OBJ);
+    monkey_vm_result_destroy(vm, &obj);
+    monkey_vm_reset(vm);
+    if (i == 0) {
+      live = vm->memory->current;
+    }
+    ck_assert_uint_eq(vm->memory->current, live);
+  }
+  ck_assert_uint_eq(vm->cache->stats.misses, 3);
+  ck_assert_uint_eq(vm->sources_len, 3);
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Located in the input that defined the failing code */
+START_TEST(test_vm_error_positions)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  vm->source_name = "script.mk";
+
+  obj_t *obj = monkey_vm_eval(vm, "let x = 1;\nx + true");
+  _test_obj_type(obj, ERROR_OBJ);
+  ck_assert_str_eq(obj->error_obj->message,
+                   "script.mk:2:3: type mismatch: INTEGER + BOOLEAN");
+  obj_destroy(&obj);
+
+  obj = monkey_vm_eval(vm, "let f = fn() {\n  -missing\n};");
+  ck_assert_msg(obj == NULL, "Expected no value");
+  obj = monkey_vm_eval(vm, "let y = 2;\nf()");
+  _test_obj_type(obj, ERROR_OBJ);
+  ck_assert_str_eq(obj->error_obj->message,
+                   "script.mk:2:4: identifier not found: missing");
+  obj_destroy(&obj);
+
+  obj = monkey_vm_eval(vm, "  1(2)");
+  _test_obj_type(obj, ERROR_OBJ);
+  ck_assert_str_eq(obj->error_obj->message,
+                   "script.mk:1:4: not a function: INTEGER");
+  obj_destroy(&obj);
+
+  obj = monkey_vm_eval(vm, "let z 1;");
+  ck_assert_msg(obj == NULL && vm->errors_len > 0, "Expected parser errors");
+  ck_assert_str_eq(vm->errors[0], "script.mk:1:7: expected next token to be "
+                                  "ASSIGN_TOKEN, got INT_TOKEN instead");
+
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+START_TEST(test_batch_eval)
+{
+  const size_t len = 257;
+  char **scripts = malloc(len * sizeof(char *));
+  for (size_t i = 0; i < len; i++) {
+    asprintf(&scripts[i], "let n = %zu; n * 2", i);
+  }
+
+  char **results = monkey_batch_eval((const char **)scripts, len, 4);
+  for (size_t i = 0; i < len; i++) {
+    char *expected = NULL;
+    asprintf(&expected, "%zu", i * 2);
+    ck_assert_msg(strcmp(results[i], expected) == 0,
+                  "Expected=%s, got=%s at %zu", expected, results[i], i);
+    free(expected);
+  }
+
+  monkey_batch_results_destroy(&results, len);
+  monkey_batch_results_destroy(&scripts, len);
+}
+END_TEST
+
+/* Scripts repeated in a batch give what they give alone */
+START_TEST(test_batch_repeated)
+{
+  const char *distinct[] = {
+      "let f = fn(x) { [fn() { x }] }; f(3)[0]()",
+      "let x = 1;\nx + true",
+      "x",
+      /* Runs out on the same concatenation however full the VM */
+      "let d = fn(s, n) { if (n == 0) { s } else { d(s + s, n - 1) } }; "
+      "len(d(\"ab\", 20))",
+      "let f = fn(n, a) { if (n == 0) { len(a) } else { f(n - 1, "
+      "push(a, n)) } }; f(10, [])",
+  };
+  const size_t kinds = sizeof(distinct) / sizeof(distinct[0]);
+  const size_t len = 64;
+  const char *scripts[64];
+  for (size_t i = 0; i < len; i++) {
+    scripts[i] = distinct[i % kinds];
+  }
+  eval_limits_t limits = {.max_bytes = 1 << 16};
+  char **alone = monkey_batch_eval_limited(distinct, kinds, 1, &limits);
+  ck_assert_str_eq(alone[0], "3");
+  ck_assert_str_eq(alone[1],
+                   "ERROR: <input>:2:3: type mismatch: INTEGER + BOOLEAN");
+  ck_assert_str_eq(alone[2], "ERROR: <input>:1:1: identifier not found: x");
+  ck_assert_str_eq(alone[3],
+                   "ERROR: <input>:1:49: memory limit exceeded: 65536 bytes");
+  ck_assert_str_eq(alone[4], "10");
+
+  char **results = monkey_batch_eval_limited(scripts, len, 3, &limits);
+  for (size_t i = 0; i < len; i++) {
+    ck_assert_msg(strcmp(results[i], alone[i % kinds]) == 0,
+                  "Expected=%s, got=%s at %zu", alone[i % kinds], results[i],
+                  i);
+  }
+  monkey_batch_results_destroy(&results, len);
+  monkey_batch_results_destroy(&alone, kinds);
+}
+END_TEST
+
+/* g(n) makes 2 * fib(n + 1) - 1 calls */
+#define COUNT_CALLS                                                            \
+  "let g = fn(n) { if (n < 2) { 1 } else { g(n - 1) + g(n - 2) } }; "
+
+struct {
+  const char *input;
+  eval_limits_t limits;
+  const char *error; /* NULL if the script finishes */
+  ERROR_KIND kind;
+} t_d_eval_limits[] = {
+    {COUNT_CALLS "g(10)", {0}, NULL},
+    {COUNT_CALLS "g(2)", {.max_steps = 3}, NULL},
+    {COUNT_CALLS "g(2)", {.max_steps = 2}, "step limit exceeded: 2 steps",
+     ERROR_STEP_LIMIT},
+    /* Past the first check */
+    {COUNT_CALLS "g(16)", {.max_steps = 3193}, NULL},
+    {COUNT_CALLS "g(16)", {.max_steps = 3192}, "step limit exceeded",
+     ERROR_STEP_LIMIT},
+    {"let f = fn() { f() }; f()", {.max_steps = 50}, "step limit exceeded",
+     ERROR_STEP_LIMIT},
+    {"let f = fn() { f() }; f()", {.max_depth = 100},
+     "call depth limit exceeded: 100", ERROR_DEPTH_LIMIT},
+    {COUNT_CALLS "g(16)", {.max_depth = 16}, NULL},
+    {COUNT_CALLS "g(16)", {.max_depth = 15}, "call depth limit exceeded",
+     ERROR_DEPTH_LIMIT},
+    {COUNT_CALLS "g(30)", {.timeout_ns = 1000000}, "deadline exceeded: 1 ms",
+     ERROR_DEADLINE},
+    {"1 + true", {.max_steps = 1}, "type mismatch", ERROR_RUNTIME},
+    {"let g = fn(a) { g(push(a, 0)) }; g([])", {.max_bytes = 65536},
+     "memory limit exceeded: 65536 bytes", ERROR_MEMORY_LIMIT},
+    {"len(push([1, 2], 3))", {.max_bytes = 65536}, NULL},
+    {"let f = fn(n) { 10 / n }; f(0)", {.max_steps = 100},
+     "division by zero", ERROR_RUNTIME},
+    /* Runaway recursion stops short of the end of the C stack */
+    {"let f = fn() { f() + 1 }; f()", {0}, "expressions nested too deep",
+     ERROR_DEPTH_LIMIT},
+    {"let f = fn() { f() + 1 }; f()", {.max_steps = 1000000},
+     "expressions nested too deep", ERROR_DEPTH_LIMIT},
+    {"let f = fn() { f() + 1 }; f()", {.timeout_ns = 60000000000},
+     "expressions nested too deep", ERROR_DEPTH_LIMIT},
+    {"let f = fn(a) { [f([a])] }; f(1)", {.max_bytes = 1 << 30},
+     "expressions nested too deep", ERROR_DEPTH_LIMIT},
+};
+
+START_TEST(test_eval_limits_loop)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  vm->limits = t_d_eval_limits[_i].limits;
+  obj_t *obj = monkey_vm_eval(vm, t_d_eval_limits[_i].input);
+  ck_assert_msg(obj != NULL, "Expected a value");
+
+  const char *error = t_d_eval_limits[_i].error;
+  if (error == NULL) {
+    ck_assert_msg(obj->type != ERROR_OBJ, "Unexpected error: %s",
+                  obj->error_obj->message);
+  } else {
+    _test_obj_type(obj, ERROR_OBJ);
+    ck_assert_msg(strstr(obj->error_obj->message, error) != NULL,
+                  "Expected=%s, got=%s", error, obj->error_obj->message);
+    ck_assert_int_eq(obj->error_obj->kind, t_d_eval_limits[_i].kind);
+  }
+  obj_destroy(&obj);
+
+  /* The next evaluation gets a fresh budget */
+  obj = monkey_vm_eval(vm, "let h = fn() { 7 }; h()");
+  _test_int_obj(obj, 7);
+  obj_destroy(&obj);
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Repeated `open`, `leaf`, then `close` as often */
+struct {
+  const char *open;
+  const char *leaf;
+  const char *close;
+} t_d_deep_expression[] = {
+    {"1 + ", "1", ""},     {"1 + (", "1", ")"},  {"-", "1", ""},
+    {"[", "1", "]"},       {"{1: ", "1", "}"},   {"[0][", "0", "]"},
+    {"len([", "1", "])"},  {"(fn(x) { x })(", "1", ")"},
+};
+
+static char *repeat_around(size_t n, const char *open, const char *leaf,
+                           const char *close) {
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  for (size_t i = 0; i < n; i++) {
+    fputs(open, out);
+  }
+  fputs(leaf, out);
+  for (size_t i = 0; i < n; i++) {
+    fputs(close, out);
+  }
+  fclose(out);
+  return str;
+}
+
+/* Nesting too deep for the C stack is an error, in batches too */
+START_TEST(test_deep_expression_loop)
+{
+  char *input = repeat_around(200000, t_d_deep_expression[_i].open,
+                              t_d_deep_expression[_i].leaf,
+                              t_d_deep_expression[_i].close);
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *obj = monkey_vm_eval(vm, input);
+  _test_obj_type(obj, ERROR_OBJ);
+  ck_assert_int_eq(obj->error_obj->kind, ERROR_DEPTH_LIMIT);
+  monkey_vm_result_destroy(vm, &obj);
+
+  /* Not nested as deep, it works */
+  char *shallow = repeat_around(100, t_d_deep_expression[_i].open,
+                                t_d_deep_expression[_i].leaf,
+                                t_d_deep_expression[_i].close);
+  obj = monkey_vm_eval(vm, shallow);
+  ck_assert_msg(obj->type != ERROR_OBJ, "Unexpected error: %s",
+                obj->error_obj->message);
+  monkey_vm_result_destroy(vm, &obj);
+  monkey_vm_destroy(&vm);
+
+  const char *scripts[] = {input, shallow};
+  char **results = monkey_batch_eval(scripts, 2, 2);
+  ck_assert_msg(strstr(results[0], "expressions nested too deep") != NULL,
+                "Expected a depth error, got %.80s", results[0]);
+  ck_assert_msg(strstr(results[1], "ERROR") == NULL, "Unexpected %s",
+                results[1]);
+  monkey_batch_results_destroy(&results, 2);
+  free(shallow);
+  free(input);
+}
+END_TEST
+
+/*
+ * `sa` of 32 bytes, then `sb = sa + sa` and so on `doublings` times,
+ * and `tail`. No calls.
+ */
+static char *doubling_script(size_t doublings, const char *tail) {
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  fputs("let sa = \"0123456789abcdef0123456789abcdef\";", out);
+  for (size_t i = 1; i <= doublings; i++) {
+    fprintf(out, "let s%c = s%c + s%c;", 'a' + (int)i, 'a' + (int)i - 1,
+            'a' + (int)i - 1);
+  }
+  fputs(tail, out);
+  fclose(out);
+  return str;
+}
+
+struct {
+  size_t doublings;
+  const char *tail;
+  size_t max_bytes;
+  bool over;
+} t_d_memory_limit_no_calls[] = {
+    /* 32 MB in the end, refused at 2 MB */
+    {20, "len(su)", 1 << 20, true},
+    {20, "len(su)", 0, false},
+    /* 1 MB, then two copies flattened by `<` */
+    {15, "let x = sp + \"a\"; let y = sp + \"b\"; x < y", 3 << 19, true},
+    {15, "let x = sp + \"a\"; let y = sp + \"b\"; x < y", 3 << 20, false},
+    /* Flattened by the last expression, then the next one is refused */
+    {15, "sp < sp; 1", 3 << 19, false},
+    {15, "sp < sp; let x = sp + sp; 1", 3 << 19, true},
+};
+
+/* Call-free scripts are held to the quota too */
+START_TEST(test_memory_limit_no_calls_loop)
+{
+  char *input = doubling_script(t_d_memory_limit_no_calls[_i].doublings,
+                                t_d_memory_limit_no_calls[_i].tail);
+  monkey_vm_t *vm = monkey_vm_new();
+  size_t max_bytes = t_d_memory_limit_no_calls[_i].max_bytes;
+  vm->limits.max_bytes = max_bytes;
+  obj_t *obj = monkey_vm_eval(vm, input);
+  if (t_d_memory_limit_no_calls[_i].over) {
+    _test_obj_type(obj, ERROR_OBJ);
+    ck_assert_int_eq(obj->error_obj->kind, ERROR_MEMORY_LIMIT);
+    /* Overshot by one flattened string at most */
+    ck_assert_msg(vm->memory->peak < 2 * max_bytes + 65536,
+                  "Peak of %zu for a quota of %zu", vm->memory->peak,
+                  max_bytes);
+  } else {
+    ck_assert_msg(obj->type != ERROR_OBJ, "Unexpected error: %s",
+                  obj->error_obj->message);
+  }
+  monkey_vm_result_destroy(vm, &obj);
+  monkey_vm_destroy(&vm);
+  free(input);
+}
+END_TEST
+
+/* Hitting the quota over and over neither leaks nor drifts */
+START_TEST(test_memory_limit_stress)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  /* Evaluating the same input again reuses its program */
+  monkey_vm_enable_cache(vm, 1 << 20);
+  obj_t *obj = monkey_vm_eval(vm, "let g = fn(a) { g(push(a, 0)) };"
+                                  "let f = fn(n) { if (n == 0) { [] } "
+                                  "else { push(f(n - 1), n) } };");
+  ck_assert_msg(obj == NULL, "Expected no value");
+
+  obj = monkey_vm_eval(vm, "len(f(100))");
+  _test_int_obj(obj, 100);
+  monkey_vm_result_destroy(vm, &obj);
+  size_t live = vm->memory->current;
+  ck_assert_msg(vm->memory->peak > live, "Expected garbage to be freed");
+
+  vm->limits.max_bytes = live + 256 * 1024;
+  for (size_t i = 0; i < 100; i++) {
+    obj = monkey_vm_eval(vm, "g([])");
+    _test_obj_type(obj, ERROR_OBJ);
+    ck_assert_int_eq(obj->error_obj->kind, ERROR_MEMORY_LIMIT);
+    monkey_vm_result_destroy(vm, &obj);
+    ck_assert_msg(vm->memory->peak >= vm->limits.max_bytes,
+                  "Expected the quota to be reached");
+
+    /* Still usable below the quota */
+    obj = monkey_vm_eval(vm, "len(f(100))");
+    _test_int_obj(obj, 100);
+    monkey_vm_result_destroy(vm, &obj);
+    if (i == 0) {
+      live = vm->memory->current;
+    }
+    ck_assert_uint_eq(vm->memory->current, live);
+  }
+
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* More arguments than the C stack could hold */
+START_TEST(test_call_many_args)
+{
+  const size_t argc = 1 << 20;
+  char *input = malloc(argc * 2 + 16);
+  char *at = input + sprintf(input, "len(");
+  for (size_t i = 0; i < argc; i++) {
+    *at++ = i == 0 ? '1' : ',';
+    if (i != 0) {
+      *at++ = '1';
+    }
+  }
+  strcpy(at, ")");
+
+  test_eval_t *eval_obj = _test_eval(input);
+  _test_error_obj("wrong number of arguments. got=1048576, want=1",
+                  eval_obj->obj);
+  eval_destroy(&eval_obj);
+  free(input);
+}
+END_TEST
+
+/* Scripts whose garbage could retain itself; `result` is an int */
+struct {
+  const char *setup;
+  const char *input;
+  int64_t result;
+} t_d_no_leak[] = {
+    {"", "let a = [1]; let b = push(a, a); len(b)", 2},
+    {"", "let a = [1]; let b = push(a, [a, {1: a}]); len(b[1])", 2},
+    {"let g = fn() { let x = [fn() { 1 }]; 1 };", "g()", 1},
+    {"let g = fn() { let x = {1: fn() { 1 }}; x[1]() };", "g()", 1},
+    {"let g = fn(n) { let x = [fn() { n }]; if (n > 0) { g(n - 1) } else "
+     "{ x[0]() } };",
+     "g(5)", 0},
+    /* Closures escaping in a container bound where they were made */
+    {"let mk = fn(x) { let g = fn() { x }; let a = [g]; a };", "mk(1)[0]()",
+     1},
+    {"let mk = fn(x) { let g = fn() { x }; let m = {1: g}; m };",
+     "mk(2)[1]()", 2},
+    {"let mk = fn(x) { let g = fn() { x }; let a = []; push(a, g) };",
+     "mk(3)[0]()", 3},
+    {"let mk = fn(x) { let g = fn() { x }; let a = push([], g); [a] };",
+     "mk(4)[0][0]()", 4},
+    /* Garbage once rebound, in a later input */
+    {"let mk = fn(x) { let a = [fn() { x }]; a };",
+     "let r = mk(5); r[0]()", 5},
+};
+
+/* Evaluating the input again leaves no more bytes live than once */
+START_TEST(test_no_leak_loop)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  monkey_vm_enable_cache(vm, 1 << 20);
+  obj_t *obj = monkey_vm_eval(vm, t_d_no_leak[_i].setup);
+  ck_assert_msg(obj == NULL, "Expected no value");
+
+  size_t live = 0;
+  for (size_t i = 0; i < 10; i++) {
+    obj = monkey_vm_eval(vm, t_d_no_leak[_i].input);
+    _test_int_obj(obj, t_d_no_leak[_i].result);
+    monkey_vm_result_destroy(vm, &obj);
+    if (i == 0) {
+      live = vm->memory->current;
+    }
+    ck_assert_uint_eq(vm->memory->current, live);
+  }
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Samples land in the functions that were running, named and located */
+START_TEST(test_profile_folded)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *obj = monkey_vm_eval(
+      vm, "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };");
+  ck_assert_msg(obj == NULL, "Expected no value");
+
+  profile_t *profile = profile_new(PROFILE_DEFAULT_HZ);
+  ck_assert_msg(profile_start(profile), "Expected the profiler to start");
+  /* CPU time is sampled, so keep busy until some samples are in */
+  for (size_t i = 0; i < 10000 && profile->samples_len < 5; i++) {
+    obj = monkey_vm_eval(vm, "fib(15)");
+    _test_int_obj(obj, 610);
+    monkey_vm_result_destroy(vm, &obj);
+  }
+  profile_stop(profile);
+  ck_assert_msg(profile->samples_len >= 5, "Expected samples, Got=%zu",
+                profile->samples_len);
+  ck_assert_uint_eq(profile->stack.depth, 0);
+
+  char *folded = NULL;
+  size_t folded_len = 0;
+  FILE *out = open_memstream(&folded, &folded_len);
+  profile_write_folded(profile, vm, out);
+  fclose(out);
+
+  size_t samples = 0;
+  char *save = NULL;
+  for (char *line = strtok_r(folded, "\n", &save); line != NULL;
+       line = strtok_r(NULL, "\n", &save)) {
+    char *count = strrchr(line, ' ');
+    ck_assert_msg(count != NULL, "Expected a count in %s", line);
+    *count++ = '\0';
+    samples += strtoul(count, NULL, 10);
+
+    char *frame_save = NULL;
+    char *frame = strtok_r(line, ";", &frame_save);
+    ck_assert_str_eq(frame, "<input>");
+    while ((frame = strtok_r(NULL, ";", &frame_save)) != NULL) {
+      ck_assert_str_eq(frame, "fib (<input>:1:17)");
+    }
+  }
+  ck_assert_uint_eq(samples, profile->samples_len);
+
+  free(folded);
+  profile_destroy(&profile);
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+/* Visits are counted per node, and each `if` knows how often it branched */
+START_TEST(test_count_listing)
+{
+  ck_assert_msg(sizeof(count_node_t) <= 32, "Expected compact counters");
+  monkey_vm_t *vm = monkey_vm_new();
+  count_t *count = count_new();
+  count_start(count);
+  obj_t *obj = monkey_vm_eval(
+      vm, "let f = fn(n) { if (n < 2) { n } else { f(n - 1) } };\nf(5)");
+  count_stop(count);
+  _test_int_obj(obj, 1);
+  monkey_vm_result_destroy(vm, &obj);
+
+  const count_node_t *if_node = NULL;
+  for (size_t i = 1; i < count->len; i++) {
+    if (count->nodes[i].kind == IF_EXP) {
+      ck_assert_msg(if_node == NULL, "Expected one if");
+      if_node = &count->nodes[i];
+    }
+  }
+  ck_assert_msg(if_node != NULL, "Expected the if to be counted");
+  ck_assert_uint_eq(if_node->hits, 5);
+  ck_assert_uint_eq(if_node->taken, 1);
+  ck_assert_uint_eq(if_node->active, 0);
+
+  char *listing = NULL;
+  size_t listing_len = 0;
+  FILE *out = open_memstream(&listing, &listing_len);
+  count_write_listing(count, vm, out);
+  fclose(out);
+  ck_assert_msg(strstr(listing, "| if at 1:17 taken 1 of 5 (20.0%)") != NULL,
+                "Expected the branch ratio in %s", listing);
+  ck_assert_msg(strstr(listing, "     2 | f(5)") != NULL,
+                "Expected the second line in %s", listing);
+  ck_assert_msg(strstr(listing, "-- hot spots") != NULL,
+                "Expected hot spots in %s", listing);
+
+  free(listing);
+  count_destroy(&count);
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+
+#define POOL_TEST_BLOCKS 1000
+
+static void *pool_test_alloc(void *arg) {
+  int_obj_t **ints = arg;
+  for (size_t i = 0; i < POOL_TEST_BLOCKS; i++) {
+    ints[i] = pool_alloc(POOL_INT, MEM_INT);
+    ints[i]->value = (int32_t)i;
+  }
+  return NULL;
+}
+
+START_TEST(test_pool_threads)
+{
+  /* Allocated on one thread, freed on another that then reuses them */
+  int_obj_t *ints[POOL_TEST_BLOCKS];
+  pthread_t thread;
+  ck_assert_int_eq(pthread_create(&thread, NULL, pool_test_alloc, ints), 0);
+  pthread_join(thread, NULL);
+
+  for (size_t i = 0; i < POOL_TEST_BLOCKS; i++) {
+    ck_assert_int_eq(ints[i]->value, (int32_t)i);
+    pool_free(POOL_INT, ints[i]);
+  }
+
+  memory_t *memory = memory_new();
+  memory_t *previous = memory_swap(memory);
+  pool_test_alloc(ints);
+  ck_assert_uint_eq(memory->current, POOL_TEST_BLOCKS * sizeof(int_obj_t));
+  for (size_t i = 0; i < POOL_TEST_BLOCKS; i++) {
+    ck_assert_int_eq(ints[i]->value, (int32_t)i);
+    pool_free(POOL_INT, ints[i]);
+  }
+  ck_assert_uint_eq(memory->current, 0);
+#ifdef MONKEY_POOLS
+  int_obj_t *last = ints[POOL_TEST_BLOCKS - 1];
+  ck_assert_msg(pool_alloc(POOL_INT, MEM_INT) == last,
+                "Expected the block freed last to be reused first");
+  pool_free(POOL_INT, last);
+#endif
+  memory_swap(previous);
+  memory_destroy(&memory);
+
+  ck_assert_int_eq(pthread_create(&thread, NULL, pool_test_alloc, ints), 0);
+  pthread_join(thread, NULL);
+  for (size_t i = 0; i < POOL_TEST_BLOCKS; i++) {
+    pool_free(POOL_INT, ints[i]);
+  }
+}
+END_TEST
+
+#ifdef MONKEY_ALLOC_STATS
+START_TEST(test_alloc_stats)
+{
+  monkey_vm_t *vm = monkey_vm_new();
+  obj_t *obj = monkey_vm_eval(
+      vm, "let a = [1, 2, 3]; let f = fn(x) { x + 1 }; f(len(a))");
+  _test_int_obj(obj, 4);
+  monkey_vm_result_destroy(vm, &obj);
+
+  const alloc_stats_t *stats = &vm->memory->stats;
+  size_t live = 0;
+  for (size_t i = 0; i < MEM_CATEGORIES; i++) {
+    const mem_category_stats_t *category = &stats->categories[i];
+    uint64_t lifetimes = 0;
+    for (size_t j = 0; j < MEM_LIFETIME_BUCKETS; j++) {
+      lifetimes += category->lifetimes[j];
+    }
+    /* Everything was allocated with the VM's context current */
+    ck_assert_uint_eq(lifetimes, category->frees);
+    ck_assert_msg(category->frees <= category->allocs,
+                  "Expected no more frees than allocations of %s",
+                  mem_category_to_str(i));
+    live += category->live;
+  }
+  ck_assert_uint_eq(live, vm->memory->current);
+  ck_assert_msg(stats->categories[MEM_TOKEN].allocs > 0, "Expected tokens");
+  ck_assert_msg(stats->categories[MEM_AST].allocs > 0, "Expected nodes");
+  ck_assert_msg(stats->categories[MEM_ARRAY].live > 0, "Expected `a` live");
+  ck_assert_msg(stats->categories[MEM_FUNCTION].live > 0, "Expected `f` live");
+  ck_assert_msg(stats->categories[MEM_INT].frees > 0,
+                "Expected intermediate ints freed");
+
+  char *report = NULL;
+  size_t report_len = 0;
+  FILE *out = open_memstream(&report, &report_len);
+  memory_write_stats(vm->memory, out);
+  fclose(out);
+  ck_assert_msg(strstr(report, "-- allocations") != NULL,
+                "Expected the table in %s", report);
+  ck_assert_msg(strstr(report, "-- int lifetimes") != NULL,
+                "Expected int lifetimes in %s", report);
+
+  free(report);
+  monkey_vm_destroy(&vm);
+}
+END_TEST
+#endif
+
 Suite *evaluator_suite(void) {
   Suite *s;
   TCase *tc_core;
@@ -277,6 +1397,57 @@ Suite *evaluator_suite(void) {
   tcase_add_loop_test(tc_core, test_error_obj_loop,
                       0, sizeof(t_d_error_obj) / sizeof(*t_d_error_obj));
 
+  tcase_add_loop_test(tc_core, test_let_statement_loop,
+                      0, sizeof(t_d_let_statement) / sizeof(*t_d_let_statement));
+
+  tcase_add_loop_test(tc_core, test_function_loop,
+                      0, sizeof(t_d_function) / sizeof(*t_d_function));
+  tcase_add_loop_test(tc_core, test_array_index_loop,
+                      0, sizeof(t_d_array_index) / sizeof(*t_d_array_index));
+  tcase_add_loop_test(tc_core, test_array_index_null_loop,
+                      0, sizeof(t_d_array_index_null) / sizeof(*t_d_array_index_null));
+  tcase_add_loop_test(tc_core, test_builtin_loop,
+                      0, sizeof(t_d_builtin) / sizeof(*t_d_builtin));
+  tcase_add_test(tc_core, test_array_literal);
+  tcase_add_test(tc_core, test_map_to_string);
+  tcase_add_loop_test(tc_core, test_map_index_loop,
+                      0, sizeof(t_d_map_index) / sizeof(*t_d_map_index));
+  tcase_add_loop_test(tc_core, test_map_index_null_loop,
+                      0, sizeof(t_d_map_index_null) / sizeof(*t_d_map_index_null));
+
+  tcase_add_loop_test(tc_core, test_string_loop,
+                      0, sizeof(t_d_string) / sizeof(*t_d_string));
+  tcase_add_loop_test(tc_core, test_string_compare_loop,
+                      0, sizeof(t_d_string_compare) / sizeof(*t_d_string_compare));
+  tcase_add_test(tc_core, test_string_rope);
+  tcase_add_test(tc_core, test_string_rope_release);
+  tcase_add_test(tc_core, test_string_interning);
+  tcase_add_test(tc_core, test_vm_isolation);
+  tcase_add_test(tc_core, test_vm_program_cache);
+  tcase_add_test(tc_core, test_vm_cache_retired);
+  tcase_add_test(tc_core, test_vm_reset);
+  tcase_add_test(tc_core, test_vm_error_positions);
+  tcase_add_test(tc_core, test_batch_eval);
+  tcase_add_test(tc_core, test_batch_repeated);
+  tcase_add_loop_test(tc_core, test_eval_limits_loop, 0,
+                      sizeof(t_d_eval_limits) / sizeof(t_d_eval_limits[0]));
+  tcase_add_loop_test(tc_core, test_deep_expression_loop, 0,
+                      sizeof(t_d_deep_expression) /
+                          sizeof(t_d_deep_expression[0]));
+  tcase_add_test(tc_core, test_memory_limit_stress);
+  tcase_add_loop_test(tc_core, test_memory_limit_no_calls_loop, 0,
+                      sizeof(t_d_memory_limit_no_calls) /
+                          sizeof(t_d_memory_limit_no_calls[0]));
+  tcase_add_test(tc_core, test_call_many_args);
+  tcase_add_loop_test(tc_core, test_no_leak_loop, 0,
+                      sizeof(t_d_no_leak) / sizeof(t_d_no_leak[0]));
+  tcase_add_test(tc_core, test_profile_folded);
+  tcase_add_test(tc_core, test_count_listing);
+  tcase_add_test(tc_core, test_pool_threads);
+#ifdef MONKEY_ALLOC_STATS
+  tcase_add_test(tc_core, test_alloc_stats);
+#endif
+
   suite_add_tcase(s, tc_core);
 
   return s;
@@ -0,0 +1,285 @@
+#include "../src/hash.h"
+#include <check.h>
+#include <inttypes.h>
+
+#define SEED 0x0123456789abcdefull
+
+static hd_t *int_data(size_t num) {
+  return hd_create(HD_INT_DT, (uintptr_t *)num);
+}
+
+/* Short keys are stored in the slot, long ones on the heap */
+static void make_key(char *key, size_t size, size_t i) {
+  snprintf(key, size, i % 2 == 0 ? "k%zu" : "a key too long to inline %zu",
+           i);
+}
+
+static void check_get(ht_t *ht, char *key, int32_t expected) {
+  hd_t *hd = ht_get(ht, key);
+  ck_assert_msg(hd != NULL, "Expected %s to be found", key);
+  ck_assert_int_eq(hd->dt, HD_INT_DT);
+  ck_assert_int_eq(hd->num, expected);
+  ck_assert(ht_exists(ht, key));
+}
+
+START_TEST(test_ht_add_get) {
+  ht_t *ht = ht_create(4);
+  ck_assert(ht_add(ht, "one", int_data(1)));
+  ck_assert(ht_add(ht, "two", int_data(2)));
+  ck_assert(ht_add(ht, "a key too long to inline", int_data(3)));
+  ck_assert_uint_eq(ht->length, 3);
+
+  check_get(ht, "one", 1);
+  check_get(ht, "two", 2);
+  check_get(ht, "a key too long to inline", 3);
+  ck_assert(ht_get(ht, "three") == NULL);
+  ck_assert(!ht_exists(ht, "three"));
+  ck_assert(ht_get(ht, "") == NULL);
+
+  ht_destroy(&ht);
+  ck_assert(ht == NULL);
+}
+END_TEST
+
+/* Adding an existing key replaces its data and releases the old data */
+START_TEST(test_ht_replace) {
+  ht_t *ht = ht_create(4);
+  ck_assert(ht_add(ht, "key", hd_create(HD_STRING_DT,
+                                        (uintptr_t *)strdup("old"))));
+  ck_assert(!ht_add(ht, "key", hd_create(HD_STRING_DT,
+                                         (uintptr_t *)strdup("new"))));
+  ck_assert_uint_eq(ht->length, 1);
+  hd_t *hd = ht_get(ht, "key");
+  ck_assert_int_eq(hd->dt, HD_STRING_DT);
+  ck_assert_str_eq(hd->str, "new");
+
+  ck_assert(!ht_add(ht, "key", int_data(7)));
+  check_get(ht, "key", 7);
+  ck_assert_uint_eq(ht->length, 1);
+  ht_destroy(&ht);
+}
+END_TEST
+
+/* Deleting removes that key only */
+START_TEST(test_ht_delete) {
+  ht_t *ht = ht_create(4);
+  char key[64];
+  for (size_t i = 0; i < 10; i++) {
+    make_key(key, sizeof(key), i);
+    ck_assert(ht_add(ht, key, int_data(i)));
+  }
+
+  ck_assert(ht_delete(ht, "k4"));
+  ck_assert(!ht_delete(ht, "k4"));
+  ck_assert(!ht_delete(ht, "missing"));
+  ck_assert(ht_get(ht, "k4") == NULL);
+  ck_assert_uint_eq(ht->length, 9);
+  for (size_t i = 0; i < 10; i++) {
+    if (i != 4) {
+      make_key(key, sizeof(key), i);
+      check_get(ht, key, (int32_t)i);
+    }
+  }
+
+  /* A deleted key can be added again */
+  ck_assert(ht_add(ht, "k4", int_data(40)));
+  check_get(ht, "k4", 40);
+  ck_assert_uint_eq(ht->length, 10);
+  ht_destroy(&ht);
+}
+END_TEST
+
+/* Every key survives the table growing past its load threshold */
+START_TEST(test_ht_growth) {
+  ht_t *ht = ht_create(1);
+  size_t capacity = ht->capacity;
+  size_t threshold = capacity * HT_MAX_LOAD_NUM / HT_MAX_LOAD_DEN;
+  char key[64];
+
+  for (size_t i = 0; i < threshold; i++) {
+    make_key(key, sizeof(key), i);
+    ck_assert(ht_add(ht, key, int_data(i)));
+  }
+  ck_assert_uint_eq(ht->capacity, capacity);
+
+  size_t n = 1000;
+  for (size_t i = threshold; i < n; i++) {
+    make_key(key, sizeof(key), i);
+    ck_assert(ht_add(ht, key, int_data(i)));
+  }
+  ck_assert_msg(ht->capacity > capacity, "Expected the table to grow");
+  ck_assert_msg(ht->length * HT_MAX_LOAD_DEN <=
+                    ht->capacity * HT_MAX_LOAD_NUM,
+                "Load over the threshold: %zu in %zu", ht->length,
+                ht->capacity);
+  ck_assert_uint_eq(ht->length, n);
+  for (size_t i = 0; i < n; i++) {
+    make_key(key, sizeof(key), i);
+    check_get(ht, key, (int32_t)i);
+  }
+  ht_destroy(&ht);
+}
+END_TEST
+
+/* Churn on a steady number of keys reuses deleted slots, never growing */
+START_TEST(test_ht_reuse_deleted) {
+  ht_t *ht = ht_create(32);
+  size_t capacity = ht->capacity;
+  size_t live = 24;
+  char key[64];
+
+  for (size_t i = 0; i < live; i++) {
+    make_key(key, sizeof(key), i);
+    ck_assert(ht_add(ht, key, int_data(i)));
+  }
+  for (size_t i = live; i < 100 * live; i++) {
+    make_key(key, sizeof(key), i - live);
+    ck_assert(ht_delete(ht, key));
+    make_key(key, sizeof(key), i);
+    ck_assert(ht_add(ht, key, int_data(i)));
+    ck_assert_uint_eq(ht->length, live);
+  }
+  ck_assert_uint_eq(ht->capacity, capacity);
+
+  for (size_t i = 99 * live; i < 100 * live; i++) {
+    make_key(key, sizeof(key), i);
+    check_get(ht, key, (int32_t)i);
+  }
+  make_key(key, sizeof(key), 0);
+  ck_assert(ht_get(ht, key) == NULL);
+  ht_destroy(&ht);
+}
+END_TEST
+
+/*
+ * Digests of the bytes `i * 31 + 7` under SEED, at the lengths where
+ * `hash_bytes_seeded` switches how it reads: none, 1 to 3 bytes, 4 to
+ * 16 in 4 byte words, then 16 and 48 byte blocks. Little endian.
+ */
+struct {
+  size_t len;
+  uint64_t digest;
+} t_d_hash_bytes[] = {
+    {0, 0x2b4e3df129b1f482ull},  {3, 0xa1aea1c588aaadbbull},
+    {4, 0x0f7afa8710da7e08ull},  {16, 0x5eef37151b6c191cull},
+    {17, 0x3666b60a397c36cfull}, {48, 0x01d882dd10c0f235ull},
+    {49, 0xdcfedffa0f32435full},
+};
+
+static void fill(uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)(i * 31 + 7);
+  }
+}
+
+START_TEST(test_hash_bytes_loop) {
+  uint8_t data[64];
+  fill(data, sizeof(data));
+  size_t len = t_d_hash_bytes[_i].len;
+  uint64_t digest = hash_bytes_seeded(data, len, SEED);
+  ck_assert_msg(digest == t_d_hash_bytes[_i].digest,
+                "Expected=%016" PRIx64 ", got=%016" PRIx64 " for %zu bytes",
+                t_d_hash_bytes[_i].digest, digest, len);
+
+  /* Every byte read counts, first and last included */
+  for (size_t i = 0; i < len; i++) {
+    data[i] ^= 1;
+    ck_assert_msg(hash_bytes_seeded(data, len, SEED) != digest,
+                  "Byte %zu of %zu is ignored", i, len);
+    data[i] ^= 1;
+  }
+  /* Bytes past the end do not */
+  data[len] ^= 1;
+  ck_assert(hash_bytes_seeded(data, len, SEED) == digest);
+}
+END_TEST
+
+START_TEST(test_hash_seeds) {
+  uint8_t data[64];
+  fill(data, sizeof(data));
+  for (size_t i = 0; i < sizeof(t_d_hash_bytes) / sizeof(t_d_hash_bytes[0]);
+       i++) {
+    size_t len = t_d_hash_bytes[i].len;
+    uint64_t digest = hash_bytes_seeded(data, len, SEED);
+    ck_assert(hash_bytes_seeded(data, len, SEED) == digest);
+    ck_assert(hash_bytes_seeded(data, len, SEED + 1) != digest);
+    ck_assert(hash_bytes_seeded(data, len, 0) != digest);
+  }
+
+  /* The process seed is the one `hash_bytes64` uses */
+  ck_assert(hash_bytes64(data, 17) ==
+            hash_bytes_seeded(data, 17, hash_seed()));
+  uint64_t h = hash_bytes64(data, 17);
+  ck_assert_uint_eq(hash_bytes(data, 17), (uint32_t)(h ^ (h >> 32)));
+}
+END_TEST
+
+/* Runs this test binary to print the digest of `key` under `seed` */
+static uint64_t digest_with_env_seed(const char *seed, const char *key) {
+  /* Resolved here: in the shell, /proc/self/exe is the shell */
+  char *self = realpath("/proc/self/exe", NULL);
+  ck_assert_ptr_nonnull(self);
+  char *command = NULL;
+  asprintf(&command, "MONKEY_HASH_SEED=%s '%s' %s", seed, self, key);
+  FILE *out = popen(command, "r");
+  ck_assert_ptr_nonnull(out);
+  uint64_t digest = 0;
+  ck_assert_int_eq(fscanf(out, "%" SCNx64, &digest), 1);
+  ck_assert_int_eq(pclose(out), 0);
+  free(command);
+  free(self);
+  return digest;
+}
+
+/* MONKEY_HASH_SEED fixes the seed across runs */
+START_TEST(test_hash_env_seed) {
+  uint64_t first = digest_with_env_seed("42", "key");
+  ck_assert(digest_with_env_seed("42", "key") == first);
+  ck_assert(digest_with_env_seed("0x2a", "key") == first);
+  ck_assert(hash_bytes_seeded("key", 3, 42) == first);
+  ck_assert(digest_with_env_seed("43", "key") != first);
+}
+END_TEST
+
+Suite *hash_suite(void) {
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("Hash");
+  tc_core = tcase_create("Core");
+
+  tcase_add_test(tc_core, test_ht_add_get);
+  tcase_add_test(tc_core, test_ht_replace);
+  tcase_add_test(tc_core, test_ht_delete);
+  tcase_add_test(tc_core, test_ht_growth);
+  tcase_add_test(tc_core, test_ht_reuse_deleted);
+  tcase_add_loop_test(tc_core, test_hash_bytes_loop, 0,
+                      sizeof(t_d_hash_bytes) / sizeof(t_d_hash_bytes[0]));
+  tcase_add_test(tc_core, test_hash_seeds);
+  tcase_add_test(tc_core, test_hash_env_seed);
+
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+int main(int argc, char **argv) {
+  /* For test_hash_env_seed: the digest of argv[1] under the seed */
+  if (argc == 2) {
+    printf("%016" PRIx64 "\n", hash_bytes64(argv[1], strlen(argv[1])));
+    return EXIT_SUCCESS;
+  }
+
+  int number_failed;
+  Suite *s;
+  SRunner *sr;
+
+  s = hash_suite();
+  sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,4 +1,5 @@
 #include "../src/lexer.h"
+#include "../src/source.h"
 #include <check.h>
 
 START_TEST(test_next_token) {
@@ -18,6 +19,10 @@ if (5 < 10) {                    \
 }                                \
 10 == 10;                        \
 10 != 9;                        \
+\"foobar\"                        \
+\"foo bar\"                       \
+[1, 2];                          \
+{\"foo\": \"bar\"}                  \
 ";
 
   typedef struct {
@@ -50,7 +55,12 @@ if (5 < 10) {                    \
       {SEMICOLON_TOKEN, ";"},  {RBRACE_TOKEN, "}"},      {INT_TOKEN, "10"},
       {EQ_TOKEN, "=="},        {INT_TOKEN, "10"},        {SEMICOLON_TOKEN, ";"},
       {INT_TOKEN, "10"},       {NOT_EQ_TOKEN, "!="},     {INT_TOKEN, "9"},
-      {SEMICOLON_TOKEN, ";"},  {EOF_TOKEN, ""}};
+      {SEMICOLON_TOKEN, ";"},  {STRING_TOKEN, "foobar"}, {STRING_TOKEN, "foo bar"},
+      {LBRACKET_TOKEN, "["},   {INT_TOKEN, "1"},         {COMMA_TOKEN, ","},
+      {INT_TOKEN, "2"},        {RBRACKET_TOKEN, "]"},    {SEMICOLON_TOKEN, ";"},
+      {LBRACE_TOKEN, "{"},     {STRING_TOKEN, "foo"},    {COLON_TOKEN, ":"},
+      {STRING_TOKEN, "bar"},   {RBRACE_TOKEN, "}"},
+      {EOF_TOKEN, ""}};
 
   lexer_t *lexer = lexer_new(input);
 
@@ -74,6 +84,40 @@ if (5 < 10) {                    \
 }
 END_TEST
 
+START_TEST(test_token_offsets) {
+  const char *input = "let x = 5;\n  \"a b\" == x\n\n}";
+  struct {
+    uint32_t offset;
+    uint32_t line;
+    uint32_t column;
+  } tests[] = {{0, 1, 1},   {4, 1, 5},   {6, 1, 7},  {8, 1, 9},
+               {9, 1, 10},  {13, 2, 3},  {19, 2, 9}, {22, 2, 12},
+               {25, 4, 1},  {26, 4, 2}};
+
+  lexer_t *lexer = lexer_new(input);
+  source_t *source = source_new("test.mk", input, strlen(input), 0);
+  for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+    token_t *tok = lexer_next_token(lexer);
+    ck_assert_msg(tok->offset == tests[i].offset,
+                  "Expected token %zu at %u, Got: %u\n", i, tests[i].offset,
+                  tok->offset);
+    source_location_t location = source_locate(source, tok->offset);
+    ck_assert_msg(location.line == tests[i].line &&
+                      location.column == tests[i].column,
+                  "Expected token %zu at %u:%u, Got: %u:%u\n", i,
+                  tests[i].line, tests[i].column, location.line,
+                  location.column);
+    token_destroy(&tok);
+  }
+
+  char *error = source_format_error(source, 13, "oops");
+  ck_assert_msg(strcmp(error, "test.mk:2:3: oops") == 0, "Got: %s\n", error);
+  free(error);
+  source_destroy(&source);
+  lexer_destroy(&lexer);
+}
+END_TEST
+
 Suite *lexer_suite(void) {
   Suite *s;
   TCase *tc_core;
@@ -82,6 +126,7 @@ Suite *lexer_suite(void) {
   tc_core = tcase_create("Core");
 
   tcase_add_test(tc_core, test_next_token);
+  tcase_add_test(tc_core, test_token_offsets);
 
   suite_add_tcase(s, tc_core);
 
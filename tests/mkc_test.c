@@ -0,0 +1,294 @@
+#include "../src/evaluator.h"
+#include "../src/lexer.h"
+#include "../src/mkc.h"
+#include "../src/parser.h"
+#include "utils.h"
+#include <check.h>
+
+static program_t *parse(const char *input, parser_t **parser) {
+  lexer_t *lexer = lexer_new(input);
+  *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(*parser);
+  ck_assert(!check_parser_errors(*parser));
+  return program;
+}
+
+/* Writes `program` to a temporary file and loads it back */
+static program_t *round_trip(program_t *program) {
+  FILE *file = tmpfile();
+  ck_assert_ptr_nonnull(file);
+  ck_assert(mkc_write(program, file));
+  fflush(file);
+
+  char *error = NULL;
+  program_t *loaded = mkc_load_fd(fileno(file), &error);
+  ck_assert_msg(loaded != NULL, "load failed: %s", error);
+  fclose(file);
+  return loaded;
+}
+
+const char *round_trip_tests[] = {
+    "let x = 5; let y = true; let foobar = y;",
+    "return 5; return x + y;",
+    "-a * b + !c / d - e",
+    "a + b * c == d < e != !(f > g)",
+    "if (x < y) { x }",
+    "if (x < y) { x } else { y; let z = 1; z }",
+    "let add = fn(a, b) { return a + b; }; add(1, 2 * 3);",
+    "fn() { fn(x) { x } }()(1)",
+    "[1, \"two\", [3], fn(x) { x }][1 + 1]",
+    "{\"one\": 1, 2: \"two\", true: [], \"nested\": {}}[\"one\"]",
+    "let s = \"hello\" + \" \" + \"world\"; len(s); puts(first([s]));",
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };",
+    /* Statements whose first token, a '(', is gone once parsed */
+    "(1 + 2) * 3; (fn(x) { x })(4); ((a));",
+};
+
+START_TEST(test_mkc_round_trip_loop) {
+  parser_t *parser = NULL;
+  program_t *program = parse(round_trip_tests[_i], &parser);
+  program_t *loaded = round_trip(program);
+
+  char *expected = program_to_string(program);
+  char *actual = program_to_string(loaded);
+  ck_assert_str_eq(actual, expected);
+  ck_assert_uint_eq(loaded->len, program->len);
+
+  free(actual);
+  free(expected);
+  program_destroy(&loaded);
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+/* An empty program has no string form, only a length */
+START_TEST(test_mkc_empty_program) {
+  parser_t *parser = NULL;
+  program_t *program = parse("", &parser);
+  program_t *loaded = round_trip(program);
+  ck_assert_uint_eq(loaded->len, 0);
+  program_destroy(&loaded);
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+START_TEST(test_mkc_eval) {
+  parser_t *parser = NULL;
+  program_t *program = parse(
+      "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+      "let names = {\"a\": \"x\", \"b\": \"y\"};"
+      "len(names[\"a\"] + names[\"b\"]) * fib(10);",
+      &parser);
+  program_t *loaded = round_trip(program);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  env_t *env = env_new();
+  obj_t *result = eval(loaded, env);
+  ck_assert_ptr_nonnull(result);
+  ck_assert_int_eq(result->type, INT_OBJ);
+  ck_assert_int_eq(result->int_obj->value, 110);
+
+  obj_destroy(&result);
+  env_destroy(&env);
+  program_destroy(&loaded);
+}
+END_TEST
+
+START_TEST(test_mkc_rejects_bad_input) {
+  parser_t *parser = NULL;
+  program_t *program = parse("let x = fn(a) { a * 2 }; x(21);", &parser);
+  FILE *file = tmpfile();
+  ck_assert(mkc_write(program, file));
+  fflush(file);
+  long size = ftell(file);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  /* Every truncation is rejected rather than read out of bounds */
+  char *error = NULL;
+  for (long len = 0; len < size; len++) {
+    ck_assert_int_eq(ftruncate(fileno(file), len), 0);
+    ck_assert_ptr_null(mkc_load_fd(fileno(file), &error));
+    ck_assert_ptr_nonnull(error);
+    free(error);
+    error = NULL;
+  }
+  fclose(file);
+
+  file = tmpfile();
+  fputs("let x = 5;", file);
+  fflush(file);
+  ck_assert_ptr_null(mkc_load_fd(fileno(file), &error));
+  ck_assert_ptr_nonnull(error);
+  free(error);
+  fclose(file);
+}
+END_TEST
+
+/* Writes `program` to a temporary file, returned rewound */
+static FILE *write_tmp(program_t *program) {
+  FILE *file = tmpfile();
+  ck_assert_ptr_nonnull(file);
+  ck_assert(mkc_write(program, file));
+  fflush(file);
+  rewind(file);
+  return file;
+}
+
+static char *repeat_around(size_t n, const char *open, const char *leaf,
+                           const char *close) {
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  for (size_t i = 0; i < n; i++) {
+    fputs(open, out);
+  }
+  fputs(leaf, out);
+  for (size_t i = 0; i < n; i++) {
+    fputs(close, out);
+  }
+  fclose(out);
+  return str;
+}
+
+struct {
+  const char *open;
+  const char *leaf;
+  const char *close;
+} t_d_deep_round_trip[] = {
+    {"1 + ", "1", ""},
+    {"-", "1", ""},
+    {"[", "1", "]"},
+    {"{1: ", "1", "}"},
+    {"(fn(x) { x })(", "1", ")"},
+};
+
+/* Nesting too deep for the C stack is written and loaded all the same */
+START_TEST(test_mkc_deep_round_trip_loop) {
+  char *input = repeat_around(200000, t_d_deep_round_trip[_i].open,
+                              t_d_deep_round_trip[_i].leaf,
+                              t_d_deep_round_trip[_i].close);
+  parser_t *parser = NULL;
+  program_t *program = parse(input, &parser);
+  program_t *loaded = round_trip(program);
+
+  /* Written again, the loaded program is the same bytes */
+  FILE *first = write_tmp(program);
+  FILE *second = write_tmp(loaded);
+  int a = 0;
+  int b = 0;
+  do {
+    a = fgetc(first);
+    b = fgetc(second);
+  } while (a == b && a != EOF);
+  ck_assert_int_eq(a, b);
+  fclose(second);
+  fclose(first);
+
+  env_t *env = env_new();
+  obj_t *result = eval(loaded, env);
+  ck_assert_int_eq(result->type, ERROR_OBJ);
+  ck_assert_int_eq(result->error_obj->kind, ERROR_DEPTH_LIMIT);
+  obj_destroy(&result);
+  env_destroy(&env);
+
+  program_destroy(&loaded);
+  program_destroy(&program);
+  parser_destroy(&parser);
+  free(input);
+}
+END_TEST
+
+/*
+ * One word of a program's node records changed. Records start with the
+ * 3 word empty program at 0, then come identifiers of 2 words each: in
+ * both inputs `x` is at 3, `y` at 5 and their parent at 7, with its
+ * children from word 9 on.
+ */
+struct {
+  const char *input;
+  uint32_t word;
+  uint32_t was;
+  uint32_t corrupt;
+} t_d_mkc_corrupt[] = {
+    /* The right operand made `x` too: records are never shared */
+    {"x + y;", 10, 2, 4},
+    /* An element missing: list children are required */
+    {"[x, y];", 11, 2, 0},
+    /* A child after its parent */
+    {"[x, y];", 11, 2, 8},
+};
+
+START_TEST(test_mkc_rejects_corrupt_loop) {
+  parser_t *parser = NULL;
+  program_t *program = parse(t_d_mkc_corrupt[_i].input, &parser);
+  FILE *file = write_tmp(program);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  mkc_header_t header;
+  ck_assert_int_eq(fread(&header, sizeof(header), 1, file), 1);
+  long at = sizeof(header) + header.strings_len * sizeof(mkc_string_t) +
+            t_d_mkc_corrupt[_i].word * sizeof(uint32_t);
+  uint32_t word = 0;
+  fseek(file, at, SEEK_SET);
+  ck_assert_int_eq(fread(&word, sizeof(word), 1, file), 1);
+  ck_assert_uint_eq(word, t_d_mkc_corrupt[_i].was);
+
+  /* Unchanged, it loads */
+  char *error = NULL;
+  program_t *loaded = mkc_load_fd(fileno(file), &error);
+  ck_assert_ptr_nonnull(loaded);
+  program_destroy(&loaded);
+
+  word = t_d_mkc_corrupt[_i].corrupt;
+  fseek(file, at, SEEK_SET);
+  ck_assert_int_eq(fwrite(&word, sizeof(word), 1, file), 1);
+  fflush(file);
+  ck_assert_ptr_null(mkc_load_fd(fileno(file), &error));
+  ck_assert_str_eq(error, "corrupt compiled program");
+  free(error);
+  fclose(file);
+}
+END_TEST
+
+Suite *mkc_suite(void) {
+  Suite *s;
+  TCase *tc_core;
+
+  s = suite_create("Compiled");
+  tc_core = tcase_create("Core");
+
+  tcase_add_loop_test(tc_core, test_mkc_round_trip_loop, 0,
+                      sizeof(round_trip_tests) / sizeof(round_trip_tests[0]));
+  tcase_add_test(tc_core, test_mkc_empty_program);
+  tcase_add_test(tc_core, test_mkc_eval);
+  tcase_add_test(tc_core, test_mkc_rejects_bad_input);
+  tcase_add_loop_test(tc_core, test_mkc_deep_round_trip_loop, 0,
+                      sizeof(t_d_deep_round_trip) /
+                          sizeof(t_d_deep_round_trip[0]));
+  tcase_add_loop_test(tc_core, test_mkc_rejects_corrupt_loop, 0,
+                      sizeof(t_d_mkc_corrupt) / sizeof(t_d_mkc_corrupt[0]));
+
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite *s;
+  SRunner *sr;
+
+  s = mkc_suite();
+  sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
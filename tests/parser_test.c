@@ -1,6 +1,8 @@
+#include "../src/parallel_parser.h"
 #include "../src/parser.h"
 #include "utils.h"
 #include <check.h>
+#include <sys/resource.h>
 
 typedef enum {
   IDENT_DT,
@@ -306,6 +308,9 @@ START_TEST(test_identifier_expressions) {
 
   _test_str_literal(identifier->token->literal, "foobar");
 
+  ck_assert_msg(identifier->symbol == intern_symbol("foobar", 6),
+                "identifier is not interned");
+
   program_destroy(&program);
   parser_destroy(&parser);
 }
@@ -474,6 +479,14 @@ operator_precedence_tests operator_tests[] = {
     {
       "add(a + b + c * d / f + g)",
       "add((((a + b) + ((c * d) / f)) + g))"
+    },
+    {
+      "a * [1, 2, 3, 4][b * c] * d",
+      "((a * ([1, 2, 3, 4][(b * c)])) * d)"
+    },
+    {
+      "add(a * b[2], b[1], 2 * [1, 2][1])",
+      "add((a * (b[2])), (b[1]), (2 * ([1, 2][1])))"
     }
 };
 
@@ -817,6 +830,555 @@ START_TEST(test_call_expression_parsing) {
 }
 END_TEST
 
+START_TEST(test_string_literal_expression) {
+  const char *input = "\"hello world\";";
+
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  if (check_parser_errors(parser)) {
+    program_destroy(&program);
+    parser_destroy(&parser); /* destroys lexer too */
+    ck_abort_msg("Program has got errors");
+    return;
+  }
+
+  ck_assert_msg(program->len == 1,
+                "program.statements does not contain %d statements. Got=%ld\n",
+                1, program->len);
+
+  statement_t *statement = program->statements[0];
+  _test_statement_type(statement, EXPRESSION_STATEMENT);
+
+  expression_t *expression = statement->expression_statement->expression;
+  _test_expression_type(expression, STRING_EXP);
+
+  string_t *string = expression->string;
+  _test_str_literal(string->value->data, "hello world");
+  ck_assert_msg(string->value->len == strlen("hello world"),
+                "Expected length=%zu, Got=%zu\n", strlen("hello world"),
+                string->value->len);
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+START_TEST(test_array_literal_parsing) {
+  const char *input = "[1, 2 * 2, 3 + 3]";
+
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  if (check_parser_errors(parser)) {
+    program_destroy(&program);
+    parser_destroy(&parser);
+    ck_abort_msg("Program has got errors");
+    return;
+  }
+
+  statement_t *statement = program->statements[0];
+  _test_statement_type(statement, EXPRESSION_STATEMENT);
+
+  expression_t *expression = statement->expression_statement->expression;
+  _test_expression_type(expression, ARRAY_EXP);
+
+  param_exp_t *elements = expression->array->elements;
+  ck_assert_msg(elements->len == 3, "Expected 3 elements, Got=%zu",
+                elements->len);
+
+  _test_integer_literal(elements->expressions[0], 1);
+  _test_infix(elements->expressions[1]->infix, "*",
+              (test_data_t){.dt = INT_DT, .int_data = 2},
+              (test_data_t){.dt = INT_DT, .int_data = 2});
+  _test_infix(elements->expressions[2]->infix, "+",
+              (test_data_t){.dt = INT_DT, .int_data = 3},
+              (test_data_t){.dt = INT_DT, .int_data = 3});
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+START_TEST(test_index_expression_parsing) {
+  const char *input = "myArray[1 + 1]";
+
+  lexer_t *lexer = lexer_new(input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  if (check_parser_errors(parser)) {
+    program_destroy(&program);
+    parser_destroy(&parser);
+    ck_abort_msg("Program has got errors");
+    return;
+  }
+
+  statement_t *statement = program->statements[0];
+  _test_statement_type(statement, EXPRESSION_STATEMENT);
+
+  expression_t *expression = statement->expression_statement->expression;
+  _test_expression_type(expression, INDEX_EXP);
+
+  index_exp_t *index_exp = expression->index_exp;
+  _test_ident_literal(index_exp->left, "myArray");
+  _test_infix(index_exp->index->infix, "+",
+              (test_data_t){.dt = INT_DT, .int_data = 1},
+              (test_data_t){.dt = INT_DT, .int_data = 1});
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+typedef struct {
+  char *input;
+  size_t len;
+  char *expected;
+} test_map_literal_t;
+
+test_map_literal_t t_d_map_literal[] = {
+  {"{}", 0, "{}"},
+  {"{\"one\": 1, \"two\": 2, \"three\": 3}", 3,
+   "{one: 1, two: 2, three: 3}"},
+  {"{1: true, true: \"one\"}", 2, "{1: true, true: one}"},
+  {"{\"one\": 0 + 1, \"two\": 10 - 8, \"three\": 15 / 5}", 3,
+   "{one: (0 + 1), two: (10 - 8), three: (15 / 5)}"},
+  {"{\"a\": [1, 2], \"b\": {\"c\": 3}}[\"b\"]", 0,
+   "({a: [1, 2], b: {c: 3}}[b])"},
+};
+
+START_TEST(test_map_literal_parsing_loop) {
+  test_map_literal_t *test = &t_d_map_literal[_i];
+
+  lexer_t *lexer = lexer_new(test->input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  if (check_parser_errors(parser)) {
+    program_destroy(&program);
+    parser_destroy(&parser);
+    ck_abort_msg("Program has got errors");
+    return;
+  }
+
+  statement_t *statement = program->statements[0];
+  _test_statement_type(statement, EXPRESSION_STATEMENT);
+
+  expression_t *expression = statement->expression_statement->expression;
+  if (expression->type == MAP_EXP) {
+    ck_assert_msg(expression->map->len == test->len,
+                  "Expected %zu pairs, Got=%zu", test->len,
+                  expression->map->len);
+  }
+
+  char *str = program_to_string(program);
+  ck_assert_msg(strcmp(str, test->expected) == 0, "Expected=%s, Got=%s",
+                test->expected, str);
+  free(str);
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+typedef struct {
+  char *input;
+  uint32_t offset;
+  uint32_t deleted;
+  char *inserted;
+} reparse_test_t;
+
+reparse_test_t reparse_tests[] = {
+    {"let a = 1; let b = 2; let c = 3;", 19, 1, "42"},
+    {"let a = 1; let b = 2; let c = 3;", 11, 11, ""},
+    {"let a = 1; let c = 3;", 11, 0, "let b = a * 2; "},
+    {"a; b", 4, 0, " + 1"},
+    {"a; b;", 0, 0, "x + "},
+    {"let ab = 1; ab; 2;", 14, 0, "c"},
+    {"let f = fn(x) {\n  x * 2\n};\nf(1);\nf(2);\n", 20, 1, "3"},
+    {"let f = fn(x) {\n  x * 2\n};\nf(1);\nf(2);\n", 14, 12, "{ x }; "},
+    {"if (a) { b } else { c }; d;", 9, 1, "bb"},
+    {"[1, 2, 3][0]; {\"a\": 1};", 4, 1, "20"},
+    {"", 0, 0, "let x = 1;"},
+    {"let x = 1;", 0, 10, ""},
+    {"let a = 1; let b = 2;", 17, 1, ""},
+};
+
+/* Reparsing after the edit gives what parsing the new text does */
+START_TEST(test_reparse_program_loop) {
+  reparse_test_t *test = &reparse_tests[_i];
+  size_t inserted = strlen(test->inserted);
+  char *edited = NULL;
+  asprintf(&edited, "%.*s%s%s", (int)test->offset, test->input,
+           test->inserted, test->input + test->offset + test->deleted);
+
+  lexer_t *lexer = lexer_new(test->input);
+  parser_t *parser = parser_new(lexer);
+  program_t *program = parser_parse_program(parser);
+  parser_destroy(&parser);
+
+  source_edit_t edit = {test->offset, test->deleted, inserted};
+  parser = parser_new(lexer_new(edited));
+  parser_reparse_program(parser, program, &edit);
+
+  parser_t *full_parser = parser_new(lexer_new(edited));
+  program_t *full = parser_parse_program(full_parser);
+  program_apply_shifts(program);
+
+  ck_assert_msg(parser->errors_len == full_parser->errors_len,
+                "Expected %zu errors, Got=%zu", full_parser->errors_len,
+                parser->errors_len);
+  if (full_parser->errors_len == 0) {
+    ck_assert_msg(program->len == full->len, "Expected %zu statements, Got=%zu",
+                  full->len, program->len);
+    if (full->len > 0) {
+      char *expected = program_to_string(full);
+      char *actual = program_to_string(program);
+      ck_assert_msg(strcmp(actual, expected) == 0, "Expected=%s, Got=%s",
+                    expected, actual);
+      free(actual);
+      free(expected);
+    }
+    for (size_t i = 0; i < full->len; i++) {
+      ck_assert_msg(program->spans[i].start == full->spans[i].start &&
+                        program->spans[i].end == full->spans[i].end,
+                    "Expected span %zu to be [%u, %u), Got=[%u, %u)", i,
+                    full->spans[i].start, full->spans[i].end,
+                    program->spans[i].start, program->spans[i].end);
+      if (full->statements[i]->type == LET_STATEMENT) {
+        /* Reused statements' tokens move with the edit */
+        uint32_t expected =
+            full->statements[i]->let_statement->name->token->offset;
+        uint32_t actual =
+            program->statements[i]->let_statement->name->token->offset;
+        ck_assert_msg(actual == expected,
+                      "Expected statement %zu's name at %u, Got=%u", i,
+                      expected, actual);
+      }
+    }
+  }
+
+  program_destroy(&full);
+  parser_destroy(&full_parser);
+  program_destroy(&program);
+  parser_destroy(&parser);
+  free(edited);
+}
+END_TEST
+
+/* Large enough to be split, `bad` is a statement with an error or NULL */
+static char *parallel_input(size_t statements, size_t bad_at, const char *bad) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  for (size_t i = 0; i < statements; i++) {
+    if (bad != NULL && i == bad_at) {
+      fputs(bad, out);
+    }
+    fprintf(out,
+            "let f = fn(a, b) { if (a < b) { [a, \"s%zu\", {true: -b}] } "
+            "else { return a * %zu; } };\nf(%zu, len(\"x\"))[1];\n",
+            i % 97, i, i);
+  }
+  fclose(out);
+  return input;
+}
+
+typedef struct {
+  size_t bad_at;
+  char *bad;
+} parallel_test_t;
+
+parallel_test_t parallel_tests[] = {
+    {0, NULL},
+    {5000, "let x 5;\n"},
+    {0, "let 5;\n"},
+    {9999, "let x 5;\n"},
+};
+
+/* Same statements, spans, symbols and errors as a sequential parse */
+START_TEST(test_parse_program_parallel_loop) {
+  parallel_test_t *test = &parallel_tests[_i];
+  char *input = parallel_input(10000, test->bad_at, test->bad);
+
+  intern_table_t *sequential_symbols = intern_table_new();
+  intern_table_t *previous = intern_table_swap(sequential_symbols);
+  parser_t *sequential_parser = parser_new(lexer_new(input));
+  program_t *sequential = parser_parse_program(sequential_parser);
+  intern_table_t *parallel_symbols = intern_table_new();
+  intern_table_swap(parallel_symbols);
+
+  parser_t *parser = parser_new(lexer_new(input));
+  program_t *program = parser_parse_program_parallel(parser, 4);
+
+  ck_assert_msg(program->len == sequential->len,
+                "Expected %zu statements, Got=%zu", sequential->len,
+                program->len);
+  if (parser->errors_len == 0) {
+    /* Statements with errors have no string form */
+    char *expected = program_to_string(sequential);
+    char *actual = program_to_string(program);
+    ck_assert_msg(strcmp(actual, expected) == 0, "parallel parse differs");
+    free(actual);
+    free(expected);
+  }
+  ck_assert_msg(parser->errors_len == sequential_parser->errors_len,
+                "Expected %zu errors, Got=%zu", sequential_parser->errors_len,
+                parser->errors_len);
+  for (size_t i = 0; i < parser->errors_len; i++) {
+    ck_assert_msg(memcmp(&parser->errors[i], &sequential_parser->errors[i],
+                         sizeof(parse_error_t)) == 0,
+                  "Expected error %zu to match the sequential parse", i);
+  }
+  ck_assert_msg((program->spans == NULL) == (sequential->spans == NULL),
+                "Expected spans only without errors");
+  for (size_t i = 0; program->spans != NULL && i < program->len; i++) {
+    ck_assert_msg(program->spans[i].start == sequential->spans[i].start &&
+                      program->spans[i].end == sequential->spans[i].end,
+                  "Expected span %zu to match", i);
+  }
+  for (size_t i = 0; i < program->len; i++) {
+    statement_t *statement = program->statements[i];
+    ck_assert_msg(statement->type == sequential->statements[i]->type,
+                  "Expected statement %zu to be a %s", i,
+                  statement_type_to_str(sequential->statements[i]->type));
+    if (statement->type == LET_STATEMENT &&
+        statement->let_statement != NULL) {
+      ck_assert_msg(statement->let_statement->name->symbol ==
+                        sequential->statements[i]->let_statement->name->symbol,
+                    "Expected statement %zu to bind the same symbol", i);
+    }
+  }
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+  program_destroy(&sequential);
+  parser_destroy(&sequential_parser);
+  intern_table_swap(previous);
+  intern_table_destroy(&parallel_symbols);
+  intern_table_destroy(&sequential_symbols);
+  free(input);
+}
+END_TEST
+
+typedef struct {
+  char *name;
+  char *input;
+  char *expected_error; /* the first one */
+} error_position_test_t;
+
+error_position_test_t error_position_tests[] = {
+    {NULL, "let x 5;",
+     "<input>:1:7: expected next token to be ASSIGN_TOKEN, got INT_TOKEN "
+     "instead"},
+    {"script.mk", "let x = 1;\n  let y 2;",
+     "script.mk:2:9: expected next token to be ASSIGN_TOKEN, got INT_TOKEN "
+     "instead"},
+    {"script.mk", "\n\nlet 5;",
+     "script.mk:3:5: expected next token to be IDENT_TOKEN, got INT_TOKEN "
+     "instead"},
+};
+
+START_TEST(test_error_positions_loop) {
+  error_position_test_t *test = &error_position_tests[_i];
+  parser_t *parser = parser_new(lexer_new(test->input));
+  parser_set_source_name(parser, test->name);
+  program_t *program = parser_parse_program(parser);
+
+  ck_assert_msg(parser->errors_len > 0, "Expected errors for %s", test->input);
+  char *error = parser_format_error(parser, 0);
+  ck_assert_msg(strcmp(error, test->expected_error) == 0,
+                "Expected=%s, Got=%s", test->expected_error, error);
+  free(error);
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+typedef struct {
+  char *input;
+  size_t errors_len;
+  char *expected; /* the statements that were kept */
+} recovery_test_t;
+
+recovery_test_t recovery_tests[] = {
+    {"let a = 1; let = 2; let b = 3;", 1, "let a = 1;let b = 3;"},
+    {"let y = ; let z = 2;", 1, "let z = 2;"},
+    {"f(1,); g(2);", 1, "g(2)"},
+    {"if (x { 1 }; let c = 3;", 1, "let c = 3;"},
+    {"fn(a, 1) { a }; let d = 4;", 1, "let d = 4;"},
+    {"let a = 1; let = 2; fn(x { 1 }; let c = }; let d = 4;", 3,
+     "let a = 1;let d = 4;"},
+    {"if (x) { let = 1; y; } else { 2 }; let z = 3;", 1,
+     "if x { y } else { 2 }let z = 3;"},
+    {"let x = (1 + ; } let q = 1;", 2, "let q = 1;"},
+    {"let x = [1, 2", 1, ""},
+};
+
+START_TEST(test_error_recovery_loop) {
+  recovery_test_t *test = &recovery_tests[_i];
+  parser_t *parser = parser_new(lexer_new(test->input));
+  program_t *program = parser_parse_program(parser);
+
+  ck_assert_msg(parser->errors_len == test->errors_len,
+                "Expected %zu errors for %s, Got=%zu", test->errors_len,
+                test->input, parser->errors_len);
+  char *actual = program_to_string(program);
+  ck_assert_str_eq(actual != NULL ? actual : "", test->expected);
+  free(actual);
+
+  program_destroy(&program);
+  parser_destroy(&parser);
+}
+END_TEST
+
+START_TEST(test_error_limit) {
+  char *input = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&input, &len);
+  for (size_t i = 0; i < PARSER_MAX_ERRORS * 3; i++) {
+    fprintf(out, "let = %zu;\n", i);
+  }
+  fclose(out);
+
+  parser_t *parser = parser_new(lexer_new(input));
+  program_t *program = parser_parse_program(parser);
+  ck_assert_uint_eq(parser->errors_len, PARSER_MAX_ERRORS + 1);
+  ck_assert_int_eq(parser->errors[PARSER_MAX_ERRORS].kind,
+                   PARSE_ERROR_TOO_MANY);
+  char *error = parser_format_error(parser, PARSER_MAX_ERRORS);
+  ck_assert_str_eq(error, "<input>:101:5: too many errors, stopped parsing");
+  free(error);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  /* Without a limit every statement is looked at */
+  parser = parser_new(lexer_new(input));
+  parser->max_errors = 0;
+  program = parser_parse_program(parser);
+  ck_assert_uint_eq(parser->errors_len, PARSER_MAX_ERRORS * 3);
+  program_destroy(&program);
+  parser_destroy(&parser);
+  free(input);
+}
+END_TEST
+
+/* Blocks are parsed recursively, up to PARSER_MAX_BLOCKS deep */
+START_TEST(test_block_limit) {
+  const char *blocks[] = {"if (x) { ", "fn() { "};
+  for (size_t i = 0; i < sizeof(blocks) / sizeof(*blocks); i++) {
+    for (size_t depth = PARSER_MAX_BLOCKS; depth <= PARSER_MAX_BLOCKS + 1;
+         depth++) {
+      char *input = NULL;
+      size_t len = 0;
+      FILE *out = open_memstream(&input, &len);
+      for (size_t j = 0; j < depth; j++) {
+        fputs(blocks[i], out);
+      }
+      fputs("1", out);
+      for (size_t j = 0; j < depth; j++) {
+        fputs(" }", out);
+      }
+      fputs("; 2;", out);
+      fclose(out);
+
+      parser_t *parser = parser_new(lexer_new(input));
+      program_t *program = parser_parse_program(parser);
+      if (depth == PARSER_MAX_BLOCKS) {
+        ck_assert_uint_eq(parser->errors_len, 0);
+        ck_assert_uint_eq(program->len, 2);
+      } else {
+        /* Stopped at the innermost block, nothing else reported */
+        ck_assert_uint_eq(parser->errors_len, 1);
+        ck_assert_int_eq(parser->errors[0].kind, PARSE_ERROR_TOO_DEEP);
+        char *error = parser_format_error(parser, 0);
+        char *expected = NULL;
+        asprintf(&expected,
+                 "<input>:1:%zu: blocks nested deeper than %d, stopped "
+                 "parsing",
+                 PARSER_MAX_BLOCKS * strlen(blocks[i]) + strlen(blocks[i]) - 1,
+                 PARSER_MAX_BLOCKS);
+        ck_assert_str_eq(error, expected);
+        free(expected);
+        free(error);
+      }
+      program_destroy(&program);
+      parser_destroy(&parser);
+      free(input);
+    }
+  }
+}
+END_TEST
+
+/* Nesting depth, and the C stack the deep nesting tests get */
+#define DEEP_NESTING 1000000
+#define DEEP_NESTING_STACK (256 * 1024)
+
+typedef struct {
+  /* input is `open` DEEP_NESTING times, `leaf`, `close` as often */
+  char *open;
+  char *leaf;
+  char *close;
+  /* and the same for what it prints as */
+  char *printed_open;
+  char *printed_close;
+} deep_nesting_test_t;
+
+deep_nesting_test_t deep_nesting_tests[] = {
+    {"(", "x", ")", "", ""},
+    {"-", "x", "", "(-", ")"},
+    {"!-", "x", "", "(!(-", "))"},
+    {"[", "1", "]", "[", "]"},
+    {"1 + (", "1", ")", "(1 + ", ")"},
+    {"", "x", " * 2", "(", " * 2)"},
+    {"f(", "x", ")", "f(", ")"},
+    {"a[", "0", "]", "(a[", "])"},
+    {"{1: ", "2", "}", "{1: ", "}"},
+};
+
+static char *nested(const char *open, const char *leaf, const char *close) {
+  char *str = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&str, &len);
+  for (size_t i = 0; i < DEEP_NESTING; i++) {
+    fputs(open, out);
+  }
+  fputs(leaf, out);
+  for (size_t i = 0; i < DEEP_NESTING; i++) {
+    fputs(close, out);
+  }
+  fclose(out);
+  return str;
+}
+
+/* Like running under `ulimit -s 256` */
+START_TEST(test_deep_nesting_loop) {
+  deep_nesting_test_t *test = &deep_nesting_tests[_i];
+  char *input = nested(test->open, test->leaf, test->close);
+  char *expected = nested(test->printed_open, test->leaf, test->printed_close);
+
+  struct rlimit saved;
+  ck_assert_int_eq(getrlimit(RLIMIT_STACK, &saved), 0);
+  struct rlimit small = {DEEP_NESTING_STACK, saved.rlim_max};
+  ck_assert_int_eq(setrlimit(RLIMIT_STACK, &small), 0);
+
+  parser_t *parser = parser_new(lexer_new(input));
+  program_t *program = parser_parse_program(parser);
+  bool errors = parser->errors_len != 0;
+  char *actual = program_to_string(program);
+  program_destroy(&program);
+  parser_destroy(&parser);
+
+  setrlimit(RLIMIT_STACK, &saved);
+  ck_assert_msg(!errors, "Expected no errors for %s...", test->open);
+  ck_assert_msg(strcmp(actual, expected) == 0, "Expected %s...%s%s...",
+                test->printed_open, test->leaf, test->printed_close);
+  free(actual);
+  free(expected);
+  free(input);
+}
+END_TEST
+
 Suite *parser_suite(void) {
   Suite *s;
   TCase *tc_core;
@@ -860,6 +1422,28 @@ Suite *parser_suite(void) {
                       fn_params_tests_len);
 
   tcase_add_test(tc_core, test_call_expression_parsing);
+  tcase_add_test(tc_core, test_string_literal_expression);
+  tcase_add_test(tc_core, test_array_literal_parsing);
+  tcase_add_test(tc_core, test_index_expression_parsing);
+  tcase_add_loop_test(tc_core, test_map_literal_parsing_loop, 0,
+                      sizeof(t_d_map_literal) / sizeof(*t_d_map_literal));
+  tcase_add_loop_test(tc_core, test_reparse_program_loop, 0,
+                      sizeof(reparse_tests) / sizeof(*reparse_tests));
+  tcase_add_loop_test(tc_core, test_parse_program_parallel_loop, 0,
+                      sizeof(parallel_tests) / sizeof(*parallel_tests));
+  tcase_add_loop_test(tc_core, test_error_positions_loop, 0,
+                      sizeof(error_position_tests) /
+                          sizeof(*error_position_tests));
+  tcase_add_loop_test(tc_core, test_error_recovery_loop, 0,
+                      sizeof(recovery_tests) / sizeof(*recovery_tests));
+  tcase_add_test(tc_core, test_error_limit);
+  tcase_add_test(tc_core, test_block_limit);
+
+  TCase *tc_deep = tcase_create("Deep nesting");
+  tcase_set_timeout(tc_deep, 60);
+  tcase_add_loop_test(tc_deep, test_deep_nesting_loop, 0,
+                      sizeof(deep_nesting_tests) / sizeof(*deep_nesting_tests));
+  suite_add_tcase(s, tc_deep);
 
   suite_add_tcase(s, tc_core);
 